@@ -14,6 +14,8 @@
 #include "apps.h"
 #include "string.h"
 #include "util.h"
+#include "usb_cdc.h"
+#include "parity.h"
 
 // BigBuf is the large multi-purpose buffer, typically used to hold A/D samples or traces.
 // Also used to hold various smaller buffers and the Mifare Emulator Memory.
@@ -39,6 +41,18 @@ static uint8_t *emulator_memory = NULL;
 static uint32_t traceLen = 0;
 static bool tracing = true;
 
+// trace streaming. Completed records are sent to the client while tracing, and
+// BigBuf is reused from the start whenever everything has been sent.
+static bool trace_streaming = false;
+static uint32_t trace_sent = 0;        // bytes of BigBuf already sent
+static uint32_t trace_stream_pos = 0;  // bytes sent since streaming started
+static uint32_t trace_dropped = 0;     // records which didn't fit into BigBuf
+
+// compact trace format. Stays on until the trace is cleared.
+static bool trace_compact = false;
+static bool trace_compact_started = false;
+static uint32_t trace_last_end = 0;
+
 
 // get the address of BigBuf
 uint8_t *BigBuf_get_addr(void)
@@ -137,6 +151,9 @@ uint16_t BigBuf_max_traceLen(void)
 
 void clear_trace() {
 	traceLen = 0;
+	trace_sent = 0;
+	trace_compact = false;
+	trace_compact_started = false;
 }
 
 
@@ -150,6 +167,70 @@ bool get_tracing(void) {
 }
 
 
+void set_trace_streaming(bool enable) {
+	trace_streaming = enable;
+	trace_sent = 0;
+	trace_stream_pos = 0;
+	trace_dropped = 0;
+}
+
+
+// Use the compact trace format for the following records. Call after clear_trace().
+void set_trace_compact(bool enable) {
+	trace_compact = enable;
+	trace_compact_started = false;
+	trace_last_end = 0;
+}
+
+
+static bool stream_trace_chunk(bool wait)
+{
+	if (!trace_streaming || trace_sent == traceLen) return false;
+
+	uint16_t len = MIN(traceLen - trace_sent, TRACE_STREAM_CHUNK_SIZE);
+	if (wait) {
+		cmd_send(CMD_TRACE_STREAM, trace_stream_pos, len, trace_dropped, BigBuf_get_addr() + trace_sent, len);
+	} else if (!cmd_send_nowait(CMD_TRACE_STREAM, trace_stream_pos, len, trace_dropped, BigBuf_get_addr() + trace_sent, len)) {
+		return false;
+	}
+	trace_sent += len;
+	trace_stream_pos += len;
+
+	// all sent, start over. A compact trace starts with its header again.
+	if (trace_sent == traceLen) {
+		traceLen = 0;
+		trace_sent = 0;
+		trace_compact_started = false;
+		trace_last_end = 0;
+	}
+	return true;
+}
+
+
+/**
+  Send the next chunk of not yet sent trace records to the client. Meant to be called
+  while sniffing, when there is nothing else to do. Sends at most one USB packet and
+  doesn't wait for the client to fetch it, so the sniffer is never held up by USB.
+  @return false if nothing was sent, because there was nothing to send or the previous
+  packet is still pending
+**/
+bool BigBuf_stream_trace(void)
+{
+	return stream_trace_chunk(false);
+}
+
+
+// send what is left and the end of stream marker, which also carries the
+// number of DMA overruns of the sniffer
+void BigBuf_stream_trace_end(uint32_t dma_overruns)
+{
+	while (stream_trace_chunk(true))
+		;
+	cmd_send(CMD_ACK, trace_stream_pos, trace_dropped, dma_overruns, 0, 0);
+	trace_streaming = false;
+}
+
+
 /**
  * Get the number of bytes traced
  * @return
@@ -160,6 +241,89 @@ uint16_t BigBuf_get_traceLen(void)
 }
 
 
+static inline void put_varint(uint8_t *trace, uint32_t value)
+{
+	while (value >= 0x80) {
+		trace[traceLen++] = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	trace[traceLen++] = value;
+}
+
+
+#define TRACE_COMPACT_PARITY_NONE       0   // no parity bytes or all zero
+#define TRACE_COMPACT_PARITY_ODD        1   // odd parity on every byte
+#define TRACE_COMPACT_PARITY_EXPLICIT   2   // parity bytes follow the data
+#define TRACE_COMPACT_MAX_HEADER        (3 + 5 + 5)    // varints
+
+static uint8_t compact_parity_mode(const uint8_t *btBytes, uint16_t iLen, const uint8_t *parity)
+{
+	if (parity == NULL || iLen == 0) return TRACE_COMPACT_PARITY_NONE;
+
+	bool all_zero = true;
+	bool all_odd = (btBytes != NULL);
+	for (int i = 0; i < iLen; i++) {
+		bool bit = (parity[i / 8] >> (7 - (i % 8))) & 0x01;
+		if (bit) all_zero = false;
+		if (all_odd && bit != oddparity8(btBytes[i])) all_odd = false;
+		if (!all_zero && !all_odd) return TRACE_COMPACT_PARITY_EXPLICIT;
+	}
+	return all_odd ? TRACE_COMPACT_PARITY_ODD : TRACE_COMPACT_PARITY_NONE;
+}
+
+
+// Compact traceformat, about half the size for short frames:
+// TRACE_COMPACT_MAGIC_LEN bytes TRACE_COMPACT_MAGIC at the start of the trace
+// then per record:
+// varint  data length << 4 | duration in 1/16 flag << 3 | parity mode << 1 | tagToReader flag
+// varint  timestamp (start) - end of the previous record
+// varint  duration (/16 if flagged, ISO14443A durations usually are multiples of 16)
+// y Bytes data
+// x Bytes parity, only for TRACE_COMPACT_PARITY_EXPLICIT
+static bool RAMFUNC LogTraceCompact(const uint8_t *btBytes, uint16_t iLen, uint32_t timestamp_start, uint32_t duration, uint8_t *parity, bool readerToTag)
+{
+	uint8_t *trace = BigBuf_get_addr();
+	uint8_t parity_mode = compact_parity_mode(btBytes, iLen, parity);
+	uint32_t num_paritybytes = (parity_mode == TRACE_COMPACT_PARITY_EXPLICIT) ? (iLen-1)/8 + 1 : 0;
+	uint32_t header_len = trace_compact_started ? 0 : TRACE_COMPACT_MAGIC_LEN;
+
+	if (traceLen + header_len + TRACE_COMPACT_MAX_HEADER + iLen + num_paritybytes >= BigBuf_max_traceLen()) {
+		if (trace_streaming) {
+			trace_dropped++;
+			return true;
+		}
+		tracing = false;
+		return false;
+	}
+
+	if (!trace_compact_started) {
+		memset(trace + traceLen, TRACE_COMPACT_MAGIC, TRACE_COMPACT_MAGIC_LEN);
+		traceLen += TRACE_COMPACT_MAGIC_LEN;
+		trace_compact_started = true;
+	}
+
+	bool duration16 = (duration & 0x0f) == 0;
+	put_varint(trace, (uint32_t)iLen << 4 | duration16 << 3 | parity_mode << 1 | (readerToTag ? 0 : 1));
+	put_varint(trace, timestamp_start - trace_last_end);
+	put_varint(trace, duration16 ? duration >> 4 : duration);
+	trace_last_end = timestamp_start + duration;
+
+	if (btBytes != NULL) {
+		memcpy(trace + traceLen, btBytes, iLen);
+	} else {
+		memset(trace + traceLen, 0x00, iLen);
+	}
+	traceLen += iLen;
+
+	if (num_paritybytes) {
+		memcpy(trace + traceLen, parity, num_paritybytes);
+		traceLen += num_paritybytes;
+	}
+
+	return true;
+}
+
+
 /**
   This is a function to store traces. All protocols can use this generic tracer-function.
   The traces produced by calling this function can be fetched on the client-side
@@ -179,7 +343,16 @@ bool RAMFUNC LogTrace(const uint8_t *btBytes, uint16_t iLen, uint32_t timestamp_
 	// Return when trace is full
 	uint16_t max_traceLen = BigBuf_max_traceLen();
 
+	if (trace_compact) {
+		return LogTraceCompact(btBytes, iLen, timestamp_start, duration, parity, readerToTag);
+	}
+
 	if (traceLen + sizeof(iLen) + sizeof(timestamp_start) + sizeof(duration) + num_paritybytes + iLen >= max_traceLen) {
+		if (trace_streaming) {
+			// the client didn't keep up. Drop the record but carry on.
+			trace_dropped++;
+			return true;
+		}
 		tracing = false;    // don't trace any more
 		return false;
 	}
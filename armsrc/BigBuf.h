@@ -22,6 +22,7 @@
 #define MAX_MIFARE_PARITY_SIZE	3		// need 18 parity bits for the 18 Byte above. 3 Bytes are enough to store these
 #define CARD_MEMORY_SIZE		4096
 #define DMA_BUFFER_SIZE    		128
+#define SNIFF_DMA_BUFFER_SIZE	2048	// default for the sniffers, split in two halves. See sniff_dma_t
 
 extern uint8_t *BigBuf_get_addr(void);
 extern uint8_t *BigBuf_get_EM_addr(void);
@@ -38,6 +39,10 @@ extern uint16_t BigBuf_get_traceLen(void);
 extern void clear_trace(void);
 extern void set_tracing(bool enable);
 extern bool get_tracing(void);
+extern void set_trace_streaming(bool enable);
+extern void set_trace_compact(bool enable);
+extern bool BigBuf_stream_trace(void);
+extern void BigBuf_stream_trace_end(uint32_t dma_overruns);
 extern bool RAMFUNC LogTrace(const uint8_t *btBytes, uint16_t iLen, uint32_t timestamp_start, uint32_t timestamp_end, uint8_t *parity, bool readerToTag);
 extern int LogTraceHitag(const uint8_t * btBytes, int iBits, int iSamples, uint32_t dwParity, int bReader);
 extern uint8_t emlSet(uint8_t *data, uint32_t offset, uint32_t length);
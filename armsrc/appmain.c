@@ -1021,6 +1021,9 @@ void UsbPacketReceived(UsbCommand *c) {
 		case CMD_T55XX_RESET_READ:
 			T55xxResetRead();
 			break;
+		case CMD_T55XX_BRUTE_FORCE:
+			T55xxBruteForce(c->arg[0], c->arg[1], c->arg[2], c->d.asDwords);
+			break;
 		case CMD_PCF7931_READ:
 			ReadPCF7931();
 			break;
@@ -1150,7 +1153,7 @@ void UsbPacketReceived(UsbCommand *c) {
 
 #ifdef WITH_ISO14443a
 		case CMD_SNOOP_ISO_14443a:
-			SnoopIso14443a(c->arg[0]);
+			SnoopIso14443a(c->arg[0], c->arg[1]);
 			break;
 		case CMD_READER_ISO_14443a:
 			ReaderIso14443a(c);
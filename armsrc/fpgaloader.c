@@ -170,6 +170,59 @@ bool FpgaSetupSscDma(uint8_t *buf, uint16_t sample_count) {
 }
 
 
+//-----------------------------------------------------------------------------
+// Set up double buffered DMA from the FPGA into size bytes at buf, see
+// sniff_dma_t. size must be a multiple of 2*sample_size, sample_size is 1
+// for 8 bit and 2 for 16 bit SSC transfers.
+//-----------------------------------------------------------------------------
+bool FpgaSetupSniffDma(sniff_dma_t *dma, uint8_t *buf, uint16_t size, uint8_t sample_size) {
+	if (buf == NULL) return false;
+
+	dma->buf = buf;
+	dma->end = buf + size;
+	dma->half_size = size / 2;
+	dma->sample_shift = sample_size == 2 ? 1 : 0;
+	dma->half_count = dma->half_size >> dma->sample_shift;
+	dma->overruns = 0;
+	dma->max_behind = 0;
+
+	AT91C_BASE_PDC_SSC->PDC_PTCR = AT91C_PDC_RXTDIS;        // Disable DMA Transfer
+	AT91C_BASE_PDC_SSC->PDC_RPR = (uint32_t) buf;           // fill the first half
+	AT91C_BASE_PDC_SSC->PDC_RCR = dma->half_count;
+	AT91C_BASE_PDC_SSC->PDC_RNPR = (uint32_t) (buf + dma->half_size); // then the second one
+	AT91C_BASE_PDC_SSC->PDC_RNCR = dma->half_count;
+	AT91C_BASE_PDC_SSC->PDC_PTCR = AT91C_PDC_RXTEN;         // go!
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// All samples in half were read, hand it back to the PDC. The PDC is
+// working on the other half at this point, unless it has stopped because
+// that one was full as well.
+//-----------------------------------------------------------------------------
+void FpgaSniffDmaRelease(sniff_dma_t *dma, uint8_t *half) {
+	if (AT91C_BASE_PDC_SSC->PDC_RCR == 0) {
+		// stopped, we lost samples. Restart with this half.
+		dma->overruns++;
+		AT91C_BASE_PDC_SSC->PDC_RPR = (uint32_t) half;
+		AT91C_BASE_PDC_SSC->PDC_RCR = dma->half_count;
+		return;
+	}
+
+	AT91C_BASE_PDC_SSC->PDC_RNPR = (uint32_t) half;
+	AT91C_BASE_PDC_SSC->PDC_RNCR = dma->half_count;
+
+	if (AT91C_BASE_PDC_SSC->PDC_RCR == 0 && AT91C_BASE_PDC_SSC->PDC_RNCR != 0) {
+		// the current buffer ran out just before the next one was set
+		dma->overruns++;
+		AT91C_BASE_PDC_SSC->PDC_RPR = (uint32_t) half;
+		AT91C_BASE_PDC_SSC->PDC_RCR = dma->half_count;
+		AT91C_BASE_PDC_SSC->PDC_RNCR = 0;
+	}
+}
+
+
 //----------------------------------------------------------------------------
 // Uncompress (inflate) the FPGA data. Returns one decompressed byte with
 // each call.
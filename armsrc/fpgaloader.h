@@ -15,6 +15,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "proxmark3.h"
 
 void FpgaSendCommand(uint16_t cmd, uint16_t v);
 void FpgaWriteConfWord(uint16_t v);
@@ -30,6 +31,49 @@ void FpgaDisableTracing(void);
 #define FpgaEnableSscDma(void) AT91C_BASE_PDC_SSC->PDC_PTCR = AT91C_PDC_RXTEN;
 void SetAdcMuxFor(uint32_t whichGpio);
 
+// Double buffered DMA for the sniffers. The DMA area is split in two halves.
+// The PDC fills one half while the other one is decoded, and a half is only
+// handed back to the PDC (as next buffer) after all of its samples were
+// read. If the decoders fall behind, the PDC stops instead of overwriting
+// samples which were not decoded yet, and the gap is counted as an overrun.
+typedef struct {
+	uint8_t *buf;
+	uint8_t *end;
+	uint16_t half_size;                     // bytes per half
+	uint16_t half_count;                    // samples per half
+	uint8_t sample_shift;                   // log2(bytes per sample)
+	uint32_t overruns;                      // number of times the PDC stopped because both halves were full
+	uint16_t max_behind;                    // maximum number of buffered samples
+} sniff_dma_t;
+
+bool FpgaSetupSniffDma(sniff_dma_t *dma, uint8_t *buf, uint16_t size, uint8_t sample_size);
+void FpgaSniffDmaRelease(sniff_dma_t *dma, uint8_t *half);
+
+// Number of samples the PDC has written but the sniffer didn't read yet
+static inline uint16_t FpgaSniffDmaAvailable(sniff_dma_t *dma, const void *upTo) {
+	int32_t behind = (uint8_t *)AT91C_BASE_PDC_SSC->PDC_RPR - (const uint8_t *)upTo;
+	if (behind < 0) {
+		behind += 2 * dma->half_size;
+	} else if (behind == 0 && AT91C_BASE_PDC_SSC->PDC_RCR == 0) {
+		behind = 2 * dma->half_size;        // stopped, both halves are full
+	}
+	behind >>= dma->sample_shift;
+	if (behind > dma->max_behind) dma->max_behind = behind;
+	return behind;
+}
+
+// Call after a sample was read, with the position of the next sample. Hands back
+// a half to the PDC when it was read completely and returns where to continue.
+static inline void *FpgaSniffDmaNext(sniff_dma_t *dma, void *upTo) {
+	if (upTo == dma->buf + dma->half_size) {
+		FpgaSniffDmaRelease(dma, dma->buf);
+	} else if (upTo == dma->end) {
+		FpgaSniffDmaRelease(dma, dma->buf + dma->half_size);
+		upTo = dma->buf;
+	}
+	return upTo;
+}
+
 // definitions for multiple FPGA config files support
 #define FPGA_BITSTREAM_LF 1
 #define FPGA_BITSTREAM_HF 2
@@ -569,10 +569,13 @@ static RAMFUNC int ManchesterDecoding(uint8_t bit, uint16_t offset, uint32_t non
 // triggering so that we start recording at the point that the tag is moved
 // near the reader.
 //-----------------------------------------------------------------------------
-void RAMFUNC SnoopIso14443a(uint8_t param) {
+void RAMFUNC SnoopIso14443a(uint8_t param, uint16_t dma_size) {
 	// param:
 	// bit 0 - trigger from first card answer
 	// bit 1 - trigger from first reader 7-bit request
+	// bit 2 - stream the trace to the client while snooping
+	// bit 3 - compact trace format
+	// dma_size: size of the DMA area in bytes, 0 for SNIFF_DMA_BUFFER_SIZE
 
 	LEDsoff();
 	LED_A_ON();
@@ -592,16 +595,24 @@ void RAMFUNC SnoopIso14443a(uint8_t param) {
 	uint8_t *receivedResponsePar = BigBuf_malloc(MAX_PARITY_SIZE);
 
 	// The DMA buffer, used to stream samples from the FPGA
-	uint8_t *dmaBuf = BigBuf_malloc(DMA_BUFFER_SIZE);
+	if (dma_size == 0) dma_size = SNIFF_DMA_BUFFER_SIZE;
+	dma_size = (dma_size + 7) & ~7;
+	uint8_t *dmaBuf = BigBuf_malloc(dma_size);
+	if (dmaBuf == NULL) {
+		Dbprintf("DMA buffer of %d bytes doesn't fit into BigBuf", dma_size);
+		LEDsoff();
+		return;
+	}
+	sniff_dma_t dma;
 
 	// init trace buffer
 	clear_trace();
 	set_tracing(true);
+	set_trace_streaming(param & 0x04);
+	set_trace_compact(param & 0x08);
 
 	uint8_t *data = dmaBuf;
 	uint8_t previous_data = 0;
-	int maxDataLen = 0;
-	int dataLen = 0;
 	bool TagIsActive = false;
 	bool ReaderIsActive = false;
 
@@ -612,7 +623,7 @@ void RAMFUNC SnoopIso14443a(uint8_t param) {
 	UartInit(receivedCmd, receivedCmdPar);
 
 	// Setup and start DMA.
-	FpgaSetupSscDma((uint8_t *)dmaBuf, DMA_BUFFER_SIZE);
+	FpgaSetupSniffDma(&dma, dmaBuf, dma_size, sizeof(uint8_t));
 
 	// We won't start recording the frames that we acquire until we trigger;
 	// a good trigger condition to get started is probably when we see a
@@ -630,34 +641,19 @@ void RAMFUNC SnoopIso14443a(uint8_t param) {
 
 		WDT_HIT();
 
-		int register readBufDataP = data - dmaBuf;
-		int register dmaBufDataP = DMA_BUFFER_SIZE - AT91C_BASE_PDC_SSC->PDC_RCR;
-		if (readBufDataP <= dmaBufDataP){
-			dataLen = dmaBufDataP - readBufDataP;
-		} else {
-			dataLen = DMA_BUFFER_SIZE - readBufDataP + dmaBufDataP;
-		}
-		// test for length of buffer
-		if(dataLen > maxDataLen) {
-			maxDataLen = dataLen;
-			if(dataLen > (9 * DMA_BUFFER_SIZE / 10)) {
-				Dbprintf("blew circular buffer! dataLen=%d", dataLen);
+		uint16_t dataLen = FpgaSniffDmaAvailable(&dma, data);
+
+		// nothing on air and the DMA buffer is almost empty. Time to send trace records.
+		if (!TagIsActive && !ReaderIsActive && dataLen < dma.half_count / 2) {
+			BigBuf_stream_trace();
+			// when streaming, the client can stop us with any command
+			if ((param & 0x04) && usb_poll_validate_length()) {
+				DbpString("cancelled by client");
 				break;
 			}
 		}
-		if(dataLen < 1) continue;
 
-		// primary buffer was stopped( <-- we lost data!
-		if (!AT91C_BASE_PDC_SSC->PDC_RCR) {
-			AT91C_BASE_PDC_SSC->PDC_RPR = (uint32_t) dmaBuf;
-			AT91C_BASE_PDC_SSC->PDC_RCR = DMA_BUFFER_SIZE;
-			Dbprintf("RxEmpty ERROR!!! data length:%d", dataLen); // temporary
-		}
-		// secondary buffer sets as primary, secondary buffer was stopped
-		if (!AT91C_BASE_PDC_SSC->PDC_RNCR) {
-			AT91C_BASE_PDC_SSC->PDC_RNPR = (uint32_t) dmaBuf;
-			AT91C_BASE_PDC_SSC->PDC_RNCR = DMA_BUFFER_SIZE;
-		}
+		if (dataLen == 0) continue;
 
 		if (rsamples & 0x01) {              // Need two samples to feed Miller and Manchester-Decoder
 
@@ -706,17 +702,19 @@ void RAMFUNC SnoopIso14443a(uint8_t param) {
 
 		previous_data = *data;
 		rsamples++;
-		data++;
-		if(data == dmaBuf + DMA_BUFFER_SIZE) {
-			data = dmaBuf;
-		}
+		data = FpgaSniffDmaNext(&dma, data + 1);
 	} // main cycle
 
 	FpgaDisableSscDma();
 	LEDsoff();
 
+	if (param & 0x04) {
+		BigBuf_stream_trace_end(dma.overruns);
+	}
+
 	DbpString("COMMAND FINISHED");
-	Dbprintf("maxDataLen=%d, Uart.state=%x, Uart.len=%d", maxDataLen, Uart.state, Uart.len);
+	Dbprintf("DMA: %d bytes, max. %d samples behind, %d overruns", dma_size, dma.max_behind, dma.overruns);
+	Dbprintf("Uart.state=%x, Uart.len=%d", Uart.state, Uart.len);
 	Dbprintf("traceLen=%d, Uart.output[0]=%08x", BigBuf_get_traceLen(), (uint32_t)Uart.output[0]);
 }
 
@@ -895,8 +893,8 @@ static bool prepare_tag_modulation(tag_response_info_t* response_info, size_t ma
 
 
   // Prepare the tag modulation bits from the message
-  GetParity(response_info->response, response_info->response_n, &(response_info->par));
-  CodeIso14443aAsTagPar(response_info->response,response_info->response_n, &(response_info->par));
+  GetParity(response_info->response, response_info->response_n, response_info->par);
+  CodeIso14443aAsTagPar(response_info->response,response_info->response_n, response_info->par);
 
   // Make sure we do not exceed the free buffer space
   if (ToSendMax > max_buffer_size) {
@@ -938,6 +936,91 @@ bool prepare_allocated_tag_modulation(tag_response_info_t* response_info, uint8_
   }
 }
 
+//-----------------------------------------------------------------------------
+// Cache for the modulation of dynamic tag responses, e.g. READ data. Coding a
+// 16 byte response eats a good part of the frame delay time, but readers tend
+// to request the same data over and over again. Entries are looked up by the
+// response data itself, so that changed (emulator) memory can never hit a
+// stale entry. The least recently used entry is replaced.
+//-----------------------------------------------------------------------------
+#define TAG_MODULATION_CACHE_ENTRIES          16
+#define TAG_MODULATION_CACHE_MAX_RESPONSE     18                                      // 16 bytes data + CRC
+#define TAG_MODULATION_CACHE_MAX_MODULATION   (TAG_MODULATION_CACHE_MAX_RESPONSE * 9 + 4) // data and parity bits, start, stop, correction, spare
+
+typedef struct {
+	tag_response_info_t info;
+	uint32_t hash;
+	uint32_t last_used;
+	uint8_t response[TAG_MODULATION_CACHE_MAX_RESPONSE];
+	uint8_t modulation[TAG_MODULATION_CACHE_MAX_MODULATION];
+} tag_modulation_cache_entry_t;
+
+static tag_modulation_cache_entry_t *tag_modulation_cache = NULL;
+static uint32_t tag_modulation_cache_time;
+static uint32_t tag_modulation_cache_hits;
+static uint32_t tag_modulation_cache_misses;
+
+
+// allocate the cache in BigBuf. Without memory, responses are coded on the fly as before.
+static void tag_modulation_cache_init(void) {
+	tag_modulation_cache = (tag_modulation_cache_entry_t *)BigBuf_malloc(TAG_MODULATION_CACHE_ENTRIES * sizeof(tag_modulation_cache_entry_t));
+	if (tag_modulation_cache != NULL) {
+		memset(tag_modulation_cache, 0, TAG_MODULATION_CACHE_ENTRIES * sizeof(tag_modulation_cache_entry_t));
+	}
+	tag_modulation_cache_time = 0;
+	tag_modulation_cache_hits = 0;
+	tag_modulation_cache_misses = 0;
+}
+
+
+static uint32_t tag_response_hash(const uint8_t *response, uint16_t len) {
+	uint32_t hash = len;
+	for (uint16_t i = 0; i < len; i++) {
+		hash = (hash << 5) + hash + response[i];
+	}
+	return hash;
+}
+
+
+// get the coded response from the cache, code and add it if it isn't there yet.
+// Returns NULL if there is no cache or the response is too long for it.
+static tag_response_info_t *tag_modulation_cache_get(const uint8_t *response, uint16_t len) {
+	if (tag_modulation_cache == NULL || len == 0 || len > TAG_MODULATION_CACHE_MAX_RESPONSE) {
+		return NULL;
+	}
+
+	uint32_t hash = tag_response_hash(response, len);
+	tag_modulation_cache_entry_t *oldest = &tag_modulation_cache[0];
+	tag_modulation_cache_time++;
+
+	for (int i = 0; i < TAG_MODULATION_CACHE_ENTRIES; i++) {
+		tag_modulation_cache_entry_t *entry = &tag_modulation_cache[i];
+		if (entry->hash == hash && entry->info.response_n == len && memcmp(entry->response, response, len) == 0) {
+			entry->last_used = tag_modulation_cache_time;
+			tag_modulation_cache_hits++;
+			return &entry->info;
+		}
+		if (entry->last_used < oldest->last_used) {
+			oldest = entry;
+		}
+	}
+
+	tag_modulation_cache_misses++;
+	memcpy(oldest->response, response, len);
+	oldest->info.response = oldest->response;
+	oldest->info.response_n = len;
+	oldest->info.modulation = oldest->modulation;
+	oldest->hash = hash;
+	oldest->last_used = tag_modulation_cache_time;
+	if (!prepare_tag_modulation(&oldest->info, TAG_MODULATION_CACHE_MAX_MODULATION)) {
+		oldest->info.response_n = 0;
+		oldest->last_used = 0;
+		return NULL;
+	}
+	return &oldest->info;
+}
+
+
 //-----------------------------------------------------------------------------
 // Main loop of simulated tag: receive commands from reader, decide what
 // response to send, and send it.
@@ -1063,6 +1146,7 @@ void SimulateIso14443aTag(int tagType, int uid_1st, int uid_2nd, uint8_t* data)
 	uint8_t *receivedCmdPar = BigBuf_malloc(MAX_PARITY_SIZE);
 	uint8_t *free_buffer_pointer = BigBuf_malloc(ALLOCATED_TAG_MODULATION_BUFFER_SIZE);
 	size_t free_buffer_size = ALLOCATED_TAG_MODULATION_BUFFER_SIZE;
+	tag_modulation_cache_init();
 	// clear trace
 	clear_trace();
 	set_tracing(true);
@@ -1112,10 +1196,11 @@ void SimulateIso14443aTag(int tagType, int uid_1st, int uid_2nd, uint8_t* data)
 		} else if(receivedCmd[1] == 0x70 && receivedCmd[0] == 0x95) {   // Received a SELECT (cascade 2)
 			p_response = &responses[4]; order = 30;
 		} else if(receivedCmd[0] == 0x30) { // Received a (plain) READ
-			EmSendCmd(data+(4*receivedCmd[1]),16);
-			// Dbprintf("Read request from reader: %x %x",receivedCmd[0],receivedCmd[1]);
-			// We already responded, do not send anything with the EmSendCmd14443aRaw() that is called below
-			p_response = NULL;
+			p_response = tag_modulation_cache_get(data+(4*receivedCmd[1]),16);
+			if (p_response == NULL) {
+				EmSendCmd(data+(4*receivedCmd[1]),16);
+				// We already responded, do not send anything with the EmSendCmd14443aRaw() that is called below
+			}
 		} else if(receivedCmd[0] == 0x50) { // Received a HALT
 			p_response = NULL;
 		} else if(receivedCmd[0] == 0x60 || receivedCmd[0] == 0x61) {   // Received an authentication request
@@ -1184,11 +1269,14 @@ void SimulateIso14443aTag(int tagType, int uid_1st, int uid_2nd, uint8_t* data)
 				AppendCrc14443a(dynamic_response_info.response,dynamic_response_info.response_n);
 				dynamic_response_info.response_n += 2;
 
-				if (prepare_tag_modulation(&dynamic_response_info,DYNAMIC_MODULATION_BUFFER_SIZE) == false) {
-					Dbprintf("Error preparing tag response");
-					break;
+				p_response = tag_modulation_cache_get(dynamic_response_info.response, dynamic_response_info.response_n);
+				if (p_response == NULL) {
+					if (prepare_tag_modulation(&dynamic_response_info,DYNAMIC_MODULATION_BUFFER_SIZE) == false) {
+						Dbprintf("Error preparing tag response");
+						break;
+					}
+					p_response = &dynamic_response_info;
 				}
-				p_response = &dynamic_response_info;
 			}
 		}
 
@@ -1215,6 +1303,10 @@ void SimulateIso14443aTag(int tagType, int uid_1st, int uid_2nd, uint8_t* data)
 	}
 
 	Dbprintf("%x %x %x", happened, happened2, cmdsRecvd);
+	if (MF_DBGLEVEL >= MF_DBG_INFO) {
+		Dbprintf("Modulation cache: %d hits, %d misses", tag_modulation_cache_hits, tag_modulation_cache_misses);
+	}
+	tag_modulation_cache = NULL;
 	LED_A_OFF();
 	BigBuf_free_keep_EM();
 }
@@ -1551,7 +1643,7 @@ int EmSendCmdPar(uint8_t *resp, uint16_t respLen, uint8_t *par){
 int EmSendPrecompiledCmd(tag_response_info_t *response_info) {
 	int ret = EmSendCmd14443aRaw(response_info->modulation, response_info->modulation_n);
 	// Log this tag answer and fix timing of previous reader command:
-	EmLogTraceTag(response_info->response, response_info->response_n, &(response_info->par), response_info->ProxToAirDuration);
+	EmLogTraceTag(response_info->response, response_info->response_n, response_info->par, response_info->ProxToAirDuration);
 	return ret;
 }
 
@@ -2469,11 +2561,11 @@ void RAMFUNC SniffMifare(uint8_t param) {
 	// free eventually allocated BigBuf memory
 	BigBuf_free();
 	// allocate the DMA buffer, used to stream samples from the FPGA
-	uint8_t *dmaBuf = BigBuf_malloc(DMA_BUFFER_SIZE);
+	uint8_t *dmaBuf = BigBuf_malloc(SNIFF_DMA_BUFFER_SIZE);
+	sniff_dma_t dma;
 	uint8_t *data = dmaBuf;
 	uint8_t previous_data = 0;
-	int maxDataLen = 0;
-	int dataLen = 0;
+	uint32_t overruns = 0;
 	bool ReaderIsActive = false;
 	bool TagIsActive = false;
 
@@ -2484,7 +2576,7 @@ void RAMFUNC SniffMifare(uint8_t param) {
 	UartInit(receivedCmd, receivedCmdPar);
 
 	// Setup for the DMA.
-	FpgaSetupSscDma((uint8_t *)dmaBuf, DMA_BUFFER_SIZE); // set transfer address and number of bytes. Start transfer.
+	FpgaSetupSniffDma(&dma, dmaBuf, SNIFF_DMA_BUFFER_SIZE, sizeof(uint8_t)); // Start transfer.
 
 	// init sniffer
 	MfSniffInit();
@@ -2506,41 +2598,14 @@ void RAMFUNC SniffMifare(uint8_t param) {
 				// Reset everything - we missed some sniffed data anyway while the DMA was stopped
 				sniffCounter = 0;
 				data = dmaBuf;
-				maxDataLen = 0;
 				ReaderIsActive = false;
 				TagIsActive = false;
-				FpgaSetupSscDma((uint8_t *)dmaBuf, DMA_BUFFER_SIZE); // set transfer address and number of bytes. Start transfer.
-			}
-		}
-
-		int register readBufDataP = data - dmaBuf;  // number of bytes we have processed so far
-		int register dmaBufDataP = DMA_BUFFER_SIZE - AT91C_BASE_PDC_SSC->PDC_RCR; // number of bytes already transferred
-		if (readBufDataP <= dmaBufDataP){           // we are processing the same block of data which is currently being transferred
-			dataLen = dmaBufDataP - readBufDataP;   // number of bytes still to be processed
-		} else {
-			dataLen = DMA_BUFFER_SIZE - readBufDataP + dmaBufDataP; // number of bytes still to be processed
-		}
-		// test for length of buffer
-		if(dataLen > maxDataLen) {                  // we are more behind than ever...
-			maxDataLen = dataLen;
-			if(dataLen > (9 * DMA_BUFFER_SIZE / 10)) {
-				Dbprintf("blew circular buffer! dataLen=0x%x", dataLen);
-				break;
+				overruns += dma.overruns;
+				FpgaSetupSniffDma(&dma, dmaBuf, SNIFF_DMA_BUFFER_SIZE, sizeof(uint8_t)); // Start transfer.
 			}
 		}
-		if(dataLen < 1) continue;
 
-		// primary buffer was stopped ( <-- we lost data!
-		if (!AT91C_BASE_PDC_SSC->PDC_RCR) {
-			AT91C_BASE_PDC_SSC->PDC_RPR = (uint32_t) dmaBuf;
-			AT91C_BASE_PDC_SSC->PDC_RCR = DMA_BUFFER_SIZE;
-			Dbprintf("RxEmpty ERROR!!! data length:%d", dataLen); // temporary
-		}
-		// secondary buffer sets as primary, secondary buffer was stopped
-		if (!AT91C_BASE_PDC_SSC->PDC_RNCR) {
-			AT91C_BASE_PDC_SSC->PDC_RNPR = (uint32_t) dmaBuf;
-			AT91C_BASE_PDC_SSC->PDC_RNCR = DMA_BUFFER_SIZE;
-		}
+		if (FpgaSniffDmaAvailable(&dma, data) == 0) continue;
 
 		if (sniffCounter & 0x01) {
 
@@ -2576,10 +2641,7 @@ void RAMFUNC SniffMifare(uint8_t param) {
 
 		previous_data = *data;
 		sniffCounter++;
-		data++;
-		if(data == dmaBuf + DMA_BUFFER_SIZE) {
-			data = dmaBuf;
-		}
+		data = FpgaSniffDmaNext(&dma, data + 1);
 
 	} // main cycle
 
@@ -2591,5 +2653,5 @@ void RAMFUNC SniffMifare(uint8_t param) {
 
 	MfSniffEnd();
 
-	Dbprintf("maxDataLen=%x, Uart.state=%x, Uart.len=%x", maxDataLen, Uart.state, Uart.len);
+	Dbprintf("DMA: max. %d samples behind, %d overruns, Uart.state=%x, Uart.len=%x", dma.max_behind, overruns + dma.overruns, Uart.state, Uart.len);
 }
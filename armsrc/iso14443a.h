@@ -18,6 +18,7 @@
 #include <stdbool.h>
 #include "usb_cmd.h"
 #include "mifare.h"
+#include "BigBuf.h"
 
 typedef struct {
   uint8_t* response;
@@ -25,13 +26,13 @@ typedef struct {
   uint16_t response_n;
   uint16_t modulation_n;
   uint32_t ProxToAirDuration;
-  uint8_t  par; // enough for precalculated parity of 8 Byte responses
+  uint8_t  par[MAX_PARITY_SIZE];
 } tag_response_info_t;
 
 extern void GetParity(const uint8_t *pbtCmd, uint16_t len, uint8_t *par);
 extern void AppendCrc14443a(uint8_t *data, int len);
 
-extern void RAMFUNC SnoopIso14443a(uint8_t param);
+extern void RAMFUNC SnoopIso14443a(uint8_t param, uint16_t dma_size);
 extern void SimulateIso14443aTag(int tagType, int uid_1st, int uid_2nd, uint8_t *data);
 extern void ReaderIso14443a(UsbCommand *c);
 extern void ReaderTransmit(uint8_t *frame, uint16_t len, uint32_t *timing);
@@ -1112,7 +1112,7 @@ void ReadSTMemoryIso14443b(uint32_t dwLast)
  * Memory usage for this function, (within BigBuf)
  * Last Received command (reader->tag) - MAX_FRAME_SIZE
  * Last Received command (tag->reader) - MAX_FRAME_SIZE
- * DMA Buffer - ISO14443B_DMA_BUFFER_SIZE
+ * DMA Buffer - SNIFF_DMA_BUFFER_SIZE
  * Demodulated samples received - all the rest
  */
 void RAMFUNC SnoopIso14443b(void)
@@ -1125,11 +1125,10 @@ void RAMFUNC SnoopIso14443b(void)
 	set_tracing(true);
 
 	// The DMA buffer, used to stream samples from the FPGA
-	uint16_t *dmaBuf = (uint16_t*) BigBuf_malloc(ISO14443B_DMA_BUFFER_SIZE * sizeof(uint16_t));
-	int lastRxCounter;
+	uint16_t *dmaBuf = (uint16_t*) BigBuf_malloc(SNIFF_DMA_BUFFER_SIZE);
+	sniff_dma_t dma;
 	uint16_t *upTo;
 	int8_t ci, cq;
-	int maxBehindBy = 0;
 
 	// Count of samples received so far, so that we can include timing
 	// information in the trace buffer.
@@ -1143,7 +1142,7 @@ void RAMFUNC SnoopIso14443b(void)
 	Dbprintf("  Trace: %i bytes", BigBuf_max_traceLen());
 	Dbprintf("  Reader -> tag: %i bytes", MAX_FRAME_SIZE);
 	Dbprintf("  tag -> Reader: %i bytes", MAX_FRAME_SIZE);
-	Dbprintf("  DMA: %i bytes", ISO14443B_DMA_BUFFER_SIZE);
+	Dbprintf("  DMA: %i bytes", SNIFF_DMA_BUFFER_SIZE);
 
 	// Signal field is off
 	LED_D_OFF();
@@ -1155,8 +1154,7 @@ void RAMFUNC SnoopIso14443b(void)
 	// Setup for the DMA.
 	FpgaSetupSsc(FPGA_MAJOR_MODE_HF_READER);
 	upTo = dmaBuf;
-	lastRxCounter = ISO14443B_DMA_BUFFER_SIZE;
-	FpgaSetupSscDma((uint8_t*) dmaBuf, ISO14443B_DMA_BUFFER_SIZE);
+	FpgaSetupSniffDma(&dma, (uint8_t*) dmaBuf, SNIFF_DMA_BUFFER_SIZE, sizeof(uint16_t));
 
 	bool TagIsActive = false;
 	bool ReaderIsActive = false;
@@ -1167,28 +1165,12 @@ void RAMFUNC SnoopIso14443b(void)
 
 	// And now we loop, receiving samples.
 	for(;;) {
-		int behindBy = (lastRxCounter - AT91C_BASE_PDC_SSC->PDC_RCR) & (ISO14443B_DMA_BUFFER_SIZE-1);
-		if(behindBy > maxBehindBy) {
-			maxBehindBy = behindBy;
-		}
-
-		if(behindBy < 1) continue;
+		if (FpgaSniffDmaAvailable(&dma, upTo) == 0) continue;
 
 		ci = *upTo>>8;
 		cq = *upTo;
-		upTo++;
-		lastRxCounter--;
-		if(upTo >= dmaBuf + ISO14443B_DMA_BUFFER_SIZE) {               // we have read all of the DMA buffer content.
-			upTo = dmaBuf;                                             // start reading the circular buffer from the beginning again
-			lastRxCounter += ISO14443B_DMA_BUFFER_SIZE;
-			if(behindBy > (9*ISO14443B_DMA_BUFFER_SIZE/10)) { 
-				Dbprintf("About to blow circular buffer - aborted! behindBy=%d", behindBy);
-				break;
-			}
-		}
-		if (AT91C_BASE_SSC->SSC_SR & (AT91C_SSC_ENDRX)) {              // DMA Counter Register had reached 0, already rotated.
-			AT91C_BASE_PDC_SSC->PDC_RNPR = (uint32_t) dmaBuf;          // refresh the DMA Next Buffer and
-			AT91C_BASE_PDC_SSC->PDC_RNCR = ISO14443B_DMA_BUFFER_SIZE;  // DMA Next Counter registers
+		upTo = FpgaSniffDmaNext(&dma, upTo + 1);
+		if (upTo == dmaBuf) {                                          // once per DMA buffer
 			WDT_HIT();
 			if(BUTTON_PRESS()) {
 				DbpString("cancelled");
@@ -1221,7 +1203,7 @@ void RAMFUNC SnoopIso14443b(void)
 		}
 
 		if (!ReaderIsActive && triggered) {						// no need to try decoding tag data if the reader is sending or not yet triggered
-			if (Handle14443bSamplesDemod(ci/2, cq/2) >= 0) {
+			if (Handle14443bSamplesDemod(ci/2, cq/2)) {
 				//Use samples as a time measurement
 				LogTrace(Demod.output, Demod.len, samples, samples, NULL, false);
 				// And ready to receive another response.
@@ -1234,7 +1216,8 @@ void RAMFUNC SnoopIso14443b(void)
 
 	FpgaDisableSscDma();
 	DbpString("Snoop statistics:");
-	Dbprintf("  Max behind by: %i", maxBehindBy);
+	Dbprintf("  Max behind by: %i", dma.max_behind);
+	Dbprintf("  DMA overruns: %i", dma.overruns);
 	Dbprintf("  Uart State: %x", Uart.state);
 	Dbprintf("  Uart ByteCnt: %i", Uart.byteCnt);
 	Dbprintf("  Uart ByteCntMax: %i", Uart.byteCntMax);
@@ -1185,11 +1185,13 @@ void SnoopIso15693(uint8_t jam_search_len, uint8_t *jam_search_string) {
 
 	FpgaDownloadAndGo(FPGA_BITSTREAM_HF);
 
+	BigBuf_free();
 	clear_trace();
 	set_tracing(true);
 
 	// The DMA buffer, used to stream samples from the FPGA
-	uint16_t dmaBuf[ISO15693_DMA_BUFFER_SIZE];
+	uint16_t *dmaBuf = (uint16_t *)BigBuf_malloc(SNIFF_DMA_BUFFER_SIZE);
+	sniff_dma_t dma;
 
 	// Count of samples received so far, so that we can include timing
 	// information in the trace buffer.
@@ -1209,7 +1211,7 @@ void SnoopIso15693(uint8_t jam_search_len, uint8_t *jam_search_string) {
 		Dbprintf("  Trace:         %i bytes", BigBuf_max_traceLen());
 		Dbprintf("  Reader -> tag: %i bytes", ISO15693_MAX_COMMAND_LENGTH);
 		Dbprintf("  tag -> Reader: %i bytes", ISO15693_MAX_RESPONSE_LENGTH);
-		Dbprintf("  DMA:           %i bytes", ISO15693_DMA_BUFFER_SIZE * sizeof(uint16_t));
+		Dbprintf("  DMA:           %i bytes", SNIFF_DMA_BUFFER_SIZE);
 	}
 	Dbprintf("Snoop started. Press PM3 Button to stop.");
 
@@ -1218,7 +1220,7 @@ void SnoopIso15693(uint8_t jam_search_len, uint8_t *jam_search_string) {
 	SetAdcMuxFor(GPIO_MUXSEL_HIPKD);
 	FpgaSetupSsc(FPGA_MAJOR_MODE_HF_READER);
 	StartCountSspClk();
-	FpgaSetupSscDma((uint8_t*) dmaBuf, ISO15693_DMA_BUFFER_SIZE);
+	FpgaSetupSniffDma(&dma, (uint8_t*) dmaBuf, SNIFF_DMA_BUFFER_SIZE, sizeof(uint16_t));
 
 	bool TagIsActive = false;
 	bool ReaderIsActive = false;
@@ -1226,16 +1228,9 @@ void SnoopIso15693(uint8_t jam_search_len, uint8_t *jam_search_string) {
 	uint32_t dma_start_time = 0;
 	uint16_t *upTo = dmaBuf;
 
-	uint16_t max_behindBy = 0;
-	
 	// And now we loop, receiving samples.
 	for(;;) {
-		uint16_t behindBy = ((uint16_t*)AT91C_BASE_PDC_SSC->PDC_RPR - upTo) & (ISO15693_DMA_BUFFER_SIZE-1);
-		if (behindBy > max_behindBy) {
-			max_behindBy = behindBy;
-		}
-		
-		if (behindBy == 0) continue;
+		if (FpgaSniffDmaAvailable(&dma, upTo) == 0) continue;
 
 		samples++;
 		if (samples == 1) {
@@ -1243,24 +1238,15 @@ void SnoopIso15693(uint8_t jam_search_len, uint8_t *jam_search_string) {
 			dma_start_time = GetCountSspClk() & 0xfffffff0;
 		}
 
-		uint16_t snoopdata = *upTo++;
+		uint16_t snoopdata = *upTo;
 
-		if (upTo >= dmaBuf + ISO15693_DMA_BUFFER_SIZE) {                   // we have read all of the DMA buffer content.
-			upTo = dmaBuf;                                                 // start reading the circular buffer from the beginning
-			if (behindBy > (9*ISO15693_DMA_BUFFER_SIZE/10)) {
-				// FpgaDisableTracing();
-				Dbprintf("About to blow circular buffer - aborted! behindBy=%d, samples=%d", behindBy, samples);
+		upTo = FpgaSniffDmaNext(&dma, upTo + 1);
+		if (upTo == dmaBuf) {                                              // once per DMA buffer
+			WDT_HIT();
+			if (BUTTON_PRESS()) {
+				DbpString("Snoop stopped.");
 				break;
 			}
-			if (AT91C_BASE_SSC->SSC_SR & (AT91C_SSC_ENDRX)) {              // DMA Counter Register had reached 0, already rotated.
-				AT91C_BASE_PDC_SSC->PDC_RNPR = (uint32_t) dmaBuf;          // refresh the DMA Next Buffer and
-				AT91C_BASE_PDC_SSC->PDC_RNCR = ISO15693_DMA_BUFFER_SIZE;   // DMA Next Counter registers
-				WDT_HIT();
-				if (BUTTON_PRESS()) {
-					DbpString("Snoop stopped.");
-					break;
-				}
-			}
 		}
 
 		if (!TagIsActive) {                                                // no need to try decoding reader data if the tag is sending
@@ -1350,7 +1336,8 @@ void SnoopIso15693(uint8_t jam_search_len, uint8_t *jam_search_string) {
 	Dbprintf("  DecodeReader byteCnt: %d", DecodeReader.byteCount);
 	Dbprintf("  DecodeReader posCount: %d", DecodeReader.posCount);
 	Dbprintf("  Trace length: %d", BigBuf_get_traceLen());
-	Dbprintf("  Max behindBy: %d", max_behindBy);
+	Dbprintf("  Max behindBy: %d", dma.max_behind);
+	Dbprintf("  DMA overruns: %d", dma.overruns);
 }
 
 
@@ -1587,6 +1587,109 @@ void T55xxWakeUp(uint32_t Pwd){
 	TurnReadLFOn(20*1000);
 }
 
+#define T55XX_BF_SAMPLES       12000  // same as T55xxReadBlock, at least two blocks at RF/128
+#define T55XX_BF_SKIP_SAMPLES  1000   // antenna still settling
+#define T55XX_BF_MIN_DEVIATION 5      // below that, there is no modulation
+#define T55XX_BF_PROGRESS_MS   2000
+
+// Lightweight check of the answer to a page 0 block 0 read. A tag which accepted
+// the password keeps repeating its config block, so the samples match themselves
+// shifted by one 32 bit block for one of the possible bitrates. This only finds
+// candidates, the client demodulates and verifies them.
+static bool T55xxResponseRepeats(uint8_t *samples, size_t len) {
+	static const uint8_t clocks[] = {8, 16, 32, 40, 50, 64, 100, 128};
+	size_t start = T55XX_BF_SKIP_SAMPLES;
+	if (len <= start) return false;
+
+	uint32_t sum = 0;
+	for (size_t i = start; i < len; i++)
+		sum += samples[i];
+	uint8_t mean = sum / (len - start);
+
+	uint32_t deviation = 0;
+	for (size_t i = start; i < len; i++)
+		deviation += (samples[i] > mean) ? samples[i] - mean : mean - samples[i];
+	deviation /= (len - start);
+	if (deviation < T55XX_BF_MIN_DEVIATION) return false;
+
+	for (uint8_t c = 0; c < sizeof(clocks); c++) {
+		size_t lag = clocks[c] * 32;
+		// need at least two blocks
+		if (start + 2 * lag > len) break;
+
+		uint32_t diff = 0;
+		for (size_t i = start; i + lag < len; i++)
+			diff += (samples[i] > samples[i+lag]) ? samples[i] - samples[i+lag] : samples[i+lag] - samples[i];
+		diff /= (len - start - lag);
+
+		// a repeating signal only differs by noise
+		if (diff * 4 < deviation) return true;
+	}
+	return false;
+}
+
+// Try all passwords in [start, end], or the dictionary entries [start, end], with
+// every downlink mode set in arg0. Stops at the first candidate and sends it with the
+// downlink modes it answered to. Otherwise the next password/index to try is sent every
+// T55XX_BF_PROGRESS_MS, so an aborted search can be resumed from there.
+void T55xxBruteForce(uint32_t arg0, uint32_t start, uint32_t end, uint32_t *dictionary) {
+	uint8_t dl_modes = arg0 & 0x0F;
+	bool use_dictionary = arg0 & FLAG_T55XX_BF_DICTIONARY;
+	uint8_t *samples = BigBuf_get_addr();
+	uint8_t status = T55XX_BF_DONE;
+	uint32_t last_progress = GetTickCount();
+	uint64_t i = start;
+
+	if (dl_modes == 0) dl_modes = 0x01;
+	if (use_dictionary) {
+		uint32_t count = (arg0 >> 16) & 0xFF;
+		if (count == 0 || count > USB_CMD_DATA_SIZE / sizeof(uint32_t)) {
+			cmd_send(CMD_ACK, T55XX_BF_DONE, start, 0, 0, 0);
+			return;
+		}
+		if (end >= count) end = count - 1;
+	}
+
+	LED_A_ON();
+	for (; i <= end; i++) {
+		uint32_t pwd = use_dictionary ? dictionary[i] : (uint32_t)i;
+		uint8_t candidates = 0;
+
+		for (uint8_t dl_mode = 0; dl_mode < 4; dl_mode++) {
+			if (!(dl_modes & (1 << dl_mode))) continue;
+			WDT_HIT();
+
+			BigBuf_Clear_ext(false);
+			// page 0, block 0, password, no data
+			T55xx_SendCMD(0, 0, pwd, 0x01 | 0x40 | (dl_mode << 3));
+			TurnReadLFOn(210*8);
+			size_t len = DoPartialAcquisition(0, true, T55XX_BF_SAMPLES, 0) / 8;
+			FpgaWriteConfWord(FPGA_MAJOR_MODE_OFF);
+
+			if (T55xxResponseRepeats(samples, len))
+				candidates |= 1 << dl_mode;
+		}
+
+		if (candidates) {
+			cmd_send(CMD_ACK, T55XX_BF_CANDIDATE, i, candidates, 0, 0);
+			LED_A_OFF();
+			return;
+		}
+
+		if (BUTTON_PRESS() || usb_poll_validate_length()) {
+			status = T55XX_BF_ABORTED;
+			i++;
+			break;
+		}
+		if (GetTickCount() - last_progress > T55XX_BF_PROGRESS_MS) {
+			cmd_send(CMD_ACK, T55XX_BF_PROGRESS, i + 1, 0, 0, 0);
+			last_progress = GetTickCount();
+		}
+	}
+	cmd_send(CMD_ACK, status, i, 0, 0, 0);
+	LED_A_OFF();
+}
+
 /*-------------- Cloning routines -----------*/
 
 void WriteT55xx(uint32_t *blockdata, uint8_t startblock, uint8_t numblocks) {
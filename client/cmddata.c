@@ -24,12 +24,14 @@
 #include "lfdemod.h"  // for demod code
 #include "loclass/cipherutils.h" // for decimating samples in getsamples
 #include "cmdlfem4x.h"// for em410x demod
+#include "samplefile.h"// for data load/save
 
 uint8_t DemodBuffer[MAX_DEMOD_BUF_LEN];
 uint8_t g_debugMode=0;
 size_t DemodBufferLen=0;
 int g_DemodStartIdx=0;
 int g_DemodClock=0;
+sample_config g_SampleConfig = {0};
 
 static int CmdHelp(const char *Cmd);
 
@@ -43,10 +45,10 @@ void setDemodBuf(uint8_t *buff, size_t size, size_t startIdx)
 	if ( size > MAX_DEMOD_BUF_LEN - startIdx)
 		size = MAX_DEMOD_BUF_LEN - startIdx;
 
-	size_t i = 0;
-	for (; i < size; i++){
-		DemodBuffer[i]=buff[startIdx++];
-	}
+	// many callers just cut a window out of the DemodBuffer itself. Nothing to copy
+	// if it starts at 0, and the source may overlap otherwise.
+	if (buff + startIdx != DemodBuffer)
+		memmove(DemodBuffer, buff + startIdx, size);
 	DemodBufferLen=size;
 	return;
 }
@@ -71,15 +73,16 @@ void save_restoreDB(uint8_t saveOpt)
 	static int savedDemodStartIdx = 0;
 	static int savedDemodClock = 0;
 
+	// only the first DemodBufferLen bits are valid, don't copy the rest
 	if (saveOpt == GRAPH_SAVE) { //save
 
-		memcpy(SavedDB, DemodBuffer, sizeof(DemodBuffer));
+		memcpy(SavedDB, DemodBuffer, DemodBufferLen);
 		SavedDBlen = DemodBufferLen;
 		DB_Saved=true;
 		savedDemodStartIdx = g_DemodStartIdx;
 		savedDemodClock = g_DemodClock;
 	} else if (DB_Saved) { //restore
-		memcpy(DemodBuffer, SavedDB, sizeof(DemodBuffer));
+		memcpy(DemodBuffer, SavedDB, SavedDBlen);
 		DemodBufferLen = SavedDBlen;
 		g_DemodClock = savedDemodClock;
 		g_DemodStartIdx = savedDemodStartIdx;
@@ -207,7 +210,7 @@ int ASKDemod_ext(const char *Cmd, bool verbose, bool emSearch, uint8_t askType,
 	int maxLen=0;
 	uint8_t askamp = 0;
 	char amp = param_getchar(Cmd, 0);
-	uint8_t BitStream[MAX_GRAPH_TRACE_LEN]={0};
+	uint8_t BitStream[MAX_GRAPH_TRACE_LEN];
 	sscanf(Cmd, "%i %i %i %i %c", &clk, &invert, &maxErr, &maxLen, &amp);
 	if (!maxLen) maxLen = BIGBUF_SIZE;
 	if (invert != 0 && invert != 1) {
@@ -331,7 +334,7 @@ int Cmdmandecoderaw(const char *Cmd)
 		return 0;
 	}
 	if (DemodBufferLen==0) return 0;
-	uint8_t BitStream[MAX_DEMOD_BUF_LEN]={0};
+	uint8_t BitStream[MAX_DEMOD_BUF_LEN];
 	int high=0,low=0;
 	for (;i<DemodBufferLen;++i){
 		if (DemodBuffer[i]>high) high=DemodBuffer[i];
@@ -399,7 +402,7 @@ int CmdBiphaseDecodeRaw(const char *Cmd)
 		PrintAndLog("DemodBuffer Empty - run 'data rawdemod ar' first");
 		return 0;
 	}
-	uint8_t BitStream[MAX_DEMOD_BUF_LEN]={0};
+	uint8_t BitStream[MAX_DEMOD_BUF_LEN];
 	size = sizeof(BitStream);
 	if ( !getDemodBuf(BitStream, &size) ) return 0;
 	errCnt=BiphaseRawDecode(BitStream, &size, &offset, invert);
@@ -788,7 +791,7 @@ int FSKrawDemod(const char *Cmd, bool verbose)
 			rfLen = 0;
 		}
 	}
-	uint8_t BitStream[MAX_GRAPH_TRACE_LEN]={0};
+	uint8_t BitStream[MAX_GRAPH_TRACE_LEN];
 	size_t BitLen = getFromGraphBuf(BitStream);
 	if (BitLen==0) return 0;
 	//get field clock lengths
@@ -871,7 +874,7 @@ int PSKDemod(const char *Cmd, bool verbose)
 		if (g_debugMode || verbose) PrintAndLog("Invalid argument: %s", Cmd);
 		return 0;
 	}
-	uint8_t BitStream[MAX_GRAPH_TRACE_LEN]={0};
+	uint8_t BitStream[MAX_GRAPH_TRACE_LEN];
 	size_t BitLen = getFromGraphBuf(BitStream);
 	if (BitLen==0) return 0;
 	int errCnt=0;
@@ -916,7 +919,7 @@ int NRZrawDemod(const char *Cmd, bool verbose)
 		PrintAndLog("Invalid argument: %s", Cmd);
 		return 0;
 	}
-	uint8_t BitStream[MAX_GRAPH_TRACE_LEN]={0};
+	uint8_t BitStream[MAX_GRAPH_TRACE_LEN];
 	size_t BitLen = getFromGraphBuf(BitStream);
 	if (BitLen==0) return 0;
 	int errCnt=0;
@@ -1212,6 +1215,7 @@ int getSamples(int n, bool silent)
 		if (!silent) PrintAndLog("Samples @ %d bits/smpl, decimation 1:%d ", sc->bits_per_sample
 		    , sc->decimation);
 		bits_per_sample = sc->bits_per_sample;
+		g_SampleConfig = *sc;
 	}
 	if(bits_per_sample < 8)
 	{
@@ -1330,22 +1334,29 @@ int CmdLoad(const char *Cmd)
 	int len = 0;
 
 	len = strlen(Cmd);
-	if (len > FILE_PATH_SIZE) len = FILE_PATH_SIZE;
+	if (len > FILE_PATH_SIZE - 1) len = FILE_PATH_SIZE - 1;
 	memcpy(filename, Cmd, len);
-	
-	FILE *f = fopen(filename, "r");
-	if (!f) {
-		 PrintAndLog("couldn't open '%s'", filename);
+
+	size_t samples = 0;
+	sample_config config;
+	samplefile_format_t format;
+	int res = samplefile_load(filename, GraphBuffer, MAX_GRAPH_TRACE_LEN, &samples, &config, &format);
+	if (res < 0) {
+		if (res == SAMPLEFILE_E_OPEN)
+			PrintAndLog("couldn't open '%s'", filename);
+		else
+			PrintAndLog("couldn't load '%s': %s", filename, samplefile_strerror(res));
 		return 0;
 	}
+	if (res == SAMPLEFILE_TRUNCATED)
+		PrintAndLog("warning: only the first %d samples have been loaded", MAX_GRAPH_TRACE_LEN);
 
-	GraphTraceLen = 0;
-	char line[80];
-	while (fgets(line, sizeof (line), f)) {
-		GraphBuffer[GraphTraceLen] = atoi(line);
-		GraphTraceLen++;
+	GraphTraceLen = samples;
+	if (format == SAMPLEFILE_BINARY) {
+		g_SampleConfig = config;
+		if (config.decimation > 0)
+			PrintAndLog("Samples @ %d bits/smpl, decimation 1:%d, divisor %d", config.bits_per_sample, config.decimation, config.divisor);
 	}
-	fclose(f);
 	PrintAndLog("loaded %d samples", GraphTraceLen);
 	setClockGrid(0,0);
 	DemodBufferLen = 0;
@@ -1420,27 +1431,55 @@ int CmdPlot(const char *Cmd)
 	return 0;
 }
 
+int usage_data_save(void)
+{
+	PrintAndLog("Save graph window samples to a file");
+	PrintAndLog("Usage:  data save [b|z] <filename>");
+	PrintAndLog("Options:");
+	PrintAndLog("       b          binary sample file, including the sample config (decimation, bits per sample, divisor)");
+	PrintAndLog("       z          same as b, zlib compressed");
+	PrintAndLog("       <filename> without b or z, a text file with one sample per line is written");
+	PrintAndLog("");
+	PrintAndLog("Sample: data save z lf_capture.pm3b");
+	PrintAndLog("`data load` detects the format automatically");
+	return 0;
+}
+
 int CmdSave(const char *Cmd)
 {
 	char filename[FILE_PATH_SIZE] = {0x00};
 	int len = 0;
+	bool binary = false;
+	bool compress = false;
+
+	// a leading "b " or "z " selects the binary format, anything else is the filename
+	char cmdp = Cmd[0];
+	if (cmdp == 'h' && Cmd[1] == '\0') return usage_data_save();
+	if ((cmdp == 'b' || cmdp == 'z') && Cmd[1] == ' ' && Cmd[2] != '\0') {
+		binary = true;
+		compress = (cmdp == 'z');
+		Cmd += 2;
+	}
 
 	len = strlen(Cmd);
-	if (len > FILE_PATH_SIZE) len = FILE_PATH_SIZE;
+	if (len > FILE_PATH_SIZE - 1) len = FILE_PATH_SIZE - 1;
 	memcpy(filename, Cmd, len);
-	 
+	if (len == 0) return usage_data_save();
 
-	FILE *f = fopen(filename, "w");
-	if(!f) {
+	int res;
+	if (binary) {
+		res = samplefile_save(filename, GraphBuffer, GraphTraceLen, &g_SampleConfig, compress);
+	} else {
+		res = samplefile_save_text(filename, GraphBuffer, GraphTraceLen);
+	}
+	if (res == SAMPLEFILE_E_OPEN) {
 		PrintAndLog("couldn't open '%s'", filename);
 		return 0;
+	} else if (res != SAMPLEFILE_OK) {
+		PrintAndLog("couldn't save '%s': %s", filename, samplefile_strerror(res));
+		return 0;
 	}
-	int i;
-	for (i = 0; i < GraphTraceLen; i++) {
-		fprintf(f, "%d\n", GraphBuffer[i]);
-	}
-	fclose(f);
-	PrintAndLog("saved to '%s'", Cmd);
+	PrintAndLog("saved to '%s'", filename);
 	return 0;
 }
 
@@ -1833,7 +1872,7 @@ static command_t CommandTable[] =
 	{"hex2bin",         Cmdhex2bin,         1, "hex2bin <hexadecimal> -- Converts hexadecimal to binary"},
 	{"hide",            CmdHide,            1, "Hide graph window"},
 	{"hpf",             CmdHpf,             1, "Remove DC offset from trace"},
-	{"load",            CmdLoad,            1, "<filename> -- Load trace (to graph window"},
+	{"load",            CmdLoad,            1, "<filename> -- Load trace (to graph window), text or binary"},
 	{"ltrim",           CmdLtrim,           1, "<samples> -- Trim samples from left of trace"},
 	{"rtrim",           CmdRtrim,           1, "<location to end trace> -- Trim samples from right of trace"},
 	{"mtrim",           CmdMtrim,           1, "<start> <stop> -- Trim out samples from the specified start to the specified stop"},
@@ -1843,7 +1882,7 @@ static command_t CommandTable[] =
 	{"printdemodbuffer",CmdPrintDemodBuff,  1, "[x] [o] <offset> [l] <length> -- print the data in the DemodBuffer - 'x' for hex output"},
 	{"rawdemod",        CmdRawDemod,        1, "[modulation] ... <options> -see help (h option) -- Demodulate the data in the GraphBuffer and output binary"},  
 	{"samples",         CmdSamples,         0, "[512 - 40000] -- Get raw samples for graph window (GraphBuffer)"},
-	{"save",            CmdSave,            1, "<filename> -- Save trace (from graph window)"},
+	{"save",            CmdSave,            1, "[b|z] <filename> -- Save trace (from graph window), b/z for binary/compressed binary"},
 	{"setgraphmarkers", CmdSetGraphMarkers, 1, "[orange_marker] [blue_marker] (in graph window)"},
 	{"scale",           CmdScale,           1, "<int> -- Set cursor display scale"},
 	{"setdebugmode",    CmdSetDebugMode,    1, "<0|1|2> -- Turn on or off Debugging Level for lf demods"},
@@ -16,6 +16,7 @@
 #include <stdbool.h> //bool
 
 #include "cmdparser.h" // for command_t
+#include "usb_cmd.h"   // for sample_config
 
 command_t * CmdDataCommands();
 
@@ -74,6 +75,7 @@ extern uint8_t DemodBuffer[MAX_DEMOD_BUF_LEN];
 extern size_t DemodBufferLen;
 extern int g_DemodStartIdx;
 extern int g_DemodClock;
+extern sample_config g_SampleConfig;
 extern uint8_t g_debugMode;
 #define BIGBUF_SIZE 40000
 
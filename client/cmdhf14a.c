@@ -32,6 +32,7 @@
 #include "emv/apduinfo.h"
 #include "emv/emvcore.h"
 #include "taginfo.h"
+#include "result.h"
 
 static int CmdHelp(const char *Cmd);
 static int waitCmd(uint8_t iLen);
@@ -40,6 +41,10 @@ static int waitCmd(uint8_t iLen);
 static uint16_t frameLength = 0;
 uint16_t atsFSC[] = {16, 24, 32, 40, 48, 64, 96, 128, 256};
 
+// the card selected by SelectCard14443_4(), until the field is dropped
+static iso14a_card_select_t SelectedCard;
+static bool CardSelected = false;
+
 int CmdHF14AList(const char *Cmd)
 {
 	PrintAndLog("Deprecated command, use 'hf list 14a' instead");
@@ -141,8 +146,14 @@ int CmdHF14AReader(const char *Cmd) {
 		PrintAndLog(" UID : %s", sprint_hex(card.uid, card.uidlen));
 		PrintAndLog("ATQA : %02x %02x", card.atqa[1], card.atqa[0]);
 		PrintAndLog(" SAK : %02x [%" PRIu64 "]", card.sak, resp.arg[0]);
+		ResultRecord("iso14443a_card");
+		ResultHex("uid", card.uid, card.uidlen);
+		uint8_t atqa[2] = {card.atqa[1], card.atqa[0]};     // in the order it is printed
+		ResultHex("atqa", atqa, 2);
+		ResultInt("sak", card.sak);
 		if(card.ats_len >= 3) {         // a valid ATS consists of at least the length byte (TL) and 2 CRC bytes
 			PrintAndLog(" ATS : %s", sprint_hex(card.ats, card.ats_len));
+			ResultHex("ats", card.ats, card.ats_len);
 		}
 		if (leaveSignalON) {
 			PrintAndLog("Card is selected. You can now start sending commands");
@@ -197,8 +208,14 @@ int CmdHF14AInfo(const char *Cmd) {
 	PrintAndLog(" UID : %s", sprint_hex(card.uid, card.uidlen));
 	PrintAndLog("ATQA : %02x %02x", card.atqa[1], card.atqa[0]);
 	PrintAndLog(" SAK : %02x [%" PRIu64 "]", card.sak, resp.arg[0]);
+	ResultRecord("iso14443a_card");
+	ResultHex("uid", card.uid, card.uidlen);
+	uint8_t atqa[2] = {card.atqa[1], card.atqa[0]};     // in the order it is printed
+	ResultHex("atqa", atqa, 2);
+	ResultInt("sak", card.sak);
 
 	bool isMifareClassic = true;
+	const char *type = NULL;
 	switch (card.sak) {
 		case 0x00:
 			isMifareClassic = false;
@@ -258,26 +275,31 @@ int CmdHF14AInfo(const char *Cmd) {
 			}
 			*/
 			break;
-		case 0x01: PrintAndLog("TYPE : NXP TNP3xxx Activision Game Appliance"); break;
-		case 0x04: PrintAndLog("TYPE : NXP MIFARE (various !DESFire !DESFire EV1)"); break;
-		case 0x08: PrintAndLog("TYPE : NXP MIFARE CLASSIC 1k | Plus 2k SL1"); break;
-		case 0x09: PrintAndLog("TYPE : NXP MIFARE Mini 0.3k"); break;
-		case 0x10: PrintAndLog("TYPE : NXP MIFARE Plus 2k SL2"); break;
-		case 0x11: PrintAndLog("TYPE : NXP MIFARE Plus 4k SL2"); break;
-		case 0x18: PrintAndLog("TYPE : NXP MIFARE Classic 4k | Plus 4k SL1"); break;
-		case 0x20: PrintAndLog("TYPE : NXP MIFARE DESFire 4k | DESFire EV1 2k/4k/8k | Plus 2k/4k SL3 | JCOP 31/41"); break;
-		case 0x24: PrintAndLog("TYPE : NXP MIFARE DESFire | DESFire EV1"); break;
-		case 0x28: PrintAndLog("TYPE : JCOP31 or JCOP41 v2.3.1"); break;
-		case 0x38: PrintAndLog("TYPE : Nokia 6212 or 6131 MIFARE CLASSIC 4K"); break;
-		case 0x88: PrintAndLog("TYPE : Infineon MIFARE CLASSIC 1K"); break;
-		case 0x98: PrintAndLog("TYPE : Gemplus MPCOS"); break;
+		case 0x01: type = "NXP TNP3xxx Activision Game Appliance"; break;
+		case 0x04: type = "NXP MIFARE (various !DESFire !DESFire EV1)"; break;
+		case 0x08: type = "NXP MIFARE CLASSIC 1k | Plus 2k SL1"; break;
+		case 0x09: type = "NXP MIFARE Mini 0.3k"; break;
+		case 0x10: type = "NXP MIFARE Plus 2k SL2"; break;
+		case 0x11: type = "NXP MIFARE Plus 4k SL2"; break;
+		case 0x18: type = "NXP MIFARE Classic 4k | Plus 4k SL1"; break;
+		case 0x20: type = "NXP MIFARE DESFire 4k | DESFire EV1 2k/4k/8k | Plus 2k/4k SL3 | JCOP 31/41"; break;
+		case 0x24: type = "NXP MIFARE DESFire | DESFire EV1"; break;
+		case 0x28: type = "JCOP31 or JCOP41 v2.3.1"; break;
+		case 0x38: type = "Nokia 6212 or 6131 MIFARE CLASSIC 4K"; break;
+		case 0x88: type = "Infineon MIFARE CLASSIC 1K"; break;
+		case 0x98: type = "Gemplus MPCOS"; break;
 		default: ;
 	}
+	if (type) {
+		PrintAndLog("TYPE : %s", type);
+		ResultString("type", type);
+	}
 
 	// Double & triple sized UID, can be mapped to a manufacturer.
 	// HACK: does this apply for Ultralight cards?
 	if (card.uidlen > 4) {
 		PrintAndLog("MANUFACTURER : %s", getManufacturerName(card.uid[0]));
+		ResultString("manufacturer", getManufacturerName(card.uid[0]));
 	}
 
 	// try to request ATS even if tag claims not to support it
@@ -302,6 +324,7 @@ int CmdHF14AInfo(const char *Cmd) {
 			PrintAndLog("SAK incorrectly claims that card doesn't support RATS");
 		}
 		PrintAndLog(" ATS : %s", sprint_hex(card.ats, card.ats_len));
+		ResultHex("ats", card.ats, card.ats_len);
 		PrintAndLog("       -  TL : length is %d bytes", card.ats[0]);
 		if (card.ats[0] != card.ats_len - 2) {
 			PrintAndLog("ATS may be corrupted. Length of ATS (%d bytes incl. 2 Bytes CRC) doesn't match TL", card.ats_len);
@@ -569,37 +592,138 @@ int CmdHF14ASim(const char *Cmd)
 }
 
 
+// Receive the trace records streamed by a running snoop and write them to <filename>,
+// until the snoop is stopped on the device.
+static int StreamTraceToFile(const char *filename) {
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		PrintAndLog("Could not create file %s", filename);
+		return 1;
+	}
+
+	PrintAndLog("Streaming trace to %s. Press the pm3 button or any key to stop snooping.", filename);
+	uint32_t received = 0, written = 0, dropped = 0, lost = 0, overruns = 0;
+	uint64_t last_report = msclock();
+	bool aborting = false;
+	int silent = 0;
+	UsbCommand resp;
+	while (true) {
+		if (!aborting && ukbhit()) {
+			int gc = getchar(); (void)gc;
+			PrintAndLog("\naborted via keyboard!");
+			// any command stops the snoop on the device, which then sends the rest of the trace
+			UsbCommand ping = {CMD_PING};
+			SendCommand(&ping);
+			aborting = true;
+		}
+		if (!WaitForResponseTimeoutW(CMD_UNKNOWN, &resp, 100, false)) {
+			if (aborting && ++silent > 30) {
+				PrintAndLog("the device did not stop snooping");
+				break;
+			}
+			continue;
+		}
+		silent = 0;
+
+		if (resp.cmd == CMD_TRACE_STREAM) {
+			uint32_t len = MIN(resp.arg[1], TRACE_STREAM_CHUNK_SIZE);
+			if (resp.arg[0] != received + lost) {
+				// client didn't keep up. The records after the gap can't be framed,
+				// so the file ends here.
+				lost += resp.arg[0] - (received + lost);
+			}
+			if (!lost) {
+				fwrite(resp.d.asBytes, 1, len, f);
+				written += len;
+			}
+			received += len;
+			dropped = resp.arg[2];
+			if (msclock() - last_report > 5000) {
+				PrintAndLog("received %u bytes, %u records dropped by the device", received, dropped);
+				last_report = msclock();
+			}
+		} else if (resp.cmd == CMD_ACK) {
+			dropped = resp.arg[1];
+			overruns = resp.arg[2];
+			if (aborting) {
+				// ack of the ping
+				WaitForResponseTimeout(CMD_ACK, NULL, 1000);
+			}
+			break;
+		}
+	}
+	fclose(f);
+
+	PrintAndLog("Saved %u bytes of trace to %s. Use 'hf list 14a -l %s' to show it.", written, filename, filename);
+	if (dropped) PrintAndLog("%u records were dropped by the device, the client did not keep up.", dropped);
+	if (lost) PrintAndLog("%u bytes were lost on the client. The file ends before the gap, the %u bytes received after it were not saved.", lost, received - written);
+	if (overruns) PrintAndLog("%u DMA overruns, the decoders did not keep up and samples were lost. Try a bigger DMA buffer (d).", overruns);
+	return 0;
+}
+
 int CmdHF14ASnoop(const char *Cmd) {
 	int param = 0;
+	uint32_t dma_size = 0;
+	char filename[FILE_PATH_SIZE] = {0};
 
 	uint8_t ctmp = param_getchar(Cmd, 0) ;
 	if (ctmp == 'h' || ctmp == 'H') {
 		PrintAndLog("It get data from the field and saves it into command buffer.");
 		PrintAndLog("Buffer accessible from command hf list 14a.");
-		PrintAndLog("Usage:  hf 14a snoop [c][r]");
+		PrintAndLog("Usage:  hf 14a snoop [c][r][z][d <bytes>][f <filename>]");
 		PrintAndLog("c - triggered by first data from card");
 		PrintAndLog("r - triggered by first 7-bit request from reader (REQ,WUP,...)");
+		PrintAndLog("z - compact trace format on the device, fits about 1.5 times more frames");
+		PrintAndLog("d - size of the DMA buffer, default 2048. A bigger one avoids overruns with chatty readers.");
+		PrintAndLog("f - stream the trace into <filename> while snooping. Not limited by the device memory.");
 		PrintAndLog("sample: hf 14a snoop c r");
+		PrintAndLog("        hf 14a snoop f turnstile.trc");
 		return 0;
 	}
 
-	for (int i = 0; i < 2; i++) {
-		ctmp = param_getchar(Cmd, i);
+	for (int i = 0; (ctmp = param_getchar(Cmd, i)) != 0x00; i++) {
 		if (ctmp == 'c' || ctmp == 'C') param |= 0x01;
 		if (ctmp == 'r' || ctmp == 'R') param |= 0x02;
+		if (ctmp == 'z' || ctmp == 'Z') param |= 0x08;
+		if (ctmp == 'd' || ctmp == 'D') {
+			dma_size = param_get32ex(Cmd, ++i, 0, 10);
+			if (dma_size < 64 || dma_size > 32768) {
+				PrintAndLog("DMA buffer size must be between 64 and 32768 bytes");
+				return 1;
+			}
+		}
+		if (ctmp == 'f' || ctmp == 'F') {
+			if (param_getstr(Cmd, ++i, filename, sizeof(filename)) <= 0) {
+				PrintAndLog("Missing file name");
+				return 1;
+			}
+			param |= 0x04;
+		}
 	}
 
-	UsbCommand c = {CMD_SNOOP_ISO_14443a, {param, 0, 0}};
+	UsbCommand c = {CMD_SNOOP_ISO_14443a, {param, dma_size, 0}};
+	clearCommandBuffer();
 	SendCommand(&c);
+
+	if (param & 0x04) {
+		return StreamTraceToFile(filename);
+	}
 	return 0;
 }
 
 
 void DropField() {
+	CardSelected = false;
 	UsbCommand c = {CMD_READER_ISO_14443a, {0, 0, 0}};
 	SendCommand(&c);
 }
 
+bool GetSelectedCard14443_4(iso14a_card_select_t *card) {
+	if (CardSelected && card)
+		memcpy(card, &SelectedCard, sizeof(iso14a_card_select_t));
+	return CardSelected;
+}
+
 
 int ExchangeRAW14a(uint8_t *datain, int datainlen, bool activateField, bool leaveSignalON, uint8_t *dataout, int maxdataoutlen, int *dataoutlen) {
 	static bool responseNum = false;
@@ -701,7 +825,7 @@ int ExchangeRAW14a(uint8_t *datain, int datainlen, bool activateField, bool leav
 }
 
 
-static int SelectCard14443_4(bool disconnect, iso14a_card_select_t *card) {
+int SelectCard14443_4(bool disconnect, iso14a_card_select_t *card) {
 	UsbCommand resp;
 
 	frameLength = 0;
@@ -761,6 +885,9 @@ static int SelectCard14443_4(bool disconnect, iso14a_card_select_t *card) {
 
 	if (disconnect) {
 		DropField();
+	} else {
+		memcpy(&SelectedCard, vcard, sizeof(iso14a_card_select_t));
+		CardSelected = true;
 	}
 
 	return 0;
@@ -921,6 +1048,76 @@ int ExchangeAPDU14a(uint8_t *datain, int datainlen, bool activateField, bool lea
 	return 0;
 }
 
+int ExchangeAPDUs14a(uint8_t **datain, int *datainlen, int count, bool activateField, uint8_t **dataout, int maxdataoutlen, int *dataoutlen, int *done) {
+	*done = 0;
+
+	if (activateField) {
+		int selres = SelectCard14443_4(false, NULL);
+		if (selres)
+			return selres;
+	}
+
+	// only APDUs which fit into one frame
+	for (int i = 0; i < count; i++) {
+		if ((frameLength && (datainlen[i] > frameLength - 3)) || (datainlen[i] > USB_CMD_DATA_SIZE - 3)) {
+			count = i;
+			break;
+		}
+	}
+
+	// the Proxmark executes the commands in order. The next one is already there when it has sent
+	// the answer to the previous one.
+	clearCommandBuffer();
+	for (int i = 0; i < count; i++) {
+		UsbCommand c = {CMD_READER_ISO_14443a, {ISO14A_APDU | ISO14A_NO_DISCONNECT, (datainlen[i] & 0xFFFF), 0}};
+		memcpy(c.d.asBytes, datain[i], datainlen[i]);
+		SendCommand(&c);
+	}
+
+	// after an error the answers of the remaining APDUs are still received, but not taken
+	int res = 0;
+	for (int i = 0; i < count; i++) {
+		UsbCommand resp;
+		if (!WaitForResponseTimeout(CMD_ACK, &resp, 1500)) {
+			PrintAndLog("APDU ERROR: Reply timeout.");
+			clearCommandBuffer();
+			return 4;
+		}
+
+		if (res)
+			continue;
+
+		int iLen = resp.arg[0];
+		uint8_t pcb = resp.arg[1];
+
+		if (!iLen) {
+			PrintAndLog("APDU ERROR: No APDU response.");
+			res = 1;
+		} else if (iLen == -2) {
+			PrintAndLog("APDU ERROR: Block type mismatch.");
+			res = 2;
+		} else if (iLen == -1) {
+			PrintAndLog("APDU ERROR: ISO 14443A CRC error.");
+			res = 3;
+		} else if (iLen < 2) {
+			PrintAndLog("APDU ERROR: Small APDU response. Len=%d", iLen);
+			res = 2;
+		} else if ((pcb & 0xf2) == 0xa2 || (pcb & 0x10) != 0) {
+			// a chained answer needs more blocks before the next APDU
+			res = 202;
+		} else if (maxdataoutlen && iLen - 2 > maxdataoutlen) {
+			PrintAndLog("APDU ERROR: Buffer too small(%d). Needs %d bytes", maxdataoutlen, iLen - 2);
+			res = 2;
+		} else {
+			memcpy(dataout[i], resp.d.asBytes, iLen - 2);
+			dataoutlen[i] = iLen - 2;
+			(*done)++;
+		}
+	}
+
+	return res;
+}
+
 // ISO14443-4. 7. Half-duplex block transmission protocol
 int CmdHF14AAPDU(const char *cmd) {
 	uint8_t data[USB_CMD_DATA_SIZE];
@@ -30,5 +30,13 @@ extern void DropField();
 extern int Hf14443_4aGetCardData(iso14a_card_select_t * card);
 extern int ExchangeRAW14a(uint8_t *datain, int datainlen, bool activateField, bool leaveSignalON, uint8_t *dataout, int maxdataoutlen, int *dataoutlen);
 extern int ExchangeAPDU14a(uint8_t *datain, int datainlen, bool activateField, bool leaveSignalON, uint8_t *dataout, int maxdataoutlen, int *dataoutlen);
+// Sends <count> APDUs without waiting for the answer to the previous one. Sending stops before the first APDU
+// which doesn't fit into one frame, and taking the answers stops at the first error or chained answer. The answers
+// without frame CRC are in dataout[i], dataoutlen[i] for i < *done. Returns 0 or the error of the first failed APDU.
+// Leaves the field on.
+extern int ExchangeAPDUs14a(uint8_t **datain, int *datainlen, int count, bool activateField, uint8_t **dataout, int maxdataoutlen, int *dataoutlen, int *done);
+extern int SelectCard14443_4(bool disconnect, iso14a_card_select_t *card);
+// the card selected by SelectCard14443_4() or APDU exchanges with activateField, while the field is on
+extern bool GetSelectedCard14443_4(iso14a_card_select_t *card);
 
 #endif
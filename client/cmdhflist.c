@@ -16,6 +16,8 @@
 #include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <inttypes.h>
+#include <pthread.h>
 #include "util.h"
 #include "ui.h"
 #include "cliparser/cliparser.h"
@@ -29,6 +31,10 @@
 #include "mifare/mifaredefault.h"
 #include "usb_cmd.h"
 #include "pcsc.h"
+#include "tracefile.h"
+#include "jansson.h"
+#include "cmdhfliststats.h"
+#include "proxmark3.h"   // for get_my_executable_directory
 
 typedef struct {
 	uint32_t uid;       // UID
@@ -618,8 +624,8 @@ static bool NestedCheckKey(uint64_t key, TAuthData *ad, uint8_t *cmd, uint8_t cm
 	uint8_t buf[32] = {0};
 	struct Crypto1State *pcs;
 
-	AuthData.ks2 = 0;
-	AuthData.ks3 = 0;
+	ad->ks2 = 0;
+	ad->ks3 = 0;
 
 	pcs = crypto1_create(key);
 	uint32_t nt1 = crypto1_word(pcs, ad->nt_enc ^ ad->uid, 1) ^ ad->nt_enc;
@@ -647,15 +653,421 @@ static bool NestedCheckKey(uint64_t key, TAuthData *ad, uint8_t *cmd, uint8_t cm
 	if(!CheckCrc14443(CRC_14443_A, buf, cmdsize))
 		return false;
 
-	AuthData.nt = nt1;
-	AuthData.ks2 = AuthData.ar_enc ^ ar;
-	AuthData.ks3 = AuthData.at_enc ^ at;
+	ad->nt = nt1;
+	ad->ks2 = ad->ar_enc ^ ar;
+	ad->ks3 = ad->at_enc ^ at;
 
 	return true;
 }
 
 
-static bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isResponse, uint8_t *mfData, size_t *mfDataLen) {
+static bool NestedCheckKeys(const uint64_t *keys, size_t keys_count, TAuthData *ad, uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, uint64_t *key) {
+	for (size_t i = 0; i < keys_count; i++) {
+		if (NestedCheckKey(keys[i], ad, cmd, cmdsize, parity)) {
+			*key = keys[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+
+// Search the encrypted tag nonce near ad->nt, the nonce of the previous authentication (weak PRNG only)
+static bool NestedSearchNonce(TAuthData *ad, uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, uint64_t *key) {
+	uint8_t buf[32];
+
+	if (!validate_prng_nonce(ad->nt))
+		return false;
+
+	uint32_t ntx = prng_successor(ad->nt, 90);
+	for (int i = 0; i < 16383; i++) {
+		ntx = prng_successor(ntx, 1);
+		if (NTParityChk(ad, ntx)){
+
+			uint32_t ks2 = ad->ar_enc ^ prng_successor(ntx, 64);
+			uint32_t ks3 = ad->at_enc ^ prng_successor(ntx, 96);
+			struct Crypto1State *pcs = lfsr_recovery64(ks2, ks3);
+			memcpy(buf, cmd, cmdsize);
+			mf_crypto1_decrypt(pcs, buf, cmdsize, 0);
+
+			crypto1_destroy(pcs);
+			if (CheckCrypto1Parity(cmd, cmdsize, buf, parity) && CheckCrc14443(CRC_14443_A, buf, cmdsize)) {
+				ad->ks2 = ks2;
+				ad->ks3 = ks3;
+
+				ad->nt = ntx;
+				*key = GetCrypto1ProbableKey(ad);
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+
+// Cipher state after the authentication. Much faster than lfsr_recovery64() when the key is known.
+static struct Crypto1State *Crypto1StateFromKey(uint64_t key, TAuthData *ad) {
+	struct Crypto1State *pcs = crypto1_create(key);
+	crypto1_word(pcs, ad->uid ^ ad->nt, 0);
+	crypto1_word(pcs, ad->nr_enc, 1);
+	crypto1_word(pcs, 0, 0);
+	crypto1_word(pcs, 0, 0);
+	return pcs;
+}
+
+
+static void SetFrameKey(hf_list_frame_t *frame, const char *source, uint64_t key, TAuthData *ad) {
+	frame->key_source = source;
+	frame->key = key;
+	frame->ks2 = ad->ks2;
+	frame->ks3 = ad->ks3;
+}
+
+
+//-----------------------------------------------------------------------------
+// Key recovery for the whole trace, done before listing it.
+//
+// Every nested authentication (and the first encrypted command after it) is
+// collected, together with the keys of the plain first authentications and
+// the keys cached for the card's UID. The searches then run in worker threads.
+// Searching the tag nonce needs the nonce of the previous authentication, so
+// this is done in rounds: a solved authentication unlocks the next one of the
+// same card session.
+//-----------------------------------------------------------------------------
+
+#define MF_KEY_CACHE_FILE       "mf_trace_keys.txt"    // in the directory of the client executable
+
+typedef struct {
+	uint32_t uid;
+	uint64_t key;
+} TUidKey;
+
+typedef struct {
+	TAuthData ad;           // ad.nt: previous tag nonce, the recovered nonce when solved
+	uint8_t cmd[32];        // first encrypted command
+	uint8_t cmdsize;
+	uint8_t parity[4];
+	long prev;              // previous nested authentication in this card session, -1 if none
+	bool nt_known;          // ad.nt is valid
+	bool keys_tried;
+	bool nonce_tried;
+	bool solved;
+	const char *source;
+	uint64_t key;
+} TNestedAuth;
+
+static TNestedAuth *NestedAuths;
+static size_t NestedAuthsCount;
+static TUidKey *KnownKeys;
+static size_t KnownKeysCount;
+static size_t KnownKeysCached;      // the first ones are from the cache file
+
+static size_t nested_next;
+static bool KeyRecoveryVerbose = true;  // progress messages, only with the text output
+static pthread_mutex_t nested_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static bool AddKnownKey(uint32_t uid, uint64_t key) {
+	for (size_t i = 0; i < KnownKeysCount; i++) {
+		if (KnownKeys[i].uid == uid && KnownKeys[i].key == key)
+			return false;
+	}
+	TUidKey *p = realloc(KnownKeys, (KnownKeysCount + 1) * sizeof(TUidKey));
+	if (!p)
+		return false;
+	KnownKeys = p;
+	KnownKeys[KnownKeysCount].uid = uid;
+	KnownKeys[KnownKeysCount].key = key;
+	KnownKeysCount++;
+	return true;
+}
+
+
+// Key of a first authentication. Known keys are tried before the (slow) state recovery.
+static uint64_t FirstAuthKey(TAuthData *ad) {
+	for (size_t i = 0; i < KnownKeysCount; i++) {
+		if (KnownKeys[i].uid != ad->uid)
+			continue;
+		struct Crypto1State *pcs = crypto1_create(KnownKeys[i].key);
+		crypto1_word(pcs, ad->uid ^ ad->nt, 0);
+		crypto1_word(pcs, ad->nr_enc, 1);
+		bool match = crypto1_word(pcs, 0, 0) == ad->ks2 && crypto1_word(pcs, 0, 0) == ad->ks3;
+		crypto1_destroy(pcs);
+		if (match)
+			return KnownKeys[i].key;
+	}
+	return GetCrypto1ProbableKey(ad);
+}
+
+
+// the cache lives next to the client, not in whatever directory hf list runs in
+static const char *KeyCachePath(void) {
+	static char path[FILE_PATH_SIZE];
+	snprintf(path, sizeof(path), "%s%s", get_my_executable_directory(), MF_KEY_CACHE_FILE);
+	return path;
+}
+
+
+static void LoadKeyCache(void) {
+	FILE *f = fopen(KeyCachePath(), "r");
+	if (!f)
+		return;
+	char line[64];
+	while (fgets(line, sizeof(line), f)) {
+		uint32_t uid;
+		uint64_t key;
+		if (line[0] == '#')
+			continue;
+		if (sscanf(line, "%08"SCNx32" %012"SCNx64, &uid, &key) == 2)
+			AddKnownKey(uid, key);
+	}
+	fclose(f);
+	KnownKeysCached = KnownKeysCount;
+}
+
+
+static void SaveKeyCache(void) {
+	if (KnownKeysCount == KnownKeysCached)
+		return;
+	FILE *f = fopen(KeyCachePath(), "a");
+	if (!f) {
+		PrintAndLog("Could not write key cache %s", KeyCachePath());
+		return;
+	}
+	for (size_t i = KnownKeysCached; i < KnownKeysCount; i++) {
+		fprintf(f, "%08"PRIx32" %012"PRIx64"\n", KnownKeys[i].uid, KnownKeys[i].key);
+	}
+	fclose(f);
+	if (KeyRecoveryVerbose)
+		PrintAndLog("%zu new key(s) added to %s", KnownKeysCount - KnownKeysCached, KeyCachePath());
+}
+
+
+static bool AddNestedAuth(TNestedAuth *na) {
+	if ((NestedAuthsCount & 0xff) == 0) {
+		TNestedAuth *p = realloc(NestedAuths, (NestedAuthsCount + 0x100) * sizeof(TNestedAuth));
+		if (!p)
+			return false;
+		NestedAuths = p;
+	}
+	NestedAuths[NestedAuthsCount++] = *na;
+	return true;
+}
+
+
+static bool GetRecord(const trace_t *trace, size_t record, bool isResponse, uint16_t len) {
+	uint16_t data_len;
+	if (record >= trace->count || trace_is_response(trace, record) != isResponse)
+		return false;
+	trace_record_data(trace, record, &data_len);
+	return data_len == len;
+}
+
+
+// Find authentications by their frame sizes: reader 4 bytes, tag 4, reader 8, tag 4.
+// Inside an encrypted session this is what a nested authentication looks like.
+static void CollectMifareAuths(const trace_t *trace) {
+	bool encrypted = false;
+	uint32_t uid = 0;
+	uint32_t prev_nt = 0;
+	long prev = -1;
+
+	for (size_t i = 0; i < trace->count; i++) {
+		uint16_t len;
+		const uint8_t *data = trace_record_data(trace, i, &len);
+		if (trace_is_response(trace, i))
+			continue;
+
+		if (len == 1 && (data[0] == ISO14443A_CMD_REQA || data[0] == ISO14443A_CMD_WUPA)) {
+			encrypted = false;
+			continue;
+		}
+		if (!encrypted && len == 9 && (data[0] == ISO14443A_CMD_ANTICOLL_OR_SELECT || data[0] == ISO14443A_CMD_ANTICOLL_OR_SELECT_2) && data[1] == 0x70) {
+			uid = bytes_to_num((uint8_t *)&data[2], 4);
+			continue;
+		}
+		if (!(len == 4 && GetRecord(trace, i + 1, true, 4) && GetRecord(trace, i + 2, false, 8) && GetRecord(trace, i + 3, true, 4)))
+			continue;
+
+		TAuthData ad = {0};
+		const uint8_t *nt = trace_record_data(trace, i + 1, &len);
+		const uint8_t *nrar = trace_record_data(trace, i + 2, &len);
+		const uint8_t *at = trace_record_data(trace, i + 3, &len);
+		ad.uid = uid;
+		ad.nr_enc = bytes_to_num((uint8_t *)nrar, 4);
+		ad.ar_enc = bytes_to_num((uint8_t *)&nrar[4], 4);
+		ad.ar_enc_par = nrar[8] << 4;
+		ad.at_enc = bytes_to_num((uint8_t *)at, 4);
+		ad.at_enc_par = at[4];
+
+		if (!encrypted) {
+			if (data[0] != MIFARE_AUTH_KEYA && data[0] != MIFARE_AUTH_KEYB)
+				continue;
+			ad.nt = bytes_to_num((uint8_t *)nt, 4);
+			ad.ks2 = ad.ar_enc ^ prng_successor(ad.nt, 64);
+			ad.ks3 = ad.at_enc ^ prng_successor(ad.nt, 96);
+			AddKnownKey(uid, FirstAuthKey(&ad));
+			prev_nt = ad.nt;
+			prev = -1;
+			encrypted = true;
+		} else {
+			uint16_t cmdsize;
+			const uint8_t *cmd = NULL;
+			if (i + 4 < trace->count && !trace_is_response(trace, i + 4))
+				cmd = trace_record_data(trace, i + 4, &cmdsize);
+			if (cmd == NULL || cmdsize == 0 || cmdsize > 32)
+				continue;
+
+			TNestedAuth na = {0};
+			na.ad = ad;
+			na.ad.nt = prev_nt;
+			na.ad.nt_enc = bytes_to_num((uint8_t *)nt, 4);
+			na.ad.nt_enc_par = nt[4];
+			memcpy(na.cmd, cmd, cmdsize);
+			na.cmdsize = cmdsize;
+			memcpy(na.parity, cmd + cmdsize, (cmdsize - 1) / 8 + 1);
+			na.prev = prev;
+			na.nt_known = (prev == -1);
+			if (!AddNestedAuth(&na))
+				break;
+			prev = NestedAuthsCount - 1;
+		}
+		i += 3;
+	}
+}
+
+
+static void *NestedAuthWorker(void *arg) {
+	uint64_t *keys = malloc(KnownKeysCount * sizeof(uint64_t));
+
+	while (true) {
+		pthread_mutex_lock(&nested_mutex);
+		size_t n = nested_next++;
+		pthread_mutex_unlock(&nested_mutex);
+		if (n >= NestedAuthsCount)
+			break;
+
+		TNestedAuth *na = &NestedAuths[n];
+		if (na->solved)
+			continue;
+
+		if (!na->keys_tried) {
+			size_t keys_count = 0;
+			for (size_t i = 0; keys && i < KnownKeysCount; i++) {
+				if (KnownKeys[i].uid == na->ad.uid)
+					keys[keys_count++] = KnownKeys[i].key;
+			}
+			if (NestedCheckKeys(keys, keys_count, &na->ad, na->cmd, na->cmdsize, na->parity, &na->key)) {
+				na->source = "known key";
+				na->solved = true;
+			} else if (NestedCheckKeys(MifareDefaultKeys, MifareDefaultKeysSize, &na->ad, na->cmd, na->cmdsize, na->parity, &na->key)) {
+				na->source = "default key";
+				na->solved = true;
+			}
+			na->keys_tried = true;
+		}
+
+		if (!na->solved && na->nt_known && !na->nonce_tried) {
+			if (NestedSearchNonce(&na->ad, na->cmd, na->cmdsize, na->parity, &na->key)) {
+				na->source = "nested probable key";
+				na->solved = true;
+			}
+			na->nonce_tried = true;
+		}
+	}
+
+	free(keys);
+	return NULL;
+}
+
+
+static void RecoverMifareTraceKeys(const trace_t *trace) {
+	LoadKeyCache();
+	CollectMifareAuths(trace);
+	if (NestedAuthsCount == 0) {
+		SaveKeyCache();
+		return;
+	}
+
+	int num_threads = num_CPUs();
+	if ((size_t)num_threads > NestedAuthsCount)
+		num_threads = NestedAuthsCount;
+	if (KeyRecoveryVerbose)
+		PrintAndLog("Recovering keys of %zu nested authentications with %d threads...", NestedAuthsCount, num_threads);
+	uint64_t start_time = msclock();
+
+	bool progress = true;
+	while (progress) {
+		size_t keys_count = KnownKeysCount;
+
+		nested_next = 0;
+		pthread_t thread_id[num_threads];
+		for (int i = 0; i < num_threads; i++) {
+			pthread_create(&thread_id[i], NULL, NestedAuthWorker, NULL);
+		}
+		for (int i = 0; i < num_threads; i++) {
+			pthread_join(thread_id[i], NULL);
+		}
+
+		// new keys may solve more authentications, solved ones give the nonce of the next one
+		for (size_t i = 0; i < NestedAuthsCount; i++) {
+			TNestedAuth *na = &NestedAuths[i];
+			if (na->solved)
+				AddKnownKey(na->ad.uid, na->key);
+		}
+		progress = false;
+		for (size_t i = 0; i < NestedAuthsCount; i++) {
+			TNestedAuth *na = &NestedAuths[i];
+			if (na->solved)
+				continue;
+			if (KnownKeysCount != keys_count) {
+				na->keys_tried = false;
+				progress = true;
+			}
+			if (!na->nt_known && na->prev >= 0 && NestedAuths[na->prev].solved) {
+				na->ad.nt = NestedAuths[na->prev].ad.nt;
+				na->nt_known = true;
+				progress = true;
+			}
+		}
+	}
+
+	size_t solved = 0;
+	for (size_t i = 0; i < NestedAuthsCount; i++) {
+		if (NestedAuths[i].solved)
+			solved++;
+	}
+	if (KeyRecoveryVerbose)
+		PrintAndLog("Found keys for %zu of %zu nested authentications in %"PRIu64" ms", solved, NestedAuthsCount, msclock() - start_time);
+	SaveKeyCache();
+}
+
+
+static TNestedAuth *FindNestedAuth(TAuthData *ad, uint8_t *cmd, uint8_t cmdsize) {
+	for (size_t i = 0; i < NestedAuthsCount; i++) {
+		TNestedAuth *na = &NestedAuths[i];
+		if (na->ad.uid == ad->uid && na->ad.nt_enc == ad->nt_enc && na->ad.nr_enc == ad->nr_enc
+			&& na->ad.ar_enc == ad->ar_enc && na->ad.at_enc == ad->at_enc
+			&& na->cmdsize == cmdsize && !memcmp(na->cmd, cmd, cmdsize))
+			return na;
+	}
+	return NULL;
+}
+
+
+static void FreeMifareTraceKeys(void) {
+	free(NestedAuths);
+	NestedAuths = NULL;
+	NestedAuthsCount = 0;
+	free(KnownKeys);
+	KnownKeys = NULL;
+	KnownKeysCount = 0;
+	KnownKeysCached = 0;
+}
+
+
+static bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, bool isResponse, uint8_t *mfData, size_t *mfDataLen, hf_list_frame_t *frame) {
 	static struct Crypto1State *traceCrypto1;
 	static uint64_t mfLastKey;
 
@@ -679,80 +1091,42 @@ static bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, boo
 			AuthData.ks2 = AuthData.ar_enc ^ prng_successor(AuthData.nt, 64);
 			AuthData.ks3 = AuthData.at_enc ^ prng_successor(AuthData.nt, 96);
 
-			mfLastKey = GetCrypto1ProbableKey(&AuthData);
-			PrintAndLog("            |          * | key | probable key:%012"PRIx64" Prng:%s   ks2:%08x ks3:%08x |     |",
-				mfLastKey,
-				validate_prng_nonce(AuthData.nt) ? "WEAK": "HARD",
-				AuthData.ks2,
-				AuthData.ks3);
+			mfLastKey = FirstAuthKey(&AuthData);
+			SetFrameKey(frame, "probable key", mfLastKey, &AuthData);
+			frame->prng = validate_prng_nonce(AuthData.nt) ? "WEAK": "HARD";
 
 			AuthData.first_auth = false;
 
-			traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
+			traceCrypto1 = Crypto1StateFromKey(mfLastKey, &AuthData);
 		} else {
 			if (traceCrypto1) {
 				crypto1_destroy(traceCrypto1);
 				traceCrypto1 = NULL;
 			}
 
-			// check last used key
-			if (mfLastKey) {
-				if (NestedCheckKey(mfLastKey, &AuthData, cmd, cmdsize, parity)) {
-					PrintAndLog("            |          * | key | last used key:%012"PRIx64"            ks2:%08x ks3:%08x |     |",
-						mfLastKey,
-						AuthData.ks2,
-						AuthData.ks3);
-
-				traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
-				};
-			}
-
-			// check default keys
-			if (!traceCrypto1) {
-				for (int defaultKeyCounter = 0; defaultKeyCounter < MifareDefaultKeysSize; defaultKeyCounter++){
-					if (NestedCheckKey(MifareDefaultKeys[defaultKeyCounter], &AuthData, cmd, cmdsize, parity)) {
-						PrintAndLog("            |          * | key | default key:%012"PRIx64"              ks2:%08x ks3:%08x |     |",
-							MifareDefaultKeys[defaultKeyCounter],
-							AuthData.ks2,
-							AuthData.ks3);
-
-						mfLastKey = MifareDefaultKeys[defaultKeyCounter];
-						traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
-						break;
-					};
-				}
-			}
-
-			// nested
-			if (!traceCrypto1 && validate_prng_nonce(AuthData.nt)) {
-				uint32_t ntx = prng_successor(AuthData.nt, 90);
-				for (int i = 0; i < 16383; i++) {
-					ntx = prng_successor(ntx, 1);
-					if (NTParityChk(&AuthData, ntx)){
-
-						uint32_t ks2 = AuthData.ar_enc ^ prng_successor(ntx, 64);
-						uint32_t ks3 = AuthData.at_enc ^ prng_successor(ntx, 96);
-						struct Crypto1State *pcs = lfsr_recovery64(ks2, ks3);
-						memcpy(mfData, cmd, cmdsize);
-						mf_crypto1_decrypt(pcs, mfData, cmdsize, 0);
-
-						crypto1_destroy(pcs);
-						if (CheckCrypto1Parity(cmd, cmdsize, mfData, parity) && CheckCrc14443(CRC_14443_A, mfData, cmdsize)) {
-							AuthData.ks2 = ks2;
-							AuthData.ks3 = ks3;
-
-							AuthData.nt = ntx;
-							mfLastKey = GetCrypto1ProbableKey(&AuthData);
-							PrintAndLog("            |          * | key | nested probable key:%012"PRIx64"      ks2:%08x ks3:%08x |     |",
-								mfLastKey,
-								AuthData.ks2,
-								AuthData.ks3);
-
-							traceCrypto1 = lfsr_recovery64(AuthData.ks2, AuthData.ks3);
-							break;
-						}
-					}
+			uint64_t key;
+			TNestedAuth *na = FindNestedAuth(&AuthData, cmd, cmdsize);
+			if (na) {
+				// already recovered before listing
+				if (na->solved) {
+					AuthData.nt = na->ad.nt;
+					AuthData.ks2 = na->ad.ks2;
+					AuthData.ks3 = na->ad.ks3;
+					SetFrameKey(frame, na->source, na->key, &AuthData);
+					mfLastKey = na->key;
+					traceCrypto1 = Crypto1StateFromKey(na->key, &AuthData);
 				}
+			} else if (mfLastKey && NestedCheckKey(mfLastKey, &AuthData, cmd, cmdsize, parity)) {
+				SetFrameKey(frame, "last used key", mfLastKey, &AuthData);
+				traceCrypto1 = Crypto1StateFromKey(mfLastKey, &AuthData);
+			} else if (NestedCheckKeys(MifareDefaultKeys, MifareDefaultKeysSize, &AuthData, cmd, cmdsize, parity, &key)) {
+				SetFrameKey(frame, "default key", key, &AuthData);
+				mfLastKey = key;
+				traceCrypto1 = Crypto1StateFromKey(key, &AuthData);
+			} else if (NestedSearchNonce(&AuthData, cmd, cmdsize, parity, &key)) {
+				SetFrameKey(frame, "nested probable key", key, &AuthData);
+				mfLastKey = key;
+				traceCrypto1 = Crypto1StateFromKey(key, &AuthData);
 			}
 
 			//hardnested
@@ -803,157 +1177,275 @@ static bool DecodeMifareData(uint8_t *cmd, uint8_t cmdsize, uint8_t *parity, boo
 }
 
 
-bool is_last_record(uint16_t tracepos, uint8_t *trace, uint16_t traceLen) {
-	return(tracepos + sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint16_t) >= traceLen);
+//-----------------------------------------------------------------------------
+// Dissectors. Each protocol computes CRC and annotation once per frame, the
+// output formats only print what is in the hf_list_frame_t.
+//-----------------------------------------------------------------------------
+
+static void dissect_iso14443a(const trace_t *trace, hf_list_frame_t *frame) {
+	if (frame->len > 2)
+		frame->crc = iso14443A_CRC_check(frame->isResponse, (uint8_t *)frame->data, frame->len);
+	if (!frame->isResponse && frame->len > 0)
+		annotateIso14443a(frame->annotation, sizeof(frame->annotation), (uint8_t *)frame->data, frame->len);
 }
 
 
-bool next_record_is_response(uint16_t tracepos, uint8_t *trace) {
-	uint16_t next_records_datalen = *((uint16_t *)(trace + tracepos + sizeof(uint32_t) + sizeof(uint16_t)));
-	return(next_records_datalen & 0x8000);
+static void dissect_mifare_begin(const trace_t *trace) {
+	RecoverMifareTraceKeys(trace);
+	ClearAuthData();
+	MifareAuthState = masNone;
 }
 
 
-bool merge_topaz_reader_frames(uint32_t timestamp, uint32_t *duration, uint16_t *tracepos, uint16_t traceLen, uint8_t *trace, uint8_t *frame, uint8_t *topaz_reader_command, uint16_t *data_len) {
+static void dissect_mifare(const trace_t *trace, hf_list_frame_t *frame) {
+	uint8_t *data = (uint8_t *)frame->data;
+	size_t decrypted_len = 0;
 
-#define MAX_TOPAZ_READER_CMD_LEN    16
+	bool in_session = MifareAuthState == masFirstData || MifareAuthState == masData;
 
-	uint32_t last_timestamp = timestamp + *duration;
+	if (frame->len > 2)
+		frame->crc = mifare_CRC_check(frame->isResponse, data, frame->len);
+	annotateMifare(frame->annotation, sizeof(frame->annotation), data, frame->len, (uint8_t *)frame->parity, frame->parity_len, frame->isResponse);
+	// after the authentication everything is encrypted, the parity bits too
+	frame->encrypted = (in_session && MifareAuthState != masNone) || strstr(frame->annotation, "(enc)") != NULL;
 
-	if ((*data_len != 1) || (frame[0] == TOPAZ_WUPA) || (frame[0] == TOPAZ_REQA)) return false;
+	if (DecodeMifareData(data, frame->len, (uint8_t *)frame->parity, frame->isResponse, frame->decrypted, &decrypted_len, frame)) {
+		frame->decrypted_len = decrypted_len;
+		if (!frame->isResponse) {
+			frame->decrypted_annotation[0] = '>';
+			annotateIso14443a(&frame->decrypted_annotation[1], sizeof(frame->decrypted_annotation) - 1, frame->decrypted, frame->decrypted_len);
+		}
+		frame->decrypted_crc = iso14443A_CRC_check(frame->isResponse, frame->decrypted, frame->decrypted_len);
+	}
+}
 
-	memcpy(topaz_reader_command, frame, *data_len);
 
-	while (!is_last_record(*tracepos, trace, traceLen) && !next_record_is_response(*tracepos, trace)) {
-		uint32_t next_timestamp = *((uint32_t *)(trace + *tracepos));
-		*tracepos += sizeof(uint32_t);
-		uint16_t next_duration = *((uint16_t *)(trace + *tracepos));
-		*tracepos += sizeof(uint16_t);
-		uint16_t next_data_len = *((uint16_t *)(trace + *tracepos)) & 0x7FFF;
-		*tracepos += sizeof(uint16_t);
-		uint8_t *next_frame = (trace + *tracepos);
-		*tracepos += next_data_len;
-		if ((next_data_len == 1) && (*data_len + next_data_len <= MAX_TOPAZ_READER_CMD_LEN)) {
-			memcpy(topaz_reader_command + *data_len, next_frame, next_data_len);
-			*data_len += next_data_len;
-			last_timestamp = next_timestamp + next_duration;
-		} else {
-			// rewind and exit
-			*tracepos = *tracepos - next_data_len - sizeof(uint16_t) - sizeof(uint16_t) - sizeof(uint32_t);
+static void dissect_mifare_end(void) {
+	FreeMifareTraceKeys();
+}
+
+
+static void dissect_iso14443b(const trace_t *trace, hf_list_frame_t *frame) {
+	if (frame->len > 2)
+		frame->crc = iso14443B_CRC_check(frame->isResponse, (uint8_t *)frame->data, frame->len);
+	if (!frame->isResponse && frame->len > 0)
+		annotateIso14443b(frame->annotation, sizeof(frame->annotation), (uint8_t *)frame->data, frame->len);
+}
+
+
+static void dissect_iso15693(const trace_t *trace, hf_list_frame_t *frame) {
+	if (frame->len > 2)
+		frame->crc = iso15693_CRC_check((uint8_t *)frame->data, frame->len);
+	if (!frame->isResponse && frame->len > 0)
+		annotateIso15693(frame->annotation, sizeof(frame->annotation), (uint8_t *)frame->data, frame->len);
+	if (frame->len == 0 && frame->duration == 512)
+		frame->marker = "<EOF>";
+}
+
+
+static void dissect_iclass(const trace_t *trace, hf_list_frame_t *frame) {
+	if (frame->len > 2)
+		frame->crc = iclass_CRC_check(frame->isResponse, (uint8_t *)frame->data, frame->len);
+	if (!frame->isResponse && frame->len > 0)
+		annotateIclass(frame->annotation, sizeof(frame->annotation), (uint8_t *)frame->data, frame->len);
+	if (frame->len == 0 && frame->duration == 2048)
+		frame->marker = "<SOF>";
+}
+
+
+// Topaz reader commands come in 1 or 9 separate frames with 7 or 8 bits each. Merge them.
+static void merge_topaz_reader_frames(const trace_t *trace, hf_list_frame_t *frame) {
+	if (frame->len != 1 || frame->data[0] == TOPAZ_WUPA || frame->data[0] == TOPAZ_REQA)
+		return;
+
+	uint16_t len = 0;
+	frame->merged[len++] = frame->data[0];
+	uint32_t last_timestamp = frame->timestamp + frame->duration;
+
+	size_t record;
+	for (record = frame->next_record; record < trace->count && !trace_is_response(trace, record); record++) {
+		uint16_t next_len;
+		const uint8_t *next = trace_record_data(trace, record, &next_len);
+		if (next_len != 1 || len + next_len > sizeof(frame->merged))
 			break;
-		}
-		uint16_t next_parity_len = (next_data_len-1)/8 + 1;
-		*tracepos += next_parity_len;
+		frame->merged[len++] = next[0];
+		last_timestamp = trace_record_timestamp(trace, record) + trace_record_duration(trace, record);
 	}
 
-	*duration = last_timestamp - timestamp;
+	frame->next_record = record;
+	frame->data = frame->merged;
+	frame->len = len;
+	frame->duration = last_timestamp - frame->timestamp;
+}
 
-	return true;
+
+static void dissect_topaz(const trace_t *trace, hf_list_frame_t *frame) {
+	if (!frame->isResponse)
+		merge_topaz_reader_frames(trace, frame);
+	if (frame->len > 2)
+		frame->crc = iso14443B_CRC_check(frame->isResponse, (uint8_t *)frame->data, frame->len);
+	if (!frame->isResponse && frame->len > 0)
+		annotateTopaz(frame->annotation, sizeof(frame->annotation), (uint8_t *)frame->data, frame->len);
+}
+
+
+static void dissect_iso7816(const trace_t *trace, hf_list_frame_t *frame) {
+	if (!frame->isResponse && frame->len > 0)
+		annotateIso7816(frame->annotation, sizeof(frame->annotation), (uint8_t *)frame->data, frame->len);
 }
 
 
-uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, uint8_t protocol, bool showWaitCycles, bool markCRCBytes, uint32_t *prev_EOT, bool times_in_us) {
-	bool isResponse;
-	uint16_t data_len, parity_len;
-	uint32_t duration;
-	uint8_t topaz_reader_command[9];
-	uint32_t timestamp, first_timestamp;
-	uint32_t EndOfTransmissionTimestamp = 0;
-	char explanation[30] = {0};
-	uint8_t mfData[32] = {0};
-	size_t mfDataLen = 0;
+static void dissect_iso14443_4(const trace_t *trace, hf_list_frame_t *frame) {
+	if (frame->len > 2)
+		frame->crc = iso14443_4_CRC_check((uint8_t *)frame->data, frame->len);
+	if (!frame->isResponse && frame->len > 0)
+		annotateIso14443_4(frame->annotation, sizeof(frame->annotation), (uint8_t *)frame->data, frame->len);
+}
 
-	if (tracepos + sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint16_t) > traceLen) return traceLen;
 
-	first_timestamp = *((uint32_t *)(trace));
-	timestamp = *((uint32_t *)(trace + tracepos));
+static const hf_list_dissector_t builtin_dissectors[] = {
+	{"raw",    "just show raw data without annotations (default)", 0xff, 1, HF_LIST_PARITY_RESPONSES, false, false, LINKTYPE_USER0, NULL, NULL, NULL},
+	{"14a",    "interpret data as ISO14443A communications", ISO_14443A, 1, HF_LIST_PARITY_ALL, true, false, LINKTYPE_ISO_14443, NULL, dissect_iso14443a, NULL},
+	{"mf",     "interpret data as ISO14443A communications and decrypt Mifare Crypto1 stream\n"
+	           "\t         (keys found are cached per UID in " MF_KEY_CACHE_FILE " next to the client executable)",
+	                                                       PROTO_MIFARE, 1, HF_LIST_PARITY_RESPONSES, true, true, LINKTYPE_ISO_14443, dissect_mifare_begin, dissect_mifare, dissect_mifare_end},
+	{"14b",    "interpret data as ISO14443B communications", ISO_14443B, 1, HF_LIST_PARITY_NONE, false, false, LINKTYPE_ISO_14443, NULL, dissect_iso14443b, NULL},
+	{"15",     "interpret data as ISO15693 communications", ISO_15693, 32, HF_LIST_PARITY_NONE, false, false, LINKTYPE_USER0, NULL, dissect_iso15693, NULL},
+	{"iclass", "interpret data as iClass communications", ICLASS, 32, HF_LIST_PARITY_NONE, false, false, LINKTYPE_USER0, NULL, dissect_iclass, NULL},
+	{"topaz",  "interpret data as Topaz communications", TOPAZ, 1, HF_LIST_PARITY_RESPONSES, false, false, LINKTYPE_ISO_14443, NULL, dissect_topaz, NULL},
+	{"7816",   "interpret data as 7816-4 APDU communications", ISO_7816_4, 1, HF_LIST_PARITY_NONE, false, false, LINKTYPE_ISO_14443, NULL, dissect_iso7816, NULL},
+	{"14-4",   "interpret data as ISO14443-4 communications", ISO_14443_4, 1, HF_LIST_PARITY_RESPONSES, false, false, LINKTYPE_ISO_14443, NULL, dissect_iso14443_4, NULL},
+};
 
-	tracepos += 4;
-	duration = *((uint16_t *)(trace + tracepos));
-	tracepos += 2;
-	data_len = *((uint16_t *)(trace + tracepos));
-	tracepos += 2;
+#define MAX_DISSECTORS 32
 
-	if (data_len & 0x8000) {
-	  data_len &= 0x7fff;
-	  isResponse = true;
-	} else {
-	  isResponse = false;
+static const hf_list_dissector_t *dissectors[MAX_DISSECTORS];
+static size_t dissectors_count;
+
+
+static void register_builtin_dissectors(void) {
+	if (dissectors_count > 0)
+		return;
+	for (size_t i = 0; i < ARRAYLEN(builtin_dissectors); i++) {
+		dissectors[dissectors_count++] = &builtin_dissectors[i];
 	}
-	parity_len = (data_len-1)/8 + 1;
+}
+
 
-	if (tracepos + data_len + parity_len > traceLen) {
-		return traceLen;
+bool hf_list_register_dissector(const hf_list_dissector_t *dissector) {
+	register_builtin_dissectors();
+	if (dissectors_count >= MAX_DISSECTORS || hf_list_find_dissector(dissector->name))
+		return false;
+	dissectors[dissectors_count++] = dissector;
+	return true;
+}
+
+
+const hf_list_dissector_t *hf_list_find_dissector(const char *name) {
+	register_builtin_dissectors();
+	for (size_t i = 0; i < dissectors_count; i++) {
+		if (strcmp(dissectors[i]->name, name) == 0)
+			return dissectors[i];
 	}
-	uint8_t *frame = trace + tracepos;
-	tracepos += data_len;
-	uint8_t *parityBytes = trace + tracepos;
-	tracepos += parity_len;
+	return NULL;
+}
+
 
-	if (protocol == TOPAZ && !isResponse) {
-		// topaz reader commands come in 1 or 9 separate frames with 7 or 8 Bits each.
-		// merge them:
-		if (merge_topaz_reader_frames(timestamp, &duration, &tracepos, traceLen, trace, frame, topaz_reader_command, &data_len)) {
-			frame = topaz_reader_command;
+void hf_list_dissect(const hf_list_dissector_t *dissector, const trace_t *trace, size_t record, hf_list_frame_t *frame) {
+	memset(frame, 0, sizeof(*frame));
+	frame->record = record;
+	frame->next_record = record + 1;
+	frame->time = trace->index[record].time;
+	frame->timestamp = trace_record_timestamp(trace, record);
+	frame->duration = trace_record_duration(trace, record) * dissector->time_scale;
+	frame->isResponse = trace_is_response(trace, record);
+	frame->data = trace_record_data(trace, record, &frame->len);
+	frame->parity = frame->data + frame->len;
+	frame->parity_len = (frame->len - 1) / 8 + 1;
+	frame->crc = HF_LIST_CRC_NONE;
+
+	if (dissector->dissect)
+		dissector->dissect(trace, frame);
+
+	if (dissector->parity == HF_LIST_PARITY_ALL || (dissector->parity == HF_LIST_PARITY_RESPONSES && frame->isResponse)) {
+		for (int i = 0; i < frame->len && i < HF_LIST_MAX_SHOWN; i++) {
+			uint8_t parityBits = frame->parity[i >> 3];
+			if (oddparity8(frame->data[i]) != ((parityBits >> (7 - (i & 0x07))) & 0x01)) {
+				frame->parity_error[i >> 3] |= 0x80 >> (i & 0x07);
+				frame->parity_errors++;
+			}
 		}
 	}
 
-	// adjust for different time scales
-	if (protocol == ICLASS || protocol == ISO_15693) {
-		duration *= 32;
-	}
+	if (dissector->short_bytes && frame->duration < 128 * (9 * frame->len))
+		frame->short_last_byte = true;
+}
 
-	//Check the CRC status
-	uint8_t crcStatus = 2;
 
-	if (data_len > 2) {
-		switch (protocol) {
-			case ICLASS:
-				crcStatus = iclass_CRC_check(isResponse, frame, data_len);
-				break;
-			case ISO_14443B:
-			case TOPAZ:
-				crcStatus = iso14443B_CRC_check(isResponse, frame, data_len);
-				break;
-			case PROTO_MIFARE:
-				crcStatus = mifare_CRC_check(isResponse, frame, data_len);
-				break;
-			case ISO_14443A:
-				crcStatus = iso14443A_CRC_check(isResponse, frame, data_len);
-				break;
-			case ISO_14443_4:
-				crcStatus = iso14443_4_CRC_check(frame, data_len);
-				break;
-			case ISO_15693:
-				crcStatus = iso15693_CRC_check(frame, data_len);
-				break;
-			default:
-				break;
-		}
+//-----------------------------------------------------------------------------
+// Output formats
+//-----------------------------------------------------------------------------
+
+typedef struct {
+	bool showWaitCycles;
+	bool markCRCBytes;
+	bool relative_times;
+	bool times_in_us;
+} hf_list_options_t;
+
+typedef struct {
+	const char *name;
+	void (*header)(const hf_list_options_t *options, const trace_t *trace);
+	void (*frame)(const hf_list_options_t *options, const trace_t *trace, const hf_list_frame_t *frame);
+} hf_list_format_t;
+
+
+static const char *crc_text(uint8_t crc) {
+	return crc == HF_LIST_CRC_FAIL ? "!crc" : (crc == HF_LIST_CRC_OK ? " ok " : "    ");
+}
+
+
+static void text_header(const hf_list_options_t *options, const trace_t *trace) {
+	PrintAndLog("Recorded Activity (TraceLen = %zu bytes)", trace->len);
+	PrintAndLog("");
+	if (options->relative_times) {
+		PrintAndLog("Gap = time between transfers. Duration = duration of data transfer. Src = Source of transfer");
+	} else {
+		PrintAndLog("Start = Start of Frame, End = End of Frame. Src = Source of transfer");
+	}
+	if (options->times_in_us) {
+		PrintAndLog("All times are in microseconds");
+	} else {
+		PrintAndLog("All times are in carrier periods (1/13.56Mhz)");
 	}
-	//0 CRC-command, CRC not ok
-	//1 CRC-command, CRC ok
-	//2 Not crc-command
+	PrintAndLog("");
+	if (options->relative_times) {
+		PrintAndLog("        Gap |   Duration | Src | Data (! denotes parity error, ' denotes short bytes)            | CRC | Annotation         |");
+	} else {
+		PrintAndLog("      Start |        End | Src | Data (! denotes parity error, ' denotes short bytes)            | CRC | Annotation         |");
+	}
+	PrintAndLog("------------|------------|-----|-----------------------------------------------------------------|-----|--------------------|");
+}
+
+
+static void text_frame(const hf_list_options_t *options, const trace_t *trace, const hf_list_frame_t *frame) {
+	uint16_t data_len = frame->len;
+	// unwrapped times since the first frame, as used by --start/--end and the csv/json formats
+	uint64_t EndOfTransmissionTime = frame->time + frame->duration;
 
 	//--- Draw the data column
 	char line[16][110];
 
 	for (int j = 0; j < data_len && j/16 < 16; j++) {
-		uint8_t parityBits = parityBytes[j>>3];
-		if (protocol != ISO_14443B
-			&& protocol != ISO_15693
-			&& protocol != ICLASS
-			&& protocol != ISO_7816_4
-			&& (isResponse || protocol == ISO_14443A)
-			&& (oddparity8(frame[j]) != ((parityBits >> (7-(j&0x0007))) & 0x01))) {
-			snprintf(line[j/16]+(( j % 16) * 4), 110, " %02x!", frame[j]);
+		if (frame->parity_error[j >> 3] & (0x80 >> (j & 0x07))) {
+			snprintf(line[j/16]+(( j % 16) * 4), 110, " %02x!", frame->data[j]);
 		} else {
-			snprintf(line[j/16]+(( j % 16) * 4), 110, " %02x ", frame[j]);
+			snprintf(line[j/16]+(( j % 16) * 4), 110, " %02x ", frame->data[j]);
 		}
 	}
 
-	if (markCRCBytes) {
-		if (crcStatus == 0 || crcStatus == 1) { //CRC-command
+	if (options->markCRCBytes) {
+		if (frame->crc == HF_LIST_CRC_FAIL || frame->crc == HF_LIST_CRC_OK) {
 			char *pos1 = line[(data_len-2)/16]+(((data_len-2) % 16) * 4);
 			(*pos1) = '[';
 			char *pos2 = line[(data_len)/16]+(((data_len) % 16) * 4);
@@ -962,141 +1454,273 @@ uint16_t printTraceLine(uint16_t tracepos, uint16_t traceLen, uint8_t *trace, ui
 	}
 
 	// mark short bytes (less than 8 Bit + Parity)
-	if (protocol == ISO_14443A || protocol == PROTO_MIFARE) {
-		if (duration < 128 * (9 * data_len)) {
-			line[(data_len-1)/16][((data_len-1)%16) * 4 + 3] = '\'';
-		}
+	if (frame->short_last_byte) {
+		line[(data_len-1)/16][((data_len-1)%16) * 4 + 3] = '\'';
 	}
 
 	if (data_len == 0) {
-		if (protocol == ICLASS && duration == 2048) {
-			sprintf(line[0], " <SOF>");
-		} else if (protocol == ISO_15693 && duration == 512) {
-			sprintf(line[0], " <EOF>");
+		if (frame->marker) {
+			sprintf(line[0], " %s", frame->marker);
 		} else {
 			sprintf(line[0], " <empty trace - possible error>");
 		}
 	}
 
 	//--- Draw the CRC column
-	char *crc = (crcStatus == 0 ? "!crc" : (crcStatus == 1 ? " ok " : "    "));
-
-	if (protocol == PROTO_MIFARE)
-		annotateMifare(explanation, sizeof(explanation), frame, data_len, parityBytes, parity_len, isResponse);
-
-	if (!isResponse) {
-		switch(protocol) {
-			case ICLASS:      annotateIclass(explanation,sizeof(explanation),frame,data_len); break;
-			case ISO_14443A:  annotateIso14443a(explanation,sizeof(explanation),frame,data_len); break;
-			case ISO_14443B:  annotateIso14443b(explanation,sizeof(explanation),frame,data_len); break;
-			case TOPAZ:       annotateTopaz(explanation,sizeof(explanation),frame,data_len); break;
-			case ISO_15693:   annotateIso15693(explanation,sizeof(explanation),frame,data_len); break;
-			case ISO_7816_4:  annotateIso7816(explanation, sizeof(explanation), frame, data_len); break;
-			case ISO_14443_4: annotateIso14443_4(explanation, sizeof(explanation), frame, data_len); break;
-			default:          break;
-		}
-	}
-
-	uint32_t previousEndOfTransmissionTimestamp = 0;
-	if (prev_EOT) {
-		if (*prev_EOT) {
-			previousEndOfTransmissionTimestamp = *prev_EOT;
-		} else {
-			previousEndOfTransmissionTimestamp = timestamp;
-		}
-	}		
-	EndOfTransmissionTimestamp = timestamp + duration;
-	if (prev_EOT) *prev_EOT = EndOfTransmissionTimestamp;
+	const char *crc = crc_text(frame->crc);
 
 	int num_lines = MIN((data_len - 1)/16 + 1, 16);
 	for (int j = 0; j < num_lines ; j++) {
 		if (j == 0) {
-			uint32_t time1 = timestamp - first_timestamp;
-			uint32_t time2 = EndOfTransmissionTimestamp - first_timestamp;
-			if (prev_EOT) {
-				time1 = timestamp - previousEndOfTransmissionTimestamp;
-				time2 = duration;
+			uint64_t time1 = frame->time;
+			uint64_t time2 = EndOfTransmissionTime;
+			if (options->relative_times) {
+				time1 = frame->gap;
+				time2 = frame->duration;
 			}
-			if (times_in_us) {
+			if (options->times_in_us) {
 				PrintAndLog(" %10.1f | %10.1f | %s |%-64s | %s| %s",
 					(float)time1/13.56,
 					(float)time2/13.56,
-					isResponse ? "Tag" : "Rdr",
+					frame->isResponse ? "Tag" : "Rdr",
 					line[j],
 					(j == num_lines-1) ? crc : "    ",
-					(j == num_lines-1) ? explanation : "");
+					(j == num_lines-1) ? frame->annotation : "");
 			} else {
-				PrintAndLog(" %10" PRIu32 " | %10" PRIu32 " | %s |%-64s | %s| %s",
+				PrintAndLog(" %10" PRIu64 " | %10" PRIu64 " | %s |%-64s | %s| %s",
 					time1,
 					time2,
-					isResponse ? "Tag" : "Rdr",
+					frame->isResponse ? "Tag" : "Rdr",
 					line[j],
 					(j == num_lines-1) ? crc : "    ",
-					(j == num_lines-1) ? explanation : "");
+					(j == num_lines-1) ? frame->annotation : "");
 			}
 		} else {
 			PrintAndLog("            |            |     |%-64s | %s| %s",
 				line[j],
 				(j == num_lines-1) ? crc : "    ",
-				(j == num_lines-1) ? explanation : "");
+				(j == num_lines-1) ? frame->annotation : "");
 		}
 	}
 
-	if (DecodeMifareData(frame, data_len, parityBytes, isResponse, mfData, &mfDataLen)) {
-		memset(explanation, 0x00, sizeof(explanation));
-		if (!isResponse) {
-			explanation[0] = '>';
-			annotateIso14443a(&explanation[1], sizeof(explanation) - 1, mfData, mfDataLen);
+	if (frame->key_source) {
+		if (frame->prng) {
+			PrintAndLog("            |          * | key | %s:%012"PRIx64" Prng:%s   ks2:%08x ks3:%08x |     |",
+				frame->key_source, frame->key, frame->prng, frame->ks2, frame->ks3);
+		} else {
+			char keystr[40];
+			snprintf(keystr, sizeof(keystr), "%s:%012"PRIx64, frame->key_source, frame->key);
+			PrintAndLog("            |          * | key | %-32s      ks2:%08x ks3:%08x |     |", keystr, frame->ks2, frame->ks3);
 		}
-		uint8_t crcc = iso14443A_CRC_check(isResponse, mfData, mfDataLen);
-		PrintAndLog("            |          * | dec |%-64s | %-4s| %s",
-			sprint_hex(mfData, mfDataLen),
-			(crcc == 0 ? "!crc" : (crcc == 1 ? " ok " : "    ")),
-			(true) ? explanation : "");
-	};
+	}
 
-	if (is_last_record(tracepos, trace, traceLen)) return traceLen;
+	if (frame->decrypted_len) {
+		PrintAndLog("            |          * | dec |%-64s | %-4s| %s",
+			sprint_hex(frame->decrypted, frame->decrypted_len),
+			crc_text(frame->decrypted_crc),
+			frame->decrypted_annotation);
+	}
 
-	if (showWaitCycles && !isResponse && next_record_is_response(tracepos, trace)) {
-		uint32_t next_timestamp = *((uint32_t *)(trace + tracepos));
+	if (options->showWaitCycles && !frame->isResponse && frame->next_record < trace->count && trace_is_response(trace, frame->next_record)) {
+		uint64_t next_time = trace->index[frame->next_record].time;
 
-		PrintAndLog(" %10d | %10d | %s | fdt (Frame Delay Time): %d",
-			(EndOfTransmissionTimestamp - first_timestamp),
-			(next_timestamp - first_timestamp),
+		PrintAndLog(" %10" PRIu64 " | %10" PRIu64 " | %s | fdt (Frame Delay Time): %" PRId64,
+			EndOfTransmissionTime,
+			next_time,
 			"   ",
-			(next_timestamp - EndOfTransmissionTimestamp));
+			(int64_t)(next_time - EndOfTransmissionTime));
+	}
+}
+
+
+// times in the CSV and JSON formats are since the first frame
+static double format_time(const hf_list_options_t *options, uint64_t time) {
+	return options->times_in_us ? time / 13.56 : time;
+}
+
+
+static void csv_header(const hf_list_options_t *options, const trace_t *trace) {
+	PrintAndLog("start,duration,src,data,parity_errors,crc,annotation,key,decrypted,decrypted_annotation");
+}
+
+
+static void csv_frame(const hf_list_options_t *options, const trace_t *trace, const hf_list_frame_t *frame) {
+	char data[2 * HF_LIST_MAX_SHOWN + 1] = {0};
+	char decrypted[2 * HF_LIST_MAX_DECRYPTED + 1] = {0};
+	char key[13] = {0};
+	hex_to_buffer((uint8_t *)data, frame->data, MIN(frame->len, HF_LIST_MAX_SHOWN), sizeof(data) - 1, 0, 0, false);
+	hex_to_buffer((uint8_t *)decrypted, frame->decrypted, frame->decrypted_len, sizeof(decrypted) - 1, 0, 0, false);
+	if (frame->key_source)
+		snprintf(key, sizeof(key), "%012"PRIx64, frame->key);
+
+	// annotations don't contain quotes, but commas
+	PrintAndLog("%.*f,%.*f,%s,%s,%u,%s,\"%s\",%s,%s,\"%s\"",
+		options->times_in_us ? 1 : 0, format_time(options, frame->time),
+		options->times_in_us ? 1 : 0, format_time(options, frame->duration),
+		frame->isResponse ? "tag" : "rdr",
+		data,
+		frame->parity_errors,
+		frame->crc == HF_LIST_CRC_OK ? "ok" : (frame->crc == HF_LIST_CRC_FAIL ? "fail" : ""),
+		frame->annotation,
+		key,
+		decrypted,
+		frame->decrypted_annotation);
+}
+
+
+static void json_set_hex(json_t *obj, const char *name, const uint8_t *data, size_t len) {
+	char hex[2 * HF_LIST_MAX_SHOWN + 1] = {0};
+	hex_to_buffer((uint8_t *)hex, data, MIN(len, HF_LIST_MAX_SHOWN), sizeof(hex) - 1, 0, 0, false);
+	json_object_set_new(obj, name, json_string(hex));
+}
+
+
+// JSON lines, one object per frame
+static void json_frame(const hf_list_options_t *options, const trace_t *trace, const hf_list_frame_t *frame) {
+	json_t *root = json_object();
+	if (options->times_in_us) {
+		json_object_set_new(root, "start", json_real(format_time(options, frame->time)));
+		json_object_set_new(root, "duration", json_real(format_time(options, frame->duration)));
+	} else {
+		json_object_set_new(root, "start", json_integer(frame->time));
+		json_object_set_new(root, "duration", json_integer(frame->duration));
+	}
+	json_object_set_new(root, "src", json_string(frame->isResponse ? "tag" : "rdr"));
+	json_set_hex(root, "data", frame->data, frame->len);
+	if (frame->parity_errors)
+		json_object_set_new(root, "parity_errors", json_integer(frame->parity_errors));
+	if (frame->crc != HF_LIST_CRC_NONE)
+		json_object_set_new(root, "crc", json_boolean(frame->crc == HF_LIST_CRC_OK));
+	if (frame->short_last_byte)
+		json_object_set_new(root, "short", json_true());
+	if (frame->annotation[0])
+		json_object_set_new(root, "annotation", json_string(frame->annotation));
+	if (frame->key_source) {
+		char key[13];
+		snprintf(key, sizeof(key), "%012"PRIx64, frame->key);
+		json_object_set_new(root, "key", json_string(key));
+		json_object_set_new(root, "key_source", json_string(frame->key_source));
+	}
+	if (frame->decrypted_len) {
+		json_set_hex(root, "decrypted", frame->decrypted, frame->decrypted_len);
+		if (frame->decrypted_crc != HF_LIST_CRC_NONE)
+			json_object_set_new(root, "decrypted_crc", json_boolean(frame->decrypted_crc == HF_LIST_CRC_OK));
+		if (frame->decrypted_annotation[0])
+			json_object_set_new(root, "decrypted_annotation", json_string(frame->decrypted_annotation));
 	}
 
-	return tracepos;
+	char *line = json_dumps(root, JSON_COMPACT | JSON_PRESERVE_ORDER);
+	if (line) {
+		PrintAndLog("%s", line);
+		free(line);
+	}
+	json_decref(root);
+}
+
+
+static const hf_list_format_t formats[] = {
+	{"text", text_header, text_frame},
+	{"csv",  csv_header,  csv_frame},
+	{"json", NULL,        json_frame},
+};
+
+
+// Load the trace from <filename>, the PCSC reader or the device
+int hf_list_get_trace(const char *filename, bool pcsc, trace_t *trace) {
+	int res;
+
+	if (filename) {
+		res = trace_load(filename, trace);
+		if (res == TRACE_E_OPEN) {
+			PrintAndLog("Could not open file %s", filename);
+			return 1;
+		} else if (res != TRACE_OK) {
+			PrintAndLog("Cannot load trace from %s%s", filename, res == TRACE_E_FORMAT ? " (invalid pcap/pcapng file)" : "");
+			return 2;
+		}
+	} else if (pcsc) {
+		res = trace_set(trace, pcsc_get_trace_addr(), pcsc_get_traceLen(), false);
+		if (res != TRACE_OK) {
+			PrintAndLog("Cannot allocate memory for trace");
+			return 2;
+		}
+	} else {
+		uint8_t *buf = malloc(USB_CMD_DATA_SIZE);
+		uint32_t traceLen;
+		// Query for the size of the trace
+		UsbCommand response;
+		if (!(GetFromBigBuf(buf, USB_CMD_DATA_SIZE, 0, &response, 500, false))) {
+			free(buf);
+			return 1;
+		}
+		traceLen = response.arg[2];
+		if (traceLen > USB_CMD_DATA_SIZE) {
+			uint8_t *p = realloc(buf, traceLen);
+			if (p == NULL) {
+				PrintAndLog("Cannot allocate memory for trace");
+				free(buf);
+				return 2;
+			}
+			buf = p;
+			if (!(GetFromBigBuf(buf, traceLen, 0, NULL, 500, false))) {
+				free(buf);
+				return 1;
+			}
+		}
+		res = trace_set(trace, buf, traceLen, true);
+		if (res != TRACE_OK) {
+			PrintAndLog("Cannot allocate memory for trace");
+			return 2;
+		}
+	}
+	return 0;
+}
+
+
+// the help of the protocol argument lists the registered dissectors
+void hf_list_protocol_help(char *help, size_t size) {
+	register_builtin_dissectors();
+	snprintf(help, size, "protocol to interpret. Possible values:");
+	for (size_t i = 0; i < dissectors_count; i++) {
+		size_t len = strlen(help);
+		snprintf(help + len, size - len, "\n\t%-6s - %s", dissectors[i]->name, dissectors[i]->description);
+	}
 }
 
 
 int CmdHFList(const char *Cmd) {
 
+	while (*Cmd == ' ') Cmd++;
+	if (strncmp(Cmd, "stats", 5) == 0 && (Cmd[5] == '\0' || Cmd[5] == ' '))
+		return CmdHFListStats(Cmd + 5);
+
+	char protocol_help[2048];
+	hf_list_protocol_help(protocol_help, sizeof(protocol_help));
+
 	CLIParserInit("hf list", "\nList or save protocol data.",
 		"examples: hf list 14a -f                    -- interpret as ISO14443A communication and display Frame Delay Times\n"\
 		"          hf list iclass                    -- interpret as iClass trace\n"\
 		"          hf list -s myCardTrace.trc        -- save trace for later use\n"\
-		"          hf list 14a -l myCardTrace.trc    -- load trace and interpret as ISO14443A communication\n");
+		"          hf list 14a -l myCardTrace.trc    -- load trace and interpret as ISO14443A communication\n"\
+		"          hf list 14a -s myCardTrace.pcapng -- save trace as pcapng, e.g. for Wireshark\n"\
+		"          hf list 14a -l big.trc --start 1e9 --end 2e9 --cmd 60  -- show AUTH commands in a time window\n"\
+		"          hf list mf -l myCardTrace.trc --format json        -- one JSON object per frame\n"\
+		"          hf list stats mf -l myCardTrace.trc                -- statistics, see hf list stats --help\n");
 	void* argtable[] = {
 		arg_param_begin,
 		arg_lit0("f",  "fdt",      "display fdt (frame delay times)"),
 		arg_lit0("r",  "relative", "show relative times (gap and duration)"),
 		arg_lit0("c",  "crc"  ,    "mark CRC bytes"),
 		arg_lit0("p",  "pcsc",     "show trace buffer from PCSC card reader instead of PM3"),
-		arg_str0("l",  "load",     "<filename>", "load trace from file"),
-		arg_str0("s",  "save",     "<filename>", "save trace to file"),
+		arg_str0("l",  "load",     "<filename>", "load trace from file (trace, pcap or pcapng)"),
+		arg_str0("s",  "save",     "<filename>", "save trace to file. *.pcapng files are written as pcapng"),
 		arg_lit0("u",  "us",       "display times in microseconds instead of clock cycles"),
-		arg_str0(NULL,  NULL,      "<protocol>", "protocol to interpret. Possible values:\n"\
-			"\traw    - just show raw data without annotations (default)\n"\
-            "\t14a    - interpret data as ISO14443A communications\n"\
-            "\tmf     - interpret data as ISO14443A communications and decrypt Mifare Crypto1 stream\n"\
-            "\t14b    - interpret data as ISO14443B communications\n"\
-            "\t15     - interpret data as ISO15693 communications\n"\
-            "\ticlass - interpret data as iClass communications\n"\
-            "\ttopaz  - interpret data as Topaz communications\n"\
-            "\t7816   - interpret data as 7816-4 APDU communications\n"\
-            "\t14-4   - interpret data as ISO14443-4 communications"),
+		arg_dbl0(NULL, "start",    "<time>", "only show frames starting at or after <time> (since the first frame)"),
+		arg_dbl0(NULL, "end",      "<time>", "only show frames starting before <time>"),
+		arg_str0(NULL, "src",      "<rdr|tag>", "only show frames from reader or tag"),
+		arg_str0(NULL, "cmd",      "<hex>", "only show reader frames starting with command byte <hex>, and the answers"),
+		arg_str0(NULL, "format",   "<text|csv|json>", "output format (default text)"),
+		arg_str0(NULL,  NULL,      "<protocol>", protocol_help),
 		arg_param_end
 	};
 
@@ -1112,13 +1736,49 @@ int CmdHFList(const char *Cmd) {
 	bool loadFromFile   = arg_get_str_len(5);
 	bool saveToFile     = arg_get_str_len(6);
 	bool times_in_us    = arg_get_lit(7);
+	bool filter_start   = arg_get_dbl_count(8);
+	bool filter_end     = arg_get_dbl_count(9);
+	double time_scale   = times_in_us ? 13.56 : 1.0;
+	uint64_t start_time = filter_start ? arg_get_dbl(8) * time_scale : 0;
+	uint64_t end_time   = filter_end ? arg_get_dbl(9) * time_scale : UINT64_MAX;
+
+	int filter_src = -1;   // -1 = all, else isResponse
+	if (arg_get_str_len(10)) {
+		if      (strcmp(arg_get_str(10)->sval[0], "rdr") == 0) filter_src = 0;
+		else if (strcmp(arg_get_str(10)->sval[0], "tag") == 0) filter_src = 1;
+		else {
+			PrintAndLog("hf list: invalid source \"%s\", use rdr or tag", arg_get_str(10)->sval[0]);
+			CLIParserFree();
+			return 0;
+		}
+	}
 
-	uint32_t previous_EOT = 0;
-	uint32_t *prev_EOT = NULL;
-	if (relative_times) {
-		prev_EOT = &previous_EOT;
+	int filter_cmd = -1;
+	if (arg_get_str_len(11)) {
+		uint8_t cmd_byte;
+		int cmd_len = 0;
+		if (CLIParamHexToBuf(arg_get_str(11), &cmd_byte, 1, &cmd_len) || cmd_len != 1) {
+			PrintAndLog("hf list: invalid command byte \"%s\"", arg_get_str(11)->sval[0]);
+			CLIParserFree();
+			return 0;
+		}
+		filter_cmd = cmd_byte;
 	}
-	
+
+	const hf_list_format_t *format = &formats[0];
+	if (arg_get_str_len(12)) {
+		format = NULL;
+		for (size_t i = 0; i < ARRAYLEN(formats); i++) {
+			if (strcmp(arg_get_str(12)->sval[0], formats[i].name) == 0)
+				format = &formats[i];
+		}
+		if (format == NULL) {
+			PrintAndLog("hf list: invalid format \"%s\", use text, csv or json", arg_get_str(12)->sval[0]);
+			CLIParserFree();
+			return 0;
+		}
+	}
+
 	char load_filename[FILE_PATH_SIZE+1] = {0};
 	if (loadFromFile) {
 		strncpy(load_filename, arg_get_str(5)->sval[0], FILE_PATH_SIZE);
@@ -1128,19 +1788,11 @@ int CmdHFList(const char *Cmd) {
 		strncpy(save_filename, arg_get_str(6)->sval[0], FILE_PATH_SIZE);
 	}
 	
-	uint8_t protocol = -1;
-	if (arg_get_str_len(8)) {
-		if     (strcmp(arg_get_str(8)->sval[0], "iclass") == 0) protocol = ICLASS;
-		else if(strcmp(arg_get_str(8)->sval[0], "14a") == 0)    protocol = ISO_14443A;
-		else if(strcmp(arg_get_str(8)->sval[0], "mf") == 0)     protocol = PROTO_MIFARE;
-		else if(strcmp(arg_get_str(8)->sval[0], "14b") == 0)    protocol = ISO_14443B;
-		else if(strcmp(arg_get_str(8)->sval[0], "topaz") == 0)  protocol = TOPAZ;
-		else if(strcmp(arg_get_str(8)->sval[0], "7816") == 0)   protocol = ISO_7816_4;
-		else if(strcmp(arg_get_str(8)->sval[0], "14-4") == 0)   protocol = ISO_14443_4;
-		else if(strcmp(arg_get_str(8)->sval[0], "15") == 0)     protocol = ISO_15693;
-		else if(strcmp(arg_get_str(8)->sval[0], "raw") == 0)    protocol = -1;//No crc, no annotations
-		else {
-			PrintAndLog("hf list: invalid argument \"%s\"\nTry 'hf list --help' for more information.", arg_get_str(8)->sval[0]);
+	const hf_list_dissector_t *dissector = hf_list_find_dissector("raw");
+	if (arg_get_str_len(13)) {
+		dissector = hf_list_find_dissector(arg_get_str(13)->sval[0]);
+		if (dissector == NULL) {
+			PrintAndLog("hf list: invalid argument \"%s\"\nTry 'hf list --help' for more information.", arg_get_str(13)->sval[0]);
 			CLIParserFree();
 			return 0;
 		}
@@ -1149,101 +1801,79 @@ int CmdHFList(const char *Cmd) {
 	CLIParserFree();
 
 
-	uint8_t *trace;
-	uint32_t tracepos = 0;
-	uint32_t traceLen = 0;
-	
-	if (loadFromFile) {
-		#define TRACE_CHUNK_SIZE (1<<16)        // 64K to start with. Will be enough for BigBuf and some room for future extensions
-		FILE *tracefile = NULL;
-		size_t bytes_read;
-		trace = malloc(TRACE_CHUNK_SIZE);
-		if (trace == NULL) {
-			PrintAndLog("Cannot allocate memory for trace");
-			return 2;
-		}
-		if ((tracefile = fopen(load_filename,"rb")) == NULL) {
-			PrintAndLog("Could not open file %s", load_filename);
-			free(trace);
-			return 0;
-		}
-		while (!feof(tracefile)) {
-			bytes_read = fread(trace+traceLen, 1, TRACE_CHUNK_SIZE, tracefile);
-			traceLen += bytes_read;
-			if (!feof(tracefile)) {
-				uint8_t *p = realloc(trace, traceLen + TRACE_CHUNK_SIZE);
-				if (p == NULL) {
-					PrintAndLog("Cannot allocate memory for trace");
-					free(trace);
-					fclose(tracefile);
-					return 2;
-				}
-				trace = p;
-			}
-		}
-		fclose(tracefile);
-	} else if (PCSCtrace) {
-		trace = pcsc_get_trace_addr();
-		traceLen = pcsc_get_traceLen();
-	} else {
-		trace = malloc(USB_CMD_DATA_SIZE);
-		// Query for the size of the trace
-		UsbCommand response;
-		if (!(GetFromBigBuf(trace, USB_CMD_DATA_SIZE, 0, &response, 500, false))) {
+	trace_t trace;
+	int res = hf_list_get_trace(loadFromFile ? load_filename : NULL, PCSCtrace, &trace);
+	if (res)
+		return res;
+
+	size_t save_len = strlen(save_filename);
+	if (saveToFile && save_len > 7 && strcmp(save_filename + save_len - 7, ".pcapng") == 0) {
+		res = trace_save_pcapng(&trace, save_filename, dissector->linktype);
+		if (res != TRACE_OK) {
+			PrintAndLog("Could not write file %s", save_filename);
+			trace_free(&trace);
 			return 1;
 		}
-		traceLen = response.arg[2];
-		if (traceLen > USB_CMD_DATA_SIZE) {
-			uint8_t *p = realloc(trace, traceLen);
-			if (p == NULL) {
-				PrintAndLog("Cannot allocate memory for trace");
-				free(trace);
-				return 2;
-			}
-			trace = p;
-			if (!(GetFromBigBuf(trace, traceLen, 0, NULL, 500, false))) {
-				return 1;
-			}
-		}
-	}
-
-	if (saveToFile) {
+		PrintAndLog("Recorded Activity (%zu frames) written to pcapng file %s", trace.count, save_filename);
+	} else if (saveToFile) {
 		FILE *tracefile = NULL;
 		if ((tracefile = fopen(save_filename,"wb")) == NULL) {
 			PrintAndLog("Could not create file %s", save_filename);
+			trace_free(&trace);
 			return 1;
 		}
-		fwrite(trace, 1, traceLen, tracefile);
-		PrintAndLog("Recorded Activity (TraceLen = %d bytes) written to file %s", traceLen, save_filename);
+		fwrite(trace.data, 1, trace.len, tracefile);
+		PrintAndLog("Recorded Activity (TraceLen = %zu bytes) written to file %s", trace.len, save_filename);
 		fclose(tracefile);
 	} else {
-		PrintAndLog("Recorded Activity (TraceLen = %d bytes)", traceLen);
-		PrintAndLog("");
-		if (relative_times) {
-			PrintAndLog("Gap = time between transfers. Duration = duration of data transfer. Src = Source of transfer");
-		} else {
-			PrintAndLog("Start = Start of Frame, End = End of Frame. Src = Source of transfer");
-		}
-		if (times_in_us) {
-			PrintAndLog("All times are in microseconds");
-		} else {
-			PrintAndLog("All times are in carrier periods (1/13.56Mhz)");
-		}
-		PrintAndLog("");
-		if (relative_times) {
-			PrintAndLog("        Gap |   Duration | Src | Data (! denotes parity error, ' denotes short bytes)            | CRC | Annotation         |");
-		} else {
-			PrintAndLog("      Start |        End | Src | Data (! denotes parity error, ' denotes short bytes)            | CRC | Annotation         |");
-		}
-		PrintAndLog("------------|------------|-----|-----------------------------------------------------------------|-----|--------------------|");
+		hf_list_options_t options = {
+			.showWaitCycles = showWaitCycles,
+			.markCRCBytes = markCRCBytes,
+			.relative_times = relative_times,
+			.times_in_us = times_in_us,
+		};
+
+		// csv and json output must stay machine readable
+		KeyRecoveryVerbose = (format == &formats[0]);
+		if (dissector->begin)
+			dissector->begin(&trace);
+		if (format->header)
+			format->header(&options, &trace);
+
+		// Dissectors which keep state have to see every frame, the others can seek to the start time.
+		size_t record = dissector->all_frames ? 0 : trace_find_time(&trace, start_time);
+		bool cmd_matched = false;
+		uint32_t previous_EOT = 0;
+		hf_list_frame_t frame;
+		while (record < trace.count && trace.index[record].time < end_time) {
+			bool isResponse = trace_is_response(&trace, record);
+			if (!isResponse) {
+				uint16_t data_len;
+				const uint8_t *data = trace_record_data(&trace, record, &data_len);
+				cmd_matched = (data_len > 0 && data[0] == filter_cmd);
+			}
+			bool show = trace.index[record].time >= start_time
+				&& (filter_src < 0 || filter_src == isResponse)
+				&& (filter_cmd < 0 || cmd_matched);
 
-		ClearAuthData();
-		while(tracepos < traceLen) {
-			tracepos = printTraceLine(tracepos, traceLen, trace, protocol, showWaitCycles, markCRCBytes, prev_EOT, times_in_us);
+			if (!show && !dissector->all_frames) {
+				record++;
+				continue;
+			}
+
+			hf_list_dissect(dissector, &trace, record, &frame);
+			frame.gap = frame.timestamp - (previous_EOT ? previous_EOT : frame.timestamp);
+			previous_EOT = frame.timestamp + frame.duration;
+			if (show)
+				format->frame(&options, &trace, &frame);
+			record = frame.next_record;
 		}
+
+		if (dissector->end)
+			dissector->end();
 	}
 
-	free(trace);
+	trace_free(&trace);
 	return 0;
 }
 
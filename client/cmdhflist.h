@@ -11,6 +11,84 @@
 #ifndef CMDHFLIST_H
 #define CMDHFLIST_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "tracefile.h"
+
+#define HF_LIST_CRC_FAIL            0
+#define HF_LIST_CRC_OK              1
+#define HF_LIST_CRC_NONE            2   // not a CRC frame
+
+#define HF_LIST_MAX_ANNOTATION      30
+#define HF_LIST_MAX_SHOWN           256 // bytes of a frame which are shown
+#define HF_LIST_MAX_DECRYPTED       32
+
+// which frames have ISO14443A parity bits
+#define HF_LIST_PARITY_NONE         0
+#define HF_LIST_PARITY_RESPONSES    1
+#define HF_LIST_PARITY_ALL          2
+
+// One frame of a trace and what the dissector found out about it. It is
+// dissected once and then passed to the output format.
+typedef struct {
+	size_t record;                          // first trace record of the frame
+	size_t next_record;                     // first record after the frame. Merged Topaz reader frames take several.
+	uint64_t time;                          // start since the first record, without timestamp wraps
+	uint32_t timestamp;                     // as in the trace
+	uint32_t duration;                      // in carrier periods
+	uint32_t gap;                           // since the end of the previous dissected frame
+	bool isResponse;
+	const uint8_t *data;
+	uint16_t len;
+	const uint8_t *parity;
+	uint16_t parity_len;
+	uint8_t crc;                            // HF_LIST_CRC_*
+	uint8_t parity_error[HF_LIST_MAX_SHOWN / 8]; // one bit per shown byte, MSB first
+	uint16_t parity_errors;                 // number of bytes with a parity error
+	bool short_last_byte;                   // less than 8 bits and parity
+	const char *marker;                     // shown instead of the data of an empty frame
+	char annotation[HF_LIST_MAX_ANNOTATION];
+	// Mifare Classic
+	bool encrypted;                         // Crypto1 encrypted, parity_errors are meaningless
+	const char *key_source;                 // the key of the authentication before this frame was found
+	uint64_t key;
+	const char *prng;                       // WEAK or HARD, for the first authentication only
+	uint32_t ks2;
+	uint32_t ks3;
+	uint8_t decrypted[HF_LIST_MAX_DECRYPTED];
+	uint16_t decrypted_len;
+	uint8_t decrypted_crc;
+	char decrypted_annotation[HF_LIST_MAX_ANNOTATION];
+	uint8_t merged[16];                     // data of merged Topaz reader frames
+} hf_list_frame_t;
+
+// A protocol for hf list. dissect() is called for every frame in order, and
+// may keep state between the frames of a trace.
+typedef struct {
+	const char *name;                       // the <protocol> argument of hf list
+	const char *description;
+	uint8_t protocol;                       // from protocols.h, 0xff if none
+	uint8_t time_scale;                     // durations in the trace are in units of this many carrier periods
+	uint8_t parity;                         // HF_LIST_PARITY_*
+	bool short_bytes;                       // mark short last bytes (ISO14443A)
+	bool all_frames;                        // dissect() has to see every frame, even if not shown
+	uint32_t linktype;                      // when saved as pcapng
+	void (*begin)(const trace_t *trace);    // optional
+	void (*dissect)(const trace_t *trace, hf_list_frame_t *frame); // optional. CRC, annotation, ...
+	void (*end)(void);                      // optional
+} hf_list_dissector_t;
+
 extern int CmdHFList(const char *Cmd);
 
+// add a protocol to hf list. <dissector> must stay valid.
+extern bool hf_list_register_dissector(const hf_list_dissector_t *dissector);
+extern const hf_list_dissector_t *hf_list_find_dissector(const char *name);
+// dissect the frame starting at <record>
+extern void hf_list_dissect(const hf_list_dissector_t *dissector, const trace_t *trace, size_t record, hf_list_frame_t *frame);
+extern void hf_list_protocol_help(char *help, size_t size);
+// load the trace from <filename> if not NULL, else from the PCSC reader or the device.
+// Returns 0 or the result of the command.
+extern int hf_list_get_trace(const char *filename, bool pcsc, trace_t *trace);
+
 #endif // CMDHFLIST_H
@@ -0,0 +1,617 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Command: hf list stats. Aggregate statistics of a trace.
+//
+// The frames are dissected like in hf list and added to fixed size counters in
+// a single pass, so the memory needed doesn't depend on the length of the trace
+// (apart from the record index of the trace itself).
+//-----------------------------------------------------------------------------
+
+#include "cmdhfliststats.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include "util.h"
+#include "ui.h"
+#include "cliparser/cliparser.h"
+#include "protocols.h"
+#include "tracefile.h"
+#include "cmdhflist.h"
+#include "jansson.h"
+
+#define STATS_SECTORS           40      // Mifare Classic 4K
+
+// Frame delay times are counted in buckets of 1/8 octave, values below 8 exactly
+#define FDT_SUB_BUCKETS         8
+#define FDT_BUCKETS             ((32 - 2) * FDT_SUB_BUCKETS)
+
+// progress of a Mifare Classic authentication
+#define AUTH_NONE               0
+#define AUTH_REQUESTED          1       // reader sent AUTH
+#define AUTH_NONCE              2       // tag sent nt
+#define AUTH_READER_ANSWERED    3       // reader sent {nr}{ar}
+
+typedef struct {
+	uint32_t count;
+	uint32_t answered;
+	uint32_t retransmissions;
+	uint32_t fdt_count;
+	uint32_t fdt_min;
+	uint32_t fdt_max;
+	uint64_t fdt_sum;
+	char annotation[HF_LIST_MAX_ANNOTATION];
+} command_stats_t;
+
+typedef struct {
+	uint32_t attempts;
+	uint32_t nonces;                        // answered with nt
+	uint32_t completed;                     // answered with {at}
+	bool key_found;
+	uint64_t key;
+} auth_stats_t;
+
+typedef struct {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t buckets[FDT_BUCKETS];
+} fdt_stats_t;
+
+typedef struct {
+	// index 0 = reader, 1 = tag
+	uint32_t frames[2];
+	uint64_t bytes[2];
+	uint32_t crc_errors[2];
+	uint32_t parity_errors[2];
+	uint32_t unanswered;
+	uint32_t overlapping;                   // answers starting before the end of the reader frame
+	uint32_t retransmissions;
+	uint32_t decrypted;
+	uint64_t first_time;
+	uint64_t last_end;
+	command_stats_t commands[256];
+	auth_stats_t auth[STATS_SECTORS][2];
+	fdt_stats_t fdt;
+
+	// state between frames
+	uint8_t cmd_offset;                     // of the command byte in reader frames
+	bool auth_tracking;
+	bool reader_pending;                    // the last frame was a reader frame
+	uint32_t reader_end;
+	uint8_t reader_cmd;
+	bool reader_has_cmd;
+	bool last_failed;                       // the last reader frame wasn't answered, or with errors
+	uint8_t last_reader[HF_LIST_MAX_SHOWN];
+	uint16_t last_reader_len;
+	uint8_t auth_state;
+	uint8_t auth_sector;
+	uint8_t auth_key;
+	bool auth_done;                         // the key of the last completed authentication wasn't seen yet
+} hf_list_stats_t;
+
+
+static uint8_t mifare_sector(uint8_t block) {
+	return block < 128 ? block / 4 : 32 + (block - 128) / 16;
+}
+
+
+static unsigned fdt_bucket(uint32_t fdt) {
+	if (fdt < FDT_SUB_BUCKETS)
+		return fdt;
+	unsigned octave = 31 - __builtin_clz(fdt);
+	return (octave - 2) * FDT_SUB_BUCKETS + ((fdt >> (octave - 3)) & (FDT_SUB_BUCKETS - 1));
+}
+
+
+// [from, to) of a bucket
+static void fdt_bucket_range(unsigned bucket, uint64_t *from, uint64_t *to) {
+	if (bucket < FDT_SUB_BUCKETS) {
+		*from = bucket;
+		*to = bucket + 1;
+	} else {
+		unsigned octave = bucket / FDT_SUB_BUCKETS + 2;
+		unsigned sub = bucket % FDT_SUB_BUCKETS;
+		*from = (uint64_t)(FDT_SUB_BUCKETS + sub) << (octave - 3);
+		*to = (uint64_t)(FDT_SUB_BUCKETS + sub + 1) << (octave - 3);
+	}
+}
+
+
+// upper bound of the bucket containing the <percent> percentile
+static uint64_t fdt_percentile(const fdt_stats_t *fdt, unsigned percent) {
+	uint64_t needed = ((uint64_t)fdt->count * percent + 99) / 100;
+	uint64_t sum = 0;
+	uint64_t from, to = 0;
+	for (unsigned i = 0; i < FDT_BUCKETS; i++) {
+		sum += fdt->buckets[i];
+		if (sum >= needed && fdt->buckets[i]) {
+			fdt_bucket_range(i, &from, &to);
+			break;
+		}
+	}
+	return MIN(to, fdt->max);
+}
+
+
+static void stats_add_fdt(hf_list_stats_t *stats, command_stats_t *cmd, uint32_t fdt) {
+	fdt_stats_t *f = &stats->fdt;
+	if (f->count == 0 || fdt < f->min) f->min = fdt;
+	if (fdt > f->max) f->max = fdt;
+	f->sum += fdt;
+	f->count++;
+	f->buckets[fdt_bucket(fdt)]++;
+
+	if (cmd) {
+		if (cmd->fdt_count == 0 || fdt < cmd->fdt_min) cmd->fdt_min = fdt;
+		if (fdt > cmd->fdt_max) cmd->fdt_max = fdt;
+		cmd->fdt_sum += fdt;
+		cmd->fdt_count++;
+	}
+}
+
+
+static void stats_reader_frame(hf_list_stats_t *stats, const hf_list_frame_t *frame, const uint8_t *data, uint16_t len) {
+	if (stats->reader_pending) {
+		stats->unanswered++;
+		stats->last_failed = true;
+	}
+
+	uint16_t cmp_len = MIN(len, sizeof(stats->last_reader));
+	bool retransmission = stats->last_failed && len > 0
+		&& len == stats->last_reader_len && memcmp(data, stats->last_reader, cmp_len) == 0;
+	memcpy(stats->last_reader, data, cmp_len);
+	stats->last_reader_len = len;
+	stats->last_failed = false;
+	if (retransmission)
+		stats->retransmissions++;
+
+	if (stats->auth_tracking) {
+		if (len == 4 && (data[0] == MIFARE_AUTH_KEYA || data[0] == MIFARE_AUTH_KEYB)) {
+			stats->auth_sector = MIN(mifare_sector(data[1]), STATS_SECTORS - 1);
+			stats->auth_key = data[0] == MIFARE_AUTH_KEYB;
+			stats->auth[stats->auth_sector][stats->auth_key].attempts++;
+			stats->auth_state = AUTH_REQUESTED;
+		} else if (stats->auth_state == AUTH_NONCE && frame->len == 8) {
+			stats->auth_state = AUTH_READER_ANSWERED;
+		} else {
+			stats->auth_state = AUTH_NONE;
+		}
+	}
+
+	// {nr}{ar} is not a command
+	stats->reader_has_cmd = len > stats->cmd_offset && stats->auth_state != AUTH_READER_ANSWERED;
+	if (stats->reader_has_cmd) {
+		command_stats_t *cmd = &stats->commands[data[stats->cmd_offset]];
+		stats->reader_cmd = data[stats->cmd_offset];
+		cmd->count++;
+		if (retransmission)
+			cmd->retransmissions++;
+		// the name of the command, without parameters
+		const char *annotation = frame->decrypted_len ? frame->decrypted_annotation + 1 : frame->annotation;
+		if (cmd->annotation[0] == '\0' && annotation[0]) {
+			snprintf(cmd->annotation, sizeof(cmd->annotation), "%s", annotation);
+			size_t name_len = strcspn(cmd->annotation, "(");
+			while (name_len > 0 && cmd->annotation[name_len - 1] == ' ')
+				name_len--;
+			cmd->annotation[name_len] = '\0';
+		}
+	}
+
+	stats->reader_pending = true;
+	stats->reader_end = frame->timestamp + frame->duration;
+}
+
+
+static void stats_tag_frame(hf_list_stats_t *stats, const hf_list_frame_t *frame) {
+	if (stats->reader_pending) {
+		command_stats_t *cmd = stats->reader_has_cmd ? &stats->commands[stats->reader_cmd] : NULL;
+		if (cmd)
+			cmd->answered++;
+		// an answer overlapping the reader frame has no frame delay time
+		int32_t fdt = frame->timestamp - stats->reader_end;
+		if (fdt >= 0)
+			stats_add_fdt(stats, cmd, fdt);
+		else
+			stats->overlapping++;
+		stats->last_failed = frame->crc == HF_LIST_CRC_FAIL || (frame->parity_errors > 0 && !frame->encrypted);
+		stats->reader_pending = false;
+	}
+
+	if (stats->auth_tracking) {
+		auth_stats_t *auth = &stats->auth[stats->auth_sector][stats->auth_key];
+		if (stats->auth_state == AUTH_REQUESTED && frame->len == 4) {
+			auth->nonces++;
+			stats->auth_state = AUTH_NONCE;
+		} else if (stats->auth_state == AUTH_READER_ANSWERED && frame->len == 4) {
+			auth->completed++;
+			stats->auth_done = true;
+			stats->auth_state = AUTH_NONE;
+		} else {
+			stats->auth_state = AUTH_NONE;
+		}
+	}
+}
+
+
+static void stats_add(hf_list_stats_t *stats, const hf_list_frame_t *frame) {
+	int src = frame->isResponse;
+	// Mifare Classic frames are counted as decrypted, if possible
+	const uint8_t *data = frame->decrypted_len ? frame->decrypted : frame->data;
+	uint16_t len = frame->decrypted_len ? frame->decrypted_len : frame->len;
+
+	if (stats->frames[0] + stats->frames[1] == 0)
+		stats->first_time = frame->time;
+	stats->last_end = frame->time + frame->duration;
+	stats->frames[src]++;
+	stats->bytes[src] += frame->len;
+	if (frame->crc == HF_LIST_CRC_FAIL)
+		stats->crc_errors[src]++;
+	// the parity bits of Crypto1 encrypted frames are encrypted as well
+	if (frame->parity_errors && !frame->encrypted)
+		stats->parity_errors[src]++;
+	if (frame->decrypted_len)
+		stats->decrypted++;
+
+	// the key is found on the first frame after the authentication
+	if (frame->key_source && stats->auth_done) {
+		auth_stats_t *auth = &stats->auth[stats->auth_sector][stats->auth_key];
+		auth->key_found = true;
+		auth->key = frame->key;
+	}
+	stats->auth_done = false;
+
+	if (frame->isResponse) {
+		stats_tag_frame(stats, frame);
+	} else if (frame->len > 0 || frame->marker == NULL) {
+		stats_reader_frame(stats, frame, data, len);
+	}
+}
+
+
+static double stats_time(bool times_in_us, uint64_t time) {
+	return times_in_us ? time / 13.56 : time;
+}
+
+
+static void print_time_row(const char *name, bool times_in_us, uint64_t min, double avg, uint64_t max) {
+	if (times_in_us) {
+		PrintAndLog("%-24s %10.1f %10.1f %10.1f", name, stats_time(true, min), avg / 13.56, stats_time(true, max));
+	} else {
+		PrintAndLog("%-24s %10"PRIu64" %10.0f %10"PRIu64, name, min, avg, max);
+	}
+}
+
+
+static void stats_print_text(const hf_list_stats_t *stats, const hf_list_dissector_t *dissector, bool times_in_us) {
+	uint32_t frames = stats->frames[0] + stats->frames[1];
+	const char *unit = times_in_us ? "us" : "carrier periods";
+
+	PrintAndLog("Trace statistics (%s, times in %s)", dissector->name, unit);
+	PrintAndLog("");
+	PrintAndLog("                             Reader        Tag");
+	PrintAndLog("Frames                   %10"PRIu32" %10"PRIu32, stats->frames[0], stats->frames[1]);
+	PrintAndLog("Bytes                    %10"PRIu64" %10"PRIu64, stats->bytes[0], stats->bytes[1]);
+	PrintAndLog("CRC errors               %10"PRIu32" %10"PRIu32, stats->crc_errors[0], stats->crc_errors[1]);
+	PrintAndLog("Parity errors            %10"PRIu32" %10"PRIu32, stats->parity_errors[0], stats->parity_errors[1]);
+	PrintAndLog("");
+	if (times_in_us) {
+		PrintAndLog("Duration                 %10.1f", frames ? stats_time(true, stats->last_end - stats->first_time) : 0.0);
+	} else {
+		PrintAndLog("Duration                 %10"PRIu64, frames ? stats->last_end - stats->first_time : 0);
+	}
+	PrintAndLog("Unanswered reader frames %10"PRIu32, stats->unanswered);
+	if (stats->overlapping)
+		PrintAndLog("Overlapping answers      %10"PRIu32, stats->overlapping);
+	PrintAndLog("Retransmissions          %10"PRIu32" (%.1f%% of reader frames)", stats->retransmissions,
+		stats->frames[0] ? 100.0 * stats->retransmissions / stats->frames[0] : 0.0);
+	if (stats->decrypted)
+		PrintAndLog("Decrypted frames         %10"PRIu32, stats->decrypted);
+
+	const fdt_stats_t *fdt = &stats->fdt;
+	if (fdt->count) {
+		PrintAndLog("");
+		PrintAndLog("Frame delay times (end of reader frame to start of answer), %"PRIu32" answers", fdt->count);
+		PrintAndLog("                                min        avg        max");
+		print_time_row("", times_in_us, fdt->min, (double)fdt->sum / fdt->count, fdt->max);
+		PrintAndLog("Percentiles (upper bound of bucket): 50%%: %.*f  90%%: %.*f  99%%: %.*f",
+			times_in_us ? 1 : 0, stats_time(times_in_us, fdt_percentile(fdt, 50)),
+			times_in_us ? 1 : 0, stats_time(times_in_us, fdt_percentile(fdt, 90)),
+			times_in_us ? 1 : 0, stats_time(times_in_us, fdt_percentile(fdt, 99)));
+		PrintAndLog("");
+		PrintAndLog("       From |         To |    Count |");
+		PrintAndLog("------------|------------|----------|----------------------------------------");
+		uint32_t max_count = 0;
+		for (unsigned i = 0; i < FDT_BUCKETS; i++)
+			max_count = MAX(max_count, fdt->buckets[i]);
+		for (unsigned i = 0; i < FDT_BUCKETS; i++) {
+			if (fdt->buckets[i] == 0)
+				continue;
+			uint64_t from, to;
+			fdt_bucket_range(i, &from, &to);
+			char bar[41];
+			size_t bar_len = (uint64_t)fdt->buckets[i] * 40 / max_count;
+			memset(bar, '#', bar_len);
+			bar[bar_len] = '\0';
+			PrintAndLog(" %10.*f | %10.*f | %8"PRIu32" | %s",
+				times_in_us ? 1 : 0, stats_time(times_in_us, from),
+				times_in_us ? 1 : 0, stats_time(times_in_us, to),
+				fdt->buckets[i], bar);
+		}
+	}
+
+	PrintAndLog("");
+	PrintAndLog("Reader commands (byte %d of the frame)", stats->cmd_offset);
+	PrintAndLog(" Cmd |    Count | Answered |  Retrans |    FDT min |    FDT avg |    FDT max | Annotation");
+	PrintAndLog("-----|----------|----------|----------|------------|------------|------------|--------------------");
+	for (int i = 0; i < 256; i++) {
+		const command_stats_t *cmd = &stats->commands[i];
+		if (cmd->count == 0)
+			continue;
+		if (cmd->fdt_count == 0) {
+			PrintAndLog("  %02x | %8"PRIu32" | %8"PRIu32" | %8"PRIu32" |            |            |            | %s",
+				i, cmd->count, cmd->answered, cmd->retransmissions, cmd->annotation);
+		} else {
+			double avg = (double)cmd->fdt_sum / cmd->fdt_count;
+			PrintAndLog("  %02x | %8"PRIu32" | %8"PRIu32" | %8"PRIu32" | %10.*f | %10.*f | %10.*f | %s",
+				i, cmd->count, cmd->answered, cmd->retransmissions,
+				times_in_us ? 1 : 0, stats_time(times_in_us, cmd->fdt_min),
+				times_in_us ? 1 : 0, times_in_us ? avg / 13.56 : avg,
+				times_in_us ? 1 : 0, stats_time(times_in_us, cmd->fdt_max),
+				cmd->annotation);
+		}
+	}
+
+	if (stats->auth_tracking) {
+		PrintAndLog("");
+		PrintAndLog("Mifare Classic authentications");
+		PrintAndLog(" Sector | Key | Attempts |   Nonces | Complete | Key found");
+		PrintAndLog("--------|-----|----------|----------|----------|-------------");
+		bool any = false;
+		for (int sector = 0; sector < STATS_SECTORS; sector++) {
+			for (int key = 0; key < 2; key++) {
+				const auth_stats_t *auth = &stats->auth[sector][key];
+				if (auth->attempts == 0)
+					continue;
+				char found[13] = "";
+				if (auth->key_found)
+					snprintf(found, sizeof(found), "%012"PRIx64, auth->key);
+				PrintAndLog("     %2d |  %c  | %8"PRIu32" | %8"PRIu32" | %8"PRIu32" | %s",
+					sector, key ? 'B' : 'A', auth->attempts, auth->nonces, auth->completed, found);
+				any = true;
+			}
+		}
+		if (!any)
+			PrintAndLog("     none");
+	}
+}
+
+
+static json_t *json_time(bool times_in_us, double time) {
+	return times_in_us ? json_real(time / 13.56) : json_integer((json_int_t)time);
+}
+
+
+static void stats_print_json(const hf_list_stats_t *stats, const hf_list_dissector_t *dissector, bool times_in_us) {
+	json_t *root = json_object();
+	json_object_set_new(root, "protocol", json_string(dissector->name));
+	json_object_set_new(root, "time_unit", json_string(times_in_us ? "us" : "carrier"));
+
+	const char *src[2] = {"reader", "tag"};
+	json_t *frames = json_object();
+	json_t *bytes = json_object();
+	json_t *crc_errors = json_object();
+	json_t *parity_errors = json_object();
+	for (int i = 0; i < 2; i++) {
+		json_object_set_new(frames, src[i], json_integer(stats->frames[i]));
+		json_object_set_new(bytes, src[i], json_integer(stats->bytes[i]));
+		json_object_set_new(crc_errors, src[i], json_integer(stats->crc_errors[i]));
+		json_object_set_new(parity_errors, src[i], json_integer(stats->parity_errors[i]));
+	}
+	json_object_set_new(root, "frames", frames);
+	json_object_set_new(root, "bytes", bytes);
+	json_object_set_new(root, "crc_errors", crc_errors);
+	json_object_set_new(root, "parity_errors", parity_errors);
+	bool empty = stats->frames[0] + stats->frames[1] == 0;
+	json_object_set_new(root, "duration", json_time(times_in_us, empty ? 0 : stats->last_end - stats->first_time));
+	json_object_set_new(root, "unanswered", json_integer(stats->unanswered));
+	json_object_set_new(root, "overlapping", json_integer(stats->overlapping));
+	json_object_set_new(root, "retransmissions", json_integer(stats->retransmissions));
+	json_object_set_new(root, "decrypted", json_integer(stats->decrypted));
+
+	const fdt_stats_t *fdt = &stats->fdt;
+	json_t *jfdt = json_object();
+	json_object_set_new(jfdt, "count", json_integer(fdt->count));
+	if (fdt->count) {
+		json_object_set_new(jfdt, "min", json_time(times_in_us, fdt->min));
+		json_object_set_new(jfdt, "avg", json_real((double)fdt->sum / fdt->count / (times_in_us ? 13.56 : 1.0)));
+		json_object_set_new(jfdt, "max", json_time(times_in_us, fdt->max));
+		json_object_set_new(jfdt, "p50", json_time(times_in_us, fdt_percentile(fdt, 50)));
+		json_object_set_new(jfdt, "p90", json_time(times_in_us, fdt_percentile(fdt, 90)));
+		json_object_set_new(jfdt, "p99", json_time(times_in_us, fdt_percentile(fdt, 99)));
+	}
+	json_t *histogram = json_array();
+	for (unsigned i = 0; i < FDT_BUCKETS; i++) {
+		if (fdt->buckets[i] == 0)
+			continue;
+		uint64_t from, to;
+		fdt_bucket_range(i, &from, &to);
+		json_t *bucket = json_object();
+		json_object_set_new(bucket, "from", json_time(times_in_us, from));
+		json_object_set_new(bucket, "to", json_time(times_in_us, to));
+		json_object_set_new(bucket, "count", json_integer(fdt->buckets[i]));
+		json_array_append_new(histogram, bucket);
+	}
+	json_object_set_new(jfdt, "histogram", histogram);
+	json_object_set_new(root, "fdt", jfdt);
+
+	json_t *commands = json_array();
+	for (int i = 0; i < 256; i++) {
+		const command_stats_t *cmd = &stats->commands[i];
+		if (cmd->count == 0)
+			continue;
+		char hex[3];
+		snprintf(hex, sizeof(hex), "%02x", i);
+		json_t *jcmd = json_object();
+		json_object_set_new(jcmd, "cmd", json_string(hex));
+		if (cmd->annotation[0])
+			json_object_set_new(jcmd, "annotation", json_string(cmd->annotation));
+		json_object_set_new(jcmd, "count", json_integer(cmd->count));
+		json_object_set_new(jcmd, "answered", json_integer(cmd->answered));
+		json_object_set_new(jcmd, "retransmissions", json_integer(cmd->retransmissions));
+		if (cmd->fdt_count) {
+			json_object_set_new(jcmd, "fdt_min", json_time(times_in_us, cmd->fdt_min));
+			json_object_set_new(jcmd, "fdt_avg", json_real((double)cmd->fdt_sum / cmd->fdt_count / (times_in_us ? 13.56 : 1.0)));
+			json_object_set_new(jcmd, "fdt_max", json_time(times_in_us, cmd->fdt_max));
+		}
+		json_array_append_new(commands, jcmd);
+	}
+	json_object_set_new(root, "commands", commands);
+
+	if (stats->auth_tracking) {
+		json_t *auths = json_array();
+		for (int sector = 0; sector < STATS_SECTORS; sector++) {
+			for (int key = 0; key < 2; key++) {
+				const auth_stats_t *auth = &stats->auth[sector][key];
+				if (auth->attempts == 0)
+					continue;
+				json_t *jauth = json_object();
+				json_object_set_new(jauth, "sector", json_integer(sector));
+				json_object_set_new(jauth, "key_type", json_string(key ? "B" : "A"));
+				json_object_set_new(jauth, "attempts", json_integer(auth->attempts));
+				json_object_set_new(jauth, "nonces", json_integer(auth->nonces));
+				json_object_set_new(jauth, "completed", json_integer(auth->completed));
+				if (auth->key_found) {
+					char keystr[13];
+					snprintf(keystr, sizeof(keystr), "%012"PRIx64, auth->key);
+					json_object_set_new(jauth, "key", json_string(keystr));
+				}
+				json_array_append_new(auths, jauth);
+			}
+		}
+		json_object_set_new(root, "auth", auths);
+	}
+
+	char *line = json_dumps(root, JSON_COMPACT | JSON_PRESERVE_ORDER);
+	if (line) {
+		PrintAndLog("%s", line);
+		free(line);
+	}
+	json_decref(root);
+}
+
+
+int CmdHFListStats(const char *Cmd) {
+	while (*Cmd == ' ') Cmd++;
+	char protocol_help[2048];
+	hf_list_protocol_help(protocol_help, sizeof(protocol_help));
+
+	CLIParserInit("hf list stats",
+		"\nAggregate statistics of a trace in a single pass: frame and error counts, frame delay times,\n"
+		"retransmissions (a reader frame repeated after no or a bad answer), reader commands and, for\n"
+		"14a and mf, Mifare Classic authentications per sector and key type. Nested authentications\n"
+		"and the keys are only seen with mf.",
+		"examples: hf list stats mf -l myCardTrace.trc          -- statistics of a Mifare Classic trace\n"\
+		"          hf list stats 14a -l big.trc --format json   -- as JSON\n"\
+		"          hf list stats 15 -u --start 1e6              -- ISO15693 trace in the device, in microseconds\n");
+	void* argtable[] = {
+		arg_param_begin,
+		arg_lit0("p",  "pcsc",     "use trace buffer from PCSC card reader instead of PM3"),
+		arg_str0("l",  "load",     "<filename>", "load trace from file (trace, pcap or pcapng)"),
+		arg_lit0("u",  "us",       "times in microseconds instead of clock cycles"),
+		arg_dbl0(NULL, "start",    "<time>", "only count frames starting at or after <time> (since the first frame)"),
+		arg_dbl0(NULL, "end",      "<time>", "only count frames starting before <time>"),
+		arg_str0(NULL, "format",   "<text|json>", "output format (default text)"),
+		arg_str0(NULL,  NULL,      "<protocol>", protocol_help),
+		arg_param_end
+	};
+
+	if (CLIParserParseString(Cmd, argtable, arg_getsize(argtable), true)){
+		CLIParserFree();
+		return 0;
+	}
+
+	bool PCSCtrace      = arg_get_lit(1);
+	bool loadFromFile   = arg_get_str_len(2);
+	bool times_in_us    = arg_get_lit(3);
+	double time_scale   = times_in_us ? 13.56 : 1.0;
+	uint64_t start_time = arg_get_dbl_count(4) ? arg_get_dbl(4) * time_scale : 0;
+	uint64_t end_time   = arg_get_dbl_count(5) ? arg_get_dbl(5) * time_scale : UINT64_MAX;
+
+	bool json = false;
+	if (arg_get_str_len(6)) {
+		if      (strcmp(arg_get_str(6)->sval[0], "json") == 0) json = true;
+		else if (strcmp(arg_get_str(6)->sval[0], "text") != 0) {
+			PrintAndLog("hf list stats: invalid format \"%s\", use text or json", arg_get_str(6)->sval[0]);
+			CLIParserFree();
+			return 0;
+		}
+	}
+
+	char load_filename[FILE_PATH_SIZE+1] = {0};
+	if (loadFromFile) {
+		strncpy(load_filename, arg_get_str(2)->sval[0], FILE_PATH_SIZE);
+	}
+
+	const hf_list_dissector_t *dissector = hf_list_find_dissector("14a");
+	if (arg_get_str_len(7)) {
+		dissector = hf_list_find_dissector(arg_get_str(7)->sval[0]);
+		if (dissector == NULL) {
+			PrintAndLog("hf list stats: invalid argument \"%s\"\nTry 'hf list stats --help' for more information.", arg_get_str(7)->sval[0]);
+			CLIParserFree();
+			return 0;
+		}
+	}
+
+	CLIParserFree();
+
+	trace_t trace;
+	int res = hf_list_get_trace(loadFromFile ? load_filename : NULL, PCSCtrace, &trace);
+	if (res)
+		return res;
+
+	hf_list_stats_t *stats = calloc(1, sizeof(hf_list_stats_t));
+	if (stats == NULL) {
+		PrintAndLog("Cannot allocate memory for statistics");
+		trace_free(&trace);
+		return 2;
+	}
+	// ISO15693 and ISO7816 commands follow the flags and CLA
+	stats->cmd_offset = (dissector->protocol == ISO_15693 || dissector->protocol == ISO_7816_4) ? 1 : 0;
+	stats->auth_tracking = dissector->protocol == ISO_14443A || dissector->protocol == PROTO_MIFARE;
+
+	if (dissector->begin)
+		dissector->begin(&trace);
+
+	size_t record = dissector->all_frames ? 0 : trace_find_time(&trace, start_time);
+	hf_list_frame_t frame;
+	while (record < trace.count && trace.index[record].time < end_time) {
+		hf_list_dissect(dissector, &trace, record, &frame);
+		if (frame.time >= start_time)
+			stats_add(stats, &frame);
+		record = frame.next_record;
+	}
+	// a reader frame at the end of the trace wasn't answered either
+	if (stats->reader_pending)
+		stats->unanswered++;
+
+	if (dissector->end)
+		dissector->end();
+
+	if (json) {
+		stats_print_json(stats, dissector, times_in_us);
+	} else {
+		stats_print_text(stats, dissector, times_in_us);
+	}
+
+	free(stats);
+	trace_free(&trace);
+	return 0;
+}
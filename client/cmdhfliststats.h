@@ -0,0 +1,14 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Command: hf list stats. Aggregate statistics of a trace.
+//-----------------------------------------------------------------------------
+
+#ifndef CMDHFLISTSTATS_H__
+#define CMDHFLISTSTATS_H__
+
+int CmdHFListStats(const char *Cmd);
+
+#endif
@@ -23,6 +23,7 @@
 #include "util_posix.h"
 #include "usb_cmd.h"
 #include "ui.h"
+#include "result.h"
 #include "mifare/mifarehost.h"
 #include "mifare.h"
 #include "mifare/mfkey.h"
@@ -255,6 +256,12 @@ uint8_t NumBlocksPerSector(uint8_t sectorNo)
 	}
 }
 
+// progress marks, which would break the machine readable output of a silent (-json) run
+static void PrintProgress(const char *marks) {
+	if (!GetSilentMode())
+		printf("%s", marks);
+}
+
 static int ParamCardSizeSectors(const char c) {
 	int numSectors = 16;
 	switch (c) {
@@ -430,6 +437,9 @@ int CmdHF14AMfDump(const char *Cmd)
 				if (isOK) {
 					memcpy(carddata[FirstBlockOfSector(sectorNo) + blockNo], data, 16);
 					PrintAndLog("Successfully read block %2d of sector %2d.", blockNo, sectorNo);
+					ResultRecord("mf_block");
+					ResultInt("block", FirstBlockOfSector(sectorNo) + blockNo);
+					ResultHex("data", data, 16);
 				} else {
 					PrintAndLog("Could not read block %2d of sector %2d", blockNo, sectorNo);
 					break;
@@ -1237,7 +1247,7 @@ int CmdHF14AMfChk(const char *Cmd) {
 			e_sector[sectorNo].foundKey[keyAB] = 0;
 		}
 	}
-	printf("\n");
+	PrintProgress("\n");
 
 	bool foundAKey = false;
 	bool clearTraceLog = true;
@@ -1246,7 +1256,7 @@ int CmdHF14AMfChk(const char *Cmd) {
 	// !SingleKey, so all key check (if SectorsCnt > 0)
 	if (!singleBlock) {
 		PrintAndLog("To cancel this operation press the button on the proxmark...");
-		printf("--");
+		PrintProgress("--");
 		for (uint32_t c = 0; c < keycnt; c += max_keys) {
 
 			uint32_t size = keycnt-c > max_keys ? max_keys : keycnt-c;
@@ -1257,13 +1267,13 @@ int CmdHF14AMfChk(const char *Cmd) {
 
 			if (res != 1) {
 				if (!res) {
-					printf("o");
+					PrintProgress("o");
 					foundAKey = true;
 				} else {
-					printf(".");
+					PrintProgress(".");
 				}
 			} else {
-				printf("\n");
+				PrintProgress("\n");
 				PrintAndLog("Command execute timeout");
 			}
 		}
@@ -1309,6 +1319,16 @@ int CmdHF14AMfChk(const char *Cmd) {
 					sprintf(keyBString, "%012" PRIx64, e_sector[i].Key[1]);
 				}
 				PrintAndLog("|%03d|  %s  |  %s  |", i, keyAString, keyBString);
+				for (int t = 0; t < 2; t++) {
+					if (e_sector[i].foundKey[t]) {
+						uint8_t key[6];
+						num_to_bytes(e_sector[i].Key[t], 6, key);
+						ResultRecord("mf_key");
+						ResultInt("sector", i);
+						ResultString("key_type", t ? "B" : "A");
+						ResultHex("key", key, 6);
+					}
+				}
 			}
 		}
 		PrintAndLog("|---|----------------|----------------|");
@@ -1855,13 +1875,13 @@ int CmdHF14AMfELoad(const char *Cmd)
 			fclose(f);
 			return 3;
 		}
-		printf(".");
+		PrintProgress(".");
 		blockNum++;
 
 		if (blockNum >= numBlocks) break;
 	}
 	fclose(f);
-	printf("\n");
+	PrintProgress("\n");
 
 	if ((blockNum != numBlocks)) {
 		PrintAndLog("File content error. Got %d must be %d blocks.",blockNum, numBlocks);
@@ -2987,10 +3007,10 @@ int CmdHFMFNDEF(const char *cmd) {
 			memcpy(&data[datalen], vsector, 16 * 3);
 			datalen += 16 * 3;
 
-			printf(".");
+			PrintProgress(".");
 		}
 	}
-	printf(" OK\n");
+	PrintProgress(" OK\n");
 
 	if (!datalen) {
 		PrintAndLogEx(ERR, "no NDEF data.");
@@ -46,6 +46,7 @@
 #include "cmdlfnoralsy.h"// for noralsy menu
 #include "cmdlfsecurakey.h"//for securakey menu
 #include "cmdlfpac.h"    // for pac menu
+#include "result.h"      // for `lf search` records
 
 bool g_lf_threshold_set = false;
 static int CmdHelp(const char *Cmd);
@@ -900,6 +901,72 @@ int CheckChipType(char cmdp) {
 	return 0;
 }
 
+static int EM4x50Search(const char *Cmd)
+{
+	return EM4x50Read(Cmd, false);
+}
+
+// known tag demodulators, in the order `lf search` tries them
+static const lf_tag_demod_t lf_known_tags[] = {
+	// TODO test for modulation then only test formats that use that modulation
+	{"IO Prox",     "FSK",            CmdFSKdemodIO,       true},
+	{"Pyramid",     "FSK",            CmdFSKdemodPyramid,  true},
+	{"Paradox",     "FSK",            CmdFSKdemodParadox,  true},
+	{"AWID",        "FSK",            CmdFSKdemodAWID,     true},
+	{"HID Prox",    "FSK",            CmdFSKdemodHID,      true},
+	{"EM410x",      "ASK/Manchester", CmdAskEM410xDemod,   true},
+	{"Visa2000",    "ASK/Manchester", CmdVisa2kDemod,      true},
+	{"G Prox II",   "ASK/Biphase",    CmdG_Prox_II_Demod,  true},
+	{"FDX-B",       "ASK/Biphase",    CmdFdxDemod,         true},
+	{"EM4x50",      "ASK/Manchester", EM4x50Search,        false},
+	{"Jablotron",   "ASK/Biphase",    CmdJablotronDemod,   true},
+	{"Noralsy",     "ASK/Manchester", CmdNoralsyDemod,     true},
+	{"Securakey",   "ASK/Manchester", CmdSecurakeyDemod,   true},
+	{"Viking",      "ASK/Manchester", CmdVikingDemod,      true},
+	{"Indala",      "PSK",            CmdIndalaDecode,     true},
+	{"NexWatch",    "PSK",            CmdPSKNexWatch,      true},
+	{"PAC/Stanley", "NRZ",            CmdPacDemod,         true},
+};
+
+// try all known tag demodulators on the GraphBuffer.
+// Returns the first one that succeeded (DemodBuffer and g_DemodClock hold its result) or NULL
+const lf_tag_demod_t *LFSearchKnownTags(void)
+{
+	for (size_t i = 0; i < ARRAYLEN(lf_known_tags); i++) {
+		if (lf_known_tags[i].demod("") > 0) {
+			return &lf_known_tags[i];
+		}
+	}
+	return NULL;
+}
+
+// start the "lf_tag" record of a decoded tag. The demodulator adds the decoded
+// fields (id, facility_code, card_number, ...) after it.
+void ResultLFTag(const char *protocol)
+{
+	ResultRecord("lf_tag");
+	ResultString("protocol", protocol);
+}
+
+#define LF_RESULT_MAX_RAW_BITS   512
+
+// complete the record of the tag found by lf search with the demodulation and
+// the raw bits the demodulator left in DemodBuffer
+static void ResultLFSearch(const lf_tag_demod_t *found)
+{
+	const char *type = ResultType();
+	if (!type || strcmp(type, "lf_tag") != 0)
+		ResultLFTag(found->name);
+
+	char hex[LF_RESULT_MAX_RAW_BITS / 4 + 1] = {0};
+	int bits = DemodBufferLen > LF_RESULT_MAX_RAW_BITS ? LF_RESULT_MAX_RAW_BITS : DemodBufferLen;
+	binarraytohex(hex, (char *)DemodBuffer, bits & ~3);
+	ResultString("modulation", found->modulation);
+	ResultInt("clock", g_DemodClock);
+	ResultString("raw", hex);
+	ResultInt("bits", DemodBufferLen);
+}
+
 //by marshmellow
 int CmdLFfind(const char *Cmd)
 {
@@ -957,108 +1024,11 @@ int CmdLFfind(const char *Cmd)
 		return 0;
 	}
 
-	// TODO test for modulation then only test formats that use that modulation
-
-	ans=CmdFSKdemodIO("");
-	if (ans>0) {
-		PrintAndLog("\nValid IO Prox ID Found!");
-		return CheckChipType(cmdp);
-	}
-
-	ans=CmdFSKdemodPyramid("");
-	if (ans>0) {
-		PrintAndLog("\nValid Pyramid ID Found!");
-		return CheckChipType(cmdp);
-	}
-
-	ans=CmdFSKdemodParadox("");
-	if (ans>0) {
-		PrintAndLog("\nValid Paradox ID Found!");
-		return CheckChipType(cmdp);
-	}
-
-	ans=CmdFSKdemodAWID("");
-	if (ans>0) {
-		PrintAndLog("\nValid AWID ID Found!");
-		return CheckChipType(cmdp);
-	}
-
-	ans=CmdFSKdemodHID("");
-	if (ans>0) {
-		PrintAndLog("\nValid HID Prox ID Found!");
-		return CheckChipType(cmdp);
-	}
-
-	ans=CmdAskEM410xDemod("");
-	if (ans>0) {
-		PrintAndLog("\nValid EM410x ID Found!");
-		return CheckChipType(cmdp);
-	}
-
-	ans=CmdVisa2kDemod("");
-	if (ans>0) {
-		PrintAndLog("\nValid Visa2000 ID Found!");
-		return CheckChipType(cmdp);		
-	}
-	
-	ans=CmdG_Prox_II_Demod("");
-	if (ans>0) {
-		PrintAndLog("\nValid G Prox II ID Found!");
-		return CheckChipType(cmdp);
-	}
-
-	ans=CmdFdxDemod(""); //biphase
-	if (ans>0) {
-		PrintAndLog("\nValid FDX-B ID Found!");
-		return CheckChipType(cmdp);
-	}
-
-	ans=EM4x50Read("", false); //ask
-	if (ans>0) {
-		PrintAndLog("\nValid EM4x50 ID Found!");
-		return 1;
-	}
-
-	ans=CmdJablotronDemod("");
-	if (ans>0) {
-		PrintAndLog("\nValid Jablotron ID Found!");
-		return CheckChipType(cmdp);
-	}
-
-	ans=CmdNoralsyDemod("");
-	if (ans>0) {
-		PrintAndLog("\nValid Noralsy ID Found!");
-		return CheckChipType(cmdp);
-	}
-
-	ans=CmdSecurakeyDemod("");
-	if (ans>0) {
-		PrintAndLog("\nValid Securakey ID Found!");
-		return CheckChipType(cmdp);
-	}
-
-	ans=CmdVikingDemod("");
-	if (ans>0) {
-		PrintAndLog("\nValid Viking ID Found!");
-		return CheckChipType(cmdp);
-	}
-
-	ans=CmdIndalaDecode(""); //psk
-	if (ans>0) {
-		PrintAndLog("\nValid Indala ID Found!");
-		return CheckChipType(cmdp);
-	}
-
-	ans=CmdPSKNexWatch("");
-	if (ans>0) {
-		PrintAndLog("\nValid NexWatch ID Found!");
-		return CheckChipType(cmdp);
-	}
-
-	ans=CmdPacDemod("");
-	if (ans>0) {
-		PrintAndLog("\nValid PAC/Stanley ID Found!");
-		return CheckChipType(cmdp);		
+	const lf_tag_demod_t *found = LFSearchKnownTags();
+	if (found) {
+		PrintAndLog("\nValid %s ID Found!", found->name);
+		ResultLFSearch(found);
+		return found->checkChipType ? CheckChipType(cmdp) : 1;
 	}
 
 	PrintAndLog("\nNo Known Tags Found!\n");
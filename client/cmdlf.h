@@ -14,6 +14,13 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+typedef struct {
+	const char *name;
+	const char *modulation;
+	int (*demod)(const char *Cmd);
+	bool checkChipType;
+} lf_tag_demod_t;
+
 extern int CmdLF(const char *Cmd);
 
 extern int CmdLFCommandRead(const char *Cmd);
@@ -30,5 +37,7 @@ extern int CmdLFSnoop(const char *Cmd);
 extern int CmdVchDemod(const char *Cmd);
 extern int CmdLFfind(const char *Cmd);
 extern bool lf_read(bool silent, uint32_t samples);
+extern const lf_tag_demod_t *LFSearchKnownTags(void);
+extern void ResultLFTag(const char *protocol);
 
 #endif
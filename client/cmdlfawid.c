@@ -24,6 +24,8 @@
 #include "cmddata.h"    // for printDemod and demodbuffer commands
 #include "graph.h"      // for getFromGraphBuff cmds
 #include "cmdmain.h"
+#include "cmdlf.h"        // for ResultLFTag
+#include "result.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -85,7 +87,7 @@ int CmdAWIDReadFSK(const char *Cmd) {
 //print full AWID Prox ID and some bit format details if found
 int CmdFSKdemodAWID(const char *Cmd)
 {
-	uint8_t BitStream[MAX_GRAPH_TRACE_LEN]={0};
+	uint8_t BitStream[MAX_GRAPH_TRACE_LEN];
 	size_t size = getFromGraphBuf(BitStream);
 	if (size==0) return 0;
 
@@ -171,6 +173,11 @@ int CmdFSKdemodAWID(const char *Cmd)
 			PrintAndLog("AWID Found - BitLength: %d -unknown BitLength- (%d) - Wiegand: %x, Raw: %08x%08x%08x", fmtLen, cardnum, code1, rawHi2, rawHi, rawLo);
 		}
 	}
+	ResultLFTag("AWID");
+	ResultInt("format_len", fmtLen);
+	if (fmtLen == 26)
+		ResultInt("facility_code", fc);
+	ResultInt("card_number", cardnum);
 	if (g_debugMode){
 		PrintAndLog("DEBUG: idx: %d, Len: %d Printing Demod Buffer:", idx, 96);
 		printDemodBuff();
@@ -24,6 +24,7 @@
 #include "lfdemod.h"
 #include "protocols.h"
 #include "util_posix.h"
+#include "result.h"
 
 uint64_t g_em410xId=0;
 
@@ -165,6 +166,13 @@ int AskEm410xDecode(bool verbose, uint32_t *hi, uint64_t *lo )
 			PrintAndLog("EM410x pattern found: ");
 			printEM410x(*hi, *lo);
 			g_em410xId = *lo;
+			char id[28];
+			if (*hi)
+				snprintf(id, sizeof(id), "%06X%016" PRIX64, *hi, *lo);
+			else
+				snprintf(id, sizeof(id), "%010" PRIX64, *lo);
+			ResultLFTag("EM410x");
+			ResultString("id", id);
 		}
 		return 1;
 	}
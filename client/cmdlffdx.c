@@ -23,6 +23,7 @@
 #include "crc16.h"
 #include "protocols.h"
 #include "lfdemod.h"
+#include "result.h"
 
 /*
 	FDX-B ISO11784/85 demod  (aka animal tag)  BIPHASE, inverted, rf/32,  with preamble of 00000000001 (128bits)
@@ -199,6 +200,15 @@ int CmdFdxDemod(const char *Cmd){
 	PrintAndLog("Animal Tag:    %s", animalBit ? "True" : "False");
 	PrintAndLog("Has Extended:  %s [0x%X]", dataBlockBit ? "True" : "False", extended);
 	PrintAndLog("CRC:           0x%04X - 0x%04X - [%s]\n", crc16, calcCrc, (calcCrc == crc16) ? "Passed" : "Failed");
+
+	char id[24];
+	snprintf(id, sizeof(id), "%04u-%012" PRIu64, countryCode, NationalCode);
+	ResultLFTag("FDX-B");
+	ResultString("id", id);
+	ResultInt("country_code", countryCode);
+	ResultInt("national_code", NationalCode);
+	ResultBool("animal", animalBit);
+	ResultBool("checksum_ok", calcCrc == crc16);
 	
 	// set block 0 for later
 	//g_DemodConfig = T55x7_MODULATION_DIPHASE | T55x7_BITRATE_RF_32 | 4 << T55x7_MAXBLOCK_SHIFT;
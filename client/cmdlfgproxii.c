@@ -20,6 +20,7 @@
 #include "cmdmain.h"
 #include "cmdlf.h"
 #include "lfdemod.h"
+#include "result.h"
 static int CmdHelp(const char *Cmd);
 
 //by marshmellow
@@ -82,6 +83,12 @@ int CmdG_Prox_II_Demod(const char *Cmd)
 		PrintAndLog("Unknown G-Prox-II Fmt Found: FmtLen %d",(int)fmtLen);
 		PrintAndLog("Decoded Raw: %s", sprint_hex(ByteStream, 8)); 
 	}
+	ResultLFTag("G Prox II");
+	ResultInt("format_len", fmtLen);
+	if (fmtLen == 36 || fmtLen == 26) {
+		ResultInt("facility_code", FC);
+		ResultInt("card_number", Card);
+	}
 	PrintAndLog("Raw: %08x%08x%08x", raw1,raw2,raw3);
 	setDemodBuf(DemodBuffer, 96, ans);
 	setClockGrid(g_DemodClock, g_DemodStartIdx + (ans*g_DemodClock));
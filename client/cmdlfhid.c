@@ -31,6 +31,8 @@
 #include "hidcardformats.h"
 #include "hidcardformatutils.h"
 #include "util.h" // for param_get8,32,64
+#include "cmdlf.h"   // for ResultLFTag
+#include "result.h"
 
 
 /**
@@ -145,7 +147,7 @@ int CmdFSKdemodHID(const char *Cmd)
   //raw fsk demod no manchester decoding no start bit finding just get binary from wave
   uint32_t hi2=0, hi=0, lo=0;
 
-  uint8_t BitStream[MAX_GRAPH_TRACE_LEN]={0};
+  uint8_t BitStream[MAX_GRAPH_TRACE_LEN];
   size_t BitLen = getFromGraphBuf(BitStream);
   if (BitLen==0) return 0;
   //get binary from fsk wave
@@ -175,6 +177,15 @@ int CmdFSKdemodHID(const char *Cmd)
   hidproxmessage_t packed = initialize_proxmessage_object(hi2, hi, lo);
   PrintProxTagId(&packed);
 
+  char id[28];
+  if (packed.top != 0) {
+    snprintf(id, sizeof(id), "%x%08x%08x", (uint32_t)packed.top, (uint32_t)packed.mid, (uint32_t)packed.bot);
+  } else {
+    snprintf(id, sizeof(id), "%x%08x", (uint32_t)packed.mid, (uint32_t)packed.bot);
+  }
+  ResultLFTag("HID Prox");
+  ResultString("id", id);
+
   bool ret = HIDTryUnpack(&packed, false);
   if (!ret) {
     PrintAndLog("Invalid or unsupported tag length.");
@@ -21,6 +21,7 @@
 #include "util.h"     //for sprint_bin_break
 #include "cmdlf.h"    //for CmdLFRead
 #include "cmdmain.h"  //for clearCommandBuffer
+#include "result.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -61,10 +62,12 @@ int CmdIndalaDecode(const char *Cmd) {
 	PrintAndLog("BitLen: %d",DemodBufferLen);
 	//convert UID to HEX
 	uint32_t uid1, uid2, uid3, uid4, uid5, uid6, uid7;
+	char id[60] = {0};
 	uid1=bytebits_to_byte(DemodBuffer,32);
 	uid2=bytebits_to_byte(DemodBuffer+32,32);
 	if (DemodBufferLen==64) {
 		PrintAndLog("Indala UID=%s (%x%08x)", sprint_bin_break(DemodBuffer,DemodBufferLen,16), uid1, uid2);
+		snprintf(id, sizeof(id), "%x%08x", uid1, uid2);
 	} else if (DemodBufferLen==224) {
 		uid3=bytebits_to_byte(DemodBuffer+64,32);
 		uid4=bytebits_to_byte(DemodBuffer+96,32);
@@ -73,7 +76,10 @@ int CmdIndalaDecode(const char *Cmd) {
 		uid7=bytebits_to_byte(DemodBuffer+192,32);
 		PrintAndLog("Indala UID=%s (%x%08x%08x%08x%08x%08x%08x)", 
 		    sprint_bin_break(DemodBuffer,DemodBufferLen,16), uid1, uid2, uid3, uid4, uid5, uid6, uid7);
+		snprintf(id, sizeof(id), "%x%08x%08x%08x%08x%08x%08x", uid1, uid2, uid3, uid4, uid5, uid6, uid7);
 	}
+	ResultLFTag("Indala");
+	ResultString("id", id);
 	if (g_debugMode) {
 		PrintAndLog("DEBUG: printing demodbuffer:");
 		printDemodBuff();
@@ -24,6 +24,7 @@
 #include "cmdlf.h"
 #include "lfdemod.h"  //for IOdemodFSK + bytebits_to_byte
 #include "util.h"     //for sprint_bin_break
+#include "result.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -49,7 +50,7 @@ int CmdFSKdemodIO(const char *Cmd)
     if (g_debugMode)PrintAndLog("DEBUG: not enough samples in GraphBuffer");
     return 0;
   }
-  uint8_t BitStream[MAX_GRAPH_TRACE_LEN]={0};
+  uint8_t BitStream[MAX_GRAPH_TRACE_LEN];
   size_t BitLen = getFromGraphBuf(BitStream);
   if (BitLen==0) return 0;
 
@@ -119,6 +120,14 @@ int CmdFSKdemodIO(const char *Cmd)
   char *crcStr = (crc == calccrc) ? "crc ok": "!crc";
 
   PrintAndLog("IO Prox XSF(%02d)%02x:%05d (%08x%08x) [%02x %s]",version,facilitycode,number,code,code2, crc, crcStr);
+  char id[20];
+  snprintf(id, sizeof(id), "XSF(%02d)%02x:%05d", version, facilitycode, number);
+  ResultLFTag("IO Prox");
+  ResultString("id", id);
+  ResultInt("version", version);
+  ResultInt("facility_code", facilitycode);
+  ResultInt("card_number", number);
+  ResultBool("checksum_ok", crc == calccrc);
   setDemodBuf(BitStream,64,idx);
   setClockGrid(64, waveIdx + (idx*64));
 
@@ -23,6 +23,7 @@
 #include "cmdlf.h"
 #include "protocols.h"  // for T55xx config register definitions
 #include "lfdemod.h"    // parityTest
+#include "result.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -138,6 +139,11 @@ int CmdJablotronDemod(const char *Cmd) {
 		(uint16_t)(id >> 16) & 0xFFFF,
 		(uint16_t)id & 0xFFFF
 	);
+
+	char idstr[12];
+	snprintf(idstr, sizeof(idstr), "%" PRIx64, id);
+	ResultLFTag("Jablotron");
+	ResultString("id", idstr);
 	return 1;
 }
 
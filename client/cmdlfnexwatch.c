@@ -22,6 +22,7 @@
 #include "cmddata.h"
 #include "cmdlf.h"
 #include "lfdemod.h"
+#include "result.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -55,6 +56,10 @@ int CmdPSKNexWatch(const char *Cmd)
 
 	//output
 	PrintAndLog("NexWatch ID: %d", ID);
+	char id[12];
+	snprintf(id, sizeof(id), "%d", ID);
+	ResultLFTag("NexWatch");
+	ResultString("id", id);
 	if (invert){
 		PrintAndLog("Had to Invert - probably NexKey");
 		for (uint8_t idx=0; idx<size; idx++)
@@ -23,6 +23,7 @@
 #include "cmdlf.h"
 #include "protocols.h"  // for T55xx config register definitions
 #include "lfdemod.h"    // parityTest
+#include "result.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -167,6 +168,10 @@ int CmdNoralsyDemod(const char *Cmd) {
 	}
 
 	PrintAndLog("Noralsy Tag Found: Card ID %X, Year: %X Raw: %08X%08X%08X", cardid, year, raw1 ,raw2, raw3);
+	char id[12];
+	snprintf(id, sizeof(id), "%X", cardid);
+	ResultLFTag("Noralsy");
+	ResultString("id", id);
 	if (raw1 != 0xBB0214FF) {
 		PrintAndLog("Unknown bits set in first block! Expected 0xBB0214FF, Found: 0x%08X", raw1);
 		PrintAndLog("Please post this output in forum to further research on this format");
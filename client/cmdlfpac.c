@@ -21,6 +21,7 @@
 #include "cmdmain.h"
 #include "cmdlf.h"
 #include "lfdemod.h"    // preamble test
+#include "result.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -75,6 +76,8 @@ int CmdPacDemod(const char *Cmd) {
 	
 	PrintAndLog("PAC/Stanley Tag Found -- Raw: %08X%08X%08X%08X", raw1 ,raw2, raw3, raw4);
 	PrintAndLog("\nHow the Raw ID is translated by the reader is unknown");
+	// no decoded ID, lf search adds the raw bits
+	ResultLFTag("PAC/Stanley");
 	return 1;
 }
 
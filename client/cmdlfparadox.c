@@ -24,6 +24,7 @@
 #include "cmdlfhid.h"
 #include "hidcardformats.h"
 #include "hidcardformatutils.h"
+#include "result.h"
 
 static int CmdHelp(const char *Cmd);
 void ParadoxWrite(hidproxmessage_t *packed);
@@ -36,7 +37,7 @@ int CmdFSKdemodParadox(const char *Cmd)
 	//raw fsk demod no manchester decoding no start bit finding just get binary from wave
 	uint32_t hi2=0, hi=0, lo=0;
 
-	uint8_t BitStream[MAX_GRAPH_TRACE_LEN]={0};
+	uint8_t BitStream[MAX_GRAPH_TRACE_LEN];
 	size_t BitLen = getFromGraphBuf(BitStream);
 	if (BitLen==0) return 0;
 	int waveIdx=0;
@@ -80,6 +81,12 @@ int CmdFSKdemodParadox(const char *Cmd)
 			hi>>10, (hi & 0x3)<<26 | (lo>>10), (uint32_t)packed.mid, (uint32_t)packed.bot, fc, cardnum, (lo>>2) & 0xFF, rawHi2, rawHi, rawLo);
 
 	}
+	char id[20];
+	snprintf(id, sizeof(id), "%x%08x", hi>>10, (hi & 0x3)<<26 | (lo>>10));
+	ResultLFTag("Paradox");
+	ResultString("id", id);
+	ResultInt("facility_code", fc);
+	ResultInt("card_number", cardnum);
 	setDemodBuf(BitStream,BitLen,idx);
 	setClockGrid(50, waveIdx + (idx*50));
 	if (g_debugMode){ 
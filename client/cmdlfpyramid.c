@@ -24,6 +24,7 @@
 #include "protocols.h"  // for T55xx config register definitions
 #include "lfdemod.h"    // parityTest
 #include "crc.h"
+#include "result.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -94,7 +95,7 @@ int GetPyramidBits(uint32_t fc, uint32_t cn, uint8_t *pyramidBits) {
 int CmdFSKdemodPyramid(const char *Cmd)
 {
 	//raw fsk demod no manchester decoding no start bit finding just get binary from wave
-	uint8_t BitStream[MAX_GRAPH_TRACE_LEN]={0};
+	uint8_t BitStream[MAX_GRAPH_TRACE_LEN];
 	size_t size = getFromGraphBuf(BitStream);
 	if (size==0) return 0;
 
@@ -222,6 +223,13 @@ int CmdFSKdemodPyramid(const char *Cmd)
 	else
 		PrintAndLog("Checksum %02x failed - should have been %02x", checksum, checkCS);
 
+	ResultLFTag("Pyramid");
+	ResultInt("format_len", fmtLen);
+	if (fmtLen == 26 || fmtLen == 42)
+		ResultInt("facility_code", fc);
+	ResultInt("card_number", cardnum);
+	ResultBool("checksum_ok", checksum == checkCS);
+
 	if (g_debugMode){
 		PrintAndLog("DEBUG: idx: %d, Len: %d, Printing Demod Buffer:", idx, 128);
 		printDemodBuff();
@@ -24,6 +24,7 @@
 #include "protocols.h"  // for T55xx config register definitions
 #include "lfdemod.h"    // preamble test
 #include "parity.h"     // for wiegand parity test
+#include "result.h"
 
 static int CmdHelp(const char *Cmd);
 
@@ -118,6 +119,12 @@ int CmdSecurakeyDemod(const char *Cmd) {
 	PrintAndLog("Securakey Tag Found--BitLen: %u, Card ID: %u, FC: 0x%X, Raw: %08X%08X%08X", bitLen, cardid, fc, raw1 ,raw2, raw3);
 	if (bitLen <= 32)
 		PrintAndLog("Wiegand: %08X, Parity: %s", (lWiegand<<(bitLen/2)) | rWiegand, parity ? "Passed" : "Failed");
+	ResultLFTag("Securakey");
+	ResultInt("format_len", bitLen);
+	ResultInt("facility_code", fc);
+	ResultInt("card_number", cardid);
+	if (bitLen <= 32)
+		ResultBool("parity_ok", parity);
 	PrintAndLog("\nHow the FC translates to printed FC is unknown");
 	PrintAndLog("How the checksum is calculated is unknown");
 	PrintAndLog("Help the community identify this format further\n by sharing your tag on the pm3 forum or with forum members");
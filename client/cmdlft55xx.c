@@ -31,6 +31,8 @@
 #define T55x7_PAGE1 0x01
 //#define T55x7_PWD	0x00000010
 #define REGULAR_READ_MODE_BLOCK 0xFF
+#define T55XX_BF_MAX_DICTIONARY (USB_CMD_DATA_SIZE / 4)
+#define T55XX_BF_TIMEOUT        10      // seconds without progress from the device
 
 // Default configuration
 t55xx_conf_block_t config = { .modulation = DEMOD_ASK, .inverted = false, .offset = 0x00, .block0 = 0x00, .Q5 = false };
@@ -174,6 +176,7 @@ int usage_t55xx_wakup(){
 int usage_t55xx_bruteforce(){
 	PrintAndLog("This command uses A) bruteforce to scan a number range");
 	PrintAndLog("                  B) a dictionary attack");
+	PrintAndLog("The passwords are tried on the device, candidates are verified by the client.");
 	PrintAndLog("Usage: lf t55xx bruteforce <start password> <end password> [i <*.dic>]");
 	PrintAndLog("       password must be 4 bytes (8 hex symbols)");
 	PrintAndLog("Options:");
@@ -547,10 +550,82 @@ int CmdT55xxDetect(const char *Cmd){
 	return 1;
 }
 
+// A tag read in "page 0 block 0" mode keeps repeating its config block. Use the
+// share of the following 32bit blocks in DemodBuffer which repeat the block0
+// found at <offset> as confidence (0-100) for a detected configuration.
+static uint8_t getDetectConfidence(uint8_t offset) {
+	uint32_t block0 = PackBits(offset, 32, DemodBuffer);
+	int blocks = 0, matches = 0;
+	for (size_t pos = offset + 32; pos + 32 <= DemodBufferLen; pos += 32) {
+		blocks++;
+		if (PackBits(0, 32, DemodBuffer + pos) == block0) matches++;
+	}
+	if (blocks == 0) return 0;
+	return matches * 100 / blocks;
+}
+
+// Results of the last detects, keyed by a hash of the graph data, so that
+// detecting again on the same samples doesn't run all the demodulators again.
+#define DETECT_CACHE_SIZE 4
+#define DETECT_MAX_HITS   15
+
+typedef struct {
+	bool valid;
+	uint32_t hash;
+	size_t len;
+	uint8_t hits;
+	t55xx_conf_block_t tests[DETECT_MAX_HITS];
+	uint8_t confidence[DETECT_MAX_HITS];
+} t55xx_detect_cache_t;
+
+static t55xx_detect_cache_t detect_cache[DETECT_CACHE_SIZE];
+static uint8_t detect_cache_next = 0;
+
+// FNV-1a
+static uint32_t getGraphHash(void) {
+	uint32_t hash = 2166136261U;
+	for (size_t i = 0; i < GraphTraceLen; i++) {
+		hash = (hash ^ (uint32_t)GraphBuffer[i]) * 16777619U;
+	}
+	return hash;
+}
+
+// sort the possible matches by descending confidence
+static void sortDetectResults(t55xx_conf_block_t *tests, uint8_t *confidence, uint8_t hits) {
+	for (int i = 1; i < hits; i++) {
+		for (int j = i; j > 0 && confidence[j] > confidence[j-1]; j--) {
+			t55xx_conf_block_t tmp = tests[j];
+			tests[j] = tests[j-1];
+			tests[j-1] = tmp;
+			uint8_t c = confidence[j];
+			confidence[j] = confidence[j-1];
+			confidence[j-1] = c;
+		}
+	}
+}
+
 // detect configuration?
 bool tryDetectModulation(){
 	uint8_t hits = 0;
-	t55xx_conf_block_t tests[15];
+	t55xx_conf_block_t tests[DETECT_MAX_HITS];
+	uint8_t confidence[DETECT_MAX_HITS];
+	uint32_t hash = getGraphHash();
+	t55xx_detect_cache_t *cached = NULL;
+
+	for (int i = 0; i < DETECT_CACHE_SIZE; i++) {
+		if (detect_cache[i].valid && detect_cache[i].hash == hash && detect_cache[i].len == GraphTraceLen) {
+			cached = &detect_cache[i];
+			break;
+		}
+	}
+	if (cached) {
+		hits = cached->hits;
+		memcpy(tests, cached->tests, hits * sizeof(t55xx_conf_block_t));
+		memcpy(confidence, cached->confidence, hits);
+		if (g_debugMode) PrintAndLog("DEBUG: using cached detect result for graph hash %08X", hash);
+		goto done;
+	}
+
 	int bitRate=0;
 	uint8_t fc1 = 0, fc2 = 0, ans = 0;
 	int clk = 0, firstClockEdge = 0;
@@ -566,6 +641,7 @@ bool tryDetectModulation(){
 			tests[hits].inverted = false;
 			tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
 			tests[hits].ST = false;
+			confidence[hits] = getDetectConfidence(tests[hits].offset);
 			++hits;
 		}
 		if ( FSKrawDemod("0 1", false) && test(DEMOD_FSK, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5)) {
@@ -578,6 +654,7 @@ bool tryDetectModulation(){
 			tests[hits].inverted = true;
 			tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
 			tests[hits].ST = false;
+			confidence[hits] = getDetectConfidence(tests[hits].offset);
 			++hits;
 		}
 	} else {
@@ -589,6 +666,7 @@ bool tryDetectModulation(){
 				tests[hits].bitrate = bitRate;
 				tests[hits].inverted = false;
 				tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
+				confidence[hits] = getDetectConfidence(tests[hits].offset);
 				++hits;
 			}
 			tests[hits].ST = true;
@@ -597,6 +675,7 @@ bool tryDetectModulation(){
 				tests[hits].bitrate = bitRate;
 				tests[hits].inverted = true;
 				tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
+				confidence[hits] = getDetectConfidence(tests[hits].offset);
 				++hits;
 			}
 			if ( ASKbiphaseDemod("0 0 0 2", false) && test(DEMOD_BI, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5) ) {
@@ -605,6 +684,7 @@ bool tryDetectModulation(){
 				tests[hits].inverted = false;
 				tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
 				tests[hits].ST = false;
+				confidence[hits] = getDetectConfidence(tests[hits].offset);
 				++hits;
 			}
 			if ( ASKbiphaseDemod("0 0 1 2", false) && test(DEMOD_BIa, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5) ) {
@@ -613,6 +693,7 @@ bool tryDetectModulation(){
 				tests[hits].inverted = true;
 				tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
 				tests[hits].ST = false;
+				confidence[hits] = getDetectConfidence(tests[hits].offset);
 				++hits;
 			}
 		}
@@ -624,6 +705,7 @@ bool tryDetectModulation(){
 				tests[hits].inverted = false;
 				tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
 				tests[hits].ST = false;
+				confidence[hits] = getDetectConfidence(tests[hits].offset);
 				++hits;
 			}
 
@@ -633,6 +715,7 @@ bool tryDetectModulation(){
 				tests[hits].inverted = true;
 				tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
 				tests[hits].ST = false;
+				confidence[hits] = getDetectConfidence(tests[hits].offset);
 				++hits;
 			}
 		}
@@ -649,6 +732,7 @@ bool tryDetectModulation(){
 				tests[hits].inverted = false;
 				tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
 				tests[hits].ST = false;
+				confidence[hits] = getDetectConfidence(tests[hits].offset);
 				++hits;
 			}
 			if ( PSKDemod("0 1 6", false) && test(DEMOD_PSK1, &tests[hits].offset, &bitRate, clk, &tests[hits].Q5)) {
@@ -657,6 +741,7 @@ bool tryDetectModulation(){
 				tests[hits].inverted = true;
 				tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
 				tests[hits].ST = false;
+				confidence[hits] = getDetectConfidence(tests[hits].offset);
 				++hits;
 			}
 			// PSK2 - needs a call to psk1TOpsk2.
@@ -668,6 +753,7 @@ bool tryDetectModulation(){
 					tests[hits].inverted = false;
 					tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
 					tests[hits].ST = false;
+					confidence[hits] = getDetectConfidence(tests[hits].offset);
 					++hits;
 				}
 			} // inverse waves does not affect this demod
@@ -680,13 +766,26 @@ bool tryDetectModulation(){
 					tests[hits].inverted = false;
 					tests[hits].block0 = PackBits(tests[hits].offset, 32, DemodBuffer);
 					tests[hits].ST = false;
+					confidence[hits] = getDetectConfidence(tests[hits].offset);
 					++hits;
 				}
 			} // inverse waves does not affect this demod
 			//undo trim samples
 			save_restoreGB(GRAPH_RESTORE);
 		}
-	}	
+	}
+	sortDetectResults(tests, confidence, hits);
+
+	cached = &detect_cache[detect_cache_next];
+	detect_cache_next = (detect_cache_next + 1) % DETECT_CACHE_SIZE;
+	cached->valid = true;
+	cached->hash = hash;
+	cached->len = GraphTraceLen;
+	cached->hits = hits;
+	memcpy(cached->tests, tests, hits * sizeof(t55xx_conf_block_t));
+	memcpy(cached->confidence, confidence, hits);
+
+done:
 	if ( hits == 1) {
 		config.modulation = tests[0].modulation;
 		config.bitrate = tests[0].bitrate;
@@ -696,6 +795,7 @@ bool tryDetectModulation(){
 		config.Q5 = tests[0].Q5;
 		config.ST = tests[0].ST;
 		
+		if (g_debugMode) PrintAndLog("DEBUG: detect confidence %d%%", confidence[0]);
 		printConfiguration( config);
 		return true;
 	}
@@ -703,7 +803,7 @@ bool tryDetectModulation(){
 	if ( hits > 1) {
 		PrintAndLog("Found [%d] possible matches for modulation.",hits);
 		for(int i=0; i<hits; ++i){
-			PrintAndLog("--[%d]---------------", i+1);
+			PrintAndLog("--[%d]--- confidence %3d%% ---", i+1, confidence[i]);
 			printConfiguration( tests[i]);
 		}
 	}
@@ -1449,18 +1549,96 @@ int CmdT55xxWipe(const char *Cmd) {
 	return 0;
 }
 
+// Let the device try the passwords [start, end], or the <count> dictionary entries
+// [start, end] of <dictionary>, with every downlink mode in <dl_modes>. The device
+// stops at the first password the tag seems to answer to, which is verified here by
+// demodulating the config block. On a false positive the search resumes after it.
+// Returns 1 if a password was found, 0 if not, -1 if aborted or failed. <next> is set
+// to the next password/dictionary index to try.
+static int T55xxBruteForceDevice(uint32_t start, uint32_t end, uint8_t dl_modes, uint8_t *dictionary, uint8_t count, uint32_t *found_pwd, uint8_t *found_dl_mode, uint32_t *next) {
+	uint64_t pos = start;
+	bool aborting = false;
+
+	PrintAndLog("Press pm3-button or any key to abort");
+	while (pos <= end) {
+		UsbCommand c = {CMD_T55XX_BRUTE_FORCE, {dl_modes, pos, end}};
+		if (dictionary) {
+			c.arg[0] |= FLAG_T55XX_BF_DICTIONARY | (count << 16);
+			for (int i = 0; i < count; i++)
+				c.d.asDwords[i] = bytes_to_num(dictionary + 4*i, 4);
+		}
+		clearCommandBuffer();
+		SendCommand(&c);
+
+		UsbCommand resp;
+		uint8_t status = T55XX_BF_PROGRESS;
+		int silent = 0;
+		while (status == T55XX_BF_PROGRESS) {
+			if (!aborting && ukbhit()) {
+				int ch = getchar();
+				(void)ch;
+				// any command stops the device loop
+				UsbCommand ping = {CMD_PING};
+				SendCommand(&ping);
+				aborting = true;
+			}
+			if (!WaitForResponseTimeout(CMD_ACK, &resp, 1000)) {
+				if (++silent > T55XX_BF_TIMEOUT) {
+					PrintAndLog("command execution time out");
+					*next = pos;
+					return -1;
+				}
+				continue;
+			}
+			silent = 0;
+			status = resp.arg[0];
+			pos = resp.arg[1];
+			if (status == T55XX_BF_PROGRESS) {
+				printf(".");
+				fflush(stdout);
+			}
+		}
+		*next = pos;
+		if (aborting) {
+			// ack of the ping
+			WaitForResponseTimeout(CMD_ACK, NULL, 1000);
+			return -1;
+		}
+		if (status == T55XX_BF_ABORTED) return -1;
+		if (status == T55XX_BF_DONE) return 0;
+
+		// T55XX_BF_CANDIDATE
+		uint32_t pwd = dictionary ? bytes_to_num(dictionary + 4*pos, 4) : pos;
+		PrintAndLog("\nTesting candidate %08X", pwd);
+		for (uint8_t dl_mode = 0; dl_mode <= 3; dl_mode++) {
+			if (!(resp.arg[2] & (1 << dl_mode))) continue;
+			if (!AquireData(T55x7_PAGE0, T55x7_CONFIGURATION_BLOCK, true, pwd, dl_mode)) {
+				PrintAndLog("Acquiring data from device failed. Quitting");
+				return -1;
+			}
+			if (tryDetectModulation()) {
+				*found_pwd = pwd;
+				*found_dl_mode = dl_mode;
+				return 1;
+			}
+		}
+		pos++;
+		*next = pos;
+	}
+	return 0;
+}
+
 int CmdT55xxBruteForce(const char *Cmd) {
 
 	// load a default pwd file.
 	char buf[9];
 	char filename[FILE_PATH_SIZE]={0};
 	int keycnt = 0;
-	int ch;
 	uint8_t stKeyBlock = 20;
 	uint8_t *keyBlock = NULL, *p = NULL;
 	uint32_t start_password = 0x00000000; //start password
 	uint32_t end_password   = 0xFFFFFFFF; //end   password
-	bool found = false;
+	uint32_t found_pwd = 0;
 	uint8_t downlink_mode = 0;
 	bool try_all_dl_modes = false;
 	uint8_t dl_mode = 0;
@@ -1536,46 +1714,23 @@ int CmdT55xxBruteForce(const char *Cmd) {
 		}
 		PrintAndLog("Loaded %d keys", keycnt);
 		
-		// loop
-		uint64_t testpwd = 0x00;
-		for (uint16_t c = 0; c < keycnt; ++c ) {
-
-			if (ukbhit()) {
-				ch = getchar();
-				(void)ch;
-				printf("\naborted via keyboard!\n");
-				free(keyBlock);
-				return 0;
-			}
-
-			testpwd = bytes_to_num(keyBlock + 4*c, 4);
-
-			PrintAndLog("Testing %08X", testpwd);
-			
-			// Try each downlink_mode if asked to 
-			// donwlink_mode will = 0 if > 3 or set to 0, so loop from 0 - 3
-			for (dl_mode = downlink_mode; dl_mode <= 3; dl_mode++){
-				if ( !AquireData(T55x7_PAGE0, T55x7_CONFIGURATION_BLOCK, true, testpwd, dl_mode)) {
-					PrintAndLog("Acquiring data from device failed. Quitting");
-					free(keyBlock);
-					return 0;
-				}
-
-				found = tryDetectModulation();
-
-				if ( found ) {
-					PrintAndLog("Found valid password: [%08X]", testpwd);
-					free(keyBlock);
-					
-					T55xx_Print_DownlinkMode (dl_mode);
-
-					return 0;
-				}
-				if (!try_all_dl_modes) // Exit loop if not trying all downlink modes
-					dl_mode = 4;
-			}	
+		uint8_t dl_modes = try_all_dl_modes ? 0x0F : (1 << downlink_mode);
+		uint32_t next = 0;
+		int res = 0;
+		// the device takes up to 128 dictionary entries at a time
+		for (int c = 0; c < keycnt && res == 0; c += T55XX_BF_MAX_DICTIONARY) {
+			uint8_t count = MIN(keycnt - c, T55XX_BF_MAX_DICTIONARY);
+			res = T55xxBruteForceDevice(0, count - 1, dl_modes, keyBlock + 4*c, count, &found_pwd, &dl_mode, &next);
+			next += c;
+		}
+		if (res > 0) {
+			PrintAndLog("Found valid password: [%08X]", found_pwd);
+			T55xx_Print_DownlinkMode (dl_mode);
+		} else if (res < 0) {
+			PrintAndLog("\naborted, next dictionary entry to try: [%d]", next);
+		} else {
+			PrintAndLog("Password NOT found.");
 		}
-		PrintAndLog("Password NOT found.");
 		free(keyBlock);
 		return 0;
 	}
@@ -1592,44 +1747,22 @@ int CmdT55xxBruteForce(const char *Cmd) {
 	}
 	PrintAndLog("Search password range [%08X -> %08X]", start_password, end_password);
 
-	uint32_t i = start_password;
-
-	while ((!found) && (i <= end_password)) {
-
-		printf(".");
-		fflush(stdout);
-		if (ukbhit()) {
-			ch = getchar();
-			(void)ch;
-			printf("\naborted via keyboard!\n");
-			free(keyBlock);
-			return 0;
-		}
-		// Try each downlink_mode if asked to 
-		// donwlink_mode will = 0 if > 3 or set to 0, so loop from 0 - 3
-		for (dl_mode = downlink_mode; dl_mode <= 3; dl_mode++){
-			if (!AquireData(T55x7_PAGE0, T55x7_CONFIGURATION_BLOCK, true, i,dl_mode)) {
-				PrintAndLog("Acquiring data from device failed. Quitting");
-				free(keyBlock);
-				return 0;
-			}
-			found = tryDetectModulation();
-
-			if (found) break;
-			if (!try_all_dl_modes) // Exit loop if not trying all downlink modes
-				dl_mode = 4;			
-		}
-		if (found) break;
-		i++;
-	}
-
-	if (found){
-		PrintAndLog("Found valid password: [%08x]", i);
-		T55xx_Print_DownlinkMode (downlink_mode);
-	}
-	else{
+	uint8_t dl_modes = try_all_dl_modes ? 0x0F : (1 << downlink_mode);
+	uint32_t next = start_password;
+	int res = T55xxBruteForceDevice(start_password, end_password, dl_modes, NULL, 0, &found_pwd, &dl_mode, &next);
+
+	if (res > 0){
+		PrintAndLog("Found valid password: [%08x]", found_pwd);
+		T55xx_Print_DownlinkMode (dl_mode);
+	} else if (res < 0) {
+		uint8_t resume_mode = try_all_dl_modes ? 4 : downlink_mode;
+		if (resume_mode)
+			PrintAndLog("\naborted, resume with: lf t55xx bruteforce r %d %08x %08x", resume_mode, next, end_password);
+		else
+			PrintAndLog("\naborted, resume with: lf t55xx bruteforce %08x %08x", next, end_password);
+	} else {
 		PrintAndLog("");
-		PrintAndLog("Password NOT found. Last tried: [%08x]", --i);
+		PrintAndLog("Password NOT found. Last tried: [%08x]", end_password);
 	}
 
 	free(keyBlock);
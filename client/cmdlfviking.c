@@ -22,6 +22,7 @@
 #include "cmdmain.h"
 #include "cmdlf.h"
 #include "lfdemod.h"
+#include "result.h"
 static int CmdHelp(const char *Cmd);
 
 int usage_lf_viking_clone(void) {
@@ -75,6 +76,10 @@ int CmdVikingDemod(const char *Cmd) {
 	uint8_t  checksum = bytebits_to_byte(DemodBuffer+ans+32+24, 8);
 	PrintAndLog("Viking Tag Found: Card ID %08X, Checksum: %02X", cardid, (unsigned int) checksum);
 	PrintAndLog("Raw: %08X%08X", raw1,raw2);
+	char id[12];
+	snprintf(id, sizeof(id), "%08X", cardid);
+	ResultLFTag("Viking");
+	ResultString("id", id);
 	setDemodBuf(DemodBuffer, 64, ans);
 	setClockGrid(g_DemodClock, g_DemodStartIdx + (ans*g_DemodClock));
 	return 1;
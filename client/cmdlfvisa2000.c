@@ -22,6 +22,7 @@
 #include "cmdlf.h"
 #include "protocols.h"  // for T55xx config register definitions
 #include "lfdemod.h"    // for Visa2kDemod_AM
+#include "result.h"
 
 #define BL0CK1 0x56495332
 
@@ -143,6 +144,8 @@ int CmdVisa2kDemod(const char *Cmd) {
 		return 0;
 	}
 	PrintAndLog("Visa2000 Tag Found: Card ID %u,  Raw: %08X%08X%08X", raw2,  raw1 ,raw2, raw3);
+	ResultLFTag("Visa2000");
+	ResultInt("card_number", raw2);
 	return 1;
 }
 
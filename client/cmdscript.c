@@ -11,13 +11,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <limits.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 
 #include "proxmark3.h"
 #include "scripting.h"
 #include "ui.h"
+#include "util.h"
 #include "graph.h"
 #include "cmdparser.h"
 #include "cmdmain.h"
@@ -25,6 +28,7 @@
 #include "cmdhfmf.h"
 #include "pm3_binlib.h"
 #include "pm3_bitlib.h"
+#include "pm3_bytelib.h"
 #include <lua.h>
 #include <lualib.h>
 #include <lauxlib.h>
@@ -32,12 +36,22 @@
 static int CmdHelp(const char *Cmd);
 static int CmdList(const char *Cmd);
 static int CmdRun(const char *Cmd);
+static int CmdCache(const char *Cmd);
+
+// registry tables of the kept Lua state
+#define SCRIPT_CACHE_SCRIPTS        "pm3_scripts"   // path -> {func, mtime, size}
+#define SCRIPT_CACHE_MODULES        "pm3_modules"   // module name -> mtime of lualibs/<name>.lua
+
+static bool keepState = false;
+static lua_State *keptState = NULL;
+static int running = 0;
 
 command_t CommandTable[] =
 {
   {"help",  CmdHelp, 1, "This help"},
   {"list",  CmdList, 1, "List available scripts"},
   {"run",   CmdRun,  1, "<name> -- Execute a script"},
+  {"cache", CmdCache, 1, "[on|off|clear] -- Keep the Lua state and the compiled scripts between runs"},
   {NULL, NULL, 0, NULL}
 };
 
@@ -116,6 +130,230 @@ bool endsWith (char* base, char* str) {
     return (blen >= slen) && (0 == strcmp(base + blen - slen, str));
 }
 
+static lua_State *NewScriptState(void)
+{
+	// create new Lua state
+	lua_State *lua_state = luaL_newstate();
+
+	// load Lua libraries
+	luaL_openlibs(lua_state);
+
+	//Sets the pm3 core libraries, that go a bit 'under the hood'
+	set_pm3_libraries(lua_state);
+
+	//Add the 'bin' library
+	set_bin_library(lua_state);
+
+	//Add the 'bit' library
+	set_bit_library(lua_state);
+
+	//Add the 'bytes' library
+	set_bytes_library(lua_state);
+
+	return lua_state;
+}
+
+static void CloseKeptState(void)
+{
+	if (keptState)
+		lua_close(keptState);
+	keptState = NULL;
+}
+
+static bool GetModulePath(const char *name, char *path, size_t pathlen)
+{
+	int len = snprintf(path, pathlen, "%s%s%s.lua", get_my_executable_directory(), LUA_LIBRARIES_DIRECTORY, name);
+	return len > 0 && (size_t)len < pathlen;
+}
+
+/**
+ * Modules stay in package.loaded of the kept state. The ones from lualibs/
+ * are dropped from it when their file has changed, so that require() loads
+ * them again.
+ */
+static void DropChangedModules(lua_State *L)
+{
+	char path[FILE_PATH_SIZE];
+	struct stat st;
+
+	lua_getfield(L, LUA_REGISTRYINDEX, SCRIPT_CACHE_MODULES);
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "loaded");
+	lua_remove(L, -2);
+
+	lua_pushnil(L);
+	while (lua_next(L, -3)) {
+		lua_Number mtime = lua_tonumber(L, -1);
+		lua_pop(L, 1);
+		const char *name = lua_tostring(L, -1);
+		if (GetModulePath(name, path, sizeof(path)) && stat(path, &st) == 0 && (lua_Number)st.st_mtime == mtime)
+			continue;
+
+		// clearing fields of the table being traversed is allowed
+		lua_pushvalue(L, -1);
+		lua_pushnil(L);
+		lua_settable(L, -4);
+		lua_pushvalue(L, -1);
+		lua_pushnil(L);
+		lua_settable(L, -5);
+	}
+	lua_pop(L, 2);
+}
+
+/**
+ * Remembers the mtime of the modules from lualibs/ which were loaded by the last run.
+ */
+static void RecordLoadedModules(lua_State *L)
+{
+	char path[FILE_PATH_SIZE];
+	struct stat st;
+
+	lua_getfield(L, LUA_REGISTRYINDEX, SCRIPT_CACHE_MODULES);
+	lua_getglobal(L, "package");
+	lua_getfield(L, -1, "loaded");
+	lua_remove(L, -2);
+
+	lua_pushnil(L);
+	while (lua_next(L, -2)) {
+		lua_pop(L, 1);
+		if (lua_type(L, -1) != LUA_TSTRING)
+			continue;
+		lua_pushvalue(L, -1);
+		lua_rawget(L, -4);
+		bool known = !lua_isnil(L, -1);
+		lua_pop(L, 1);
+		if (known)
+			continue;
+
+		const char *name = lua_tostring(L, -1);
+		if (!GetModulePath(name, path, sizeof(path)) || stat(path, &st) != 0)
+			continue;
+		lua_pushvalue(L, -1);
+		lua_pushnumber(L, st.st_mtime);
+		lua_rawset(L, -5);
+	}
+	lua_pop(L, 2);
+}
+
+/**
+ * Pushes the compiled script. The kept state compiles a script once and
+ * takes it from SCRIPT_CACHE_SCRIPTS as long as the file has the same mtime and size.
+ * Returns the result of luaL_loadfile, with the error message pushed.
+ */
+static int LoadScript(lua_State *L, const char *script_path, bool cache)
+{
+	struct stat st;
+	if (!cache || stat(script_path, &st) != 0)
+		return luaL_loadfile(L, script_path);
+
+	lua_getfield(L, LUA_REGISTRYINDEX, SCRIPT_CACHE_SCRIPTS);
+	lua_getfield(L, -1, script_path);
+	if (lua_istable(L, -1)) {
+		lua_getfield(L, -1, "mtime");
+		lua_getfield(L, -2, "size");
+		bool same = lua_tonumber(L, -2) == (lua_Number)st.st_mtime && lua_tonumber(L, -1) == (lua_Number)st.st_size;
+		lua_pop(L, 2);
+		if (same) {
+			lua_getfield(L, -1, "func");
+			lua_replace(L, -3);
+			lua_pop(L, 1);
+			return LUA_OK;
+		}
+	}
+	lua_pop(L, 1);
+
+	int error = luaL_loadfile(L, script_path);
+	if (error) {
+		lua_remove(L, -2);
+		return error;
+	}
+
+	lua_createtable(L, 0, 3);
+	lua_pushvalue(L, -2);
+	lua_setfield(L, -2, "func");
+	lua_pushnumber(L, st.st_mtime);
+	lua_setfield(L, -2, "mtime");
+	lua_pushnumber(L, st.st_size);
+	lua_setfield(L, -2, "size");
+	lua_setfield(L, -3, script_path);
+	lua_remove(L, -2);
+	return LUA_OK;
+}
+
+/**
+ * Gives the script on the top of the stack its own global table. Globals
+ * of a script don't stay in the kept state, the libraries are read through _G.
+ */
+static void SetScriptEnvironment(lua_State *L, const char *arguments)
+{
+	lua_newtable(L);
+	lua_createtable(L, 0, 1);
+	lua_pushglobaltable(L);
+	lua_setfield(L, -2, "__index");
+	lua_setmetatable(L, -2);
+
+	lua_pushstring(L, arguments);
+	lua_setfield(L, -2, "args");
+
+	// the first upvalue of a main chunk is its _ENV
+	lua_setupvalue(L, -2, 1);
+}
+
+/**
+ * Keeps the Lua state between the runs of scripts, or closes it
+ * @brief CmdCache
+ * @param Cmd
+ * @return
+ */
+int CmdCache(const char *Cmd)
+{
+	char ctmp = tolower(param_getchar(Cmd, 0));
+	char param[6] = {0};
+	param_getstr(Cmd, 0, param, sizeof(param));
+
+	if (ctmp == 'h') {
+		PrintAndLog("Usage:  script cache [on|off|clear]");
+		PrintAndLog("   on    - keep the Lua state between runs. Modules from lualibs/ are loaded once, scripts compiled once.");
+		PrintAndLog("           A changed file is loaded again.");
+		PrintAndLog("   off   - a new Lua state for each run (default)");
+		PrintAndLog("   clear - start again with a new Lua state");
+		return 0;
+	}
+
+	if (!strcmp(param, "on")) {
+		keepState = true;
+	} else if (!strcmp(param, "off")) {
+		keepState = false;
+		CloseKeptState();
+	} else if (!strcmp(param, "clear")) {
+		CloseKeptState();
+	} else if (param[0]) {
+		PrintAndLog("Unknown parameter '%s'", param);
+		return 1;
+	}
+
+	int scripts = 0;
+	int modules = 0;
+	if (keptState) {
+		lua_getfield(keptState, LUA_REGISTRYINDEX, SCRIPT_CACHE_SCRIPTS);
+		lua_getfield(keptState, LUA_REGISTRYINDEX, SCRIPT_CACHE_MODULES);
+		lua_pushnil(keptState);
+		while (lua_next(keptState, -2)) {
+			lua_pop(keptState, 1);
+			modules++;
+		}
+		lua_pushnil(keptState);
+		while (lua_next(keptState, -3)) {
+			lua_pop(keptState, 1);
+			scripts++;
+		}
+		lua_pop(keptState, 2);
+	}
+
+	PrintAndLog("Lua state is %s between runs. Cached: %d scripts, %d modules", keepState ? "kept" : "not kept", scripts, modules);
+	return 0;
+}
+
 /**
  * @brief CmdRun - executes a script file.
  * @param argc
@@ -124,21 +362,22 @@ bool endsWith (char* base, char* str) {
  */
 int CmdRun(const char *Cmd)
 {
-    // create new Lua state
+    // a script which runs a script gets a state of its own
+    bool cache = keepState && running == 0;
     lua_State *lua_state;
-    lua_state = luaL_newstate();
-
-    // load Lua libraries
-    luaL_openlibs(lua_state);
-
-    //Sets the pm3 core libraries, that go a bit 'under the hood'
-    set_pm3_libraries(lua_state);
-
-    //Add the 'bin' library
-    set_bin_library(lua_state);
-
-	//Add the 'bit' library
-	set_bit_library(lua_state);
+    if (cache) {
+        if (!keptState) {
+            keptState = NewScriptState();
+            lua_newtable(keptState);
+            lua_setfield(keptState, LUA_REGISTRYINDEX, SCRIPT_CACHE_SCRIPTS);
+            lua_newtable(keptState);
+            lua_setfield(keptState, LUA_REGISTRYINDEX, SCRIPT_CACHE_MODULES);
+        }
+        lua_state = keptState;
+        DropChangedModules(lua_state);
+    } else {
+        lua_state = NewScriptState();
+    }
 
     char script_name[128] = {0};
     char arguments[256] = {0};
@@ -165,15 +404,15 @@ int CmdRun(const char *Cmd)
 
     // run the Lua script
 
-    int error = luaL_loadfile(lua_state, script_path);
+    int error = LoadScript(lua_state, script_path, cache);
     if(!error)
     {
-
-        lua_pushstring(lua_state, arguments);
-        lua_setglobal(lua_state, "args");
+        SetScriptEnvironment(lua_state, arguments);
 
         //Call it with 0 arguments
-         error = lua_pcall(lua_state, 0, LUA_MULTRET, 0); // once again, returns non-0 on error,
+        running++;
+        error = lua_pcall(lua_state, 0, 0, 0); // once again, returns non-0 on error,
+        running--;
     }
     if(error) // if non-0, then an error
     {
@@ -187,10 +426,13 @@ int CmdRun(const char *Cmd)
         puts(str);
     }
 
-    //luaL_dofile(lua_state, buf);
-    // close the Lua state
-    lua_close(lua_state);
+    if (cache) {
+        RecordLoadedModules(lua_state);
+        lua_settop(lua_state, 0);
+    } else {
+        // close the Lua state
+        lua_close(lua_state);
+    }
     printf("\n-----Finished\n");
     return 0;
 }
-
@@ -0,0 +1,367 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Daemon mode: client commands over a Unix domain socket
+//
+// The client keeps the device open and executes the commands it gets on the
+// socket, so a test step costs a round trip instead of a client start and a
+// USB reconnect. Commands print through PrintAndLog() and printf(), so the
+// output of a command is captured by pointing stdout to a temporary file while
+// it runs.
+//-----------------------------------------------------------------------------
+
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L      // need sigaction(), strdup(), pread()
+#endif
+
+#include "daemon.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <jansson.h>
+#if !defined(_WIN32)
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+#include "util_posix.h"
+#include "cmdmain.h"
+#include "result.h"
+
+#if !defined(_WIN32)
+
+static volatile sig_atomic_t stop_daemon = 0;
+static FILE *capture = NULL;
+
+
+static void on_signal(int sig)
+{
+	stop_daemon = 1;
+}
+
+
+static bool read_full(int fd, void *buf, size_t len)
+{
+	uint8_t *p = buf;
+	while (len) {
+		ssize_t n = read(fd, p, len);
+		if (n < 0 && errno == EINTR && !stop_daemon)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+
+static bool write_full(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	while (len) {
+		ssize_t n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= n;
+	}
+	return true;
+}
+
+
+// a request, zero terminated. NULL at the end of the connection or on a wrong length.
+static char *read_frame(int fd, size_t *len)
+{
+	uint8_t hdr[4];
+	if (!read_full(fd, hdr, sizeof(hdr)))
+		return NULL;
+
+	*len = (uint32_t)hdr[0] << 24 | hdr[1] << 16 | hdr[2] << 8 | hdr[3];
+	if (*len > DAEMON_MAX_REQUEST)
+		return NULL;
+
+	char *data = malloc(*len + 1);
+	if (!data)
+		return NULL;
+	if (!read_full(fd, data, *len)) {
+		free(data);
+		return NULL;
+	}
+	data[*len] = '\0';
+	return data;
+}
+
+
+static bool write_frame(int fd, const char *data, size_t len)
+{
+	uint8_t hdr[4] = {len >> 24, len >> 16, len >> 8, len};
+	return write_full(fd, hdr, sizeof(hdr)) && write_full(fd, data, len);
+}
+
+
+// length of the valid UTF-8 sequence at <s>, 0 if there is none
+static size_t utf8_sequence_len(const uint8_t *s, size_t len)
+{
+	uint32_t cp;
+	size_t n;
+	if (s[0] < 0x80)
+		return 1;
+	else if ((s[0] & 0xe0) == 0xc0) {
+		cp = s[0] & 0x1f;
+		n = 2;
+	} else if ((s[0] & 0xf0) == 0xe0) {
+		cp = s[0] & 0x0f;
+		n = 3;
+	} else if ((s[0] & 0xf8) == 0xf0) {
+		cp = s[0] & 0x07;
+		n = 4;
+	} else
+		return 0;
+
+	if (n > len)
+		return 0;
+	for (size_t i = 1; i < n; i++) {
+		if ((s[i] & 0xc0) != 0x80)
+			return 0;
+		cp = cp << 6 | (s[i] & 0x3f);
+	}
+	// overlong forms, surrogates and beyond Unicode
+	static const uint32_t min_cp[] = {0, 0, 0x80, 0x800, 0x10000};
+	if (cp < min_cp[n] || (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff)
+		return 0;
+	return n;
+}
+
+
+// JSON strings have to be UTF-8, but commands print raw card data as well. Bytes
+// which aren't valid UTF-8 are taken as Latin-1, so "\xe9" becomes "\u00e9".
+static json_t *json_string_from_output(const char *output, size_t len)
+{
+	char *text = malloc(len * 2 + 1);
+	if (!text)
+		return NULL;
+
+	const uint8_t *in = (const uint8_t *)output;
+	size_t pos = 0;
+	for (size_t i = 0; i < len; ) {
+		size_t n = utf8_sequence_len(in + i, len - i);
+		if (n) {
+			memcpy(text + pos, in + i, n);
+			pos += n;
+			i += n;
+		} else {
+			text[pos++] = 0xc0 | in[i] >> 6;
+			text[pos++] = 0x80 | (in[i] & 0x3f);
+			i++;
+		}
+	}
+
+	json_t *value = json_stringn(text, pos);
+	free(text);
+	return value;
+}
+
+
+// Executes <cmd> with stdout going to the capture file. Returns what it printed,
+// without the blanks PrintAndLog() puts at the end of each line.
+static char *run_captured(char *cmd, int *result, size_t *output_len)
+{
+	int capture_fd = fileno(capture);
+	lseek(capture_fd, 0, SEEK_SET);
+	if (ftruncate(capture_fd, 0) != 0)
+		return NULL;
+
+	fflush(stdout);
+	int saved_stdout = dup(STDOUT_FILENO);
+	dup2(capture_fd, STDOUT_FILENO);
+
+	*result = CommandReceived(cmd);
+
+	fflush(stdout);
+	dup2(saved_stdout, STDOUT_FILENO);
+	close(saved_stdout);
+
+	off_t size = lseek(capture_fd, 0, SEEK_CUR);
+	char *output = malloc(size + 1);
+	if (!output)
+		return NULL;
+	ssize_t n = pread(capture_fd, output, size, 0);
+	if (n < 0)
+		n = 0;
+
+	size_t len = 0;
+	for (ssize_t i = 0; i < n; i++) {
+		if (output[i] == '\n')
+			while (len && output[len - 1] == ' ')
+				len--;
+		output[len++] = output[i];
+	}
+	while (len && output[len - 1] == ' ')
+		len--;
+	output[len] = '\0';
+	*output_len = len;
+	return output;
+}
+
+
+// The JSON response to a request. Sets <exit> for "exit" and "quit".
+static char *handle_request(const char *request, size_t len, bool *exit)
+{
+	json_t *response = json_object();
+	json_error_t error;
+	json_t *root = json_loadb(request, len, 0, &error);
+	const char *cmd = json_is_object(root) ? json_string_value(json_object_get(root, "cmd")) : NULL;
+
+	if (json_is_object(root) && json_object_get(root, "id"))
+		json_object_set(response, "id", json_object_get(root, "id"));
+
+	if (!root) {
+		json_object_set_new(response, "status", json_string("error"));
+		json_object_set_new(response, "error", json_string(error.text));
+	} else if (!cmd) {
+		json_object_set_new(response, "status", json_string("error"));
+		json_object_set_new(response, "error", json_string("no \"cmd\" string"));
+	} else {
+		char *cmdline = strdup(cmd);
+		int result = 0;
+		size_t output_len = 0;
+		uint64_t start = msclock();
+		ResultCollect();
+		char *output = cmdline ? run_captured(cmdline, &result, &output_len) : NULL;
+		json_t *records = ResultTake();
+		json_t *output_str = output ? json_string_from_output(output, output_len) : NULL;
+
+		json_object_set_new(response, "cmd", json_string(cmd));
+		if (output_str) {
+			json_object_set_new(response, "status", json_string("ok"));
+			json_object_set_new(response, "result", json_integer(result));
+			json_object_set_new(response, "output", output_str);
+			json_object_set_new(response, "records", records);
+			json_object_set_new(response, "time_ms", json_integer(msclock() - start));
+		} else {
+			json_object_set_new(response, "status", json_string("error"));
+			json_object_set_new(response, "error", json_string("can't capture the output"));
+			json_decref(records);
+		}
+		*exit = (result == 99);
+		free(output);
+		free(cmdline);
+	}
+
+	char *text = json_dumps(response, JSON_COMPACT | JSON_PRESERVE_ORDER);
+	json_decref(response);
+	json_decref(root);
+	return text;
+}
+
+
+// Serves the requests of one connection. Returns false if the daemon has to stop.
+static bool serve_connection(int conn)
+{
+	bool exit = false;
+	while (!exit && !stop_daemon) {
+		size_t len;
+		char *request = read_frame(conn, &len);
+		if (!request)
+			break;
+		char *response = handle_request(request, len, &exit);
+		free(request);
+		if (!response || !write_frame(conn, response, strlen(response))) {
+			free(response);
+			break;
+		}
+		free(response);
+	}
+	return !exit;
+}
+
+
+int DaemonRun(const char *socket_path)
+{
+	struct sockaddr_un addr = {0};
+	addr.sun_family = AF_UNIX;
+	if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path too long: %s\n", socket_path);
+		return 1;
+	}
+	strcpy(addr.sun_path, socket_path);
+
+	// remove the socket of a previous daemon, but nothing else
+	struct stat st;
+	if (stat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(socket_path);
+
+	int srv = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (srv < 0) {
+		perror("socket");
+		return 1;
+	}
+	mode_t old_mask = umask(0077);
+	int res = bind(srv, (struct sockaddr *)&addr, sizeof(addr));
+	umask(old_mask);
+	if (res < 0 || listen(srv, 4) < 0) {
+		perror(socket_path);
+		close(srv);
+		return 1;
+	}
+
+	capture = tmpfile();
+	if (!capture) {
+		perror("tmpfile");
+		close(srv);
+		unlink(socket_path);
+		return 1;
+	}
+
+	// a client closing its connection early mustn't kill the daemon
+	signal(SIGPIPE, SIG_IGN);
+	struct sigaction sa = {0};
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	printf("Daemon listening on %s\n", socket_path);
+	fflush(stdout);
+
+	while (!stop_daemon) {
+		int conn = accept(srv, NULL, NULL);
+		if (conn < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("accept");
+			break;
+		}
+		bool go_on = serve_connection(conn);
+		close(conn);
+		if (!go_on)
+			break;
+	}
+
+	printf("Daemon stopped\n");
+	fclose(capture);
+	close(srv);
+	unlink(socket_path);
+	return 0;
+}
+
+#else
+
+int DaemonRun(const char *socket_path)
+{
+	fprintf(stderr, "Daemon mode needs Unix domain sockets, which aren't available on Windows\n");
+	return 1;
+}
+
+#endif
@@ -0,0 +1,25 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Daemon mode: client commands over a Unix domain socket
+//-----------------------------------------------------------------------------
+
+#ifndef DAEMON_H__
+#define DAEMON_H__
+
+#define DAEMON_MAX_REQUEST      65536
+
+// Serve client commands on the Unix domain socket <socket_path>, one connection
+// at a time, until a client sends "exit" or "quit". Each request and response
+// is a 4 byte big endian length followed by a JSON object:
+//   request:  {"cmd": "hw version", "id": <optional, sent back>}
+//   response: {"id": ..., "cmd": "hw version", "status": "ok", "result": 0,
+//              "output": "<what the command printed>", "records": [...], "time_ms": 12}
+// "records" are the typed results of the command, see result.h. Output bytes
+// which aren't valid UTF-8 are sent as the Latin-1 character of the same value.
+// Returns the process exit code.
+int DaemonRun(const char *socket_path);
+
+#endif
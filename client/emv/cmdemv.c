@@ -12,10 +12,12 @@
 
 #include <ctype.h>
 #include <string.h>
+#include <inttypes.h>
 #include "proxmark3.h"
 #include "cmdparser.h"
 #include "ui.h"
 #include "util.h"
+#include "util_posix.h"
 #include "mifare.h"
 #include "emvjson.h"
 #include "emv_pki.h"
@@ -127,7 +129,8 @@ int CmdEMVSearch(const char *cmd) {
 
 	CLIParserInit("emv search",
 		"Tries to select all applets from applet list:\n",
-		"Usage:\n\temv search -s -> select card and search\n\temv search -st -> select card, search and show result in TLV\n");
+		"Usage:\n\temv search -s -> select card and search\n\temv search -st -> select card, search and show result in TLV\n"
+			"\temv search -sf -> select card and search until the applets of one payment system are found\n");
 
 	void* argtable[] = {
 		arg_param_begin,
@@ -135,6 +138,7 @@ int CmdEMVSearch(const char *cmd) {
 		arg_lit0("kK",  "keep",    "keep field ON for next command"),
 		arg_lit0("aA",  "apdu",    "show APDU reqests and responses"),
 		arg_lit0("tT",  "tlv",     "TLV decode results of selected applets"),
+		arg_lit0("fF",  "first",   "don't search the applets of other payment systems when one is found"),
 #ifdef WITH_SMARTCARD
 		arg_lit0("wW",  "wired",   "Send data via contact (iso7816) interface. Contactless interface set by default."),
 #endif
@@ -146,9 +150,10 @@ int CmdEMVSearch(const char *cmd) {
 	bool leaveSignalON = arg_get_lit(2);
 	bool APDULogging = arg_get_lit(3);
 	bool decodeTLV = arg_get_lit(4);
+	bool firstVendorOnly = arg_get_lit(5);
 	EMVCommandChannel channel = ECC_CONTACTLESS;
 #ifdef WITH_SMARTCARD
-	if (arg_get_lit(5))
+	if (arg_get_lit(6))
 		channel = ECC_CONTACT;
 #endif
 	PrintChannel(channel);
@@ -160,7 +165,7 @@ int CmdEMVSearch(const char *cmd) {
 	const char *al = "Applets list";
 	t = tlvdb_fixed(1, strlen(al), (const unsigned char *)al);
 
-	if (EMVSearch(channel, activateField, leaveSignalON, decodeTLV, t)) {
+	if (EMVSearch(channel, activateField, leaveSignalON, decodeTLV, firstVendorOnly, t)) {
 		tlvdb_free(t);
 		return 2;
 	}
@@ -784,7 +789,7 @@ void ProcessACResponseFormat1(struct tlvdb *tlvRoot, uint8_t *buf, size_t len, b
 	}
 }
 
-int CmdEMVExec(const char *cmd) {
+static int EMVExec(EMVCommandChannel channel, bool activateField, bool showAPDU, bool decodeTLV, bool paramLoadJSON, bool forceSearch, bool firstVendorOnly, enum TransactionType TrType, bool GenACGPO) {
 	uint8_t buf[APDU_RESPONSE_LEN] = {0};
 	size_t len = 0;
 	uint16_t sw = 0;
@@ -799,55 +804,9 @@ int CmdEMVExec(const char *cmd) {
 	struct tlvdb *tlvRoot = NULL;
 	struct tlv *pdol_data_tlv = NULL;
 
-	CLIParserInit("emv exec",
-		"Executes EMV contactless transaction",
-		"Usage:\n"
-			"\temv exec -sat -> select card, execute MSD transaction, show APDU and TLV\n"
-			"\temv exec -satc -> select card, execute CDA transaction, show APDU and TLV\n");
-
-	void* argtable[] = {
-		arg_param_begin,
-		arg_lit0("sS",  "select",   "activate field and select card."),
-		arg_lit0("aA",  "apdu",     "show APDU reqests and responses."),
-		arg_lit0("tT",  "tlv",      "TLV decode results."),
-		arg_lit0("jJ",  "jload",    "Load transaction parameters from `emv/defparams.json` file."),
-		arg_lit0("fF",  "forceaid", "Force search AID. Search AID instead of execute PPSE."),
-		arg_rem("By default:",      "Transaction type - MSD"),
-		arg_lit0("vV",  "qvsdc",    "Transaction type - qVSDC or M/Chip."),
-		arg_lit0("cC",  "qvsdccda", "Transaction type - qVSDC or M/Chip plus CDA (SDAD generation)."),
-		arg_lit0("xX",  "vsdc",     "Transaction type - VSDC. For test only. Not a standart behavior."),
-		arg_lit0("gG",  "acgpo",    "VISA. generate AC from GPO."),
-		arg_lit0("wW",  "wired",   "Send data via contact (iso7816) interface. Contactless interface set by default."),
-		arg_param_end
-	};
-	CLIExecWithReturn(cmd, argtable, true);
-
-	bool activateField = arg_get_lit(1);
-	bool showAPDU = arg_get_lit(2);
-	bool decodeTLV = arg_get_lit(3);
-	bool paramLoadJSON = arg_get_lit(4);
-	bool forceSearch = arg_get_lit(5);
-
-	enum TransactionType TrType = TT_MSD;
-	if (arg_get_lit(7))
-		TrType = TT_QVSDCMCHIP;
-	if (arg_get_lit(8))
-		TrType = TT_CDA;
-	if (arg_get_lit(9))
-		TrType = TT_VSDC;
-
-	bool GenACGPO = arg_get_lit(10);
-	EMVCommandChannel channel = ECC_CONTACTLESS;
-#ifdef WITH_SMARTCARD
-	if (arg_get_lit(11))
-		channel = ECC_CONTACT;
-#endif
-	PrintChannel(channel);
 	uint8_t psenum = (channel == ECC_CONTACT) ? 1 : 2;
 	char *PSE_or_PPSE = psenum == 1 ? "PSE" : "PPSE";
 
-	CLIParserFree();
-
 	SetAPDULogging(showAPDU);
 
 	// init applets list tree
@@ -873,7 +832,7 @@ int CmdEMVExec(const char *cmd) {
 	if (!AIDlen) {
 		PrintAndLogEx(NORMAL, "\n* Search AID in list.");
 		SetAPDULogging(false);
-		if (EMVSearch(channel, activateField, true, decodeTLV, tlvSelect)) {
+		if (EMVSearch(channel, activateField, true, decodeTLV, firstVendorOnly, tlvSelect)) {
 			dreturn(2);
 		}
 
@@ -1147,7 +1106,8 @@ int CmdEMVExec(const char *cmd) {
 			// 9F27: Cryptogram Information Data (CID)
 			const struct tlv *CID = tlvdb_get(tlvRoot, 0x9F27, NULL);
 			if (CID) {
-				emv_tag_dump(CID, stdout, 0);
+				if (!GetSilentMode())
+					emv_tag_dump(CID, stdout, 0);
 				PrintAndLogEx(NORMAL, "------------------------------");
 				if (CID->len > 0) {
 					switch(CID->value[0] & EMVAC_AC_MASK){
@@ -1374,6 +1334,107 @@ int CmdEMVExec(const char *cmd) {
 	return 0;
 }
 
+int CmdEMVExec(const char *cmd) {
+	CLIParserInit("emv exec",
+		"Executes EMV contactless transaction",
+		"Usage:\n"
+			"\temv exec -sat -> select card, execute MSD transaction, show APDU and TLV\n"
+			"\temv exec -satc -> select card, execute CDA transaction, show APDU and TLV\n"
+			"\temv exec -sc --record card.apdu -> select card, execute CDA transaction and save the APDUs\n"
+			"\temv exec -sc --replay card.apdu -n 1000 -> execute the saved CDA transaction 1000 times\n");
+
+	void* argtable[] = {
+		arg_param_begin,
+		arg_lit0("sS",  "select",   "activate field and select card."),
+		arg_lit0("aA",  "apdu",     "show APDU reqests and responses."),
+		arg_lit0("tT",  "tlv",      "TLV decode results."),
+		arg_lit0("jJ",  "jload",    "Load transaction parameters from `emv/defparams.json` file."),
+		arg_lit0("fF",  "forceaid", "Force search AID. Search AID instead of execute PPSE."),
+		arg_rem("By default:",      "Transaction type - MSD"),
+		arg_lit0("vV",  "qvsdc",    "Transaction type - qVSDC or M/Chip."),
+		arg_lit0("cC",  "qvsdccda", "Transaction type - qVSDC or M/Chip plus CDA (SDAD generation)."),
+		arg_lit0("xX",  "vsdc",     "Transaction type - VSDC. For test only. Not a standart behavior."),
+		arg_lit0("gG",  "acgpo",    "VISA. generate AC from GPO."),
+		arg_lit0("wW",  "wired",   "Send data via contact (iso7816) interface. Contactless interface set by default."),
+		arg_str0(NULL,  "record",   "<file>", "Save the APDUs of the transaction to a file."),
+		arg_str0(NULL,  "replay",   "<file>", "Answer the APDUs from a file saved with --record instead of the card."),
+		arg_int0("nN",  "count",    "<n>", "With --replay: execute the transaction n times without output and show the time."),
+		arg_lit0(NULL,  "first",    "With the AID search: don't search the applets of other payment systems when one is found."),
+		arg_param_end
+	};
+	CLIExecWithReturn(cmd, argtable, true);
+
+	bool activateField = arg_get_lit(1);
+	bool showAPDU = arg_get_lit(2);
+	bool decodeTLV = arg_get_lit(3);
+	bool paramLoadJSON = arg_get_lit(4);
+	bool forceSearch = arg_get_lit(5);
+
+	enum TransactionType TrType = TT_MSD;
+	if (arg_get_lit(7))
+		TrType = TT_QVSDCMCHIP;
+	if (arg_get_lit(8))
+		TrType = TT_CDA;
+	if (arg_get_lit(9))
+		TrType = TT_VSDC;
+
+	bool GenACGPO = arg_get_lit(10);
+	EMVCommandChannel channel = ECC_CONTACTLESS;
+#ifdef WITH_SMARTCARD
+	if (arg_get_lit(11))
+		channel = ECC_CONTACT;
+#endif
+	PrintChannel(channel);
+
+	char recordFile[FILE_PATH_SIZE] = {0};
+	char replayFile[FILE_PATH_SIZE] = {0};
+	int fnlen = 0;
+	CLIParamStrToBuf(arg_get_str(12), (uint8_t *)recordFile, FILE_PATH_SIZE, &fnlen);
+	CLIParamStrToBuf(arg_get_str(13), (uint8_t *)replayFile, FILE_PATH_SIZE, &fnlen);
+	int count = arg_get_int_def(14, 0);
+	bool firstVendorOnly = arg_get_lit(15);
+
+	CLIParserFree();
+
+	if (count && !replayFile[0]) {
+		PrintAndLogEx(ERR, "--count needs --replay.");
+		return 1;
+	}
+
+	if (replayFile[0] && EMVReplayStart(replayFile))
+		return 1;
+	if (recordFile[0] && EMVRecordStart(recordFile)) {
+		EMVReplayStop();
+		return 1;
+	}
+
+	int res;
+	if (count) {
+		// a new activation starts the recorded transaction again
+		PrintAndLogEx(INFO, "Executing the transaction %d times...", count);
+		uint64_t start_time = msclock();
+		SetSilentMode(true);
+		int i;
+		for (i = 0; i < count; i++) {
+			res = EMVExec(channel, true, false, false, paramLoadJSON, forceSearch, firstVendorOnly, TrType, GenACGPO);
+			if (res)
+				break;
+		}
+		SetSilentMode(false);
+		uint64_t elapsed = msclock() - start_time;
+		if (res)
+			PrintAndLogEx(ERR, "Transaction %d failed (%d).", i + 1, res);
+		PrintAndLogEx(SUCCESS, "%d transactions in %" PRIu64 " ms, %.0f transactions/s", i, elapsed, elapsed ? i * 1000.0 / elapsed : 0.0);
+	} else {
+		res = EMVExec(channel, activateField, showAPDU, decodeTLV, paramLoadJSON, forceSearch, firstVendorOnly, TrType, GenACGPO);
+	}
+
+	EMVRecordStop();
+	EMVReplayStop();
+
+	return res;
+}
+
 int CmdEMVScan(const char *cmd) {
 	uint8_t AID[APDU_DATA_LEN] = {0};
 	size_t AIDlen = 0;
@@ -1535,7 +1596,7 @@ int CmdEMVScan(const char *cmd) {
 		// EMV SEARCH with AID list
 		SetAPDULogging(false);
 		PrintAndLogEx(NORMAL, "--> AID search.");
-		if (EMVSearch(channel, false, true, decodeTLV, tlvSelect)) {
+		if (EMVSearch(channel, false, true, decodeTLV, false, tlvSelect)) {
 			PrintAndLogEx(ERR, "Can't found any of EMV AID. Exit...");
 			tlvdb_free(tlvSelect);
 			DropFieldEx( channel );
@@ -1750,6 +1811,7 @@ int CmdEMVRoca(const char *cmd) {
 		"Usage:\n"
 			"\temv roca -w -> select --CONTACT-- card and run test\n"
 			"\temv roca -> select --CONTACTLESS-- card and run test\n"
+			"\temv roca -f keys.pem -f card.json -> test the moduli from the files\n"
 	);
 
 	void* argtable[] = {
@@ -1757,6 +1819,8 @@ int CmdEMVRoca(const char *cmd) {
 		arg_lit0("tT",  "selftest",   "self test"),
 		arg_lit0("aA",  "apdu",    "show APDU reqests and responses"),
 		arg_lit0("wW",  "wired",   "Send data via contact (iso7816) interface. Contactless interface set by default."),
+		arg_strx0("fF", "file",    "<file>", "test the RSA moduli from PEM/DER keys or certificates, `emv scan` json files or text files with a hex modulus per line instead of a card"),
+		arg_lit0("vV",  "verbose", "show the result for every modulus from the files"),
 		arg_param_end
 	};
 	CLIExecWithReturn(cmd, argtable, true);
@@ -1765,6 +1829,36 @@ int CmdEMVRoca(const char *cmd) {
 		return roca_self_test();
 	bool showAPDU = arg_get_lit(2);
 
+	struct arg_str *files = arg_get_str(4);
+	if (files->count) {
+		bool verbose = arg_get_lit(5);
+		roca_keys_t keys = {0};
+		for (int i = 0; i < files->count; i++) {
+			if (emv_roca_load_file(files->sval[i], &keys) < 0) {
+				emv_roca_keys_free(&keys);
+				CLIParserFree();
+				return 1;
+			}
+		}
+		CLIParserFree();
+
+		uint64_t start_time = msclock();
+		size_t vulnerable = emv_rocacheck_batch(keys.keys, keys.count, num_CPUs());
+		uint64_t elapsed = msclock() - start_time;
+
+		for (size_t i = 0; i < keys.count; i++) {
+			roca_key_t *key = &keys.keys[i];
+			if (key->vulnerable)
+				PrintAndLogEx(WARNING, "%s: %zu bit modulus is subject to ROCA vulnerability (it is NOT secure).", key->source, key->mlen * 8);
+			else if (verbose)
+				PrintAndLogEx(INFO, "%s: %zu bit modulus is not subject to ROCA vulnerability.", key->source, key->mlen * 8);
+		}
+		PrintAndLogEx(SUCCESS, "Tested %zu moduli in %" PRIu64 " ms, %zu subject to ROCA vulnerability.", keys.count, elapsed, vulnerable);
+
+		emv_roca_keys_free(&keys);
+		return 0;
+	}
+
 	EMVCommandChannel channel = ECC_CONTACTLESS;
 #ifdef WITH_SMARTCARD
 	if (arg_get_lit(3))
@@ -1793,7 +1887,7 @@ int CmdEMVRoca(const char *cmd) {
 	} else {
 		// EMV SEARCH with AID list
 		PrintAndLogEx(NORMAL, "--> AID search.");
-		if (EMVSearch(channel, false, true, false, tlvSelect)) {
+		if (EMVSearch(channel, false, true, false, false, tlvSelect)) {
 			PrintAndLogEx(ERR, "Couldn't find any known EMV AID. Exit...");
 			tlvdb_free(tlvSelect);
 			DropFieldEx( channel );
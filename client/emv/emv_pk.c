@@ -24,11 +24,13 @@
 #include "emv_pk.h"
 #include "crypto.h"
 #include "proxmark3.h"
+#include "ui.h"
 
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 
 #define BCD(c) (((c) >= '0' && (c) <= '9') ? ((c) - '0') : \
 		-1)
@@ -379,6 +381,20 @@ struct emv_pk *emv_pk_new(size_t modlen, size_t explen)
 	return pk;
 }
 
+struct emv_pk *emv_pk_copy(const struct emv_pk *pk)
+{
+	struct emv_pk *copy = emv_pk_new(pk->mlen, pk->elen);
+	if (!copy)
+		return NULL;
+
+	unsigned char *modulus = copy->modulus;
+	*copy = *pk;
+	copy->modulus = modulus;
+	memcpy(copy->modulus, pk->modulus, pk->mlen);
+
+	return copy;
+}
+
 void emv_pk_free(struct emv_pk *pk)
 {
 	if (!pk)
@@ -388,17 +404,76 @@ void emv_pk_free(struct emv_pk *pk)
 	free(pk);
 }
 
-static struct emv_pk *emv_pk_get_ca_pk_from_file(const char *fname,
-		const unsigned char *rid,
-		unsigned char idx)
+// The keys of capk.txt, parsed once and looked up by RID and index. The file
+// is parsed again if it changes.
+#define CAPK_STORE_BUCKETS	64
+
+struct capk_store_entry {
+	struct emv_pk *pk;
+	int verified;			// -1 not yet, else the result of emv_pk_verify()
+	struct capk_store_entry *next;
+};
+
+static struct {
+	char *fname;
+	time_t mtime;
+	off_t size;
+	struct capk_store_entry *buckets[CAPK_STORE_BUCKETS];
+} capk_store;
+
+static unsigned capk_store_bucket(const unsigned char *rid, unsigned char idx)
 {
-	if  (!fname)
-		return NULL;
+	unsigned h = idx;
+	for (int i = 0; i < 5; i++)
+		h = h * 31 + rid[i];
+	return h % CAPK_STORE_BUCKETS;
+}
+
+static struct capk_store_entry *capk_store_find(const unsigned char *rid, unsigned char idx)
+{
+	struct capk_store_entry *entry = capk_store.buckets[capk_store_bucket(rid, idx)];
+	for (; entry; entry = entry->next) {
+		if (!memcmp(entry->pk->rid, rid, 5) && entry->pk->index == idx)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static void capk_store_clear(void)
+{
+	for (int i = 0; i < CAPK_STORE_BUCKETS; i++) {
+		struct capk_store_entry *entry, *next;
+		for (entry = capk_store.buckets[i]; entry; entry = next) {
+			next = entry->next;
+			emv_pk_free(entry->pk);
+			free(entry);
+		}
+		capk_store.buckets[i] = NULL;
+	}
+	free(capk_store.fname);
+	capk_store.fname = NULL;
+}
+
+static bool capk_store_load(const char *fname)
+{
+	struct stat st;
+	if (stat(fname, &st)) {
+		perror("stat");
+		capk_store_clear();
+		return false;
+	}
+
+	if (capk_store.fname && !strcmp(capk_store.fname, fname)
+		&& capk_store.mtime == st.st_mtime && capk_store.size == st.st_size)
+		return true;
+
+	capk_store_clear();
 
 	FILE *f = fopen(fname, "r");
 	if (!f) {
 		perror("fopen");
-		return NULL;
+		return false;
 	}
 
 	while (!feof(f)) {
@@ -409,19 +484,30 @@ static struct emv_pk *emv_pk_get_ca_pk_from_file(const char *fname,
 		struct emv_pk *pk = emv_pk_parse_pk(buf);
 		if (!pk)
 			continue;
-		if (memcmp(pk->rid, rid, 5) || pk->index != idx) {
+
+		// the first key with a RID and index wins
+		struct capk_store_entry *entry = NULL;
+		if (!capk_store_find(pk->rid, pk->index))
+			entry = malloc(sizeof(*entry));
+		if (!entry) {
 			emv_pk_free(pk);
 			continue;
 		}
 
-		fclose(f);
-
-		return pk;
+		unsigned bucket = capk_store_bucket(pk->rid, pk->index);
+		entry->pk = pk;
+		entry->verified = -1;
+		entry->next = capk_store.buckets[bucket];
+		capk_store.buckets[bucket] = entry;
 	}
 
 	fclose(f);
 
-	return NULL;
+	capk_store.fname = strdup(fname);
+	capk_store.mtime = st.st_mtime;
+	capk_store.size = st.st_size;
+
+	return true;
 }
 
 char *emv_pk_get_ca_pk_file(const char *dirname, const unsigned char *rid, unsigned char idx)
@@ -473,52 +559,35 @@ char *emv_pk_get_ca_pk_rid_file(const char *dirname, const unsigned char *rid)
 
 struct emv_pk *emv_pk_get_ca_pk(const unsigned char *rid, unsigned char idx)
 {
-	struct emv_pk *pk = NULL;
+	const char *relfname = "emv/capk.txt"; 
 
-/*	if (!pk) {
-		char *fname = emv_pk_get_ca_pk_file(NULL, rid, idx);
-		if (fname) {
-			pk = emv_pk_get_ca_pk_from_file(fname, rid, idx);
-			free(fname);
-		}
-	}
-
-	if (!pk) {
-		char *fname = emv_pk_get_ca_pk_rid_file(NULL, rid);
-		if (fname) {
-			pk = emv_pk_get_ca_pk_from_file(fname, rid, idx);
-			free(fname);
-		}
-	}
-*/
-	if (!pk) {
-		const char *relfname = "emv/capk.txt"; 
+	char fname[strlen(get_my_executable_directory()) + strlen(relfname) + 1];
+	strcpy(fname, get_my_executable_directory());
+	strcat(fname, relfname);
 
-		char fname[strlen(get_my_executable_directory()) + strlen(relfname) + 1];
-		strcpy(fname, get_my_executable_directory());
-		strcat(fname, relfname);
+	if (!capk_store_load(fname))
+		return NULL;
 
-		pk = emv_pk_get_ca_pk_from_file(fname, rid, idx);
-	}
-	if (!pk)
+	struct capk_store_entry *entry = capk_store_find(rid, idx);
+	if (!entry)
 		return NULL;
+	struct emv_pk *pk = entry->pk;
+
+	if (entry->verified < 0)
+		entry->verified = emv_pk_verify(pk);
 
-	printf("Verifying CA Public Key for %02hhx:%02hhx:%02hhx:%02hhx:%02hhx IDX %02hhx %zd bits...",
+	PrintAndLogEx(NORMAL, "Verifying CA Public Key for %02hhx:%02hhx:%02hhx:%02hhx:%02hhx IDX %02hhx %zd bits...%s",
 				pk->rid[0],
 				pk->rid[1],
 				pk->rid[2],
 				pk->rid[3],
 				pk->rid[4],
 				pk->index,
-				pk->mlen * 8);
-	if (emv_pk_verify(pk)) {
-		printf("OK\n");
-
-		return pk;
-	}
+				pk->mlen * 8,
+				entry->verified ? "OK" : "Failed!");
 
-	printf("Failed!\n");
-	emv_pk_free(pk);
+	if (entry->verified)
+		return emv_pk_copy(pk);
 
 	return NULL;
 }
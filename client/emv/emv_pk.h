@@ -38,6 +38,7 @@ struct emv_pk {
 
 struct emv_pk *emv_pk_parse_pk(char *buf);
 struct emv_pk *emv_pk_new(size_t modlen, size_t explen);
+struct emv_pk *emv_pk_copy(const struct emv_pk *pk);
 void emv_pk_free(struct emv_pk *pk);
 char *emv_pk_dump_pk(const struct emv_pk *pk);
 bool emv_pk_verify(const struct emv_pk *pk);
@@ -37,6 +37,77 @@ static const struct tlv empty_tlv = {.tag = 0x0, .len = 0, .value = empty_tlv_va
 
 static size_t emv_pki_hash_psn[256] = { 0, 0, 11, 2, 17, 2, };
 
+// Opened RSA keys, so the CA and issuer keys used for every card are only set
+// up once. The least recently used key is closed.
+#define EMV_PKI_KEY_CACHE_SIZE		16
+
+static struct {
+	struct emv_pk *pk;
+	struct crypto_pk *kcp;
+	unsigned long used;
+} emv_pki_key_cache[EMV_PKI_KEY_CACHE_SIZE];
+static unsigned long emv_pki_key_cache_clock;
+
+static struct crypto_pk *emv_pki_open_key(const struct emv_pk *pk)
+{
+	int victim = 0;
+	for (int i = 0; i < EMV_PKI_KEY_CACHE_SIZE; i++) {
+		struct emv_pk *cpk = emv_pki_key_cache[i].pk;
+		if (cpk && cpk->pk_algo == pk->pk_algo && cpk->mlen == pk->mlen && cpk->elen == pk->elen
+			&& !memcmp(cpk->modulus, pk->modulus, pk->mlen) && !memcmp(cpk->exp, pk->exp, pk->elen)) {
+			emv_pki_key_cache[i].used = ++emv_pki_key_cache_clock;
+			return emv_pki_key_cache[i].kcp;
+		}
+		if (emv_pki_key_cache[i].used < emv_pki_key_cache[victim].used)
+			victim = i;
+	}
+
+	struct crypto_pk *kcp = crypto_pk_open(pk->pk_algo,
+			pk->modulus, pk->mlen,
+			pk->exp, pk->elen);
+	if (!kcp)
+		return NULL;
+
+	struct emv_pk *cpk = emv_pk_copy(pk);
+	if (!cpk) {
+		crypto_pk_close(kcp);
+		return NULL;
+	}
+
+	emv_pk_free(emv_pki_key_cache[victim].pk);
+	if (emv_pki_key_cache[victim].kcp)
+		crypto_pk_close(emv_pki_key_cache[victim].kcp);
+	emv_pki_key_cache[victim].pk = cpk;
+	emv_pki_key_cache[victim].kcp = kcp;
+	emv_pki_key_cache[victim].used = ++emv_pki_key_cache_clock;
+
+	return kcp;
+}
+
+// Recovered issuer keys by a hash of everything the recovery depends on
+#define EMV_PKI_ISSUER_CACHE_SIZE	32
+
+static struct {
+	unsigned char hash[20];
+	struct emv_pk *pk;
+} emv_pki_issuer_cache[EMV_PKI_ISSUER_CACHE_SIZE];
+static unsigned emv_pki_issuer_cache_next;
+
+static void emv_pki_hash_tlv(struct crypto_hash *ch, const struct tlv *tlv)
+{
+	unsigned char hdr[4] = {0xff, 0xff, 0xff, 0xff};	// missing
+
+	if (tlv) {
+		hdr[0] = tlv->tag >> 8;
+		hdr[1] = tlv->tag;
+		hdr[2] = tlv->len >> 8;
+		hdr[3] = tlv->len;
+	}
+	crypto_hash_write(ch, hdr, sizeof(hdr));
+	if (tlv)
+		crypto_hash_write(ch, tlv->value, tlv->len);
+}
+
 static unsigned char *emv_pki_decode_message(const struct emv_pk *enc_pk,
 		uint8_t msgtype,
 		size_t *len,
@@ -62,14 +133,11 @@ static unsigned char *emv_pki_decode_message(const struct emv_pk *enc_pk,
 		PrintAndLogEx(ERR, "Certificate length (%zd) not equal key length (%zd)\n", cert_tlv->len, enc_pk->mlen);
 		return NULL;
 	}
-	kcp = crypto_pk_open(enc_pk->pk_algo,
-			enc_pk->modulus, enc_pk->mlen,
-			enc_pk->exp, enc_pk->elen);
+	kcp = emv_pki_open_key(enc_pk);
 	if (!kcp)
 		return NULL;
 
 	data = crypto_pk_encrypt(kcp, cert_tlv->value, cert_tlv->len, &data_len);
-	crypto_pk_close(kcp);
 
 	/*if (true){
 		PrintAndLogEx(INFO, "Recovered data:\n");
@@ -290,13 +358,55 @@ static struct emv_pk *emv_pki_decode_key(const struct emv_pk *enc_pk,
 
 struct emv_pk *emv_pki_recover_issuer_cert(const struct emv_pk *pk, struct tlvdb *db)
 {
-	return emv_pki_decode_key(pk, 2,
-			tlvdb_get(db, 0x5a, NULL),
-			tlvdb_get(db, 0x90, NULL),
-			tlvdb_get(db, 0x9f32, NULL),
-			tlvdb_get(db, 0x92, NULL),
+	const struct tlv *pan_tlv = tlvdb_get(db, 0x5a, NULL);
+	const struct tlv *cert_tlv = tlvdb_get(db, 0x90, NULL);
+	const struct tlv *exp_tlv = tlvdb_get(db, 0x9f32, NULL);
+	const struct tlv *rem_tlv = tlvdb_get(db, 0x92, NULL);
+
+	if (!pk)
+		return NULL;
+
+	unsigned char hash[20] = {0};
+	bool hashed = false;
+	struct crypto_hash *ch = crypto_hash_open(HASH_SHA_1);
+	if (ch) {
+		unsigned char strict = strictExecution;
+		crypto_hash_write(ch, pk->rid, sizeof(pk->rid));
+		crypto_hash_write(ch, &pk->index, 1);
+		crypto_hash_write(ch, pk->modulus, pk->mlen);
+		crypto_hash_write(ch, pk->exp, pk->elen);
+		crypto_hash_write(ch, &strict, 1);
+		emv_pki_hash_tlv(ch, pan_tlv);
+		emv_pki_hash_tlv(ch, cert_tlv);
+		emv_pki_hash_tlv(ch, exp_tlv);
+		emv_pki_hash_tlv(ch, rem_tlv);
+		memcpy(hash, crypto_hash_read(ch), sizeof(hash));
+		crypto_hash_close(ch);
+		hashed = true;
+
+		for (int i = 0; i < EMV_PKI_ISSUER_CACHE_SIZE; i++) {
+			if (emv_pki_issuer_cache[i].pk && !memcmp(emv_pki_issuer_cache[i].hash, hash, sizeof(hash)))
+				return emv_pk_copy(emv_pki_issuer_cache[i].pk);
+		}
+	}
+
+	struct emv_pk *issuer_pk = emv_pki_decode_key(pk, 2,
+			pan_tlv,
+			cert_tlv,
+			exp_tlv,
+			rem_tlv,
 			NULL,
 			NULL);
+
+	// failures aren't cached, they print why
+	if (issuer_pk && hashed) {
+		unsigned i = emv_pki_issuer_cache_next++ % EMV_PKI_ISSUER_CACHE_SIZE;
+		emv_pk_free(emv_pki_issuer_cache[i].pk);
+		emv_pki_issuer_cache[i].pk = emv_pk_copy(issuer_pk);
+		memcpy(emv_pki_issuer_cache[i].hash, hash, sizeof(hash));
+	}
+
+	return issuer_pk;
 }
 
 struct emv_pk *emv_pki_recover_icc_cert(const struct emv_pk *pk, struct tlvdb *db, const struct tlv *sda_tlv)
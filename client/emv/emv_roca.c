@@ -26,125 +26,367 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
 
 #include "ui.h"
 #include "util.h"
-#include "mbedtls/bignum.h"
+#include "jansson.h"
+#include "emv_pk.h"
+#include "emvjson.h"
+#include "mbedtls/pk.h"
+#include "mbedtls/rsa.h"
+#include "mbedtls/x509_crt.h"
 
+#define ROCA_GROUPS			4
+#define ROCA_MAX_FILE_SIZE	(64 * 1024 * 1024)
+#define ROCA_BATCH_PER_THREAD	256	// smaller batches are not worth a thread
 
-static uint8_t g_primes[ROCA_PRINTS_LENGTH] = {
+static const uint8_t g_primes[ROCA_PRINTS_LENGTH] = {
 	11, 13, 17, 19, 37, 53, 61, 71, 73, 79, 97, 103, 107, 109, 127, 151, 157
 };
 
-mbedtls_mpi g_prints[ROCA_PRINTS_LENGTH];
+// the fingerprints. Bit r is set if a ROCA modulus can be r mod g_primes[i].
+static const uint64_t g_prints[ROCA_PRINTS_LENGTH][3] = {
+	{ 0x0000000000000402ULL, 0x0000000000000000ULL, 0x0000000000000000ULL }, // 11
+	{ 0x000000000000161aULL, 0x0000000000000000ULL, 0x0000000000000000ULL }, // 13
+	{ 0x000000000001a316ULL, 0x0000000000000000ULL, 0x0000000000000000ULL }, // 17
+	{ 0x0000000000030af2ULL, 0x0000000000000000ULL, 0x0000000000000000ULL }, // 19
+	{ 0x0000000004000402ULL, 0x0000000000000000ULL, 0x0000000000000000ULL }, // 37
+	{ 0x0012dd703303aed2ULL, 0x0000000000000000ULL, 0x0000000000000000ULL }, // 53
+	{ 0x1434026619900b0aULL, 0x0000000000000000ULL, 0x0000000000000000ULL }, // 61
+	{ 0x164729716b1d977eULL, 0x0000000000000001ULL, 0x0000000000000000ULL }, // 71
+	{ 0x811a48004962078aULL, 0x0000000000000147ULL, 0x0000000000000000ULL }, // 73
+	{ 0x4010404000640502ULL, 0x000000000000000bULL, 0x0000000000000000ULL }, // 79
+	{ 0x6000001800000002ULL, 0x0000000100000000ULL, 0x0000000000000000ULL }, // 97
+	{ 0xbd964257768fe396ULL, 0x00000016380e9115ULL, 0x0000000000000000ULL }, // 103
+	{ 0x633397be6a897e1aULL, 0x0000027816ea9821ULL, 0x0000000000000000ULL }, // 107
+	{ 0xb003685cbe7192baULL, 0x00001752639f4e85ULL, 0x0000000000000000ULL }, // 109
+	{ 0xa04c81430a190536ULL, 0x6ca09850c2813205ULL, 0x0000000000000000ULL }, // 127
+	{ 0x1a2412003d18030aULL, 0xbc00482458dac35bULL, 0x000000000050c018ULL }, // 151
+	{ 0x071bd5baca0b7e1aULL, 0xd76af63826461899ULL, 0x00000000161fb414ULL }, // 157
+};
 
-void rocacheck_init(void) {
-	
-	for (int i = 0; i < ROCA_PRINTS_LENGTH; i++)
-		mbedtls_mpi_init(&g_prints[i]);
-	
-	mbedtls_mpi_read_string(&g_prints[0], 10, "1026");
-	mbedtls_mpi_read_string(&g_prints[1], 10, "5658");
-	mbedtls_mpi_read_string(&g_prints[2], 10, "107286");
-	mbedtls_mpi_read_string(&g_prints[3], 10, "199410");
-	mbedtls_mpi_read_string(&g_prints[4], 10, "67109890");
-	mbedtls_mpi_read_string(&g_prints[5], 10, "5310023542746834");
-	mbedtls_mpi_read_string(&g_prints[6], 10, "1455791217086302986");
-	mbedtls_mpi_read_string(&g_prints[7], 10, "20052041432995567486");
-	mbedtls_mpi_read_string(&g_prints[8], 10, "6041388139249378920330");
-	mbedtls_mpi_read_string(&g_prints[9], 10, "207530445072488465666");
-	mbedtls_mpi_read_string(&g_prints[10], 10, "79228162521181866724264247298");
-	mbedtls_mpi_read_string(&g_prints[11], 10, "1760368345969468176824550810518");
-	mbedtls_mpi_read_string(&g_prints[12], 10, "50079290986288516948354744811034");
-	mbedtls_mpi_read_string(&g_prints[13], 10, "473022961816146413042658758988474");
-	mbedtls_mpi_read_string(&g_prints[14], 10, "144390480366845522447407333004847678774");
-	mbedtls_mpi_read_string(&g_prints[15], 10, "1800793591454480341970779146165214289059119882");
-	mbedtls_mpi_read_string(&g_prints[16], 10, "126304807362733370595828809000324029340048915994");
+// The primes multiplied into groups which fit into 32 bits. The modulus is
+// reduced once per group, 32 bits at a time, and the small residues are
+// taken from the group residue.
+static const uint32_t g_groups[ROCA_GROUPS] = {
+	11U * 13 * 17 * 19 * 37 * 53,
+	61U * 71 * 73 * 79 * 97,
+	103U * 107 * 109 * 127,
+	151U * 157,
+};
+
+static const uint8_t g_group_of_prime[ROCA_PRINTS_LENGTH] = {
+	0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3
+};
+
+static bool rocacheck(const unsigned char *buf, size_t buflen) {
+	uint64_t r[ROCA_GROUPS] = {0};
+
+	// the bytes before the first full word
+	size_t head = buflen % 4;
+	if (head) {
+		uint32_t w = 0;
+		for (size_t i = 0; i < head; i++)
+			w = (w << 8) | buf[i];
+		for (int g = 0; g < ROCA_GROUPS; g++)
+			r[g] = w % g_groups[g];
+	}
+
+	for (size_t i = head; i < buflen; i += 4) {
+		uint64_t w = ((uint32_t)buf[i] << 24) | ((uint32_t)buf[i + 1] << 16) | ((uint32_t)buf[i + 2] << 8) | buf[i + 3];
+		for (int g = 0; g < ROCA_GROUPS; g++)
+			r[g] = ((r[g] << 32) | w) % g_groups[g];
+	}
+
+	for (int i = 0; i < ROCA_PRINTS_LENGTH; i++) {
+		uint32_t residue = r[g_group_of_prime[i]] % g_primes[i];
+		if (!(g_prints[i][residue / 64] & (1ULL << (residue % 64))))
+			return false;
+	}
+
+	return true;
+}
+
+bool emv_rocacheck(const unsigned char *buf, size_t buflen, bool verbose) {
+
+	bool ret = rocacheck(buf, buflen);
+
+	if (verbose) {
+		if (ret)
+			PrintAndLogEx(SUCCESS, "Fingerprint found!\n");
+		else
+			PrintAndLogEx(FAILED, "No fingerprint found.\n");
+	}
+
+	return ret;
 }
 
-void rocacheck_cleanup(void) {
-	for (int i = 0; i < ROCA_PRINTS_LENGTH; i++)
-		mbedtls_mpi_free(&g_prints[i]);
+typedef struct {
+	roca_key_t *keys;
+	size_t count;
+} roca_batch_t;
+
+static void *rocacheck_batch_thread(void *arg) {
+	roca_batch_t *batch = (roca_batch_t *)arg;
+
+	for (size_t i = 0; i < batch->count; i++)
+		batch->keys[i].vulnerable = rocacheck(batch->keys[i].modulus, batch->keys[i].mlen);
+
+	return NULL;
 }
 
-int bitand_is_zero(	mbedtls_mpi* a, mbedtls_mpi* b ) {
+size_t emv_rocacheck_batch(roca_key_t *keys, size_t count, int threads) {
+	if (threads < 1)
+		threads = 1;
+	if ((size_t)threads > count / ROCA_BATCH_PER_THREAD)
+		threads = count / ROCA_BATCH_PER_THREAD;
 
-	for (int i = 0; i < mbedtls_mpi_bitlen(a); i++) {
-	
-		if (mbedtls_mpi_get_bit(a, i) && mbedtls_mpi_get_bit(b, i))
-			return 0;
+	if (threads <= 1) {
+		roca_batch_t batch = {keys, count};
+		rocacheck_batch_thread(&batch);
+	} else {
+		pthread_t thread_id[threads];
+		roca_batch_t batch[threads];
+		size_t start = 0;
+		for (int i = 0; i < threads; i++) {
+			batch[i].keys = &keys[start];
+			batch[i].count = count / threads + ((size_t)i < count % threads ? 1 : 0);
+			start += batch[i].count;
+			pthread_create(&thread_id[i], NULL, rocacheck_batch_thread, &batch[i]);
+		}
+		for (int i = 0; i < threads; i++)
+			pthread_join(thread_id[i], NULL);
 	}
-	return 1;
+
+	size_t vulnerable = 0;
+	for (size_t i = 0; i < count; i++)
+		if (keys[i].vulnerable)
+			vulnerable++;
+
+	return vulnerable;
 }
 
+static bool roca_add_key(roca_keys_t *keys, const char *filename, size_t item, const unsigned char *modulus, size_t mlen) {
+	// leading zeros don't change the residues
+	while (mlen && !*modulus) {
+		modulus++;
+		mlen--;
+	}
+	if (!mlen || mlen > ROCA_MAX_MODULUS_LEN)
+		return false;
 
-mbedtls_mpi_uint mpi_get_uint(const mbedtls_mpi *X) {
-	
-	if (X->n == 1 && X->s > 0) {
-		return X->p[0];
+	if (keys->count == keys->size) {
+		size_t size = keys->size ? keys->size * 2 : 64;
+		roca_key_t *k = realloc(keys->keys, size * sizeof(roca_key_t));
+		if (!k)
+			return false;
+		keys->keys = k;
+		keys->size = size;
 	}
-	printf("ZERRRRO!!!\n");
-	return 0;
+
+	roca_key_t *key = &keys->keys[keys->count++];
+	const char *name = strrchr(filename, '/');
+	snprintf(key->source, sizeof(key->source), "%s#%zu", name ? name + 1 : filename, item);
+	memcpy(key->modulus, modulus, mlen);
+	key->mlen = mlen;
+	key->vulnerable = false;
+
+	return true;
 }
 
-void print_mpi(const char *msg, int radix, const mbedtls_mpi *X) {
-	
-	char Xchar[400] = {0};
-	size_t len = 0;
-	
-	mbedtls_mpi_write_string(X, radix, Xchar, sizeof(Xchar), &len);	
-	printf("%s[%zd] %s\n", msg, len, Xchar);	
+static bool roca_add_pk(roca_keys_t *keys, const char *filename, size_t item, mbedtls_pk_context *pk) {
+	if (mbedtls_pk_get_type(pk) != MBEDTLS_PK_RSA)
+		return false;
+
+	mbedtls_rsa_context *rsa = mbedtls_pk_rsa(*pk);
+	unsigned char modulus[ROCA_MAX_MODULUS_LEN];
+	size_t mlen = mbedtls_mpi_size(&rsa->N);
+	if (mlen > sizeof(modulus) || mbedtls_mpi_write_binary(&rsa->N, modulus, mlen))
+		return false;
+
+	return roca_add_key(keys, filename, item, modulus, mlen);
 }
 
-bool emv_rocacheck(const unsigned char *buf, size_t buflen, bool verbose) {
+// one DER or NUL terminated PEM public key, private key or certificate
+static bool roca_add_encoded(roca_keys_t *keys, const char *filename, size_t item, const unsigned char *buf, size_t len) {
+	bool res = false;
+
+	mbedtls_pk_context pk;
+	mbedtls_pk_init(&pk);
+	if (!mbedtls_pk_parse_public_key(&pk, buf, len) || !mbedtls_pk_parse_key(&pk, buf, len, NULL, 0)) {
+		res = roca_add_pk(keys, filename, item, &pk);
+		mbedtls_pk_free(&pk);
+		return res;
+	}
+	mbedtls_pk_free(&pk);
 
-	mbedtls_mpi t_modulus;
-	mbedtls_mpi_init(&t_modulus);
+	mbedtls_x509_crt crt;
+	mbedtls_x509_crt_init(&crt);
+	if (!mbedtls_x509_crt_parse(&crt, buf, len))
+		res = roca_add_pk(keys, filename, item, &crt.pk);
+	mbedtls_x509_crt_free(&crt);
 
-	bool ret = false;
+	return res;
+}
 
-	rocacheck_init();
+static int roca_load_pem(roca_keys_t *keys, const char *filename, char *data) {
+	int count = 0;
+	size_t item = 0;
 
-	MBEDTLS_MPI_CHK( mbedtls_mpi_read_binary(&t_modulus, buf, buflen) );
-	
-	for (int i = 0; i < ROCA_PRINTS_LENGTH; i++) {
+	char *begin = strstr(data, "-----BEGIN ");
+	while (begin) {
+		char *end = strstr(begin, "-----END ");
+		if (!end)
+			break;
+		end = strstr(end + 9, "-----");
+		if (!end)
+			break;
+		end += 5;
+
+		char c = *end;
+		*end = 0x00;
+		if (roca_add_encoded(keys, filename, ++item, (unsigned char *)begin, end - begin + 1))
+			count++;
+		*end = c;
+
+		begin = strstr(end, "-----BEGIN ");
+	}
+
+	return count;
+}
+
+// `emv scan` output
+static int roca_load_json(roca_keys_t *keys, const char *filename, const char *data, size_t len) {
+	json_error_t error;
+	json_t *root = json_loadb(data, len, 0, &error);
+	if (!root) {
+		PrintAndLogEx(ERR, "%s: json error on line %d: %s", filename, error.line, error.text);
+		return -1;
+	}
+
+	int count = 0;
+	char *paths[] = {"$.ApplicationData.ICCPublicKeyModulus", "$.ApplicationData.IssuerPublicKeyModulus"};
+	for (int i = 0; i < 2; i++) {
+		uint8_t modulus[ROCA_MAX_MODULUS_LEN];
+		size_t mlen = 0;
+		if (!JsonLoadBufAsHex(root, paths[i], modulus, sizeof(modulus), &mlen) && roca_add_key(keys, filename, i + 1, modulus, mlen))
+			count++;
+	}
+
+	json_decref(root);
+	return count;
+}
+
+// one modulus per line in hex, or lines of capk.txt
+static int roca_load_text(roca_keys_t *keys, const char *filename, char *data) {
+	int count = 0;
+	size_t lineno = 0;
+
+	for (char *line = strtok(data, "\r\n"); line; line = strtok(NULL, "\r\n")) {
+		lineno++;
+		while (isspace((unsigned char)*line))
+			line++;
+		if (!*line || *line == '#')
+			continue;
+
+		struct emv_pk *pk = emv_pk_parse_pk(line);
+		if (pk) {
+			if (roca_add_key(keys, filename, lineno, pk->modulus, pk->mlen))
+				count++;
+			emv_pk_free(pk);
+			continue;
+		}
+
+		uint8_t modulus[ROCA_MAX_MODULUS_LEN];
+		size_t mlen = 0;
+		int nibbles = 0;
+		char *p;
+		for (p = line; *p; p++) {
+			if (isspace((unsigned char)*p) || *p == ':')
+				continue;
+			if (!isxdigit((unsigned char)*p) || mlen == sizeof(modulus))
+				break;
+			int v = isdigit((unsigned char)*p) ? *p - '0' : tolower((unsigned char)*p) - 'a' + 10;
+			if (nibbles++ % 2)
+				modulus[mlen++] |= v;
+			else
+				modulus[mlen] = v << 4;
+		}
+		if (*p || nibbles % 2) {
+			PrintAndLogEx(WARNING, "%s: line %zu is not a hex modulus. Skipped.", filename, lineno);
+			continue;
+		}
 
-		mbedtls_mpi t_temp;
-		mbedtls_mpi t_prime;
-		mbedtls_mpi g_one;
-		
-		mbedtls_mpi_init(&t_temp);
-		mbedtls_mpi_init(&t_prime);
-		mbedtls_mpi_init(&g_one);
-
-		MBEDTLS_MPI_CHK( mbedtls_mpi_read_string(&g_one, 10, "1") );
-
-		MBEDTLS_MPI_CHK( mbedtls_mpi_add_int(&t_prime, &t_prime, g_primes[i]) );
-		
-		MBEDTLS_MPI_CHK( mbedtls_mpi_mod_mpi(&t_temp, &t_modulus, &t_prime) ); 
-		
-		MBEDTLS_MPI_CHK( mbedtls_mpi_shift_l(&g_one, mpi_get_uint(&t_temp)) );
-		
-		if (bitand_is_zero(&g_one, &g_prints[i])) {
-			if (verbose)
-				PrintAndLogEx(FAILED, "No fingerprint found.\n");
-			goto cleanup;
+		if (roca_add_key(keys, filename, lineno, modulus, mlen))
+			count++;
+	}
+
+	return count;
+}
+
+int emv_roca_load_file(const char *filename, roca_keys_t *keys) {
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		PrintAndLogEx(ERR, "Could not open file %s", filename);
+		return -1;
+	}
+
+	fseek(f, 0, SEEK_END);
+	long fsize = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (fsize < 0 || fsize > ROCA_MAX_FILE_SIZE) {
+		PrintAndLogEx(ERR, "%s: wrong file size %ld", filename, fsize);
+		fclose(f);
+		return -1;
+	}
+
+	char *data = malloc(fsize + 1);
+	if (!data || fread(data, 1, fsize, f) != (size_t)fsize) {
+		PrintAndLogEx(ERR, "%s: read error", filename);
+		free(data);
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	data[fsize] = 0x00;
+
+	bool binary = false;
+	for (long i = 0; i < fsize; i++) {
+		if (!isprint((unsigned char)data[i]) && !isspace((unsigned char)data[i])) {
+			binary = true;
+			break;
 		}
-		
-		mbedtls_mpi_free(&g_one);		
-		mbedtls_mpi_free(&t_temp);
-		mbedtls_mpi_free(&t_prime);
 	}
 
-	ret = true;
-	if (verbose)
-		PrintAndLogEx(SUCCESS, "Fingerprint found!\n");
+	const char *first = data;
+	while (isspace((unsigned char)*first))
+		first++;
 
-cleanup:
-	mbedtls_mpi_free(&t_modulus);
+	int count;
+	if (binary) {
+		count = roca_add_encoded(keys, filename, 1, (unsigned char *)data, fsize) ? 1 : 0;
+	} else if (strstr(data, "-----BEGIN ")) {
+		count = roca_load_pem(keys, filename, data);
+	} else if (*first == '{') {
+		count = roca_load_json(keys, filename, data, fsize);
+	} else {
+		count = roca_load_text(keys, filename, data);
+	}
 
-	rocacheck_cleanup();
-	return ret;
+	free(data);
+	return count;
+}
+
+void emv_roca_keys_free(roca_keys_t *keys) {
+	free(keys->keys);
+	keys->keys = NULL;
+	keys->count = 0;
+	keys->size = 0;
 }
 
 int roca_self_test( void ) {
@@ -180,5 +422,22 @@ int roca_self_test( void ) {
 		PrintAndLogEx(SUCCESS, "Strong modulus [ %s]", _GREEN_(PASS) );	
 	}
 
+	// batch, with enough keys for several threads
+	roca_keys_t keys = {0};
+	for (int i = 0; i < 4 * ROCA_BATCH_PER_THREAD; i++)
+		roca_add_key(&keys, "selftest", i, (i % 2) ? keyn : keyp, 64);
+
+	bool batch_ok = keys.count == 4 * ROCA_BATCH_PER_THREAD && emv_rocacheck_batch(keys.keys, keys.count, 4) == keys.count / 2;
+	for (size_t i = 0; batch_ok && i < keys.count; i++)
+		batch_ok = keys.keys[i].vulnerable == !(i % 2);
+	emv_roca_keys_free(&keys);
+
+	if (batch_ok) {
+		PrintAndLogEx(SUCCESS, "Batch [ %s]", _GREEN_(PASS) );
+	} else {
+		ret++;
+		PrintAndLogEx(FAILED, "Batch [ %s]", _RED_(FAIL) );
+	}
+
 	return ret;
 }
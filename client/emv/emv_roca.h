@@ -28,8 +28,29 @@
 #include <stdbool.h>
 
 #define ROCA_PRINTS_LENGTH	17
+#define ROCA_MAX_MODULUS_LEN	512	// 4096 bit
+
+typedef struct {
+	char source[64];	// file name and line or item number
+	unsigned char modulus[ROCA_MAX_MODULUS_LEN];
+	size_t mlen;
+	bool vulnerable;	// set by emv_rocacheck_batch()
+} roca_key_t;
+
+typedef struct {
+	roca_key_t *keys;
+	size_t count;
+	size_t size;
+} roca_keys_t;
 
 extern bool emv_rocacheck( const unsigned char *buf, size_t buflen, bool verbose );
+// checks all <keys> with up to <threads> threads. Returns the number of vulnerable keys.
+extern size_t emv_rocacheck_batch( roca_key_t *keys, size_t count, int threads );
+// adds the RSA moduli of a PEM/DER key or certificate file, an `emv scan` json file or
+// a text file with a hex modulus or a capk.txt line per line to <keys>.
+// Returns the number of moduli found, or -1.
+extern int emv_roca_load_file( const char *filename, roca_keys_t *keys );
+extern void emv_roca_keys_free( roca_keys_t *keys );
 extern int roca_self_test( void );
 
 #endif
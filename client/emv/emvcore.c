@@ -10,6 +10,8 @@
 
 #include "emvcore.h"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "emvjson.h"
 #include "util_posix.h"
@@ -138,13 +140,236 @@ static const TAIDList AIDlist [] = {
 };
 static const size_t AIDlistLen = sizeof(AIDlist)/sizeof(TAIDList);
 
+// SELECTs of the AID search which are sent to a contactless card at once
+#define EMV_SEARCH_PIPELINE 8
+
 static bool APDULogging = false;
 void SetAPDULogging(bool logging) {
 	APDULogging = logging;
 }
 
+// APDU log. Requests and answers (with SW) as hex lines starting with ">> " and "<< ",
+// "!! <code>" instead of the answer for an exchange which failed with that error code,
+// "--" for an activation of the card.
+typedef struct {
+	uint8_t *request;                   // NULL for an activation
+	size_t requestlen;
+	uint8_t *response;
+	size_t responselen;
+	int error;                          // the exchange failed with this code
+	bool answered;
+} APDULogElm;
+
+static FILE *RecordFile = NULL;
+static APDULogElm *ReplayLog = NULL;
+static size_t ReplayLogLen = 0;
+static size_t ReplayPos = 0;
+static bool Replaying = false;
+
+static void RecordHex(const char *prefix, const uint8_t *data, size_t len) {
+	fprintf(RecordFile, "%s", prefix);
+	for (size_t i = 0; i < len; i++)
+		fprintf(RecordFile, "%02X", data[i]);
+	fprintf(RecordFile, "\n");
+}
+
+static void EMVRecordActivation(void) {
+	if (RecordFile)
+		fprintf(RecordFile, "--\n");
+}
+
+static void EMVRecordExchange(uint8_t *apdu, int apdu_len, int res, uint8_t *Result, size_t ResultLen) {
+	if (RecordFile) {
+		RecordHex(">> ", apdu, apdu_len);
+		if (res)
+			fprintf(RecordFile, "!! %d\n", res);
+		else
+			RecordHex("<< ", Result, ResultLen);
+	}
+}
+
+int EMVRecordStart(const char *filename) {
+	EMVRecordStop();
+	RecordFile = fopen(filename, "w");
+	if (!RecordFile) {
+		PrintAndLogEx(ERR, "Can't create APDU log file %s", filename);
+		return 1;
+	}
+	fprintf(RecordFile, "# proxmark3 EMV APDU log\n");
+	return 0;
+}
+
+void EMVRecordStop(void) {
+	if (RecordFile)
+		fclose(RecordFile);
+	RecordFile = NULL;
+}
+
+int EMVReplayStart(const char *filename) {
+	EMVReplayStop();
+
+	FILE *f = fopen(filename, "r");
+	if (!f) {
+		PrintAndLogEx(ERR, "Can't open APDU log file %s", filename);
+		return 1;
+	}
+
+	char line[4096 * 2 + 16];
+	uint8_t data[4096];
+	size_t size = 0;
+	int lineno = 0;
+	int res = 0;
+	while (fgets(line, sizeof(line), f)) {
+		lineno++;
+		line[strcspn(line, "\r\n")] = 0x00;
+		if (line[0] == '#' || line[0] == 0x00)
+			continue;
+
+		if (ReplayLogLen == size) {
+			size = size ? size * 2 : 64;
+			APDULogElm *log = realloc(ReplayLog, size * sizeof(APDULogElm));
+			if (!log) {
+				res = 1;
+				break;
+			}
+			ReplayLog = log;
+		}
+
+		APDULogElm *elm = &ReplayLog[ReplayLogLen];
+		if (!strncmp(line, "--", 2)) {
+			memset(elm, 0, sizeof(APDULogElm));
+			ReplayLogLen++;
+			continue;
+		}
+
+		APDULogElm *prev = ReplayLogLen ? &ReplayLog[ReplayLogLen - 1] : NULL;
+		bool can_answer = prev && prev->request && !prev->answered;
+		if (!strncmp(line, "!! ", 3)) {
+			int error = atoi(line + 3);
+			if (!can_answer || error == 0) {
+				PrintAndLogEx(ERR, "%s:%d: wrong error line", filename, lineno);
+				res = 1;
+				break;
+			}
+			prev->error = error;
+			prev->answered = true;
+			continue;
+		}
+
+		int len = 0;
+		bool request = !strncmp(line, ">> ", 3);
+		if ((!request && strncmp(line, "<< ", 3)) || param_gethex_to_eol(line + 3, 0, data, sizeof(data), &len)) {
+			PrintAndLogEx(ERR, "%s:%d: wrong line", filename, lineno);
+			res = 1;
+			break;
+		}
+
+		uint8_t *copy = malloc(len ? len : 1);
+		memcpy(copy, data, len);
+		if (request) {
+			memset(elm, 0, sizeof(APDULogElm));
+			elm->request = copy;
+			elm->requestlen = len;
+		} else if (can_answer) {
+			prev->response = copy;
+			prev->responselen = len;
+			prev->answered = true;
+			continue;
+		} else {
+			free(copy);
+			PrintAndLogEx(ERR, "%s:%d: answer without request", filename, lineno);
+			res = 1;
+			break;
+		}
+		ReplayLogLen++;
+	}
+	fclose(f);
+
+	// every request needs its answer
+	for (size_t i = 0; !res && i < ReplayLogLen; i++) {
+		if (ReplayLog[i].request && !ReplayLog[i].answered) {
+			PrintAndLogEx(ERR, "%s: request without answer: %s", filename, sprint_hex(ReplayLog[i].request, ReplayLog[i].requestlen));
+			res = 1;
+		}
+	}
+
+	if (res) {
+		EMVReplayStop();
+		return res;
+	}
+
+	Replaying = true;
+	ReplayPos = 0;
+	return 0;
+}
+
+void EMVReplayStop(void) {
+	for (size_t i = 0; i < ReplayLogLen; i++) {
+		free(ReplayLog[i].request);
+		free(ReplayLog[i].response);
+	}
+	free(ReplayLog);
+	ReplayLog = NULL;
+	ReplayLogLen = 0;
+	ReplayPos = 0;
+	Replaying = false;
+}
+
+bool EMVReplaying(void) {
+	return Replaying;
+}
+
+// continue after the next recorded activation, or after the first one again
+static void EMVReplayActivation(void) {
+	size_t i = ReplayPos;
+	while (i < ReplayLogLen && ReplayLog[i].request)
+		i++;
+	if (i == ReplayLogLen) {
+		i = 0;
+		while (i < ReplayLogLen && ReplayLog[i].request)
+			i++;
+	}
+	ReplayPos = (i == ReplayLogLen) ? 0 : i + 1;
+}
+
+// The answer to the same request at the current position or later, up to the next activation. Requests with
+// different data (e.g. other terminal parameters) get the answer to the next request with the same header.
+static int EMVReplayExchange(uint8_t *apdu, int apdu_len, uint8_t *Result, size_t MaxResultLen, size_t *ResultLen) {
+	size_t found = ReplayLogLen;
+	for (size_t i = ReplayPos; i < ReplayLogLen && ReplayLog[i].request; i++) {
+		if (ReplayLog[i].requestlen == apdu_len && !memcmp(ReplayLog[i].request, apdu, apdu_len)) {
+			found = i;
+			break;
+		}
+	}
+	for (size_t i = ReplayPos; found == ReplayLogLen && i < ReplayLogLen && ReplayLog[i].request; i++) {
+		if (apdu_len >= 4 && ReplayLog[i].requestlen >= 4 && !memcmp(ReplayLog[i].request, apdu, 4))
+			found = i;
+	}
+
+	if (found == ReplayLogLen) {
+		PrintAndLogEx(ERR, "APDU replay: no answer recorded for %s", sprint_hex(apdu, apdu_len));
+		return 4;
+	}
+
+	APDULogElm *elm = &ReplayLog[found];
+	if (elm->error) {
+		ReplayPos = found + 1;
+		return elm->error;
+	}
+	if (elm->responselen > MaxResultLen) {
+		PrintAndLogEx(ERR, "APDU replay: buffer too small(%zu). Needs %zu bytes", MaxResultLen, elm->responselen);
+		return 2;
+	}
+
+	memcpy(Result, elm->response, elm->responselen);
+	*ResultLen = elm->responselen;
+	ReplayPos = found + 1;
+	return 0;
+}
+
 void DropFieldEx(EMVCommandChannel channel) {
-	if (channel == ECC_CONTACTLESS) {
+	if (channel == ECC_CONTACTLESS && !Replaying) {
 		DropField();
 	}
 }
@@ -180,7 +405,9 @@ bool TLVPrintFromBuffer(uint8_t *data, int datalen) {
 	if (t) {
 		PrintAndLogEx(NORMAL, "-------------------- TLV decoded --------------------");
 
-		tlvdb_visit(t, print_cb, NULL, 0);
+		// the dump goes to stdout directly, not through PrintAndLog()
+		if (!GetSilentMode())
+			tlvdb_visit(t, print_cb, NULL, 0);
 		tlvdb_free(t);
 		return true;
 	} else {
@@ -190,7 +417,7 @@ bool TLVPrintFromBuffer(uint8_t *data, int datalen) {
 }
 
 void TLVPrintFromTLVLev(struct tlvdb *tlv, int level) {
-	if (!tlv)
+	if (!tlv || GetSilentMode())
 		return;
 
 	tlvdb_visit(tlv, print_cb, NULL, level);
@@ -287,34 +514,68 @@ struct tlvdb *GetdCVVRawFromTrack2(const struct tlv *track2) {
 }
 
 
+// SW and TLV of the answer <Result> to <apdu>
+static int EMVExchangeResult(uint8_t *apdu, uint8_t *Result, size_t *ResultLen, uint16_t *sw, struct tlvdb *tlv)
+{
+	*ResultLen -= 2;
+
+	uint16_t isw = Result[*ResultLen] * 0x0100 + Result[*ResultLen + 1];
+	if (sw)
+		*sw = isw;
+
+	if (isw != 0x9000) {
+		if (APDULogging) {
+			PrintAndLogEx(ERR, "APDU(%02x%02x) ERROR: [%4X] %s", apdu[0], apdu[1], isw, GetAPDUCodeDescription(isw >> 8, isw & 0xff));
+			return 5;
+		}
+	}
+
+	// add to tlv tree
+	if (tlv) {
+		struct tlvdb *t = tlvdb_parse_multi(Result, *ResultLen);
+		tlvdb_add(tlv, t);
+	}
+
+	return 0;
+}
+
 int EMVExchangeEx(EMVCommandChannel channel, bool ActivateField, bool LeaveFieldON, uint8_t *apdu, int apdu_len, uint8_t *Result, size_t MaxResultLen, size_t *ResultLen, uint16_t *sw, struct tlvdb *tlv)
 {
 	*ResultLen = 0;
 	if (sw) *sw = 0;
-	uint16_t isw = 0;
 	int res = 0;
 
 	if (ActivateField) {
 		DropFieldEx( channel );
-		msleep(50);
+		if (Replaying)
+			EMVReplayActivation();
+		else
+			msleep(50);
+		EMVRecordActivation();
 	}
 
 	if (APDULogging)
 		PrintAndLogEx(SUCCESS, ">>>> %s", sprint_hex(apdu, apdu_len));
 
+	if (Replaying) {
+		res = EMVReplayExchange(apdu, apdu_len, Result, MaxResultLen, ResultLen);
+	} else {
 #ifdef WITH_SMARTCARD
-	switch(channel) {
-		case ECC_CONTACTLESS:
-			// 6 byes + data = INS + CLA + P1 + P2 + Lc + <data = Nc> + Le(?IncludeLe)
-			res = ExchangeAPDU14a(apdu, apdu_len, ActivateField, LeaveFieldON, Result, (int)MaxResultLen, (int *)ResultLen);
-			break;
-		case ECC_CONTACT:
-			res = ExchangeAPDUSC(apdu, apdu_len, ActivateField, LeaveFieldON, Result, (int)MaxResultLen, (int *)ResultLen);
-			break;
-	}
+		switch(channel) {
+			case ECC_CONTACTLESS:
+				// 6 byes + data = INS + CLA + P1 + P2 + Lc + <data = Nc> + Le(?IncludeLe)
+				res = ExchangeAPDU14a(apdu, apdu_len, ActivateField, LeaveFieldON, Result, (int)MaxResultLen, (int *)ResultLen);
+				break;
+			case ECC_CONTACT:
+				res = ExchangeAPDUSC(apdu, apdu_len, ActivateField, LeaveFieldON, Result, (int)MaxResultLen, (int *)ResultLen);
+				break;
+		}
 #else
-	res = ExchangeAPDU14a(apdu, apdu_len, ActivateField, LeaveFieldON, Result, (int)MaxResultLen, (int *)ResultLen);
+		res = ExchangeAPDU14a(apdu, apdu_len, ActivateField, LeaveFieldON, Result, (int)MaxResultLen, (int *)ResultLen);
 #endif
+	}
+
+	EMVRecordExchange(apdu, apdu_len, res, Result, *ResultLen);
 
 	if (res) {
 		return res;
@@ -337,26 +598,7 @@ int EMVExchangeEx(EMVCommandChannel channel, bool ActivateField, bool LeaveField
 
 	if (res) return res;
 
-	*ResultLen -= 2;
-
-	isw = Result[*ResultLen] * 0x0100 + Result[*ResultLen + 1];
-	if (sw)
-		*sw = isw;
-
-	if (isw != 0x9000) {
-		if (APDULogging) {
-			PrintAndLogEx(ERR, "APDU(%02x%02x) ERROR: [%4X] %s", apdu[0], apdu[1], isw, GetAPDUCodeDescription(*sw >> 8, *sw & 0xff));
-			return 5;
-		}
-	}
-
-	// add to tlv tree
-	if (tlv) {
-		struct tlvdb *t = tlvdb_parse_multi(Result, *ResultLen);
-		tlvdb_add(tlv, t);
-	}
-
-	return 0;
+	return EMVExchangeResult(apdu, Result, ResultLen, sw, tlv);
 }
 
 static int EMVExchange(EMVCommandChannel channel, bool LeaveFieldON, uint8_t *apdu, int apdu_len, uint8_t *Result, size_t MaxResultLen, size_t *ResultLen, uint16_t *sw, struct tlvdb *tlv)
@@ -376,14 +618,23 @@ static int EMVExchange(EMVCommandChannel channel, bool LeaveFieldON, uint8_t *ap
 	return EMVExchangeEx(channel, false, LeaveFieldON, APDU, apdu_len, Result, MaxResultLen, ResultLen, sw, tlv);
 }
 
-int EMVSelect(EMVCommandChannel channel, bool ActivateField, bool LeaveFieldON, uint8_t *AID, size_t AIDLen, uint8_t *Result, size_t MaxResultLen, size_t *ResultLen, uint16_t *sw, struct tlvdb *tlv)
+static int EMVSelectAPDU(EMVCommandChannel channel, uint8_t *AID, size_t AIDLen, uint8_t *Select_APDU)
 {
-	uint8_t Select_APDU[APDU_COMMAND_LEN] = {0x00, ISO7816_SELECT_FILE, 0x04, 0x00, AIDLen, 0x00};
+	uint8_t header[] = {0x00, ISO7816_SELECT_FILE, 0x04, 0x00, AIDLen};
+	memcpy(Select_APDU, header, sizeof(header));
 	memcpy(Select_APDU + 5, AID, AIDLen);
+	Select_APDU[5 + AIDLen] = 0x00;
 	int apdulen = 5 + AIDLen;
 	if (channel == ECC_CONTACTLESS) {
 		apdulen++;  // some vendors require Le = 0x00 for contactless operations
 	}
+	return apdulen;
+}
+
+int EMVSelect(EMVCommandChannel channel, bool ActivateField, bool LeaveFieldON, uint8_t *AID, size_t AIDLen, uint8_t *Result, size_t MaxResultLen, size_t *ResultLen, uint16_t *sw, struct tlvdb *tlv)
+{
+	uint8_t Select_APDU[APDU_COMMAND_LEN];
+	int apdulen = EMVSelectAPDU(channel, AID, AIDLen, Select_APDU);
 	return EMVExchangeEx(channel, ActivateField, LeaveFieldON, Select_APDU, apdulen, Result, MaxResultLen, ResultLen, sw, tlv);
 }
 
@@ -472,19 +723,93 @@ int EMVCheckAID(EMVCommandChannel channel, bool decodeTLV, struct tlvdb *tlvdbel
 }
 
 
+// PSE/PPSE directories of contactless cards read in this session
+#define PSE_CACHE_SIZE 8
+
+typedef struct {
+	uint8_t uid[10];
+	uint8_t uidlen;
+	uint8_t PSENum;
+	uint8_t data[APDU_RESPONSE_LEN];            // answer to the PSE/PPSE SELECT
+	size_t datalen;
+	uint8_t sfidata[0x11][APDU_RESPONSE_LEN];   // directory records
+	size_t sfidatalen[0x11];
+} PSECacheElm;
+
+static PSECacheElm PSECache[PSE_CACHE_SIZE];
+static int PSECacheLen = 0;
+static int PSECacheNext = 0;
+
+static PSECacheElm *PSECacheFind(iso14a_card_select_t *card, uint8_t PSENum) {
+	for (int i = 0; i < PSECacheLen; i++) {
+		if (PSECache[i].PSENum == PSENum && PSECache[i].uidlen == card->uidlen && !memcmp(PSECache[i].uid, card->uid, card->uidlen))
+			return &PSECache[i];
+	}
+	return NULL;
+}
+
+static void PSECacheAdd(iso14a_card_select_t *card, uint8_t PSENum, uint8_t *data, size_t datalen, uint8_t sfidata[][APDU_RESPONSE_LEN], size_t *sfidatalen) {
+	// random UIDs are new on every activation
+	if (card->uidlen == 4 && card->uid[0] == 0x08)
+		return;
+	if (card->uidlen > sizeof(PSECache[0].uid))
+		return;
+
+	PSECacheElm *elm = PSECacheFind(card, PSENum);
+	if (!elm) {
+		elm = &PSECache[PSECacheNext];
+		PSECacheNext = (PSECacheNext + 1) % PSE_CACHE_SIZE;
+		if (PSECacheLen < PSE_CACHE_SIZE)
+			PSECacheLen++;
+	}
+
+	memcpy(elm->uid, card->uid, card->uidlen);
+	elm->uidlen = card->uidlen;
+	elm->PSENum = PSENum;
+	memcpy(elm->data, data, datalen);
+	elm->datalen = datalen;
+	memcpy(elm->sfidata, sfidata, sizeof(elm->sfidata));
+	memcpy(elm->sfidatalen, sfidatalen, sizeof(elm->sfidatalen));
+}
+
 int EMVSearchPSE(EMVCommandChannel channel, bool ActivateField, bool LeaveFieldON, uint8_t PSENum, bool decodeTLV, struct tlvdb *tlv) {
 	uint8_t data[APDU_RESPONSE_LEN] = {0};
 	size_t datalen = 0;
 	uint8_t sfidata[0x11][APDU_RESPONSE_LEN] = {0};
 	size_t sfidatalen[0x11] = {0};
 	uint16_t sw = 0;
-	int res;
+	int res = 0;
 	bool fileFound = false;
 
 	char *PSE_or_PPSE = PSENum == 1 ? "PSE" : "PPSE";
 
+	// the directory of a contactless card is read once per session. The UID is known after the activation.
+	iso14a_card_select_t card;
+	bool cardKnown = false;
+	PSECacheElm *cached = NULL;
+	if (channel == ECC_CONTACTLESS && !Replaying) {
+		if (ActivateField) {
+			DropFieldEx(channel);
+			msleep(50);
+			EMVRecordActivation();
+			res = SelectCard14443_4(false, NULL);
+			ActivateField = false;
+		}
+		if (!res && GetSelectedCard14443_4(&card)) {
+			cardKnown = true;
+			cached = PSECacheFind(&card, PSENum);
+		}
+	}
+
 	// select PPSE
-	res = EMVSelectPSE(channel, ActivateField, true, PSENum, data, sizeof(data), &datalen, &sw);
+	if (cached) {
+		PrintAndLogEx(INFO, "* %s directory of card %s from cache.", PSE_or_PPSE, sprint_hex_inrow(card.uid, card.uidlen));
+		memcpy(data, cached->data, cached->datalen);
+		datalen = cached->datalen;
+		sw = 0x9000;
+	} else if (!res) {
+		res = EMVSelectPSE(channel, ActivateField, true, PSENum, data, sizeof(data), &datalen, &sw);
+	}
 
 	if (!res){
 		if (sw != 0x9000) {
@@ -502,7 +827,16 @@ int EMVSearchPSE(EMVCommandChannel channel, bool ActivateField, bool LeaveFieldO
 				tlv_get_uint8(tlvdb_get_tlv(tsfi), &sfin);
 				PrintAndLogEx(INFO, "* PPSE get SFI: 0x%02x.", sfin);
 
-				for (uint8_t ui = 0x01; ui <= 0x10; ui++) {
+				if (cached) {
+					memcpy(sfidata, cached->sfidata, sizeof(sfidata));
+					memcpy(sfidatalen, cached->sfidatalen, sizeof(sfidatalen));
+					for (uint8_t ui = 0x01; ui <= 0x10; ui++) {
+						if (decodeTLV && sfidatalen[ui])
+							TLVPrintFromBuffer(sfidata[ui], sfidatalen[ui]);
+					}
+				}
+
+				for (uint8_t ui = 0x01; ui <= 0x10 && !cached; ui++) {
 					PrintAndLogEx(INFO, "* * Get SFI: 0x%02x. num: 0x%02x", sfin, ui);
 					res = EMVReadRecord(channel, true, sfin, ui, sfidata[ui], APDU_RESPONSE_LEN, &sfidatalen[ui], &sw, NULL);
 
@@ -553,6 +887,8 @@ int EMVSearchPSE(EMVCommandChannel channel, bool ActivateField, bool LeaveFieldO
 
 			if (!fileFound)
 				PrintAndLogEx(FAILED, "PPSE doesn't have any records.");
+			else if (cardKnown && !cached)
+				PSECacheAdd(&card, PSENum, data, datalen, sfidata, sfidatalen);
 
 			tlvdb_free(t);
 		} else {
@@ -568,18 +904,104 @@ int EMVSearchPSE(EMVCommandChannel channel, bool ActivateField, bool LeaveFieldO
 	return res;
 }
 
-int EMVSearch(EMVCommandChannel channel, bool ActivateField, bool LeaveFieldON, bool decodeTLV, struct tlvdb *tlv) {
+// Sends the SELECTs of AIDlist[aids[]] to a contactless card without waiting for the answers in between.
+// Returns the number of answers in Result, ResultLen, which is less than count after an error.
+static int EMVSelectAIDs(bool ActivateField, const int *aids, int count, uint8_t Result[][APDU_RESPONSE_LEN], size_t *ResultLen) {
+	uint8_t apdu[EMV_SEARCH_PIPELINE][APDU_COMMAND_LEN];
+	uint8_t *apdus[EMV_SEARCH_PIPELINE];
+	int apdulen[EMV_SEARCH_PIPELINE];
+	uint8_t *results[EMV_SEARCH_PIPELINE];
+	int resultlen[EMV_SEARCH_PIPELINE];
+
+	for (int i = 0; i < count; i++) {
+		uint8_t aidbuf[APDU_DATA_LEN] = {0};
+		int aidlen = 0;
+		param_gethex_to_eol(AIDlist[aids[i]].aid, 0, aidbuf, sizeof(aidbuf), &aidlen);
+		apdus[i] = apdu[i];
+		apdulen[i] = EMVSelectAPDU(ECC_CONTACTLESS, aidbuf, aidlen, apdu[i]);
+		results[i] = Result[i];
+	}
+
+	if (ActivateField) {
+		DropFieldEx(ECC_CONTACTLESS);
+		msleep(50);
+	}
+
+	int done = 0;
+	ExchangeAPDUs14a(apdus, apdulen, count, ActivateField, results, APDU_RESPONSE_LEN, resultlen, &done);
+	for (int i = 0; i < done; i++)
+		ResultLen[i] = resultlen[i];
+
+	return done;
+}
+
+int EMVSearch(EMVCommandChannel channel, bool ActivateField, bool LeaveFieldON, bool decodeTLV, bool FirstVendorOnly, struct tlvdb *tlv) {
 	uint8_t aidbuf[APDU_DATA_LEN] = {0};
 	int aidlen = 0;
 	uint8_t data[APDU_RESPONSE_LEN] = {0};
 	size_t datalen = 0;
 	uint16_t sw = 0;
 
+	// answers of the pipelined SELECTs of AIDlist[window[]]. Not for APDU logs, they are in order.
+	bool pipeline = (channel == ECC_CONTACTLESS) && !RecordFile && !Replaying;
+	bool reactivate = false;
+	int window[EMV_SEARCH_PIPELINE];
+	uint8_t windowdata[EMV_SEARCH_PIPELINE][APDU_RESPONSE_LEN];
+	size_t windowdatalen[EMV_SEARCH_PIPELINE];
+	int windowcnt = 0;
+	int windowpos = 0;
+
+	// payment system of the first application found
+	enum CardPSVendor vendor = CV_NA;
+
 	int res = 0;
 	int retrycnt = 0;
 	for(int i = 0; i < AIDlistLen; i ++) {
+		if (vendor != CV_NA && AIDlist[i].vendor != vendor)
+			continue;
+
 		param_gethex_to_eol(AIDlist[i].aid, 0, aidbuf, sizeof(aidbuf), &aidlen);
-		res = EMVSelect(channel, (i == 0) ? ActivateField : false, true, aidbuf, aidlen, data, sizeof(data), &datalen, &sw, tlv);
+
+		while (windowpos < windowcnt && window[windowpos] < i)
+			windowpos++;
+		if (pipeline && !retrycnt && windowpos == windowcnt) {
+			int count = 0;
+			for (int j = i; j < AIDlistLen && count < EMV_SEARCH_PIPELINE; j++) {
+				if (vendor == CV_NA || AIDlist[j].vendor == vendor)
+					window[count++] = j;
+			}
+			windowcnt = EMVSelectAIDs((i == 0) ? ActivateField : false, window, count, windowdata, windowdatalen);
+			windowpos = 0;
+			// the card may be out of step now, so the rest goes one by one after a new activation
+			if (windowcnt < count) {
+				pipeline = false;
+				reactivate = true;
+			}
+		}
+
+		if (windowpos < windowcnt && window[windowpos] == i) {
+			uint8_t apdu[APDU_COMMAND_LEN];
+			int apdulen = EMVSelectAPDU(channel, aidbuf, aidlen, apdu);
+			datalen = windowdatalen[windowpos];
+			memcpy(data, windowdata[windowpos], datalen);
+			windowpos++;
+
+			if (APDULogging) {
+				PrintAndLogEx(SUCCESS, ">>>> %s", sprint_hex(apdu, apdulen));
+				PrintAndLogEx(SUCCESS, "<<<< %s", sprint_hex(data, datalen));
+			}
+
+			if (datalen < 2 || data[datalen - 2] == 0x61) {
+				// GET RESPONSE has to follow the SELECT immediately
+				res = EMVSelect(channel, false, true, aidbuf, aidlen, data, sizeof(data), &datalen, &sw, tlv);
+			} else {
+				res = EMVExchangeResult(apdu, data, &datalen, &sw, tlv);
+			}
+		} else {
+			res = EMVSelect(channel, (i == 0) ? ActivateField : reactivate, true, aidbuf, aidlen, data, sizeof(data), &datalen, &sw, tlv);
+			reactivate = false;
+		}
+
 		// retry if error and not returned sw error
 		if (res && res != 5) {
 			if (++retrycnt < 3){
@@ -610,6 +1032,13 @@ int EMVSearch(EMVCommandChannel channel, bool ActivateField, bool LeaveFieldON,
 			PrintAndLogEx(SUCCESS, "%s", AIDlist[i].aid);
 			TLVPrintFromBuffer(data, datalen);
 		}
+
+		// the other payment systems are not searched then
+		if (FirstVendorOnly && vendor == CV_NA && sw == 0x9000) {
+			enum CardPSVendor v = GetCardPSVendor(aidbuf, aidlen);
+			if (v != CV_NA && v != CV_OTHER)
+				vendor = v;
+		}
 	}
 
 	if (!LeaveFieldON)
@@ -27,6 +27,7 @@
 #include "mbedtls/timing.h"
 
 #include "crypto_test.h"
+#include "tlv_test.h"
 #include "sda_test.h"
 #include "dda_test.h"
 #include "cda_test.h"
@@ -79,6 +80,9 @@ int ExecuteCryptoTests(bool verbose) {
 	res = mbedtls_x509_self_test(verbose);
 	if (res) TestFail = true;
 	
+	res = exec_tlv_test(verbose);
+	if (res) TestFail = true;
+
 	res = exec_sda_test(verbose);
 	if (res) TestFail = true;
 
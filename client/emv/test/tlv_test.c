@@ -0,0 +1,140 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// TLV database tests
+//-----------------------------------------------------------------------------
+
+#include "tlv_test.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "../tlv.h"
+
+// FCI of a Visa application
+static const unsigned char fci[] = {
+	0x6f, 0x1c,
+		0x84, 0x07, 0xa0, 0x00, 0x00, 0x00, 0x03, 0x10, 0x10,
+		0xa5, 0x11,
+			0x50, 0x04, 'V', 'I', 'S', 'A',
+			0x87, 0x01, 0x01,
+			0xbf, 0x0c, 0x05,
+				0x9f, 0x4d, 0x02, 0x0b, 0x0a,
+};
+
+// record with a tag twice
+static const unsigned char records[] = {
+	0x5a, 0x02, 0x12, 0x34,
+	0x5f, 0x24, 0x03, 0x25, 0x12, 0x31,
+	0x5a, 0x02, 0x56, 0x78,
+};
+
+static bool check_tlv(const struct tlv *tlv, size_t len, const unsigned char *value, const char *what, bool verbose)
+{
+	bool ok = tlv && tlv->len == len && memcmp(tlv->value, value, len) == 0;
+	if (!ok || verbose)
+		fprintf(ok ? stdout : stderr, "TLV %s: %s\n", what, ok ? "ok" : "failed");
+	return ok;
+}
+
+static int tlv_test_parse(bool verbose)
+{
+	unsigned char buf[sizeof(fci)];
+	memcpy(buf, fci, sizeof(fci));
+
+	struct tlvdb *db = tlvdb_parse(buf, sizeof(buf));
+	if (!db)
+		return 1;
+	// the buffer is copied
+	memset(buf, 0, sizeof(buf));
+
+	int ret = 0;
+	if (!check_tlv(tlvdb_get(db, 0x50, NULL), 4, (const unsigned char *)"VISA", "get", verbose))
+		ret = 1;
+	if (!check_tlv(tlvdb_get(db, 0x9f4d, NULL), 2, (const unsigned char[]){0x0b, 0x0a}, "get nested", verbose))
+		ret = 1;
+	if (!check_tlv(tlvdb_get_tlv(tlvdb_find_full(db, 0x87)), 1, (const unsigned char[]){0x01}, "find full", verbose))
+		ret = 1;
+	if (!check_tlv(tlvdb_get_tlv(tlvdb_find_path(db, (tlv_tag_t[]){0x6f, 0xa5, 0xbf0c, 0x00})), 5, &fci[25], "find path", verbose))
+		ret = 1;
+	if (tlvdb_get(db, 0x9f38, NULL) || tlvdb_find_full(db, 0x9f38))
+		ret = 1;
+	if (!check_tlv(tlvdb_get_inchild(tlvdb_find_full(db, 0xa5), 0x87, NULL), 1, (const unsigned char[]){0x01}, "get in child", verbose))
+		ret = 1;
+
+	tlvdb_free(db);
+
+	// truncated
+	if (tlvdb_parse(fci, sizeof(fci) - 1) || tlvdb_parse_multi(records, sizeof(records) - 1))
+		ret = 1;
+
+	return ret;
+}
+
+static int tlv_test_modify(bool verbose)
+{
+	int ret = 0;
+	struct tlvdb *root = tlvdb_fixed(0x02, 4, (const unsigned char *)"root");
+	struct tlvdb *multi = tlvdb_parse_multi(records, sizeof(records));
+	if (!root || !multi)
+		return 1;
+
+	if (tlvdb_get(root, 0x5a, NULL))
+		ret = 1;
+
+	tlvdb_add(root, multi);
+	tlvdb_add(root, tlvdb_parse(fci, sizeof(fci)));
+
+	const struct tlv *pan = tlvdb_get(root, 0x5a, NULL);
+	if (!check_tlv(pan, 2, &records[2], "get after add", verbose))
+		ret = 1;
+	if (!check_tlv(tlvdb_get(root, 0x5a, pan), 2, &records[12], "get next", verbose))
+		ret = 1;
+	if (!check_tlv(tlvdb_get(root, 0x50, NULL), 4, (const unsigned char *)"VISA", "get in added tree", verbose))
+		ret = 1;
+
+	// replaces the first element of the parsed records, the others stay
+	tlvdb_change_or_add_node(root, 0x5a, 3, (const unsigned char[]){0x11, 0x22, 0x33});
+	if (!check_tlv(tlvdb_get(root, 0x5a, NULL), 3, (const unsigned char[]){0x11, 0x22, 0x33}, "change", verbose))
+		ret = 1;
+	if (!check_tlv(tlvdb_get(root, 0x5f24, NULL), 3, &records[7], "get after change", verbose))
+		ret = 1;
+
+	// replaces a nested element
+	tlvdb_change_or_add_node(root, 0x87, 1, (const unsigned char[]){0x02});
+	if (!check_tlv(tlvdb_get(root, 0x87, NULL), 1, (const unsigned char[]){0x02}, "change nested", verbose))
+		ret = 1;
+	if (!check_tlv(tlvdb_get(root, 0x9f4d, NULL), 2, (const unsigned char[]){0x0b, 0x0a}, "get after change nested", verbose))
+		ret = 1;
+
+	tlvdb_change_or_add_node(root, 0x9f37, 4, (const unsigned char[]){0x01, 0x02, 0x03, 0x04});
+	if (!check_tlv(tlvdb_get(root, 0x9f37, NULL), 4, (const unsigned char[]){0x01, 0x02, 0x03, 0x04}, "add", verbose))
+		ret = 1;
+
+	tlvdb_free(root);
+
+	return ret;
+}
+
+int exec_tlv_test(bool verbose)
+{
+	int ret;
+	fprintf(stdout, "\n");
+
+	ret = tlv_test_parse(verbose);
+	if (ret) {
+		fprintf(stderr, "TLV parse test: failed\n");
+		return ret;
+	}
+	fprintf(stdout, "TLV parse test: passed\n");
+
+	ret = tlv_test_modify(verbose);
+	if (ret) {
+		fprintf(stderr, "TLV modify test: failed\n");
+		return ret;
+	}
+	fprintf(stdout, "TLV modify test: passed\n");
+
+	return 0;
+}
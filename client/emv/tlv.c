@@ -46,14 +46,37 @@ struct tlvdb {
 	struct tlvdb *next;
 	struct tlvdb *parent;
 	struct tlvdb *children;
+	struct tlvdb_block *block;
+	struct tlvdb_index *index;	// lookups from this root, built on demand
+	bool linked;			// follows another element in a list
 };
 
-struct tlvdb_root {
-	struct tlvdb db;
-	size_t len;
-	unsigned char buf[0];
+// All nodes of a parsed buffer are allocated in one block together with a copy
+// of the buffer. The block is free'd with the last of its nodes, so single nodes
+// may still be replaced by tlvdb_change_or_add_node() or free'd on their own.
+struct tlvdb_block {
+	size_t refs;			// nodes not free'd yet
+	size_t count;			// nodes handed out
+	size_t size;			// nodes available
+	unsigned char *buf;
+	struct tlvdb nodes[0];
 };
 
+// tag -> first element in the order of tlvdb_get()
+struct tlvdb_index_entry {
+	tlv_tag_t tag;
+	struct tlvdb *elm;
+};
+
+struct tlvdb_index {
+	unsigned long generation;
+	size_t mask;
+	struct tlvdb_index_entry entries[0];
+};
+
+// changed by everything which modifies or frees a tree, indexes built before are stale
+static unsigned long tlvdb_generation = 1;
+
 static tlv_tag_t tlv_parse_tag(const unsigned char **buf, size_t *len)
 {
 	tlv_tag_t tag;
@@ -92,7 +115,7 @@ static size_t tlv_parse_len(const unsigned char **buf, size_t *len)
 		return l;
 
 	size_t ll = l &~ TLV_LEN_LONG;
-	if (ll > 5)
+	if (ll > 5 || ll > *len)
 		return TLV_LEN_INVALID;
 
 	l = 0;
@@ -120,9 +143,61 @@ bool tlv_parse_tl(const unsigned char **buf, size_t *len, struct tlv *tlv)
 	return true;
 }
 
-static struct tlvdb *tlvdb_parse_children(struct tlvdb *parent);
+static struct tlvdb_block *tlvdb_block_new(size_t nodes, const unsigned char *buf, size_t len)
+{
+	struct tlvdb_block *block = malloc(sizeof(*block) + nodes * sizeof(struct tlvdb) + len);
+	if (!block)
+		return NULL;
+
+	block->refs = 0;
+	block->count = 0;
+	block->size = nodes;
+	block->buf = (unsigned char *)&block->nodes[nodes];
+	if (len)
+		memcpy(block->buf, buf, len);
+
+	return block;
+}
+
+static struct tlvdb *tlvdb_block_node(struct tlvdb_block *block)
+{
+	struct tlvdb *tlvdb = &block->nodes[block->count++];
+
+	tlvdb->parent = tlvdb->next = tlvdb->children = NULL;
+	tlvdb->block = block;
+	tlvdb->index = NULL;
+	tlvdb->linked = false;
+	block->refs++;
+
+	return tlvdb;
+}
 
-static bool tlvdb_parse_one(struct tlvdb *tlvdb,
+// number of TLV elements in <buf>, including the nested ones. Counts as far as
+// <buf> can be parsed, which is enough for everything tlvdb_parse_one() accepts.
+static size_t tlv_count_elements(const unsigned char *buf, size_t len)
+{
+	size_t count = 0;
+	struct tlv tlv;
+
+	while (len != 0) {
+		if (!tlv_parse_tl(&buf, &len, &tlv) || tlv.len > len)
+			break;
+
+		count++;
+		if (tlv_is_constructed(&tlv))
+			count += tlv_count_elements(buf, tlv.len);
+
+		buf += tlv.len;
+		len -= tlv.len;
+	}
+
+	return count;
+}
+
+static struct tlvdb *tlvdb_parse_children(struct tlvdb_block *block, struct tlvdb *parent);
+
+static bool tlvdb_parse_one(struct tlvdb_block *block,
+		struct tlvdb *tlvdb,
 		struct tlvdb *parent,
 		const unsigned char **tmp,
 		size_t *left)
@@ -147,7 +222,7 @@ static bool tlvdb_parse_one(struct tlvdb *tlvdb,
 	*left -= tlvdb->tag.len;
 
 	if (tlv_is_constructed(&tlvdb->tag) && (tlvdb->tag.len != 0)) {
-		tlvdb->children = tlvdb_parse_children(tlvdb);
+		tlvdb->children = tlvdb_parse_children(block, tlvdb);
 		if (!tlvdb->children)
 			goto err;
 	} else {
@@ -160,128 +235,111 @@ err:
 	return false;
 }
 
-static struct tlvdb *tlvdb_parse_children(struct tlvdb *parent)
+static struct tlvdb *tlvdb_parse_children(struct tlvdb_block *block, struct tlvdb *parent)
 {
 	const unsigned char *tmp = parent->tag.value;
 	size_t left = parent->tag.len;
 	struct tlvdb *tlvdb, *first = NULL, *prev = NULL;
 
 	while (left != 0) {
-		tlvdb = malloc(sizeof(*tlvdb));
+		if (block->count == block->size)
+			return NULL;
+
+		tlvdb = tlvdb_block_node(block);
 		if (prev)
 			prev->next = tlvdb;
 		else
 			first = tlvdb;
 		prev = tlvdb;
 
-		if (!tlvdb_parse_one(tlvdb, parent, &tmp, &left))
-			goto err;
-
-		tlvdb->parent = parent;
+		if (!tlvdb_parse_one(block, tlvdb, parent, &tmp, &left))
+			return NULL;
 	}
 
 	return first;
-
-err:
-	tlvdb_free(first);
-
-	return NULL;
 }
 
-struct tlvdb *tlvdb_parse(const unsigned char *buf, size_t len)
+static struct tlvdb *tlvdb_parse_block(const unsigned char *buf, size_t len, bool multi)
 {
-	struct tlvdb_root *root;
+	struct tlvdb_block *block;
+	struct tlvdb *first, *prev;
 	const unsigned char *tmp;
 	size_t left;
 
 	if (!len || !buf)
 		return NULL;
 
-	root = malloc(sizeof(*root) + len);
-	root->len = len;
-	memcpy(root->buf, buf, len);
+	size_t count = tlv_count_elements(buf, len);
+	if (count == 0)
+		return NULL;
+
+	block = tlvdb_block_new(count, buf, len);
+	if (!block)
+		return NULL;
 
-	tmp = root->buf;
+	tmp = block->buf;
 	left = len;
 
-	if (!tlvdb_parse_one(&root->db, NULL, &tmp, &left))
+	first = prev = tlvdb_block_node(block);
+	if (!tlvdb_parse_one(block, first, NULL, &tmp, &left))
 		goto err;
 
+	while (multi && left != 0) {
+		if (block->count == block->size)
+			goto err;
+
+		struct tlvdb *db = tlvdb_block_node(block);
+		if (!tlvdb_parse_one(block, db, NULL, &tmp, &left))
+			goto err;
+
+		db->linked = true;
+		prev->next = db;
+		prev = db;
+	}
+
 	if (left)
 		goto err;
 
-	return &root->db;
+	return first;
 
 err:
-	tlvdb_free(&root->db);
+	free(block);
 
 	return NULL;
 }
 
-struct tlvdb *tlvdb_parse_multi(const unsigned char *buf, size_t len)
+struct tlvdb *tlvdb_parse(const unsigned char *buf, size_t len)
 {
-	struct tlvdb_root *root;
-	const unsigned char *tmp;
-	size_t left;
-
-	if (!len || !buf)
-		return NULL;
-
-	root = malloc(sizeof(*root) + len);
-	root->len = len;
-	memcpy(root->buf, buf, len);
-
-	tmp = root->buf;
-	left = len;
-
-	if (!tlvdb_parse_one(&root->db, NULL, &tmp, &left))
-		goto err;
-
-	while (left != 0) {
-		struct tlvdb *db = malloc(sizeof(*db));
-		if (!tlvdb_parse_one(db, NULL, &tmp, &left)) {
-			free (db);
-			goto err;
-		}
-
-		tlvdb_add(&root->db, db);
-	}
-
-	return &root->db;
-
-err:
-	tlvdb_free(&root->db);
+	return tlvdb_parse_block(buf, len, false);
+}
 
-	return NULL;
+struct tlvdb *tlvdb_parse_multi(const unsigned char *buf, size_t len)
+{
+	return tlvdb_parse_block(buf, len, true);
 }
 
 struct tlvdb *tlvdb_fixed(tlv_tag_t tag, size_t len, const unsigned char *value)
 {
-	struct tlvdb_root *root = malloc(sizeof(*root) + len);
-
-	root->len = len;
-	memcpy(root->buf, value, len);
+	struct tlvdb_block *block = tlvdb_block_new(1, value, len);
+	struct tlvdb *tlvdb = tlvdb_block_node(block);
 
-	root->db.parent = root->db.next = root->db.children = NULL;
-	root->db.tag.tag = tag;
-	root->db.tag.len = len;
-	root->db.tag.value = root->buf;
+	tlvdb->tag.tag = tag;
+	tlvdb->tag.len = len;
+	tlvdb->tag.value = block->buf;
 
-	return &root->db;
+	return tlvdb;
 }
 
 struct tlvdb *tlvdb_external(tlv_tag_t tag, size_t len, const unsigned char *value)
 {
-	struct tlvdb_root *root = malloc(sizeof(*root));
+	struct tlvdb_block *block = tlvdb_block_new(1, NULL, 0);
+	struct tlvdb *tlvdb = tlvdb_block_node(block);
 
-	root->len = 0;
+	tlvdb->tag.tag = tag;
+	tlvdb->tag.len = len;
+	tlvdb->tag.value = value;
 
-	root->db.parent = root->db.next = root->db.children = NULL;
-	root->db.tag.tag = tag;
-	root->db.tag.len = len;
-	root->db.tag.value = value;
-
-	return &root->db;
+	return tlvdb;
 }
 
 void tlvdb_free(struct tlvdb *tlvdb)
@@ -291,13 +349,95 @@ void tlvdb_free(struct tlvdb *tlvdb)
 	if (!tlvdb)
 		return;
 
+	// only indexes of other trees can refer to a tree which is part of another one
+	if (tlvdb->parent || tlvdb->linked)
+		tlvdb_generation++;
+
 	for (; tlvdb; tlvdb = next) {
 		next = tlvdb->next;
 		tlvdb_free(tlvdb->children);
-		free(tlvdb);
+		free(tlvdb->index);
+		if (--tlvdb->block->refs == 0)
+			free(tlvdb->block);
 	}
 }
 
+static const struct tlvdb *tlvdb_next(const struct tlvdb *tlvdb)
+{
+	if (tlvdb->children)
+		return tlvdb->children;
+
+	while (tlvdb) {
+		if (tlvdb->next)
+			return tlvdb->next;
+
+		tlvdb = tlvdb->parent;
+	}
+
+	return NULL;
+}
+
+static size_t tlvdb_index_slot(tlv_tag_t tag, size_t mask)
+{
+	return ((tag * 0x9e3779b1u) >> 16) & mask;
+}
+
+// (re)build the index of the tree starting at <root>
+static struct tlvdb_index *tlvdb_index_build(struct tlvdb *root)
+{
+	size_t count = 0;
+	for (const struct tlvdb *elm = root; elm; elm = tlvdb_next(elm))
+		count++;
+
+	size_t size = 16;
+	while (size < 2 * count)
+		size <<= 1;
+
+	struct tlvdb_index *index = root->index;
+	if (!index || index->mask + 1 < size) {
+		free(index);
+		index = malloc(sizeof(*index) + size * sizeof(struct tlvdb_index_entry));
+		root->index = index;
+		if (!index)
+			return NULL;
+		index->mask = size - 1;
+	}
+	memset(index->entries, 0, (index->mask + 1) * sizeof(struct tlvdb_index_entry));
+
+	// the first element with a tag wins
+	for (const struct tlvdb *elm = root; elm; elm = tlvdb_next(elm)) {
+		size_t slot = tlvdb_index_slot(elm->tag.tag, index->mask);
+		while (index->entries[slot].elm && index->entries[slot].tag != elm->tag.tag)
+			slot = (slot + 1) & index->mask;
+		if (!index->entries[slot].elm) {
+			index->entries[slot].tag = elm->tag.tag;
+			index->entries[slot].elm = (struct tlvdb *)elm;
+		}
+	}
+
+	index->generation = tlvdb_generation;
+	return index;
+}
+
+// Same as walking the tree with tlvdb_next() from <root>, which has to be a top
+// level element. Returns false if there is no memory for the index.
+static bool tlvdb_index_find(const struct tlvdb *root, tlv_tag_t tag, struct tlvdb **elm)
+{
+	struct tlvdb_index *index = root->index;
+	if (!index || index->generation != tlvdb_generation) {
+		index = tlvdb_index_build((struct tlvdb *)root);
+		if (!index)
+			return false;
+	}
+
+	size_t slot = tlvdb_index_slot(tag, index->mask);
+	while (index->entries[slot].elm && index->entries[slot].tag != tag)
+		slot = (slot + 1) & index->mask;
+	*elm = index->entries[slot].elm;
+
+	return true;
+}
+
 struct tlvdb *tlvdb_find_next(struct tlvdb *tlvdb, tlv_tag_t tag) {
 	if (!tlvdb)
 		return NULL;
@@ -320,6 +460,11 @@ struct tlvdb *tlvdb_find(struct tlvdb *tlvdb, tlv_tag_t tag) {
 struct tlvdb *tlvdb_find_full(struct tlvdb *tlvdb, tlv_tag_t tag) {
 	if (!tlvdb)
 		return NULL;
+
+	// top level elements are found through the index
+	struct tlvdb *elm;
+	if (!tlvdb->parent && tlvdb_index_find(tlvdb, tag, &elm))
+		return elm;
 	
 	for (; tlvdb; tlvdb = tlvdb->next) {
 		if (tlvdb->tag.tag == tag)
@@ -352,9 +497,12 @@ struct tlvdb *tlvdb_find_path(struct tlvdb *tlvdb, tlv_tag_t tag[]) {
 
 void tlvdb_add(struct tlvdb *tlvdb, struct tlvdb *other)
 {
-	if (tlvdb == other)
+	if (!other || tlvdb == other)
 		return;
-	
+
+	tlvdb_generation++;
+	other->linked = true;
+
 	while (tlvdb->next) {
 		if (tlvdb->next == other)
 			return;
@@ -407,6 +555,7 @@ void tlvdb_change_or_add_node_ex(struct tlvdb *tlvdb, tlv_tag_t tag, size_t len,
 		}
 		
 		// free old element with childrens
+		tlvdb_generation++;
 		telm->next = NULL;
 		tlvdb_free(telm);
 		
@@ -436,26 +585,15 @@ void tlvdb_visit(const struct tlvdb *tlvdb, tlv_cb cb, void *data, int level)
 	}
 }
 
-static const struct tlvdb *tlvdb_next(const struct tlvdb *tlvdb)
-{
-	if (tlvdb->children)
-		return tlvdb->children;
-
-	while (tlvdb) {
-		if (tlvdb->next)
-			return tlvdb->next;
-
-		tlvdb = tlvdb->parent;
-	}
-
-	return NULL;
-}
-
 const struct tlv *tlvdb_get(const struct tlvdb *tlvdb, tlv_tag_t tag, const struct tlv *prev)
 {
 	if (prev) {
 //		tlvdb = tlvdb_next(container_of(prev, struct tlvdb, tag));
 		tlvdb = tlvdb_next((struct tlvdb *)prev);
+	} else if (tlvdb && !tlvdb->parent) {
+		struct tlvdb *elm;
+		if (tlvdb_index_find(tlvdb, tag, &elm))
+			return elm ? &elm->tag : NULL;
 	}
 
 
@@ -57,13 +57,14 @@ void save_restoreGB(uint8_t saveOpt)
 	static bool GB_Saved = false;
 	static int SavedGridOffsetAdj=0;
 
+	// only the first GraphTraceLen samples are valid, don't copy the rest
 	if (saveOpt == GRAPH_SAVE) { //save
-		memcpy(SavedGB, GraphBuffer, sizeof(GraphBuffer));
+		memcpy(SavedGB, GraphBuffer, GraphTraceLen * sizeof(int));
 		SavedGBlen = GraphTraceLen;
 		GB_Saved=true;
 		SavedGridOffsetAdj = GridOffset;
 	} else if (GB_Saved) { //restore
-		memcpy(GraphBuffer, SavedGB, sizeof(GraphBuffer));
+		memcpy(GraphBuffer, SavedGB, SavedGBlen * sizeof(int));
 		GraphTraceLen = SavedGBlen;
 		GridOffset = SavedGridOffsetAdj;
 		RepaintGraphWindow();
@@ -77,10 +78,9 @@ void setGraphBuf(uint8_t *buff, size_t size)
 {
 	if ( buff == NULL ) return;
 	
-	uint16_t i = 0;  
+	size_t i = 0;
 	if ( size > MAX_GRAPH_TRACE_LEN )
 		size = MAX_GRAPH_TRACE_LEN;
-	ClearGraph(0);
 	for (; i < size; ++i){
 		GraphBuffer[i]=buff[i]-128;
 	}
@@ -143,7 +143,7 @@ int GetAskClock(const char str[], bool printAns, bool verbose)
 	if (clock != 0) 
 		return clock;
 	// Auto-detect clock
-	uint8_t grph[MAX_GRAPH_TRACE_LEN]={0};
+	uint8_t grph[MAX_GRAPH_TRACE_LEN];
 	size_t size = getFromGraphBuf(grph);
 	if (size == 0) {
 		if (verbose)
@@ -168,7 +168,7 @@ int GetAskClock(const char str[], bool printAns, bool verbose)
 uint8_t GetPskCarrier(const char str[], bool printAns, bool verbose)
 {
 	uint8_t carrier=0;
-	uint8_t grph[MAX_GRAPH_TRACE_LEN]={0};
+	uint8_t grph[MAX_GRAPH_TRACE_LEN];
 	size_t size = getFromGraphBuf(grph);
 	if ( size == 0 ) {
 		if (verbose) 
@@ -196,7 +196,7 @@ int GetPskClock(const char str[], bool printAns, bool verbose)
 	if (clock!=0) 
 		return clock;
 	// Auto-detect clock
-	uint8_t grph[MAX_GRAPH_TRACE_LEN]={0};
+	uint8_t grph[MAX_GRAPH_TRACE_LEN];
 	size_t size = getFromGraphBuf(grph);
 	if ( size == 0 ) {
 		if (verbose) 
@@ -224,7 +224,7 @@ uint8_t GetNrzClock(const char str[], bool printAns, bool verbose)
 	if (clock!=0) 
 		return clock;
 	// Auto-detect clock
-	uint8_t grph[MAX_GRAPH_TRACE_LEN]={0};
+	uint8_t grph[MAX_GRAPH_TRACE_LEN];
 	size_t size = getFromGraphBuf(grph);
 	if ( size == 0 ) {
 		if (verbose) 
@@ -268,7 +268,7 @@ uint8_t GetFskClock(const char str[], bool printAns, bool verbose)
 }
 uint8_t fskClocks(uint8_t *fc1, uint8_t *fc2, uint8_t *rf1, bool verbose, int *firstClockEdge)
 {
-	uint8_t BitStream[MAX_GRAPH_TRACE_LEN]={0};
+	uint8_t BitStream[MAX_GRAPH_TRACE_LEN];
 	size_t size = getFromGraphBuf(BitStream);
 	if (size==0) return 0;
 	uint16_t ans = countFC(BitStream, size, 1); 
@@ -17,6 +17,7 @@
 #include "hidcardformatutils.h"
 #include "parity.h" // for parity
 #include "ui.h"
+#include "result.h"
 
 bool Pack_H10301(/*in*/hidproxcard_t* card, /*out*/hidproxmessage_t* packed){
   memset(packed, 0, sizeof(hidproxmessage_t));
@@ -585,6 +586,21 @@ void HIDDisplayUnpackedCard(hidproxcard_t* card, const hidcardformat_t format){
     PrintAndLog("       Parity: %s",card->ParityValid ? "Valid" : "Invalid");
 }
 
+// the fields of the first format which matched go to the current record
+static void HIDResultUnpackedCard(hidproxcard_t* card, const hidcardformat_t format){
+  ResultString("format", format.Name);
+  if (format.Fields.hasFacilityCode)
+    ResultInt("facility_code", card->FacilityCode);
+  if (format.Fields.hasCardNumber)
+    ResultInt("card_number", card->CardNumber);
+  if (format.Fields.hasIssueLevel)
+    ResultInt("issue_level", card->IssueLevel);
+  if (format.Fields.hasOEMCode)
+    ResultInt("oem_code", card->OEM);
+  if (format.Fields.hasParity)
+    ResultBool("parity_ok", card->ParityValid);
+}
+
 bool HIDTryUnpack(/* in */hidproxmessage_t* packed, /* in */bool ignoreParity){
   if (FormatTable[0].Name == NULL) 
     return false;
@@ -597,7 +613,10 @@ bool HIDTryUnpack(/* in */hidproxmessage_t* packed, /* in */bool ignoreParity){
   {
     if (FormatTable[i].Unpack(packed, &card)){
       if (ignoreParity || !FormatTable[i].Fields.hasParity || card.ParityValid){
-        if (!result) PrintAndLog("--------------------------------------------------");
+        if (!result) {
+          PrintAndLog("--------------------------------------------------");
+          HIDResultUnpackedCard(&card, FormatTable[i]);
+        }
         result = true;
         HIDDisplayUnpackedCard(&card, FormatTable[i]);
         PrintAndLog("--------------------------------------------------");
@@ -0,0 +1,297 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Non-interactive batch decoding of LF sample files
+//
+// The demodulators work on the global GraphBuffer/DemodBuffer, so instead of
+// threads we fork() worker processes, each with its own copy of the buffers.
+// Every worker decodes a share of the files and writes one JSON line per file
+// into a pipe shared with the parent. Lines are written with a single write()
+// and are shorter than PIPE_BUF, so they don't interleave.
+//-----------------------------------------------------------------------------
+
+#if !defined(_WIN32)
+#define _POSIX_C_SOURCE 200809L      // need fork(), sysconf(), strdup()
+#endif
+
+#include "lfbatch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <jansson.h>
+#if !defined(_WIN32)
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+#include "util.h"
+#include "util_posix.h"
+#include "ui.h"
+#include "graph.h"
+#include "comms.h"
+#include "cmddata.h"
+#include "cmdlf.h"
+#include "samplefile.h"
+#include "result.h"
+
+#define LFBATCH_MAX_RAW_BITS    512
+#define LFBATCH_MIN_SAMPLES     1000   // same as `lf search`
+#define LFBATCH_MAX_LINE        4000   // keep below PIPE_BUF
+
+typedef struct {
+	char **names;
+	size_t count;
+	size_t size;
+} file_list_t;
+
+
+static void add_file(file_list_t *list, const char *name)
+{
+	if (list->count == list->size) {
+		list->size = list->size ? list->size * 2 : 64;
+		list->names = realloc(list->names, list->size * sizeof(char *));
+		if (!list->names) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	list->names[list->count++] = strdup(name);
+}
+
+
+static bool has_sample_file_suffix(const char *name)
+{
+	const char *dot = strrchr(name, '.');
+	return dot && (strcmp(dot, ".pm3") == 0 || strcmp(dot, ".pm3b") == 0);
+}
+
+
+static int compare_names(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+
+static void collect_files(file_list_t *list, const char *path)
+{
+	struct stat st;
+	if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+		// not a directory. Let the decoder report it if it doesn't exist.
+		add_file(list, path);
+		return;
+	}
+
+	DIR *dir = opendir(path);
+	if (!dir) {
+		add_file(list, path);
+		return;
+	}
+	size_t first = list->count;
+	size_t pathlen = strlen(path);
+	while (pathlen > 1 && path[pathlen - 1] == '/') pathlen--;
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		if (!has_sample_file_suffix(entry->d_name)) continue;
+		char fullname[FILE_PATH_SIZE];
+		snprintf(fullname, sizeof(fullname), "%.*s/%s", (int)pathlen, path, entry->d_name);
+		add_file(list, fullname);
+	}
+	closedir(dir);
+	qsort(list->names + first, list->count - first, sizeof(char *), compare_names);
+}
+
+
+static void emit_line(int fd, const char *line)
+{
+	size_t len = strlen(line);
+#if !defined(_WIN32)
+	if (fd >= 0) {
+		char buf[LFBATCH_MAX_LINE + 2];
+		if (len > LFBATCH_MAX_LINE) len = LFBATCH_MAX_LINE;
+		memcpy(buf, line, len);
+		buf[len++] = '\n';
+		if (write(fd, buf, len) != (ssize_t)len) {
+			// parent went away, nothing we can do
+		}
+		return;
+	}
+#endif
+	fwrite(line, 1, len, stdout);
+	fputc('\n', stdout);
+	fflush(stdout);
+}
+
+
+static void decode_file(const char *filename, int fd)
+{
+	json_t *root = json_object();
+	json_object_set_new(root, "file", json_string(filename));
+
+	uint64_t start = msclock();
+	size_t samples = 0;
+	int res = samplefile_load(filename, GraphBuffer, MAX_GRAPH_TRACE_LEN, &samples, NULL, NULL);
+	GraphTraceLen = samples;
+	// start from a clean state, so that results don't depend on the previous file
+	memset(DemodBuffer, 0, sizeof(DemodBuffer));
+	DemodBufferLen = 0;
+	setClockGrid(0, 0);
+
+	if (res < 0) {
+		json_object_set_new(root, "status", json_string("error"));
+		json_object_set_new(root, "error", json_string(samplefile_strerror(res)));
+	} else {
+		json_object_set_new(root, "samples", json_integer(samples));
+		const lf_tag_demod_t *found = NULL;
+		json_t *records = NULL;
+		const char *status;
+		if (GraphTraceLen < LFBATCH_MIN_SAMPLES) {
+			status = "too_short";
+		} else if (graphJustNoise(GraphBuffer, LFBATCH_MIN_SAMPLES)) {
+			status = "noise";
+		} else {
+			// the demodulator which succeeds leaves its decoded fields in an lf_tag record
+			ResultCollect();
+			found = LFSearchKnownTags();
+			records = ResultTake();
+			status = found ? "found" : "not_found";
+		}
+		json_object_set_new(root, "status", json_string(status));
+
+		if (found) {
+			json_object_set_new(root, "protocol", json_string(found->name));
+			// same fields as the lf_tag record of `lf search` (id, facility_code, card_number, ...)
+			json_t *tag = json_array_get(records, json_array_size(records) - 1);
+			const char *type = json_string_value(json_object_get(tag, "type"));
+			if (type && strcmp(type, "lf_tag") == 0) {
+				const char *key;
+				json_t *value;
+				json_object_foreach(tag, key, value) {
+					if (strcmp(key, "type") != 0 && strcmp(key, "protocol") != 0)
+						json_object_set(root, key, value);
+				}
+			}
+			char hex[LFBATCH_MAX_RAW_BITS / 4 + 1] = {0};
+			int bits = DemodBufferLen > LFBATCH_MAX_RAW_BITS ? LFBATCH_MAX_RAW_BITS : DemodBufferLen;
+			binarraytohex(hex, (char *)DemodBuffer, bits & ~3);
+			json_object_set_new(root, "modulation", json_string(found->modulation));
+			json_object_set_new(root, "clock", json_integer(g_DemodClock));
+			json_object_set_new(root, "raw", json_string(hex));
+			json_object_set_new(root, "bits", json_integer(DemodBufferLen));
+		}
+		json_decref(records);
+	}
+	json_object_set_new(root, "decode_ms", json_integer(msclock() - start));
+
+	char *line = json_dumps(root, JSON_COMPACT | JSON_PRESERVE_ORDER);
+	if (line) {
+		emit_line(fd, line);
+		free(line);
+	}
+	json_decref(root);
+}
+
+
+#if !defined(_WIN32)
+static int run_workers(file_list_t *list, int jobs)
+{
+	int pipefd[2];
+	if (pipe(pipefd) != 0) {
+		perror("pipe");
+		return EXIT_FAILURE;
+	}
+
+	fflush(stdout);
+	fflush(stderr);
+
+	int started = 0;
+	for (int worker = 0; worker < jobs; worker++) {
+		pid_t pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			break;
+		}
+		if (pid == 0) {
+			close(pipefd[0]);
+			for (size_t i = worker; i < list->count; i += jobs) {
+				decode_file(list->names[i], pipefd[1]);
+			}
+			close(pipefd[1]);
+			_exit(EXIT_SUCCESS);
+		}
+		started++;
+	}
+	close(pipefd[1]);
+
+	if (started < jobs) {
+		// files of workers which didn't start are decoded here
+		for (int worker = started; worker < jobs; worker++) {
+			for (size_t i = worker; i < list->count; i += jobs) {
+				decode_file(list->names[i], -1);
+			}
+		}
+	}
+
+	char buf[4096];
+	ssize_t n;
+	while ((n = read(pipefd[0], buf, sizeof(buf))) > 0) {
+		fwrite(buf, 1, n, stdout);
+	}
+	fflush(stdout);
+	close(pipefd[0]);
+
+	int result = EXIT_SUCCESS;
+	int status;
+	while (started-- > 0) {
+		if (wait(&status) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+			result = EXIT_FAILURE;
+		}
+	}
+	return result;
+}
+#endif
+
+
+int LFBatchDecode(char *paths[], int num_paths, int jobs)
+{
+	file_list_t list = {NULL, 0, 0};
+
+	for (int i = 0; i < num_paths; i++) {
+		collect_files(&list, paths[i]);
+	}
+	if (list.count == 0) {
+		fprintf(stderr, "No sample files found.\n");
+		return EXIT_FAILURE;
+	}
+
+	// the demodulators are chatty. We only want the JSON lines.
+	SetOffline(true);
+	SetSilentMode(true);
+
+	int result = EXIT_SUCCESS;
+#if !defined(_WIN32)
+	if (jobs <= 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		jobs = cpus > 0 ? cpus : 1;
+	}
+	if (jobs > list.count) jobs = list.count;
+	if (jobs > 1) {
+		result = run_workers(&list, jobs);
+	} else
+#endif
+	{
+		for (size_t i = 0; i < list.count; i++) {
+			decode_file(list.names[i], -1);
+		}
+	}
+
+	SetSilentMode(false);
+	for (size_t i = 0; i < list.count; i++) {
+		free(list.names[i]);
+	}
+	free(list.names);
+	return result;
+}
@@ -0,0 +1,18 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Non-interactive batch decoding of LF sample files
+//-----------------------------------------------------------------------------
+
+#ifndef LFBATCH_H__
+#define LFBATCH_H__
+
+// Run the `lf search 1` known tag pipeline on every sample file given in <paths>
+// (files, or directories which are scanned for *.pm3 and *.pm3b files), using
+// <jobs> worker processes (0 = one per CPU). Prints one JSON object per file
+// to stdout. Returns the process exit code.
+int LFBatchDecode(char *paths[], int num_paths, int jobs);
+
+#endif
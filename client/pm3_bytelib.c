@@ -0,0 +1,417 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Lua byte buffers, for binary data and UsbCommands without hex strings.
+//
+//   bytes.new(n), bytes.fromhex(hex), bytes.fromstring(s)
+//   bytes.usbcommand([cmd, arg1, arg2, arg3, data]), bytes.usbcommand(s)
+//
+//   b[i], #b, b:sub(i, j)         - bytes from 1. sub() is a view, not a copy
+//   b:hex(i, j), b:string(i, j)   - copies as hex or binary string
+//   b:u8(off), b:u16(off), b:u32(off), b:u16be(off), b:u32be(off)
+//   b:set_u8(off, v), b:set_u16(off, v), ... , b:fill(v), b:copy(off, src)
+//
+// Buffers from bytes.usbcommand() and core.WaitForResponse() also have the
+// fields cmd, arg1, arg2, arg3 and data (a view of the 512 data bytes).
+//-----------------------------------------------------------------------------
+
+#include "pm3_bytelib.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include <lauxlib.h>
+
+#define BYTES_METATABLE         "pm3.bytes"
+
+typedef struct {
+	uint8_t *data;
+	size_t len;
+	bool usbcommand;            // the data is a UsbCommand
+	uint8_t storage[];          // empty for a view
+} bytes_t;
+
+static bytes_t *newbytes(lua_State *L, size_t len) {
+	bytes_t *b = lua_newuserdata(L, sizeof(bytes_t) + len);
+	b->data = b->storage;
+	b->len = len;
+	b->usbcommand = false;
+	memset(b->storage, 0, len);
+	luaL_setmetatable(L, BYTES_METATABLE);
+	return b;
+}
+
+// a view into the buffer at <parent>. The view keeps the parent alive.
+static bytes_t *newview(lua_State *L, int parent, size_t start, size_t len) {
+	parent = lua_absindex(L, parent);
+	bytes_t *p = lua_touserdata(L, parent);
+	bytes_t *b = lua_newuserdata(L, sizeof(bytes_t));
+	b->data = p->data + start;
+	b->len = len;
+	b->usbcommand = false;
+	luaL_setmetatable(L, BYTES_METATABLE);
+
+	lua_createtable(L, 1, 0);
+	lua_pushvalue(L, parent);
+	lua_rawseti(L, -2, 1);
+	lua_setuservalue(L, -2);
+	return b;
+}
+
+static bytes_t *checkbytes(lua_State *L, int idx) {
+	return luaL_checkudata(L, idx, BYTES_METATABLE);
+}
+
+// the range i..j like string.sub(), from the arguments <idx> and <idx> + 1
+static void getrange(lua_State *L, const bytes_t *b, int idx, size_t *start, size_t *len) {
+	lua_Integer i = luaL_optinteger(L, idx, 1);
+	lua_Integer j = luaL_optinteger(L, idx + 1, -1);
+	if (i < 0) i += b->len + 1;
+	if (j < 0) j += b->len + 1;
+	if (i < 1) i = 1;
+	if (j > (lua_Integer)b->len) j = b->len;
+
+	*start = i - 1;
+	*len = (i > j) ? 0 : j - i + 1;
+}
+
+// <size> bytes at the offset (from 1) in argument <idx>
+static uint8_t *checkoffset(lua_State *L, const bytes_t *b, int idx, size_t size) {
+	lua_Integer off = luaL_checkinteger(L, idx);
+	luaL_argcheck(L, off >= 1 && (size_t)off - 1 + size <= b->len, idx, "offset out of range");
+	return b->data + off - 1;
+}
+
+// the data of a byte buffer or a string
+static const uint8_t *checkdata(lua_State *L, int idx, size_t *len) {
+	bytes_t *b = luaL_testudata(L, idx, BYTES_METATABLE);
+	if (b) {
+		*len = b->len;
+		return b->data;
+	}
+	return (const uint8_t *)luaL_checklstring(L, idx, len);
+}
+
+static uint32_t getnum(const uint8_t *p, size_t size, bool be) {
+	uint32_t v = 0;
+	for (size_t i = 0; i < size; i++)
+		v |= (uint32_t)p[be ? size - 1 - i : i] << (8 * i);
+	return v;
+}
+
+static void setnum(uint8_t *p, size_t size, bool be, uint32_t v) {
+	for (size_t i = 0; i < size; i++)
+		p[be ? size - 1 - i : i] = v >> (8 * i);
+}
+
+static int l_get(lua_State *L, size_t size, bool be) {
+	bytes_t *b = checkbytes(L, 1);
+	lua_pushunsigned(L, getnum(checkoffset(L, b, 2, size), size, be));
+	return 1;
+}
+
+static int l_set(lua_State *L, size_t size, bool be) {
+	bytes_t *b = checkbytes(L, 1);
+	uint8_t *p = checkoffset(L, b, 2, size);
+	setnum(p, size, be, luaL_checkunsigned(L, 3));
+	return 0;
+}
+
+static int l_u8(lua_State *L)         { return l_get(L, 1, false); }
+static int l_u16(lua_State *L)        { return l_get(L, 2, false); }
+static int l_u32(lua_State *L)        { return l_get(L, 4, false); }
+static int l_u16be(lua_State *L)      { return l_get(L, 2, true); }
+static int l_u32be(lua_State *L)      { return l_get(L, 4, true); }
+static int l_set_u8(lua_State *L)     { return l_set(L, 1, false); }
+static int l_set_u16(lua_State *L)    { return l_set(L, 2, false); }
+static int l_set_u32(lua_State *L)    { return l_set(L, 4, false); }
+static int l_set_u16be(lua_State *L)  { return l_set(L, 2, true); }
+static int l_set_u32be(lua_State *L)  { return l_set(L, 4, true); }
+
+static int l_len(lua_State *L) {
+	lua_pushunsigned(L, checkbytes(L, 1)->len);
+	return 1;
+}
+
+static int l_sub(lua_State *L) {
+	bytes_t *b = checkbytes(L, 1);
+	size_t start, len;
+	getrange(L, b, 2, &start, &len);
+	newview(L, 1, start, len);
+	return 1;
+}
+
+static void pushhex(lua_State *L, const uint8_t *data, size_t len) {
+	static const char hexdigits[] = "0123456789ABCDEF";
+	luaL_Buffer buf;
+	char *p = luaL_buffinitsize(L, &buf, len * 2);
+	for (size_t i = 0; i < len; i++) {
+		p[i * 2] = hexdigits[data[i] >> 4];
+		p[i * 2 + 1] = hexdigits[data[i] & 0x0f];
+	}
+	luaL_pushresultsize(&buf, len * 2);
+}
+
+static int l_hex(lua_State *L) {
+	bytes_t *b = checkbytes(L, 1);
+	size_t start, len;
+	getrange(L, b, 2, &start, &len);
+	pushhex(L, b->data + start, len);
+	return 1;
+}
+
+static int l_string(lua_State *L) {
+	bytes_t *b = checkbytes(L, 1);
+	size_t start, len;
+	getrange(L, b, 2, &start, &len);
+	lua_pushlstring(L, (const char *)b->data + start, len);
+	return 1;
+}
+
+static int l_fill(lua_State *L) {
+	bytes_t *b = checkbytes(L, 1);
+	uint8_t v = luaL_checkunsigned(L, 2);
+	size_t start, len;
+	getrange(L, b, 3, &start, &len);
+	memset(b->data + start, v, len);
+	return 0;
+}
+
+// b:copy(off, src) copies a byte buffer or string to the offset
+static int l_copy(lua_State *L) {
+	bytes_t *b = checkbytes(L, 1);
+	size_t len;
+	const uint8_t *src = checkdata(L, 3, &len);
+	uint8_t *dst = checkoffset(L, b, 2, len);
+	memmove(dst, src, len);
+	return 0;
+}
+
+static int l_tostring(lua_State *L) {
+	bytes_t *b = checkbytes(L, 1);
+	pushhex(L, b->data, b->len);
+	return 1;
+}
+
+static int l_eq(lua_State *L) {
+	bytes_t *a = checkbytes(L, 1);
+	bytes_t *b = checkbytes(L, 2);
+	lua_pushboolean(L, a->len == b->len && !memcmp(a->data, b->data, a->len));
+	return 1;
+}
+
+// the offset of a UsbCommand field, or -1
+static int usbfield(const char *name) {
+	if (!strcmp(name, "cmd"))  return offsetof(UsbCommand, cmd);
+	if (!strcmp(name, "arg1")) return offsetof(UsbCommand, arg[0]);
+	if (!strcmp(name, "arg2")) return offsetof(UsbCommand, arg[1]);
+	if (!strcmp(name, "arg3")) return offsetof(UsbCommand, arg[2]);
+	return -1;
+}
+
+static void setusbdata(lua_State *L, bytes_t *b, int idx) {
+	size_t len;
+	const uint8_t *src = checkdata(L, idx, &len);
+	luaL_argcheck(L, len <= USB_CMD_DATA_SIZE, idx, "data too long");
+	uint8_t *dst = b->data + offsetof(UsbCommand, d);
+	memmove(dst, src, len);
+	memset(dst + len, 0, USB_CMD_DATA_SIZE - len);
+}
+
+static int l_index(lua_State *L) {
+	bytes_t *b = checkbytes(L, 1);
+
+	if (lua_type(L, 2) == LUA_TNUMBER) {
+		lua_Integer i = lua_tointeger(L, 2);
+		if (i >= 1 && (size_t)i <= b->len)
+			lua_pushunsigned(L, b->data[i - 1]);
+		else
+			lua_pushnil(L);
+		return 1;
+	}
+
+	const char *name = luaL_checkstring(L, 2);
+	if (b->usbcommand) {
+		int off = usbfield(name);
+		if (off >= 0) {
+			uint64_t v;
+			memcpy(&v, b->data + off, sizeof(v));
+			lua_pushnumber(L, v);
+			return 1;
+		}
+		if (!strcmp(name, "data")) {
+			newview(L, 1, offsetof(UsbCommand, d), USB_CMD_DATA_SIZE);
+			return 1;
+		}
+	}
+
+	// methods
+	lua_pushvalue(L, 2);
+	lua_rawget(L, lua_upvalueindex(1));
+	return 1;
+}
+
+static int l_newindex(lua_State *L) {
+	bytes_t *b = checkbytes(L, 1);
+
+	if (lua_type(L, 2) == LUA_TNUMBER) {
+		lua_Integer i = lua_tointeger(L, 2);
+		luaL_argcheck(L, i >= 1 && (size_t)i <= b->len, 2, "index out of range");
+		b->data[i - 1] = luaL_checkunsigned(L, 3);
+		return 0;
+	}
+
+	const char *name = luaL_checkstring(L, 2);
+	if (b->usbcommand) {
+		int off = usbfield(name);
+		if (off >= 0) {
+			uint64_t v = luaL_checknumber(L, 3);
+			memcpy(b->data + off, &v, sizeof(v));
+			return 0;
+		}
+		if (!strcmp(name, "data")) {
+			setusbdata(L, b, 3);
+			return 0;
+		}
+	}
+	return luaL_error(L, "can't set field '%s' of a byte buffer", name);
+}
+
+static int l_new(lua_State *L) {
+	lua_Integer len = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, len >= 0, 1, "negative length");
+	newbytes(L, len);
+	return 1;
+}
+
+static int hexval(char c) {
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+// returns nil and an error message for a wrong hex string
+static int l_fromhex(lua_State *L) {
+	size_t hexlen;
+	const char *hex = luaL_checklstring(L, 1, &hexlen);
+	if (hexlen % 2) {
+		lua_pushnil(L);
+		lua_pushstring(L, "odd number of hex digits");
+		return 2;
+	}
+
+	bytes_t *b = newbytes(L, hexlen / 2);
+	for (size_t i = 0; i < b->len; i++) {
+		int hi = hexval(hex[i * 2]);
+		int lo = hexval(hex[i * 2 + 1]);
+		if (hi < 0 || lo < 0) {
+			lua_pushnil(L);
+			lua_pushstring(L, "not a hex string");
+			return 2;
+		}
+		b->data[i] = hi << 4 | lo;
+	}
+	return 1;
+}
+
+static int l_fromstring(lua_State *L) {
+	size_t len;
+	const char *s = luaL_checklstring(L, 1, &len);
+	bytes_t *b = newbytes(L, len);
+	memcpy(b->data, s, len);
+	return 1;
+}
+
+// bytes.usbcommand([cmd, arg1, arg2, arg3, data]), or bytes.usbcommand(s) with a whole UsbCommand as string
+static int l_usbcommand(lua_State *L) {
+	UsbCommand c = {0};
+	if (lua_type(L, 1) == LUA_TSTRING || luaL_testudata(L, 1, BYTES_METATABLE)) {
+		size_t len;
+		const uint8_t *data = checkdata(L, 1, &len);
+		luaL_argcheck(L, len == sizeof(UsbCommand), 1, "wrong UsbCommand size");
+		memcpy(&c, data, sizeof(c));
+		bytes_push_usbcommand(L, &c);
+		return 1;
+	}
+
+	c.cmd = luaL_optnumber(L, 1, 0);
+	for (int i = 0; i < 3; i++)
+		c.arg[i] = luaL_optnumber(L, 2 + i, 0);
+
+	bytes_push_usbcommand(L, &c);
+	if (!lua_isnoneornil(L, 5))
+		setusbdata(L, lua_touserdata(L, -1), 5);
+	return 1;
+}
+
+uint8_t *bytes_tobytes(lua_State *L, int idx, size_t *len) {
+	bytes_t *b = luaL_testudata(L, idx, BYTES_METATABLE);
+	if (b == NULL)
+		return NULL;
+	*len = b->len;
+	return b->data;
+}
+
+void bytes_push_usbcommand(lua_State *L, const UsbCommand *c) {
+	bytes_t *b = newbytes(L, sizeof(UsbCommand));
+	b->usbcommand = true;
+	memcpy(b->data, c, sizeof(UsbCommand));
+}
+
+static const luaL_Reg bytes_methods[] = {
+	{"len",         l_len},
+	{"sub",         l_sub},
+	{"hex",         l_hex},
+	{"string",      l_string},
+	{"fill",        l_fill},
+	{"copy",        l_copy},
+	{"u8",          l_u8},
+	{"u16",         l_u16},
+	{"u32",         l_u32},
+	{"u16be",       l_u16be},
+	{"u32be",       l_u32be},
+	{"set_u8",      l_set_u8},
+	{"set_u16",     l_set_u16},
+	{"set_u32",     l_set_u32},
+	{"set_u16be",   l_set_u16be},
+	{"set_u32be",   l_set_u32be},
+	{NULL, NULL}
+};
+
+static const luaL_Reg byteslib[] = {
+	{"new",         l_new},
+	{"fromhex",     l_fromhex},
+	{"fromstring",  l_fromstring},
+	{"usbcommand",  l_usbcommand},
+	{NULL, NULL}
+};
+
+static int luaopen_bytes(lua_State *L) {
+	luaL_newmetatable(L, BYTES_METATABLE);
+	luaL_newlib(L, bytes_methods);
+	lua_pushcclosure(L, l_index, 1);
+	lua_setfield(L, -2, "__index");
+	lua_pushcfunction(L, l_newindex);
+	lua_setfield(L, -2, "__newindex");
+	lua_pushcfunction(L, l_len);
+	lua_setfield(L, -2, "__len");
+	lua_pushcfunction(L, l_tostring);
+	lua_setfield(L, -2, "__tostring");
+	lua_pushcfunction(L, l_eq);
+	lua_setfield(L, -2, "__eq");
+	lua_pop(L, 1);
+
+	luaL_newlib(L, byteslib);
+	return 1;
+}
+
+/*
+** Open bytes library
+*/
+int set_bytes_library(lua_State *L) {
+	luaL_requiref(L, "bytes", luaopen_bytes, 1);
+	lua_pop(L, 1);
+	return 1;
+}
@@ -0,0 +1,23 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Lua byte buffers, for binary data and UsbCommands without hex strings
+//-----------------------------------------------------------------------------
+#ifndef PM3_BYTELIB
+#define PM3_BYTELIB
+
+#include <stddef.h>
+#include <stdint.h>
+#include <lua.h>
+#include "usb_cmd.h"
+
+int set_bytes_library(lua_State *L);
+
+// the data of the byte buffer at <idx>, or NULL if it isn't a byte buffer
+uint8_t *bytes_tobytes(lua_State *L, int idx, size_t *len);
+// pushes a copy of <c> as a byte buffer with the UsbCommand fields
+void bytes_push_usbcommand(lua_State *L, const UsbCommand *c);
+
+#endif /* PM3_BYTELIB */
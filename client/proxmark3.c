@@ -18,6 +18,7 @@
 #include <unistd.h>
 #include <readline/readline.h>
 #include <readline/history.h>
+#include <jansson.h>
 
 #include "util_posix.h"
 #include "proxgui.h"
@@ -29,6 +30,37 @@
 #include "whereami.h"
 #include "comms.h"
 #include "uart.h"
+#include "lfbatch.h"
+#include "daemon.h"
+#include "result.h"
+
+static bool json_output = false;
+
+
+// -json: runs <cmd> without its screen output and prints a JSON line with the
+// records of the command instead
+static int CommandReceivedJSON(char *cmd)
+{
+	SetSilentMode(true);
+	ResultCollect();
+	int ret = CommandReceived(cmd);
+	json_t *records = ResultTake();
+	SetSilentMode(false);
+
+	json_t *root = json_object();
+	json_object_set_new(root, "cmd", json_string(cmd));
+	json_object_set_new(root, "result", json_integer(ret));
+	json_object_set_new(root, "records", records);
+	char *line = json_dumps(root, JSON_COMPACT | JSON_PRESERVE_ORDER);
+	if (line) {
+		printf("%s\n", line);
+		fflush(stdout);
+		free(line);
+	}
+	json_decref(root);
+	return ret;
+}
+
 
 void
 #ifdef __has_attribute
@@ -44,7 +76,9 @@ main_loop(char *script_cmds_file, char *script_cmd, bool usb_present) {
 	if (usb_present) {
 		SetOffline(false);
 		// cache Version information now:
+		SetSilentMode(json_output);
 		CmdVersion(NULL);
+		SetSilentMode(false);
 	} else {
 		SetOffline(true);
 	}
@@ -56,7 +90,7 @@ main_loop(char *script_cmds_file, char *script_cmd, bool usb_present) {
 
 	if (script_cmds_file) {
 		script_file = fopen(script_cmds_file, "r");
-		if (script_file) {
+		if (script_file && !json_output) {
 			printf("executing commands from file: %s\n", script_cmds_file);
 		}
 	}
@@ -74,14 +108,14 @@ main_loop(char *script_cmds_file, char *script_cmd, bool usb_present) {
 			} else {
 				strcleanrn(script_cmd_buf, sizeof(script_cmd_buf));
 
-				if ((cmd = strmcopy(script_cmd_buf)) != NULL) {
+				if ((cmd = strmcopy(script_cmd_buf)) != NULL && !json_output) {
 					printf(PROXPROMPT"%s\n", cmd);
 				}
 			}
 		} else {
 			// If there is a script command
 			if (execCommand){
-				if ((cmd = strmcopy(script_cmd)) != NULL) {
+				if ((cmd = strmcopy(script_cmd)) != NULL && !json_output) {
 					printf(PROXPROMPT"%s\n", cmd);
 				}
 
@@ -95,12 +129,13 @@ main_loop(char *script_cmds_file, char *script_cmd, bool usb_present) {
 				if (stdinOnPipe) {
 					memset(script_cmd_buf, 0, sizeof(script_cmd_buf));
 					if (!fgets(script_cmd_buf, sizeof(script_cmd_buf), stdin)) {
-						printf("\nStdin end. Exit...\n");
+						if (!json_output)
+							printf("\nStdin end. Exit...\n");
 						break;
 					}
 					strcleanrn(script_cmd_buf, sizeof(script_cmd_buf));
 
-					if ((cmd = strmcopy(script_cmd_buf)) != NULL) {
+					if ((cmd = strmcopy(script_cmd_buf)) != NULL && !json_output) {
 						printf(PROXPROMPT"%s\n", cmd);
 					}
 					
@@ -118,7 +153,7 @@ main_loop(char *script_cmds_file, char *script_cmd, bool usb_present) {
 				cmd[strlen(cmd) - 1] = 0x00;
 			
 			if (cmd[0] != 0x00) {
-				int ret = CommandReceived(cmd);
+				int ret = json_output ? CommandReceivedJSON(cmd) : CommandReceived(cmd);
 				add_history(cmd);
 				if (ret == 99) {  // exit or quit
 					break;
@@ -179,7 +214,9 @@ static void set_my_executable_path(void)
 }
 
 static void show_help(bool showFullHelp, char *command_line){
-	printf("syntax: %s <port> [-h|-help|-m|-f|-flush|-w|-wait|-c|-command|-l|-lua] [cmd_script_file_name] [command][lua_script_name]\n", command_line);
+	printf("syntax: %s <port> [-h|-help|-m|-f|-flush|-w|-wait|-c|-command|-l|-lua|-json] [cmd_script_file_name] [command][lua_script_name]\n", command_line);
+	printf("        %s <-b|-batch> [-j <jobs>] <sample file|directory> ...\n", command_line);
+	printf("        %s <port> <-d|-daemon> <socket>\n", command_line);
 	printf("\texample: %s "SERIAL_PORT_H"\n\n", command_line);
 
 	if (showFullHelp){
@@ -197,6 +234,16 @@ static void show_help(bool showFullHelp, char *command_line){
 		printf("\t%s "SERIAL_PORT_H" -command \"hf mf nested 1 *\"\n\n", command_line);
 		printf("lua: <-l|-lua> Execute lua script.\n");
 		printf("\t%s "SERIAL_PORT_H" -l hf_read\n\n", command_line);
+		printf("batch: <-b|-batch> Offline `lf search 1` on sample files (*.pm3, *.pm3b in directories), no device needed.\n");
+		printf("\tOne JSON line per file. -j <jobs> sets the number of worker processes (default: one per CPU).\n");
+		printf("\t%s -b -j 4 traces/\n\n", command_line);
+		printf("daemon: <-d|-daemon> Keep the device open and execute the commands sent to a Unix domain socket.\n");
+		printf("\tRequests and responses are JSON objects, each after its length as 4 byte big endian number:\n");
+		printf("\t{\"cmd\": \"hw version\"} -> {\"cmd\": ..., \"status\": \"ok\", \"result\": 0, \"output\": ..., \"time_ms\": ...}\n");
+		printf("\t%s "SERIAL_PORT_H" -d /tmp/proxmark3.sock\n\n", command_line);
+		printf("json: <-json> Print one JSON line per command with what it found (UIDs, tag types, keys, blocks)\n");
+		printf("\tinstead of its usual output.\n");
+		printf("\t%s "SERIAL_PORT_H" -json -c \"hf 14a info\"\n\n", command_line);
 	}
 }
 
@@ -209,12 +256,28 @@ int main(int argc, char* argv[]) {
 	bool addLuaExec = false;
 	char *script_cmds_file = NULL;
 	char *script_cmd = NULL;
+	char *daemon_socket = NULL;
 
 	if (argc < 2) {
 		show_help(true, argv[0]);
 		return 1;
 	}
 
+	// offline batch decoding doesn't need a port
+	if (strcmp(argv[1], "-b") == 0 || strcmp(argv[1], "-batch") == 0) {
+		int first = 2;
+		int jobs = 0;
+		if (argc > 3 && strcmp(argv[2], "-j") == 0) {
+			jobs = atoi(argv[3]);
+			first = 4;
+		}
+		if (first >= argc) {
+			show_help(true, argv[0]);
+			return 1;
+		}
+		return LFBatchDecode(&argv[first], argc - first, jobs);
+	}
+
 	for (int i = 1; i < argc; i++) {
 		if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i],"-help") == 0) {
 			show_help(false, argv[0]);
@@ -244,10 +307,18 @@ int main(int argc, char* argv[]) {
 			executeCommand = true;
 			addLuaExec = true;
 		}
+
+		if(strcmp(argv[i],"-json") == 0){
+			json_output = true;
+		}
+
+		if((strcmp(argv[i],"-d") == 0 || strcmp(argv[i],"-daemon") == 0) && i + 1 < argc){
+			daemon_socket = argv[++i];
+		}
 	}
 
 	// If the user passed the filename of the 'script' to execute, get it from last parameter
-	if (argc > 2 && argv[argc - 1] && argv[argc - 1][0] != '-') {
+	if (!daemon_socket && argc > 2 && argv[argc - 1] && argv[argc - 1][0] != '-') {
 		if (executeCommand){
 			script_cmd = argv[argc - 1];
 			
@@ -269,7 +340,8 @@ int main(int argc, char* argv[]) {
 					}
 				}
 				
-				printf("Execute command from commandline: %s\n", script_cmd);
+				if (!json_output)
+					printf("Execute command from commandline: %s\n", script_cmd);
 			}
 		} else {
 			script_cmds_file = argv[argc - 1];
@@ -288,26 +360,36 @@ int main(int argc, char* argv[]) {
 	// try to open USB connection to Proxmark
 	usb_present = OpenProxmark(argv[1], waitCOMPort, 20);
 
+	int exit_code = 0;
+	if (daemon_socket) {
+		SetOffline(!usb_present);
+		if (usb_present) {
+			// cache Version information now:
+			CmdVersion(NULL);
+		}
+		exit_code = DaemonRun(daemon_socket);
+	} else {
 #ifdef HAVE_GUI
 #ifdef _WIN32
-	InitGraphics(argc, argv, script_cmds_file, script_cmd, usb_present);
-	MainGraphics();
-#else
-	char* display = getenv("DISPLAY");
-
-	if (display && strlen(display) > 1)
-	{
 		InitGraphics(argc, argv, script_cmds_file, script_cmd, usb_present);
 		MainGraphics();
-	}
-	else
-	{
-		main_loop(script_cmds_file, script_cmd, usb_present);
-	}
+#else
+		char* display = getenv("DISPLAY");
+
+		if (display && strlen(display) > 1)
+		{
+			InitGraphics(argc, argv, script_cmds_file, script_cmd, usb_present);
+			MainGraphics();
+		}
+		else
+		{
+			main_loop(script_cmds_file, script_cmd, usb_present);
+		}
 #endif
 #else
-	main_loop(script_cmds_file, script_cmd, usb_present);
-#endif	
+		main_loop(script_cmds_file, script_cmd, usb_present);
+#endif
+	}
 
 	// Switch off field and clean up the port
 	if (usb_present) {
@@ -316,5 +398,5 @@ int main(int argc, char* argv[]) {
 		CloseProxmark();
 	}
 
-	exit(0);
+	exit(exit_code);
 }
@@ -0,0 +1,90 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Typed command results, for tools which would otherwise parse the screen
+//-----------------------------------------------------------------------------
+
+#include "result.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static json_t *records = NULL;
+static json_t *record = NULL;
+
+
+void ResultCollect(void)
+{
+	json_decref(records);
+	records = json_array();
+	record = NULL;
+}
+
+
+json_t *ResultTake(void)
+{
+	json_t *taken = records ? records : json_array();
+	records = NULL;
+	record = NULL;
+	return taken;
+}
+
+
+void ResultRecord(const char *type)
+{
+	if (!records)
+		return;
+	record = json_object();
+	json_object_set_new(record, "type", json_string(type));
+	json_array_append_new(records, record);
+}
+
+
+static void set_field(const char *name, json_t *value)
+{
+	if (record)
+		json_object_set_new(record, name, value);
+	else
+		json_decref(value);
+}
+
+
+void ResultString(const char *name, const char *value)
+{
+	set_field(name, json_string(value));
+}
+
+
+void ResultHex(const char *name, const uint8_t *data, size_t len)
+{
+	if (!record)
+		return;
+	char *hex = malloc(len * 2 + 1);
+	if (!hex)
+		return;
+	for (size_t i = 0; i < len; i++)
+		sprintf(hex + i * 2, "%02X", data[i]);
+	hex[len * 2] = '\0';
+	set_field(name, json_string(hex));
+	free(hex);
+}
+
+
+void ResultInt(const char *name, int64_t value)
+{
+	set_field(name, json_integer(value));
+}
+
+
+void ResultBool(const char *name, bool value)
+{
+	set_field(name, json_boolean(value));
+}
+
+
+const char *ResultType(void)
+{
+	return record ? json_string_value(json_object_get(record, "type")) : NULL;
+}
@@ -0,0 +1,36 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Typed command results, for tools which would otherwise parse the screen
+//
+// Commands report what they found (UIDs, tag types, keys, block data) as
+// records next to their PrintAndLog() output. A record is a JSON object with a
+// "type" and the fields added after ResultRecord(). Nothing is kept unless a
+// caller asked for the records with ResultCollect().
+//-----------------------------------------------------------------------------
+
+#ifndef RESULT_H__
+#define RESULT_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <jansson.h>
+
+// start collecting the records of the next command, dropping any left over
+void ResultCollect(void);
+// stop collecting. Returns the JSON array of the records, to be freed with json_decref().
+json_t *ResultTake(void);
+
+// start a new record of <type>. The fields below go to the latest record.
+void ResultRecord(const char *type);
+void ResultString(const char *name, const char *value);
+void ResultHex(const char *name, const uint8_t *data, size_t len);
+void ResultInt(const char *name, int64_t value);
+void ResultBool(const char *name, bool value);
+// the type of the latest record, or NULL if there is none
+const char *ResultType(void);
+
+#endif
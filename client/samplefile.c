@@ -0,0 +1,369 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Sample file (graph trace) load and save.
+//-----------------------------------------------------------------------------
+
+#include "samplefile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zlib.h"
+#include "util_posix.h"
+
+#define SAMPLEFILE_COMPRESS_LEVEL   6
+
+static voidpf samplefile_zalloc(voidpf opaque, uInt items, uInt size)
+{
+	return malloc(items*size);
+}
+
+
+static void samplefile_zfree(voidpf opaque, voidpf address)
+{
+	free(address);
+}
+
+
+static size_t packed_len(size_t count, uint8_t bits_per_sample)
+{
+	return (count * bits_per_sample + 7) / 8;
+}
+
+
+static bool valid_bits_per_sample(uint8_t bits_per_sample)
+{
+	return (bits_per_sample >= 1 && bits_per_sample <= 8) || bits_per_sample == 16 || bits_per_sample == 32;
+}
+
+
+//-----------------------------------------------------------------------------
+// parse the legacy text format (one decimal number per line) from memory.
+// The buffer isn't NUL terminated, so we can't use strtol() here.
+//-----------------------------------------------------------------------------
+static int load_text(const uint8_t *data, size_t size, int *samples, size_t maxlen, size_t *len)
+{
+	size_t n = 0;
+	size_t pos = 0;
+
+	while (pos < size) {
+		// same semantics as atoi() on each line: leading blanks, optional sign, digits
+		while (pos < size && (data[pos] == ' ' || data[pos] == '\t')) pos++;
+		bool negative = false;
+		if (pos < size && (data[pos] == '-' || data[pos] == '+')) {
+			negative = (data[pos] == '-');
+			pos++;
+		}
+		int value = 0;
+		while (pos < size && data[pos] >= '0' && data[pos] <= '9') {
+			value = value * 10 + (data[pos] - '0');
+			pos++;
+		}
+		// skip the rest of the line
+		while (pos < size && data[pos] != '\n') pos++;
+		if (pos < size) pos++;
+
+		if (n == maxlen) {
+			*len = n;
+			return SAMPLEFILE_TRUNCATED;
+		}
+		samples[n++] = negative ? -value : value;
+	}
+
+	*len = n;
+	return SAMPLEFILE_OK;
+}
+
+
+static int load_binary(const uint8_t *data, size_t size, int *samples, size_t maxlen, size_t *len, sample_config *config)
+{
+	samplefile_header_t hdr;
+	memcpy(&hdr, data, sizeof(hdr));
+
+	if (hdr.version != SAMPLEFILE_VERSION
+		|| !valid_bits_per_sample(hdr.bits_per_sample)
+		|| hdr.data_len > size - sizeof(hdr)) {
+		return SAMPLEFILE_E_FORMAT;
+	}
+
+	if (config) {
+		config->decimation = hdr.decimation;
+		// wide samples have been processed on the client, the device sampled them with 8 bits at most
+		config->bits_per_sample = hdr.bits_per_sample > 8 ? 8 : hdr.bits_per_sample;
+		config->averaging = hdr.averaging;
+		config->divisor = hdr.divisor;
+		config->trigger_threshold = hdr.trigger_threshold;
+		config->samples_to_skip = hdr.samples_to_skip;
+	}
+
+	size_t count = hdr.sample_count;
+	int res = SAMPLEFILE_OK;
+	if (count > maxlen) {
+		count = maxlen;
+		res = SAMPLEFILE_TRUNCATED;
+	}
+
+	// we only need to decode as many bytes as there are samples to load
+	size_t needed = packed_len(count, hdr.bits_per_sample);
+	const uint8_t *payload = data + sizeof(hdr);
+	uint8_t *inflated = NULL;
+
+	if (hdr.flags & SAMPLEFILE_FLAG_ZLIB) {
+		inflated = malloc(needed ? needed : 1);
+		if (!inflated) {
+			return SAMPLEFILE_E_MEMORY;
+		}
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		stream.next_in = (uint8_t *)payload;
+		stream.avail_in = hdr.data_len;
+		stream.next_out = inflated;
+		stream.avail_out = needed;
+		stream.zalloc = samplefile_zalloc;
+		stream.zfree = samplefile_zfree;
+		if (inflateInit(&stream) != Z_OK) {
+			free(inflated);
+			return SAMPLEFILE_E_ZLIB;
+		}
+		int ret = inflate(&stream, Z_FINISH);
+		inflateEnd(&stream);
+		if ((ret != Z_STREAM_END && ret != Z_BUF_ERROR && ret != Z_OK) || stream.avail_out != 0) {
+			free(inflated);
+			return SAMPLEFILE_E_ZLIB;
+		}
+		payload = inflated;
+	} else if (hdr.data_len < needed) {
+		return SAMPLEFILE_E_FORMAT;
+	}
+
+	if (hdr.bits_per_sample == 32) {
+		for (size_t i = 0; i < count; i++) {
+			const uint8_t *p = payload + i * 4;
+			samples[i] = (int32_t)(p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24);
+		}
+	} else if (hdr.bits_per_sample == 16) {
+		for (size_t i = 0; i < count; i++) {
+			const uint8_t *p = payload + i * 2;
+			samples[i] = (int16_t)(p[0] | p[1] << 8);
+		}
+	} else if (hdr.bits_per_sample == 8) {
+		const int8_t *p = (const int8_t *)payload;
+		for (size_t i = 0; i < count; i++) {
+			samples[i] = p[i];
+		}
+	} else {
+		// unpack MSB first, same as getSamples() does for the device's packed buffer
+		uint8_t shift = 8 - hdr.bits_per_sample;
+		size_t bitpos = 0;
+		for (size_t i = 0; i < count; i++) {
+			uint8_t val = 0;
+			for (uint8_t b = 0; b < hdr.bits_per_sample; b++, bitpos++) {
+				val = (val << 1) | ((payload[bitpos >> 3] >> (7 - (bitpos & 7))) & 1);
+			}
+			samples[i] = (int)(val << shift) - 128;
+		}
+	}
+
+	free(inflated);
+	*len = count;
+	return res;
+}
+
+
+int samplefile_load(const char *filename, int *samples, size_t maxlen, size_t *len, sample_config *config, samplefile_format_t *format)
+{
+	mapped_file_t mf;
+	*len = 0;
+	if (config) memset(config, 0, sizeof(sample_config));
+
+	int res = map_file(filename, &mf);
+	if (res != MAP_FILE_OK) {
+		return res == MAP_FILE_E_OPEN ? SAMPLEFILE_E_OPEN : res == MAP_FILE_E_MEMORY ? SAMPLEFILE_E_MEMORY : SAMPLEFILE_E_IO;
+	}
+
+	if (mf.size >= sizeof(samplefile_header_t) && memcmp(mf.data, SAMPLEFILE_MAGIC, 4) == 0) {
+		if (format) *format = SAMPLEFILE_BINARY;
+		res = load_binary(mf.data, mf.size, samples, maxlen, len, config);
+	} else {
+		if (format) *format = SAMPLEFILE_TEXT;
+		res = load_text(mf.data, mf.size, samples, maxlen, len);
+	}
+
+	unmap_file(&mf);
+	return res;
+}
+
+
+int samplefile_save(const char *filename, const int *samples, size_t len, const sample_config *config, bool compress)
+{
+	if (len > UINT32_MAX) {
+		return SAMPLEFILE_E_FORMAT;
+	}
+
+	samplefile_header_t hdr;
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, SAMPLEFILE_MAGIC, 4);
+	hdr.version = SAMPLEFILE_VERSION;
+	hdr.bits_per_sample = 8;
+	if (config) {
+		if (config->bits_per_sample >= 1 && config->bits_per_sample <= 8) {
+			hdr.bits_per_sample = config->bits_per_sample;
+		}
+		hdr.decimation = config->decimation;
+		hdr.averaging = config->averaging;
+		hdr.divisor = config->divisor;
+		hdr.trigger_threshold = config->trigger_threshold;
+		hdr.samples_to_skip = config->samples_to_skip;
+	}
+	hdr.sample_count = len;
+
+	// Only pack if this is lossless, i.e. the samples still look like they did
+	// when they came from the device. Graph operations may have changed them.
+	if (hdr.bits_per_sample < 8) {
+		uint8_t lowmask = (1 << (8 - hdr.bits_per_sample)) - 1;
+		for (size_t i = 0; i < len; i++) {
+			if (samples[i] < -128 || samples[i] > 127 || ((samples[i] + 128) & lowmask)) {
+				hdr.bits_per_sample = 8;
+				break;
+			}
+		}
+	}
+	// graph operations may also have taken them out of the int8 range
+	if (hdr.bits_per_sample == 8) {
+		for (size_t i = 0; i < len; i++) {
+			if (samples[i] < INT16_MIN || samples[i] > INT16_MAX) {
+				hdr.bits_per_sample = 32;
+				break;
+			}
+			if (samples[i] < -128 || samples[i] > 127) {
+				hdr.bits_per_sample = 16;
+			}
+		}
+	}
+
+	size_t rawlen = packed_len(len, hdr.bits_per_sample);
+	uint8_t *raw = calloc(rawlen ? rawlen : 1, 1);
+	if (!raw) {
+		return SAMPLEFILE_E_MEMORY;
+	}
+
+	if (hdr.bits_per_sample == 32) {
+		for (size_t i = 0; i < len; i++) {
+			uint32_t v = (uint32_t)samples[i];
+			raw[i * 4] = v & 0xFF;
+			raw[i * 4 + 1] = (v >> 8) & 0xFF;
+			raw[i * 4 + 2] = (v >> 16) & 0xFF;
+			raw[i * 4 + 3] = (v >> 24) & 0xFF;
+		}
+	} else if (hdr.bits_per_sample == 16) {
+		for (size_t i = 0; i < len; i++) {
+			uint16_t v = (uint16_t)samples[i];
+			raw[i * 2] = v & 0xFF;
+			raw[i * 2 + 1] = v >> 8;
+		}
+	} else if (hdr.bits_per_sample == 8) {
+		for (size_t i = 0; i < len; i++) {
+			raw[i] = (uint8_t)(int8_t)samples[i];
+		}
+	} else {
+		uint8_t shift = 8 - hdr.bits_per_sample;
+		size_t bitpos = 0;
+		for (size_t i = 0; i < len; i++) {
+			uint8_t val = (uint8_t)(samples[i] + 128) >> shift;
+			for (int8_t b = hdr.bits_per_sample - 1; b >= 0; b--, bitpos++) {
+				if ((val >> b) & 1) {
+					raw[bitpos >> 3] |= 0x80 >> (bitpos & 7);
+				}
+			}
+		}
+	}
+
+	uint8_t *payload = raw;
+	uint8_t *deflated = NULL;
+	size_t payload_len = rawlen;
+
+	if (compress && rawlen > 0) {
+		z_stream stream;
+		memset(&stream, 0, sizeof(stream));
+		stream.zalloc = samplefile_zalloc;
+		stream.zfree = samplefile_zfree;
+		stream.opaque = Z_NULL;
+		if (deflateInit(&stream, SAMPLEFILE_COMPRESS_LEVEL) != Z_OK) {
+			free(raw);
+			return SAMPLEFILE_E_ZLIB;
+		}
+		size_t maxlen = deflateBound(&stream, rawlen);
+		deflated = malloc(maxlen);
+		if (!deflated) {
+			deflateEnd(&stream);
+			free(raw);
+			return SAMPLEFILE_E_MEMORY;
+		}
+		stream.next_in = raw;
+		stream.avail_in = rawlen;
+		stream.next_out = deflated;
+		stream.avail_out = maxlen;
+		int ret = deflate(&stream, Z_FINISH);
+		deflateEnd(&stream);
+		// keep it uncompressed if compression didn't help. Our zlib is tuned to
+		// never emit stored blocks, so incompressible data may not even fit the bound.
+		if (ret == Z_STREAM_END && stream.total_out < rawlen) {
+			payload = deflated;
+			payload_len = stream.total_out;
+			hdr.flags |= SAMPLEFILE_FLAG_ZLIB;
+		}
+	}
+	hdr.data_len = payload_len;
+
+	int res = SAMPLEFILE_OK;
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		res = SAMPLEFILE_E_OPEN;
+	} else {
+		if (fwrite(&hdr, sizeof(hdr), 1, f) != 1
+			|| fwrite(payload, 1, payload_len, f) != payload_len) {
+			res = SAMPLEFILE_E_IO;
+		}
+		if (fclose(f) != 0) {
+			res = SAMPLEFILE_E_IO;
+		}
+	}
+
+	free(deflated);
+	free(raw);
+	return res;
+}
+
+
+int samplefile_save_text(const char *filename, const int *samples, size_t len)
+{
+	FILE *f = fopen(filename, "w");
+	if (!f) {
+		return SAMPLEFILE_E_OPEN;
+	}
+	for (size_t i = 0; i < len; i++) {
+		fprintf(f, "%d\n", samples[i]);
+	}
+	if (fclose(f) != 0) {
+		return SAMPLEFILE_E_IO;
+	}
+	return SAMPLEFILE_OK;
+}
+
+
+const char *samplefile_strerror(int res)
+{
+	switch (res) {
+		case SAMPLEFILE_OK:        return "ok";
+		case SAMPLEFILE_TRUNCATED: return "file holds more samples than the buffer can take, truncated";
+		case SAMPLEFILE_E_OPEN:    return "couldn't open file";
+		case SAMPLEFILE_E_IO:      return "read/write error";
+		case SAMPLEFILE_E_FORMAT:  return "invalid or unsupported sample file";
+		case SAMPLEFILE_E_MEMORY:  return "out of memory";
+		case SAMPLEFILE_E_ZLIB:    return "compressed data is corrupt";
+		default:                   return "unknown error";
+	}
+}
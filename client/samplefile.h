@@ -0,0 +1,78 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Sample file (graph trace) load and save.
+//
+// Two formats are supported:
+//  - the legacy text format: one decimal sample per line (see traces/)
+//  - a versioned binary container: a fixed header carrying the sample_config
+//    the samples were taken with, followed by int8 samples (or samples packed
+//    with bits_per_sample bits, MSB first, or little endian int16/int32 samples
+//    if the client took them out of the int8 range), optionally zlib compressed.
+// Loading auto-detects the format and maps the file into memory.
+//-----------------------------------------------------------------------------
+
+#ifndef SAMPLEFILE_H__
+#define SAMPLEFILE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "usb_cmd.h"   // for sample_config, PACKED
+
+#define SAMPLEFILE_MAGIC            "PM3S"
+#define SAMPLEFILE_VERSION          1
+
+#define SAMPLEFILE_FLAG_ZLIB        0x01
+
+typedef struct {
+	char magic[4];              // SAMPLEFILE_MAGIC
+	uint8_t version;            // SAMPLEFILE_VERSION
+	uint8_t flags;              // SAMPLEFILE_FLAG_*
+	uint8_t bits_per_sample;    // 1..8, 16 or 32. Samples are packed MSB first if < 8, little endian if > 8
+	uint8_t decimation;         // 0 if unknown
+	uint8_t averaging;
+	uint8_t reserved[3];
+	int32_t divisor;
+	int32_t trigger_threshold;
+	int32_t samples_to_skip;
+	uint32_t sample_count;
+	uint32_t data_len;          // length of the (possibly compressed) payload following the header
+} PACKED samplefile_header_t;
+
+// return codes. Negative values are errors, SAMPLEFILE_TRUNCATED means that
+// the file held more samples than fit into the buffer and the rest was dropped
+#define SAMPLEFILE_OK               0
+#define SAMPLEFILE_TRUNCATED        1
+#define SAMPLEFILE_E_OPEN          -1
+#define SAMPLEFILE_E_IO            -2
+#define SAMPLEFILE_E_FORMAT        -3
+#define SAMPLEFILE_E_MEMORY        -4
+#define SAMPLEFILE_E_ZLIB          -5
+
+typedef enum {
+	SAMPLEFILE_TEXT = 0,
+	SAMPLEFILE_BINARY,
+} samplefile_format_t;
+
+// Save <len> samples in the binary format. <config> may be NULL if the sample
+// configuration is unknown. Samples outside of int8 range are stored as int16 or int32.
+// Returns SAMPLEFILE_OK on success.
+int samplefile_save(const char *filename, const int *samples, size_t len, const sample_config *config, bool compress);
+
+// Save <len> samples in the text format. Returns SAMPLEFILE_OK on success.
+int samplefile_save_text(const char *filename, const int *samples, size_t len);
+
+// Load samples from a text or binary sample file into <samples> (max <maxlen> samples).
+// <len> receives the number of samples loaded. <config> (optional) receives the
+// sample configuration stored in the file (zeroed for text files), <format>
+// (optional) receives the detected format. Returns SAMPLEFILE_OK or SAMPLEFILE_TRUNCATED
+// on success. Doesn't print anything and doesn't touch global state, so it can be
+// used from worker threads.
+int samplefile_load(const char *filename, int *samples, size_t maxlen, size_t *len, sample_config *config, samplefile_format_t *format);
+
+const char *samplefile_strerror(int res);
+
+#endif
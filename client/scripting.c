@@ -15,17 +15,20 @@
 #include <lualib.h>
 #include <lauxlib.h>
 #include <string.h>
+#include <inttypes.h>
 #include "proxmark3.h"
 #include "comms.h"
 #include "usb_cmd.h"
 #include "cmdmain.h"
 #include "util.h"
+#include "pm3_bytelib.h"
 #include "mifare/mifarehost.h"
 #include "../common/iso15693tools.h"
 #include "iso14443crc.h"
 #include "../common/crc16.h"
 #include "../common/crc64.h"
 #include <mbedtls/sha1.h>
+#include <mbedtls/md5.h>
 #include <mbedtls/aes.h>
 
 /**
@@ -52,9 +55,11 @@ static int l_SendCommand(lua_State *L){
 
 	==> A 544 byte buffer will do.
 	**/
-	//Pop cmd
+	//Pop cmd, a byte buffer or a string
 	size_t size;
-	const char *data = luaL_checklstring(L, 1, &size);
+	const char *data = (const char *)bytes_tobytes(L, 1, &size);
+	if (data == NULL)
+		data = luaL_checklstring(L, 1, &size);
 	if(size != sizeof(UsbCommand))
 	{
 		printf("Got data size %d, expected %d" , (int) size,(int) sizeof(UsbCommand));
@@ -115,6 +120,27 @@ static int l_WaitForResponseTimeout(lua_State *L){
 	}
 }
 
+/**
+ * @brief Like WaitForResponseTimeout, but returns the response as a byte buffer
+ * with the fields cmd, arg1, arg2, arg3 and data, instead of a string.
+ * uint32_t cmd
+ * size_t ms_timeout
+ * @param L
+ * @return the response, or nil on timeout
+ */
+static int l_WaitForResponse(lua_State *L){
+
+	uint32_t cmd = luaL_checkunsigned(L, 1);
+	size_t ms_timeout = luaL_optunsigned(L, 2, -1);
+
+	UsbCommand response;
+	if (WaitForResponseTimeout(cmd, &response, ms_timeout))
+		bytes_push_usbcommand(L, &response);
+	else
+		lua_pushnil(L);
+	return 1;
+}
+
 static int returnToLuaWithError(lua_State *L, const char* fmt, ...)
 {
 	char buffer[200];
@@ -393,6 +419,180 @@ static int l_sha1(lua_State *L)
 	return 1;
 }
 
+static int l_md5(lua_State *L)
+{
+	size_t size;
+	const char *p_str = luaL_checklstring(L, 1, &size);
+	unsigned char outdata[16] = {0x00};
+	mbedtls_md5( (uint8_t*) p_str, size, outdata);
+	lua_pushlstring(L,(const char *)&outdata, sizeof(outdata));
+	return 1;
+}
+
+/**
+ * @brief The key of a block of a TNP3xxx tag, from its UID. Used by lualibs/precalc.lua
+ * @param L uid as 8 hex digits, block 0..16
+ * @return key as 12 hex digits, or nil and an error message
+ */
+static int l_precalc_key(lua_State *L)
+{
+	static const uint8_t shifts[10][16] = {
+		{ 0x4, 0x5, 0x7, 0x6, 0x3, 0x2, 0x0, 0x1, 0xB, 0xA, 0x8, 0x9, 0xC, 0xD, 0xF, 0xE },
+		{ 0x4, 0xB, 0xB, 0x4, 0xB, 0x4, 0x4, 0xB, 0xA, 0x5, 0x5, 0xA, 0x5, 0xA, 0xA, 0x5 },
+		{ 0xB, 0x6, 0x0, 0xD, 0xD, 0x0, 0x6, 0xB, 0x6, 0xB, 0xD, 0x0, 0x0, 0xD, 0xB, 0x6 },
+		{ 0xE, 0x5, 0x9, 0x2, 0x0, 0xB, 0x7, 0xC, 0x3, 0x8, 0x4, 0xF, 0xD, 0x6, 0xA, 0x1 },
+		{ 0x4, 0xE, 0x1, 0xB, 0xF, 0x5, 0xA, 0x0, 0x3, 0x9, 0x6, 0xC, 0x8, 0x2, 0xD, 0x7 },
+		{ 0xA, 0x4, 0x7, 0x9, 0x0, 0xE, 0xD, 0x3, 0xE, 0x0, 0x3, 0xD, 0x4, 0xA, 0x9, 0x7 },
+		{ 0xE, 0x6, 0xE, 0x6, 0xF, 0x7, 0xF, 0x7, 0xD, 0x5, 0xD, 0x5, 0xC, 0x4, 0xC, 0x4 },
+		{ 0x7, 0x1, 0xB, 0xD, 0xE, 0x8, 0x2, 0x4, 0x4, 0x2, 0x8, 0xE, 0xD, 0xB, 0x1, 0x7 },
+		{ 0xD, 0xB, 0x0, 0x6, 0x6, 0x0, 0xB, 0xD, 0xA, 0xC, 0x7, 0x1, 0x1, 0x7, 0xC, 0xA },
+		{ 0xE, 0x1, 0x1, 0xE, 0x1, 0xE, 0xE, 0x1, 0x1, 0xE, 0xE, 0x1, 0xE, 0x1, 0x1, 0xE }
+	};
+
+	size_t size;
+	const char *uid = luaL_checklstring(L, 1, &size);
+	lua_Integer block = luaL_checkinteger(L, 2);
+	uint8_t uidbytes[4];
+	if (size != 8 || param_gethex(uid, 0, uidbytes, 8))
+		return returnToLuaWithError(L, "uid wrong length. Should be 4 hex bytes");
+	if (block < 0 || block > 16)
+		return returnToLuaWithError(L, "block is out-of-range");
+
+	// uid and block as 10 nibbles
+	uint8_t nibbles[10];
+	for (int i = 0; i < 4; i++) {
+		nibbles[i * 2] = uidbytes[i] >> 4;
+		nibbles[i * 2 + 1] = uidbytes[i] & 0x0f;
+	}
+	nibbles[8] = (block >> 4) & 0x0f;
+	nibbles[9] = block & 0x0f;
+
+	// 0xC2 and the permuted nibbles
+	uint8_t permuted[6] = {0xC2};
+	for (int i = 0; i < 10; i++) {
+		uint8_t value = shifts[i][nibbles[0]];
+		for (int j = 0; j < i; j++)
+			value ^= shifts[i - j - 1][0] ^ shifts[i - j - 1][nibbles[j + 1]];
+		permuted[1 + i / 2] |= (i & 1) ? value : value << 4;
+	}
+
+	uint64_t crc = 0;
+	crc64(permuted, sizeof(permuted), &crc);
+
+	// the 6 low bytes, least significant first
+	char key[13];
+	for (int i = 0; i < 6; i++)
+		sprintf(&key[i * 2], "%02X", (uint8_t)(crc >> (8 * i)));
+	lua_pushstring(L, key);
+	return 1;
+}
+
+/**
+ * Reads a table of keys, each 12 hex digits, into a malloced key block.
+ * Returns the number of keys, or -1 with the key block not allocated.
+ */
+static int getKeyBlock(lua_State *L, int idx, uint8_t **keyBlock)
+{
+	luaL_checktype(L, idx, LUA_TTABLE);
+	size_t keycnt = lua_rawlen(L, idx);
+	*keyBlock = calloc(keycnt ? keycnt : 1, 6);
+	if (*keyBlock == NULL)
+		return -1;
+
+	for (size_t i = 0; i < keycnt; i++) {
+		lua_rawgeti(L, idx, i + 1);
+		const char *key = lua_tostring(L, -1);
+		bool ok = key && !param_gethex(key, 0, *keyBlock + i * 6, 12);
+		lua_pop(L, 1);
+		if (!ok) {
+			free(*keyBlock);
+			*keyBlock = NULL;
+			return -1;
+		}
+	}
+	return keycnt;
+}
+
+/**
+ * @brief Checks a table of keys against one block, like 'hf mf chk <block> <A|B>'
+ * @param L blockNo, keyType (0 = A, 1 = B), table of keys as 12 hex digits
+ * @return the valid key as 12 hex digits, or nil and an error message
+ */
+static int l_mfCheckKeys(lua_State *L)
+{
+	lua_Integer blockNo = luaL_checkinteger(L, 1);
+	lua_Integer keyType = luaL_checkinteger(L, 2);
+	uint8_t *keyBlock;
+	int keycnt = getKeyBlock(L, 3, &keyBlock);
+	if (keycnt < 0)
+		return returnToLuaWithError(L, "keys should be a table of 6 byte hex strings");
+
+	uint64_t key64 = 0;
+	int res = mfCheckKeys(blockNo, keyType & 0x01, 0, true, keycnt, keyBlock, &key64);
+	free(keyBlock);
+
+	switch (res) {
+	case 0: {
+		char key[13];
+		sprintf(key, "%012" PRIx64, key64);
+		lua_pushstring(L, key);
+		return 1;
+	}
+	case 1:
+		return returnToLuaWithError(L, "Timeout while waiting for device to respond");
+	case 2:
+		return returnToLuaWithError(L, "Key not found");
+	default:
+		return returnToLuaWithError(L, "Aborted (%d)", res);
+	}
+}
+
+/**
+ * @brief Checks a table of keys against key A and B of the first sectors, like 'hf mf chk *<size>'.
+ *  The keys are sent to the device in as few commands as possible.
+ * @param L sectorCnt (1..40), table of keys as 12 hex digits
+ * @return table of sectors (from 1) with {A, B}, each the key as 12 hex digits or nil.
+ *  Or nil and an error message
+ */
+static int l_mfCheckKeysSec(lua_State *L)
+{
+	lua_Integer sectorCnt = luaL_checkinteger(L, 1);
+	if (sectorCnt < 1 || sectorCnt > 40)
+		return returnToLuaWithError(L, "sector count is out-of-range");
+
+	uint8_t *keyBlock;
+	int keycnt = getKeyBlock(L, 2, &keyBlock);
+	if (keycnt < 0)
+		return returnToLuaWithError(L, "keys should be a table of 6 byte hex strings");
+
+	sector_t e_sector[40] = {{{0}}};
+	int max_keys = USB_CMD_DATA_SIZE / 6;
+	for (int c = 0; c < keycnt; c += max_keys) {
+		int size = keycnt - c > max_keys ? max_keys : keycnt - c;
+		int res = mfCheckKeysSec(sectorCnt, 2, 0, c == 0, c == 0, c + size == keycnt, size, &keyBlock[6 * c], e_sector);
+		if (res == 1) {
+			free(keyBlock);
+			return returnToLuaWithError(L, "Timeout while waiting for device to respond");
+		}
+	}
+	free(keyBlock);
+
+	lua_createtable(L, sectorCnt, 0);
+	for (int sec = 0; sec < sectorCnt; sec++) {
+		lua_createtable(L, 2, 0);
+		for (int keyAB = 0; keyAB < 2; keyAB++) {
+			if (e_sector[sec].foundKey[keyAB]) {
+				char key[13];
+				sprintf(key, "%012" PRIx64, e_sector[sec].Key[keyAB]);
+				lua_pushstring(L, key);
+				lua_rawseti(L, -2, keyAB + 1);
+			}
+		}
+		lua_rawseti(L, -2, sec + 1);
+	}
+	return 1;
+}
+
 /**
  * @brief Sets the lua path to include "./lualibs/?.lua", in order for a script to be
  * able to do "require('foobar')" if foobar.lua is within lualibs folder.
@@ -424,6 +624,7 @@ int set_pm3_libraries(lua_State *L)
 	static const luaL_Reg libs[] = {
 		{"SendCommand",                 l_SendCommand},
 		{"WaitForResponseTimeout",      l_WaitForResponseTimeout},
+		{"WaitForResponse",             l_WaitForResponse},
 		{"mfDarkside",                  l_mfDarkside},
 		//{"PrintAndLog",                 l_PrintAndLog},
 		{"foobar",                      l_foobar},
@@ -439,6 +640,10 @@ int set_pm3_libraries(lua_State *L)
 		{"crc16",                       l_crc16},
 		{"crc64",                       l_crc64},
 		{"sha1",                        l_sha1},
+		{"md5",                         l_md5},
+		{"precalc_key",                 l_precalc_key},
+		{"mfCheckKeys",                 l_mfCheckKeys},
+		{"mfCheckKeysSec",              l_mfCheckKeysSec},
 		{NULL, NULL}
 	};
 
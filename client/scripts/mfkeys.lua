@@ -8,8 +8,6 @@
 
 	Copyright (C) 2013 m h swende <martin at swende.se>
 --]]
--- Loads the commands-library
-local cmds = require('commands')
 -- Load the default keys
 local keys = require('mf_default_keys')
 -- Ability to read what card is there
@@ -22,58 +20,6 @@ local desc = ("This script implements check keys. \
 It utilises a large list of default keys (currently %d keys).\
 If you want to add more, just put them inside mf_default_keys.lua. "):format(#keys)
 
-local TIMEOUT = 10000 -- 10 seconds
-
-
-local function checkCommand(command)
-
-	--print("Sending this command : " .. tostring(command))
-	local usbcommand = command:getBytes()
-	core.SendCommand(usbcommand)
-	local result = core.WaitForResponseTimeout(cmds.CMD_ACK,TIMEOUT)
-	if result then
-		local count,cmd,arg0 = bin.unpack('LL',result)
-		if(arg0==1) then
-			local count,arg1,arg2,data = bin.unpack('LLH511',result,count)
-			key = data:sub(1,12)
-			return key
-		else
-			--print("Key not found...")
-			return nil
-		end
-	else
-		print("Timeout while waiting for response. Increase TIMEOUT in keycheck.lua to wait longer")
-		return nil, "Timeout while waiting for device to respond"
-	end
-end
-
-
-function checkBlock(blockNo, keys, keyType)
-	-- The command data is only 512 bytes, each key is 6 bytes, meaning that we can send max 85 keys in one go.
-	-- If there's more, we need to split it up
-	local start, remaining= 1, #keys
-	local arg1 = bit32.bor(bit32.lshift(keyType, 8), blockNo)
-	local packets = {}
-	while remaining > 0 do
-		local n,data = remaining, nil
-		if remaining > 85 then n = 85 end
-		local data = table.concat(keys, "", start, start + n - 1)
-		--print("data",data)
-		--print("data len", #data)
-		print(("Testing block %d, keytype %d, with %d keys"):format(blockNo, keyType, n))
-		local command = Command:new{cmd = cmds.CMD_MIFARE_CHKKEYS,
-								arg1 = arg1,
-								arg2 = 1,
-								arg3 = n,
-								data = data}
-		local status = checkCommand(command)
-		if status then return status, blockNo end
-		start = start + n
-		remaining = remaining - n
-	end
-	return nil
-end
-
 -- A function to display the results
 local function displayresults(results)
 	local sector, blockNo, keyA, keyB,_
@@ -91,23 +37,6 @@ local function displayresults(results)
 
 end
 
--- A little helper to place an item first in the list
-local function placeFirst(akey, list)
-	akey = akey:lower()
-	if list[1] == akey then
-		-- Already at pole position
-		return list
-	end
-	local result = {akey}
-	--print(("Putting '%s' first"):format(akey))
-	for i,v in ipairs(list) do
-		if v ~= akey then
-			result[#result+1] = v
-		end
-	end
-	return result
-end
-
 local function dumptofile(results)
 	local sector, blockNo, keyA, keyB,_
 
@@ -147,8 +76,6 @@ local function main(args)
 
 
 	core.clearCommandBuffer()
-	local blockNo
-	local keyType = 0 -- A=0, B=1
 	local numSectors = 16
 
 	if 0x18 == result.sak then -- NXP MIFARE Classic 4k | Plus 4k
@@ -167,6 +94,15 @@ local function main(args)
 		print("I don't know how many sectors there are on this type of card, defaulting to 16")
 	end
 
+	-- core.mfCheckKeysSec checks key A and B of all sectors at once,
+	-- with as few commands to the device as possible
+	print(("Testing %d sectors with %d keys"):format(numSectors, #keys))
+	local found, err = core.mfCheckKeysSec(numSectors, keys)
+	if not found then
+		print(err)
+		return
+	end
+
 	result = {}
 	for sector=1,numSectors,1 do
 
@@ -181,21 +117,7 @@ local function main(args)
 			blockNo = 32*4 + (sector-32)*16 - 1
 		end
 
-		local keyA = checkBlock(blockNo, keys, 0)
-		if keyA then keys = placeFirst(keyA, keys) end
-		keyA = keyA or ""
-
-		local keyB = checkBlock(blockNo, keys, 1)
-		if keyB then keys = placeFirst(keyB, keys) end
-		keyB = keyB or ""
-
-		result[sector] = {blockNo, keyA, keyB}
-
-		-- Check if user aborted
-		if core.ukbhit() then
-			print("Aborted by user")
-			break
-		end
+		result[sector] = {blockNo, found[sector][1] or "", found[sector][2] or ""}
 	end
 	displayresults(result)
 	dumptofile(result)
@@ -80,15 +80,18 @@ local function readdumpkeys(infile)
 	 return hex
 end
 
-local function waitCmd()
-	local response = core.WaitForResponseTimeout(cmds.CMD_ACK,TIMEOUT)
+local function readBlock(blockNo, key)
+	local keybytes = bytes.fromhex(key)
+	if not keybytes then return nil, "Wrong key "..key end
+	local err = core.SendCommand(bytes.usbcommand(cmds.CMD_MIFARE_READBL, blockNo, 0, 0, keybytes))
+	if err then return nil, err end
+
+	local response = core.WaitForResponse(cmds.CMD_ACK,TIMEOUT)
 	if response then
-		local count,cmd,arg0 = bin.unpack('LL',response)
-		if(arg0==1) then
-			local count,arg1,arg2,data = bin.unpack('LLH511',response,count)
-			return data:sub(1,32)
+		if response.arg1 == 1 then
+			return response.data:hex(1, 16)
 		else
-			return nil, "Couldn't read block.." 
+			return nil, "Couldn't read block.."
 		end
 	end
 	return nil, "No response from device"
@@ -100,7 +103,6 @@ local function main(args)
 	print( string.rep('--',20) )
 	
 	local keyA
-	local cmd
 	local err
 	local useNested = false
 	local usePreCalc = false
@@ -160,17 +162,11 @@ local function main(args)
 	end
 	
 	-- Read block 0
-	cmd = Command:new{cmd = cmds.CMD_MIFARE_READBL, arg1 = 0,arg2 = 0,arg3 = 0, data = keyA}
-	err = core.SendCommand(cmd:getBytes())
-	if err then return oops(err) end
-	local block0, err = waitCmd()
+	local block0, err = readBlock(0, keyA)
 	if err then return oops(err) end
 	
 	-- Read block 1
-	cmd = Command:new{cmd = cmds.CMD_MIFARE_READBL, arg1 = 1,arg2 = 0,arg3 = 0, data = keyA}
-	err = core.SendCommand(cmd:getBytes())
-	if err then return oops(err) end
-	local block1, err = waitCmd()
+	local block1, err = readBlock(1, keyA)
 	if err then return oops(err) end
 
 	local tmpHash = block0..block1..'%02x'..RANDOM
@@ -194,10 +190,7 @@ local function main(args)
 	
 		pos = (math.floor( blockNo / 4 ) * 12)+1
 		key = akeys:sub(pos, pos + 11 )
-		cmd = Command:new{cmd = cmds.CMD_MIFARE_READBL, arg1 = blockNo ,arg2 = 0,arg3 = 0, data = key}
-		local err = core.SendCommand(cmd:getBytes())
-		if err then return oops(err) end
-		local blockdata, err = waitCmd()
+		local blockdata, err = readBlock(blockNo, key)
 		if err then return oops(err) end		
 
 
@@ -214,8 +207,7 @@ local function main(args)
 					local baseStr = utils.ConvertHexToAscii(tmpHash:format(blockNo))
 					local key = md5.sumhexa(baseStr)
 					local aestest = core.aes128_decrypt(key, blockdata)
-					local hex = utils.ConvertAsciiToBytes(aestest)
-					hex = utils.ConvertBytesToHex(hex)
+					local hex = bytes.fromstring(aestest):hex()
 					blocks[blockNo+1] = ('%02d  :: %s'):format(blockNo,hex)
 					io.write(blockNo..',')
 				end		
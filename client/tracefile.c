@@ -0,0 +1,596 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// HF traces (as recorded by LogTrace() on the device) with a record index
+//
+// The index is built on load. It only needs to walk the record headers, which
+// is a lot cheaper than reading the trace file and keeps it always in sync.
+//
+// pcapng (and pcap) files carry one frame per packet with the 4 byte
+// LINKTYPE_ISO_14443 header. Timestamps are in ns. Duration and parity bits
+// have no place in the format and go into the packet comment as
+// "duration=<n> parity=<hex>". Files from other tools don't have them, then
+// the duration is estimated and the parity is assumed to be ok.
+//
+// Compact traces (see LogTrace() on the device) are expanded to the normal
+// format on load.
+//-----------------------------------------------------------------------------
+
+#include "tracefile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+#include "parity.h"
+#include "usb_cmd.h"
+
+#define PCAPNG_BLOCK_SHB            0x0A0D0D0A
+#define PCAPNG_BLOCK_IDB            0x00000001
+#define PCAPNG_BLOCK_EPB            0x00000006
+#define PCAPNG_BYTE_ORDER_MAGIC     0x1A2B3C4D
+#define PCAP_MAGIC_US               0xA1B2C3D4
+#define PCAP_MAGIC_NS               0xA1B23C4D
+
+#define PCAPNG_OPT_ENDOFOPT         0
+#define PCAPNG_OPT_COMMENT          1
+#define PCAPNG_OPT_SHB_USERAPPL     4
+#define PCAPNG_OPT_IF_NAME          2
+#define PCAPNG_OPT_IF_TSRESOL       9
+#define PCAPNG_OPT_EPB_FLAGS        2
+#define PCAPNG_EPB_FLAGS_INBOUND    0x01
+#define PCAPNG_EPB_FLAGS_OUTBOUND   0x02
+
+#define PCAPNG_MAX_INTERFACES       16
+
+#define ISO14443_HEADER_SIZE        4
+#define ISO14443_EVT_DATA_PICC_TO_PCD   0xFF
+#define ISO14443_EVT_DATA_PCD_TO_PICC   0xFE
+
+#define CARRIER_FREQUENCY           13.56e6
+
+
+static int build_index(trace_t *trace)
+{
+	size_t size = 1024;
+	trace->count = 0;
+	trace->index = malloc(size * sizeof(trace_index_t));
+	if (!trace->index) return TRACE_E_MEMORY;
+
+	const uint8_t *data = trace->data;
+	size_t pos = 0;
+	uint32_t prev_timestamp = 0;
+	uint64_t time = 0;
+	while (pos + TRACE_RECORD_HEADER_SIZE <= trace->len) {
+		uint32_t timestamp = data[pos] | (data[pos+1] << 8) | (data[pos+2] << 16) | ((uint32_t)data[pos+3] << 24);
+		uint16_t data_len = (data[pos+6] | (data[pos+7] << 8)) & 0x7fff;
+		size_t record_len = TRACE_RECORD_HEADER_SIZE + data_len + (data_len - 1) / 8 + 1;
+		if (pos + record_len > trace->len) break;   // incomplete record
+
+		if (trace->count == 0) {
+			prev_timestamp = timestamp;
+		}
+		// the 32 bit timestamps wrap after ~5 minutes
+		time += (uint32_t)(timestamp - prev_timestamp);
+		prev_timestamp = timestamp;
+
+		if (trace->count == size) {
+			size *= 2;
+			trace_index_t *p = realloc(trace->index, size * sizeof(trace_index_t));
+			if (!p) {
+				free(trace->index);
+				trace->index = NULL;
+				trace->count = 0;
+				return TRACE_E_MEMORY;
+			}
+			trace->index = p;
+		}
+		trace->index[trace->count].offset = pos;
+		trace->index[trace->count].time = time;
+		trace->count++;
+		pos += record_len;
+	}
+	return TRACE_OK;
+}
+
+
+typedef struct {
+	uint8_t *data;
+	size_t len;
+	size_t size;
+} trace_buffer_t;
+
+
+static bool append_record(trace_buffer_t *buf, uint32_t timestamp, uint16_t duration, bool isResponse, const uint8_t *frame, uint16_t len, const uint8_t *parity, size_t parity_len)
+{
+	size_t num_paritybytes = (len - 1) / 8 + 1;
+	size_t record_len = TRACE_RECORD_HEADER_SIZE + len + num_paritybytes;
+	if (buf->len + record_len > buf->size) {
+		size_t size = buf->size ? buf->size : 0x10000;
+		while (buf->len + record_len > size) size *= 2;
+		uint8_t *p = realloc(buf->data, size);
+		if (!p) return false;
+		buf->data = p;
+		buf->size = size;
+	}
+	uint8_t *r = buf->data + buf->len;
+	uint16_t data_len = len | (isResponse ? 0x8000 : 0);
+	r[0] = timestamp; r[1] = timestamp >> 8; r[2] = timestamp >> 16; r[3] = timestamp >> 24;
+	r[4] = duration; r[5] = duration >> 8;
+	r[6] = data_len; r[7] = data_len >> 8;
+	memcpy(r + TRACE_RECORD_HEADER_SIZE, frame, len);
+	uint8_t *par = r + TRACE_RECORD_HEADER_SIZE + len;
+	if (parity && parity_len == num_paritybytes) {
+		memcpy(par, parity, num_paritybytes);
+	} else {
+		memset(par, 0, num_paritybytes);
+		for (int i = 0; i < len; i++) {
+			par[i / 8] |= oddparity8(frame[i]) << (7 - (i % 8));
+		}
+	}
+	buf->len += record_len;
+	return true;
+}
+
+
+static uint16_t get16(const uint8_t *p, bool swap)
+{
+	return swap ? (p[0] << 8 | p[1]) : (p[1] << 8 | p[0]);
+}
+
+
+static uint32_t get32(const uint8_t *p, bool swap)
+{
+	return swap ? ((uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]) : ((uint32_t)p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0]);
+}
+
+
+// Our own files start near 0 and keep their time base, others (epoch timestamps) start at 0
+static double time_base(double first_time)
+{
+	return first_time * CARRIER_FREQUENCY < 4294967296.0 ? first_time : 0;
+}
+
+
+// one packet, <time> in seconds
+static bool add_packet(trace_buffer_t *buf, const uint8_t *packet, size_t len, double time, const char *comment, size_t comment_len)
+{
+	if (len < ISO14443_HEADER_SIZE || packet[0] != 0) return true;
+	bool isResponse;
+	if (packet[1] == ISO14443_EVT_DATA_PICC_TO_PCD) {
+		isResponse = true;
+	} else if (packet[1] == ISO14443_EVT_DATA_PCD_TO_PICC) {
+		isResponse = false;
+	} else {
+		return true;        // field on/off events etc.
+	}
+	size_t frame_len = packet[2] << 8 | packet[3];
+	if (frame_len > len - ISO14443_HEADER_SIZE || frame_len == 0 || frame_len > 0x7fff) return true;
+
+	uint32_t duration = frame_len * 9 * 128;    // no idea, ISO14443A at 106kBit/s
+	uint8_t parity[0x1000];
+	size_t parity_len = 0;
+	if (comment && comment_len > 9 && comment_len < 0x2040 && memcmp(comment, "duration=", 9) == 0) {
+		char text[0x2040];
+		memcpy(text, comment, comment_len);
+		text[comment_len] = '\0';
+		sscanf(text, "duration=%" SCNu32, &duration);
+		char *hex = strstr(text, "parity=");
+		if (hex) {
+			hex += 7;
+			unsigned int byte;
+			while (parity_len < sizeof(parity) && sscanf(hex, "%2x", &byte) == 1) {
+				parity[parity_len++] = byte;
+				hex += 2;
+			}
+		}
+	}
+	if (duration > 0xffff) duration = 0xffff;
+
+	uint32_t timestamp = (uint64_t)llround(time * CARRIER_FREQUENCY);
+	return append_record(buf, timestamp, duration, isResponse, packet + ISO14443_HEADER_SIZE, frame_len, parity_len ? parity : NULL, parity_len);
+}
+
+
+static int convert_pcapng(const uint8_t *data, size_t len, trace_buffer_t *buf)
+{
+	bool swap = false;
+	uint32_t linktype[PCAPNG_MAX_INTERFACES];
+	double resolution[PCAPNG_MAX_INTERFACES];
+	int num_interfaces = 0;
+	bool first = true;
+	uint64_t first_ts = 0;
+	double base = 0;
+
+	size_t pos = 0;
+	while (pos + 12 <= len) {
+		const uint8_t *block = data + pos;
+		uint32_t type = get32(block, false);
+		if (type == PCAPNG_BLOCK_SHB) {
+			if (get32(block + 8, false) == PCAPNG_BYTE_ORDER_MAGIC) {
+				swap = false;
+			} else if (get32(block + 8, true) == PCAPNG_BYTE_ORDER_MAGIC) {
+				swap = true;
+			} else {
+				return TRACE_E_FORMAT;
+			}
+			num_interfaces = 0;
+		} else {
+			type = get32(block, swap);
+		}
+		uint32_t block_len = get32(block + 4, swap);
+		if (block_len < 12 || block_len % 4 || block_len > len - pos) return TRACE_E_FORMAT;
+
+		if (type == PCAPNG_BLOCK_IDB && block_len >= 20 && num_interfaces < PCAPNG_MAX_INTERFACES) {
+			linktype[num_interfaces] = get16(block + 8, swap);
+			resolution[num_interfaces] = 1e-6;
+			// options
+			size_t opt = 16;
+			while (opt + 4 <= block_len - 4) {
+				uint16_t code = get16(block + opt, swap);
+				uint16_t opt_len = get16(block + opt + 2, swap);
+				if (code == PCAPNG_OPT_ENDOFOPT || opt + 4 + opt_len > block_len - 4) break;
+				if (code == PCAPNG_OPT_IF_TSRESOL && opt_len == 1) {
+					uint8_t tsresol = block[opt + 4];
+					resolution[num_interfaces] = (tsresol & 0x80) ? pow(2, -(tsresol & 0x7f)) : pow(10, -tsresol);
+				}
+				opt += 4 + ((opt_len + 3) & ~3);
+			}
+			num_interfaces++;
+		} else if (type == PCAPNG_BLOCK_EPB && block_len >= 32) {
+			uint32_t interface = get32(block + 8, swap);
+			uint64_t ts = (uint64_t)get32(block + 12, swap) << 32 | get32(block + 16, swap);
+			uint32_t caplen = get32(block + 20, swap);
+			if (caplen > block_len - 32) return TRACE_E_FORMAT;
+			if (interface < (uint32_t)num_interfaces && (linktype[interface] == LINKTYPE_ISO_14443 || linktype[interface] == LINKTYPE_USER0)) {
+				const char *comment = NULL;
+				size_t comment_len = 0;
+				size_t opt = 28 + ((caplen + 3) & ~3);
+				while (opt + 4 <= block_len - 4) {
+					uint16_t code = get16(block + opt, swap);
+					uint16_t opt_len = get16(block + opt + 2, swap);
+					if (code == PCAPNG_OPT_ENDOFOPT || opt + 4 + opt_len > block_len - 4) break;
+					if (code == PCAPNG_OPT_COMMENT) {
+						comment = (const char *)block + opt + 4;
+						comment_len = opt_len;
+					}
+					opt += 4 + ((opt_len + 3) & ~3);
+				}
+				if (first) {
+					first_ts = ts;
+					base = time_base(ts * resolution[interface]);
+					first = false;
+				}
+				double time = base + (int64_t)(ts - first_ts) * resolution[interface];
+				if (!add_packet(buf, block + 28, caplen, time, comment, comment_len)) return TRACE_E_MEMORY;
+			}
+		}
+		pos += block_len;
+	}
+	return TRACE_OK;
+}
+
+
+static int convert_pcap(const uint8_t *data, size_t len, trace_buffer_t *buf)
+{
+	if (len < 24) return TRACE_E_FORMAT;
+	uint32_t magic = get32(data, false);
+	bool swap = (magic != PCAP_MAGIC_US && magic != PCAP_MAGIC_NS);
+	magic = get32(data, swap);
+	double resolution = (magic == PCAP_MAGIC_NS) ? 1e-9 : 1e-6;
+	uint32_t linktype = get32(data + 20, swap) & 0xffff;
+	if (linktype != LINKTYPE_ISO_14443 && linktype != LINKTYPE_USER0) return TRACE_E_FORMAT;
+
+	bool first = true;
+	uint32_t first_sec = 0;
+	uint32_t first_frac = 0;
+	double base = 0;
+	size_t pos = 24;
+	while (pos + 16 <= len) {
+		uint32_t sec = get32(data + pos, swap);
+		uint32_t frac = get32(data + pos + 4, swap);
+		uint32_t caplen = get32(data + pos + 8, swap);
+		if (caplen > len - pos - 16) return TRACE_E_FORMAT;
+		if (first) {
+			first_sec = sec;
+			first_frac = frac;
+			base = time_base(sec + frac * resolution);
+			first = false;
+		}
+		double time = base + (double)(sec - first_sec) + ((double)frac - first_frac) * resolution;
+		if (!add_packet(buf, data + pos + 16, caplen, time, NULL, 0)) return TRACE_E_MEMORY;
+		pos += 16 + caplen;
+	}
+	return TRACE_OK;
+}
+
+
+static bool is_compact(const uint8_t *data, size_t len)
+{
+	if (len < TRACE_COMPACT_MAGIC_LEN) return false;
+	for (int i = 0; i < TRACE_COMPACT_MAGIC_LEN; i++) {
+		if (data[i] != TRACE_COMPACT_MAGIC) return false;
+	}
+	return true;
+}
+
+
+static bool get_varint(const uint8_t *data, size_t len, size_t *pos, uint32_t *value)
+{
+	*value = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		if (*pos >= len) return false;
+		uint8_t b = data[(*pos)++];
+		*value |= (uint32_t)(b & 0x7f) << shift;
+		if (!(b & 0x80)) return true;
+	}
+	return false;
+}
+
+
+#define TRACE_COMPACT_PARITY_NONE       0
+#define TRACE_COMPACT_PARITY_ODD        1
+#define TRACE_COMPACT_PARITY_EXPLICIT   2
+
+static int convert_compact(const uint8_t *data, size_t len, trace_buffer_t *buf)
+{
+	static const uint8_t zero_parity[0x1000] = {0};
+	uint32_t last_end = 0;
+	size_t pos = 0;
+	while (pos < len) {
+		// the header starts the trace, and again whenever a streamed trace was restarted on the device
+		if (is_compact(data + pos, len - pos)) {
+			pos += TRACE_COMPACT_MAGIC_LEN;
+			last_end = 0;
+			continue;
+		}
+		uint32_t header, gap, duration;
+		if (!get_varint(data, len, &pos, &header)
+			|| !get_varint(data, len, &pos, &gap)
+			|| !get_varint(data, len, &pos, &duration)) {
+			break;      // incomplete record
+		}
+		uint32_t data_len = header >> 4;
+		if (header & 0x08) duration <<= 4;
+		uint8_t parity_mode = (header >> 1) & 0x03;
+		bool isResponse = header & 0x01;
+		size_t parity_len = data_len ? (data_len - 1) / 8 + 1 : 1;      // as in the normal format
+		size_t num_paritybytes = (parity_mode == TRACE_COMPACT_PARITY_EXPLICIT) ? parity_len : 0;
+		if (data_len > 0x7fff || pos + data_len + num_paritybytes > len) break;
+
+		uint32_t timestamp = last_end + gap;
+		last_end = timestamp + duration;
+		const uint8_t *parity = NULL;
+		if (parity_mode == TRACE_COMPACT_PARITY_EXPLICIT) {
+			parity = data + pos + data_len;
+		} else if (parity_mode == TRACE_COMPACT_PARITY_NONE) {
+			parity = zero_parity;
+		}
+		if (!append_record(buf, timestamp, duration > 0xffff ? 0xffff : duration, isResponse, data + pos, data_len, parity, parity_len)) {
+			return TRACE_E_MEMORY;
+		}
+		pos += data_len + num_paritybytes;
+	}
+	return TRACE_OK;
+}
+
+
+int trace_load(const char *filename, trace_t *trace)
+{
+	memset(trace, 0, sizeof(trace_t));
+	int res = map_file(filename, &trace->file);
+	if (res != MAP_FILE_OK) {
+		return res == MAP_FILE_E_OPEN ? TRACE_E_OPEN : res == MAP_FILE_E_MEMORY ? TRACE_E_MEMORY : TRACE_E_IO;
+	}
+
+	const uint8_t *data = trace->file.data;
+	size_t len = trace->file.size;
+	uint32_t magic = len >= 4 ? get32(data, false) : 0;
+	bool compact = is_compact(data, len);
+	if (compact || magic == PCAPNG_BLOCK_SHB || magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS
+		|| get32(data, true) == PCAP_MAGIC_US || get32(data, true) == PCAP_MAGIC_NS) {
+		trace_buffer_t buf = {NULL, 0, 0};
+		if (compact) {
+			res = convert_compact(data, len, &buf);
+		} else if (magic == PCAPNG_BLOCK_SHB) {
+			res = convert_pcapng(data, len, &buf);
+		} else {
+			res = convert_pcap(data, len, &buf);
+		}
+		unmap_file(&trace->file);
+		if (res != TRACE_OK) {
+			free(buf.data);
+			return res;
+		}
+		return trace_set(trace, buf.data, buf.len, true);
+	}
+
+	trace->data = data;
+	trace->len = len;
+	res = build_index(trace);
+	if (res != TRACE_OK) {
+		trace_free(trace);
+	}
+	return res;
+}
+
+
+int trace_set(trace_t *trace, uint8_t *data, size_t len, bool owned)
+{
+	if (is_compact(data, len)) {
+		trace_buffer_t buf = {NULL, 0, 0};
+		int res = convert_compact(data, len, &buf);
+		if (owned) free(data);
+		if (res != TRACE_OK) {
+			free(buf.data);
+			memset(trace, 0, sizeof(trace_t));
+			return res;
+		}
+		data = buf.data;
+		len = buf.len;
+		owned = true;
+	}
+
+	memset(trace, 0, sizeof(trace_t));
+	trace->data = data;
+	trace->len = len;
+	if (owned) trace->buffer = data;
+	int res = build_index(trace);
+	if (res != TRACE_OK) {
+		trace_free(trace);
+	}
+	return res;
+}
+
+
+void trace_free(trace_t *trace)
+{
+	free(trace->index);
+	trace->index = NULL;
+	trace->count = 0;
+	if (trace->file.data) {
+		unmap_file(&trace->file);
+	}
+	free(trace->buffer);
+	trace->buffer = NULL;
+	trace->data = NULL;
+	trace->len = 0;
+}
+
+
+size_t trace_find_time(const trace_t *trace, uint64_t time)
+{
+	size_t lo = 0, hi = trace->count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (trace->index[mid].time < time) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v; p[1] = v >> 8;
+}
+
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+
+static size_t put_option(uint8_t *p, uint16_t code, const void *value, uint16_t len)
+{
+	put16(p, code);
+	put16(p + 2, len);
+	memcpy(p + 4, value, len);
+	size_t padded = (len + 3) & ~3;
+	memset(p + 4 + len, 0, padded - len);
+	return 4 + padded;
+}
+
+
+// <block> has room for the header and trailer, the body starts at block + 8
+static bool write_block(FILE *f, uint32_t type, uint8_t *block, size_t body_len)
+{
+	uint32_t block_len = body_len + 12;
+	put32(block, type);
+	put32(block + 4, block_len);
+	put32(block + 8 + body_len, block_len);
+	return fwrite(block, 1, block_len, f) == block_len;
+}
+
+
+int trace_save_pcapng(const trace_t *trace, const char *filename, uint32_t linktype)
+{
+	// largest block: EPB with a 0x7fff bytes frame and its parity in the comment
+	size_t max_block = 12 + 20 + ISO14443_HEADER_SIZE + 0x8000 + 4 + 0x2040 + 8 + 4;
+	uint8_t *block = malloc(max_block);
+	if (!block) return TRACE_E_MEMORY;
+
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		free(block);
+		return TRACE_E_OPEN;
+	}
+
+	bool ok = true;
+	uint8_t *body = block + 8;
+	uint8_t end_of_options[4] = {0};
+
+	// Section Header Block
+	put32(body, PCAPNG_BYTE_ORDER_MAGIC);
+	put16(body + 4, 1);                     // version 1.0
+	put16(body + 6, 0);
+	memset(body + 8, 0xff, 8);              // section length unknown
+	size_t len = 16;
+	const char *appl = "proxmark3";
+	len += put_option(body + len, PCAPNG_OPT_SHB_USERAPPL, appl, strlen(appl));
+	len += put_option(body + len, PCAPNG_OPT_ENDOFOPT, end_of_options, 0);
+	ok = ok && write_block(f, PCAPNG_BLOCK_SHB, block, len);
+
+	// Interface Description Block
+	put16(body, linktype);
+	put16(body + 2, 0);
+	put32(body + 4, 0);                     // no snap length
+	len = 8;
+	const char *if_name = linktype == LINKTYPE_ISO_14443 ? "proxmark3 ISO14443" : "proxmark3 HF";
+	len += put_option(body + len, PCAPNG_OPT_IF_NAME, if_name, strlen(if_name));
+	uint8_t tsresol = 9;                    // ns
+	len += put_option(body + len, PCAPNG_OPT_IF_TSRESOL, &tsresol, 1);
+	len += put_option(body + len, PCAPNG_OPT_ENDOFOPT, end_of_options, 0);
+	ok = ok && write_block(f, PCAPNG_BLOCK_IDB, block, len);
+
+	// Enhanced Packet Blocks, one per record
+	uint32_t first_timestamp = trace->count ? get32(trace->data + trace->index[0].offset, false) : 0;
+	for (size_t i = 0; ok && i < trace->count; i++) {
+		const uint8_t *record = trace->data + trace->index[i].offset;
+		uint16_t duration = get16(record + 4, false);
+		uint16_t data_len;
+		const uint8_t *frame = trace_record_data(trace, i, &data_len);
+		bool isResponse = trace_is_response(trace, i);
+		const uint8_t *parity = frame + data_len;
+		size_t parity_len = data_len ? (data_len - 1) / 8 + 1 : 0;
+
+		uint64_t ticks = first_timestamp + trace->index[i].time;
+		uint64_t ts = llround(ticks * 1e9 / CARRIER_FREQUENCY);
+		put32(body, 0);
+		put32(body + 4, ts >> 32);
+		put32(body + 8, ts);
+		put32(body + 12, ISO14443_HEADER_SIZE + data_len);
+		put32(body + 16, ISO14443_HEADER_SIZE + data_len);
+		uint8_t *packet = body + 20;
+		packet[0] = 0;
+		packet[1] = isResponse ? ISO14443_EVT_DATA_PICC_TO_PCD : ISO14443_EVT_DATA_PCD_TO_PICC;
+		packet[2] = data_len >> 8;
+		packet[3] = data_len;
+		memcpy(packet + ISO14443_HEADER_SIZE, frame, data_len);
+		len = 20 + ISO14443_HEADER_SIZE + data_len;
+		while (len % 4) body[len++] = 0;
+
+		char comment[0x2040];
+		int comment_len = snprintf(comment, sizeof(comment), "duration=%u parity=", duration);
+		for (size_t j = 0; j < parity_len; j++) {
+			comment_len += snprintf(comment + comment_len, sizeof(comment) - comment_len, "%02x", parity[j]);
+		}
+		len += put_option(body + len, PCAPNG_OPT_COMMENT, comment, comment_len);
+		uint8_t flags[4];
+		put32(flags, isResponse ? PCAPNG_EPB_FLAGS_INBOUND : PCAPNG_EPB_FLAGS_OUTBOUND);
+		len += put_option(body + len, PCAPNG_OPT_EPB_FLAGS, flags, 4);
+		len += put_option(body + len, PCAPNG_OPT_ENDOFOPT, end_of_options, 0);
+		ok = write_block(f, PCAPNG_BLOCK_EPB, block, len);
+	}
+
+	if (fclose(f) != 0) ok = false;
+	free(block);
+	return ok ? TRACE_OK : TRACE_E_IO;
+}
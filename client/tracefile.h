@@ -0,0 +1,80 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// HF traces (as recorded by LogTrace() on the device) with a record index
+//-----------------------------------------------------------------------------
+
+#ifndef TRACEFILE_H__
+#define TRACEFILE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "util_posix.h"
+
+// Trace record format:
+//   32 bits timestamp (little endian)
+//   16 bits duration (little endian)
+//   16 bits data length (little endian, highest bit set for tag to reader)
+//   y bytes data
+//   x bytes parity (one byte per 8 bytes data)
+#define TRACE_RECORD_HEADER_SIZE	8
+
+#define TRACE_OK             0
+#define TRACE_E_OPEN        -1
+#define TRACE_E_IO          -2
+#define TRACE_E_MEMORY      -3
+#define TRACE_E_FORMAT      -4
+
+// pcap link types. There is none registered for ISO 15693 and iClass, these are saved
+// as LINKTYPE_USER0 with the same 4 byte header as LINKTYPE_ISO_14443.
+#define LINKTYPE_USER0      147
+#define LINKTYPE_ISO_14443  264
+
+typedef struct {
+	size_t offset;      // of the record in the trace data
+	uint64_t time;      // start time since the first record. Timestamp wraps are removed.
+} trace_index_t;
+
+typedef struct {
+	const uint8_t *data;
+	size_t len;
+	trace_index_t *index;   // one entry per complete record
+	size_t count;
+	mapped_file_t file;     // if loaded from a file
+	uint8_t *buffer;        // if owned
+} trace_t;
+
+// map a trace file and index it. pcap and pcapng files are converted.
+extern int trace_load(const char *filename, trace_t *trace);
+// write the trace as pcapng. Duration and parity go into the packet comments.
+extern int trace_save_pcapng(const trace_t *trace, const char *filename, uint32_t linktype);
+// index a trace in memory. If <owned>, <data> is free'd by trace_free()
+extern int trace_set(trace_t *trace, uint8_t *data, size_t len, bool owned);
+extern void trace_free(trace_t *trace);
+// index of the first record starting at or after <time>, or trace->count
+extern size_t trace_find_time(const trace_t *trace, uint64_t time);
+
+static inline bool trace_is_response(const trace_t *trace, size_t record) {
+	return trace->data[trace->index[record].offset + 7] & 0x80;
+}
+
+static inline uint32_t trace_record_timestamp(const trace_t *trace, size_t record) {
+	const uint8_t *p = trace->data + trace->index[record].offset;
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint16_t trace_record_duration(const trace_t *trace, size_t record) {
+	const uint8_t *p = trace->data + trace->index[record].offset;
+	return p[4] | (p[5] << 8);
+}
+
+static inline const uint8_t *trace_record_data(const trace_t *trace, size_t record, uint16_t *len) {
+	const uint8_t *p = trace->data + trace->index[record].offset;
+	*len = (p[6] | (p[7] << 8)) & 0x7fff;
+	return p + TRACE_RECORD_HEADER_SIZE;
+}
+
+#endif
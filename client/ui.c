@@ -25,6 +25,7 @@
 double CursorScaleFactor = 1;
 int PlotGridX=0, PlotGridY=0, PlotGridXdefault= 64, PlotGridYdefault= 64, CursorCPos= 0, CursorDPos= 0;
 bool flushAfterWrite = false;  //buzzy
+bool silentMode = false;
 int GridOffset = 0;
 bool GridLocked = false;
 bool showDemod = true;
@@ -39,6 +40,8 @@ void PrintAndLogEx(logLevel_t level, char *fmt, ...) {
 	// skip debug messages if client debugging is turned off i.e. 'DATA SETDEBUG 0' 
 //	if (g_debugMode	== 0 && level == DEBUG)
 //		return;
+
+	if (silentMode) return;
 	
 	char buffer[MAX_PRINT_BUFFER] = {0};
 	char buffer2[MAX_PRINT_BUFFER] = {0};
@@ -113,6 +116,8 @@ void PrintAndLog(char *fmt, ...)
 	static FILE *logfile = NULL;
 	static int logging=1;
 
+	if (silentMode) return;
+
 	// lock this section to avoid interlacing prints from different threads
 	pthread_mutex_lock(&print_lock);
   
@@ -183,3 +188,12 @@ void SetFlushAfterWrite(bool flush_after_write) {
 	flushAfterWrite = flush_after_write;
 }
 
+// suppress all PrintAndLog output (screen and logfile), e.g. for batch processing
+void SetSilentMode(bool silent) {
+	silentMode = silent;
+}
+
+bool GetSilentMode(void) {
+	return silentMode;
+}
+
@@ -25,6 +25,8 @@ void PrintAndLog(char *fmt, ...);
 void PrintAndLogEx(logLevel_t level, char *fmt, ...);
 void SetLogFilename(char *fn);
 void SetFlushAfterWrite(bool flush_after_write);
+void SetSilentMode(bool silent);
+bool GetSilentMode(void);
 
 extern double CursorScaleFactor;
 extern int PlotGridX, PlotGridY, PlotGridXdefault, PlotGridYdefault, CursorCPos, CursorDPos, GridOffset;
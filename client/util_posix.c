@@ -9,14 +9,22 @@
 //-----------------------------------------------------------------------------
 
 #if !defined(_WIN32)
-#define _POSIX_C_SOURCE	199309L			// need nanosleep()
+#define _POSIX_C_SOURCE	200112L			// need nanosleep(), mmap()
 #else
 #include <windows.h>
 #endif
 
 #include "util_posix.h"
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 
 // Timer functions
@@ -133,3 +141,80 @@ uint64_t msclock() {
 #endif
 }
 
+
+// map a whole file read-only into memory. Falls back to reading it into
+// a malloc'd buffer where mmap() isn't available.
+int map_file(const char *filename, mapped_file_t *mf) {
+	mf->data = NULL;
+	mf->size = 0;
+	mf->mapped = false;
+
+#if !defined(_WIN32)
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return MAP_FILE_E_OPEN;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return MAP_FILE_E_IO;
+	}
+	mf->size = st.st_size;
+	if (mf->size == 0) {
+		close(fd);
+		return MAP_FILE_OK;
+	}
+	void *addr = mmap(NULL, mf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (addr != MAP_FAILED) {
+		mf->data = addr;
+		mf->mapped = true;
+		return MAP_FILE_OK;
+	}
+	// not mappable (e.g. a pipe). Read it instead.
+#endif
+
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		return MAP_FILE_E_OPEN;
+	}
+	fseek(f, 0, SEEK_END);
+	long fsize = ftell(f);
+	rewind(f);
+	if (fsize < 0) {
+		fclose(f);
+		return MAP_FILE_E_IO;
+	}
+	mf->size = fsize;
+	if (mf->size == 0) {
+		fclose(f);
+		return MAP_FILE_OK;
+	}
+	uint8_t *buf = malloc(mf->size);
+	if (!buf) {
+		fclose(f);
+		return MAP_FILE_E_MEMORY;
+	}
+	size_t bytes_read = fread(buf, 1, mf->size, f);
+	fclose(f);
+	if (bytes_read != mf->size) {
+		free(buf);
+		return MAP_FILE_E_IO;
+	}
+	mf->data = buf;
+	return MAP_FILE_OK;
+}
+
+
+void unmap_file(mapped_file_t *mf) {
+	if (mf->data == NULL) return;
+#if !defined(_WIN32)
+	if (mf->mapped) {
+		munmap((void *)mf->data, mf->size);
+		mf->data = NULL;
+		return;
+	}
+#endif
+	free((void *)mf->data);
+	mf->data = NULL;
+}
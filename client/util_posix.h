@@ -12,6 +12,8 @@
 #define UTIL_POSIX_H__
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 
 #ifdef _WIN32
 # include <windows.h>
@@ -23,4 +25,19 @@ extern void msleep(uint32_t n);		// sleep n milliseconds
 
 extern uint64_t msclock(); 			// a milliseconds clock
 
+// a whole file, read-only in memory
+typedef struct {
+	const uint8_t *data;
+	size_t size;
+	bool mapped;
+} mapped_file_t;
+
+#define MAP_FILE_OK          0
+#define MAP_FILE_E_OPEN     -1
+#define MAP_FILE_E_IO       -2
+#define MAP_FILE_E_MEMORY   -3
+
+extern int map_file(const char *filename, mapped_file_t *mf);	// mmap() a file, or read it if that fails
+extern void unmap_file(mapped_file_t *mf);
+
 #endif
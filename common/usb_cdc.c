@@ -291,6 +291,7 @@ static AT91S_CDC_LINE_CODING line = {
 static uint8_t btConfiguration = 0;
 static uint8_t btConnection    = 0;
 static uint8_t btReceiveBank   = AT91C_UDP_RX_DATA_BK0;
+static bool    btSendPending   = false;     // packet of cmd_send_nowait() not yet acknowledged
 
 
 //*----------------------------------------------------------------------------
@@ -638,6 +639,17 @@ static uint32_t usb_write(const uint8_t* data, const size_t len) {
 	if (!length) return 0;
 	if (!usb_check()) return 0;
 
+	// Finish a packet of usb_write_nowait() first
+	if (btSendPending) {
+		while (!(AT91C_BASE_UDP->UDP_CSR[AT91C_EP_IN] & AT91C_UDP_TXCOMP)) {
+			if (!usb_check()) return length;
+		}
+		UDP_CLEAR_EP_FLAGS(AT91C_EP_IN, AT91C_UDP_TXCOMP);
+		while (AT91C_BASE_UDP->UDP_CSR[AT91C_EP_IN] & AT91C_UDP_TXCOMP)
+			/* wait */;
+		btSendPending = false;
+	}
+
 	// Send the first packet
 	cpt = MIN(length, AT91C_EP_IN_SIZE);
 	length -= cpt;
@@ -683,6 +695,37 @@ static uint32_t usb_write(const uint8_t* data, const size_t len) {
 }
 
 
+//*----------------------------------------------------------------------------
+//* \fn    usb_write_nowait
+//* \brief Send a short packet through endpoint 2 without waiting for the host
+//*        to fetch it. Returns false, without sending, while the previous
+//*        packet is still pending.
+//*----------------------------------------------------------------------------
+static bool usb_write_nowait(const uint8_t* data, const size_t len) {
+	// a full packet would need a zero length packet to complete the transfer
+	if (!len || len >= AT91C_EP_IN_SIZE) return false;
+	if (!usb_check()) return false;
+
+	if (btSendPending) {
+		if (!(AT91C_BASE_UDP->UDP_CSR[AT91C_EP_IN] & AT91C_UDP_TXCOMP))
+			return false;
+		UDP_CLEAR_EP_FLAGS(AT91C_EP_IN, AT91C_UDP_TXCOMP);
+		while (AT91C_BASE_UDP->UDP_CSR[AT91C_EP_IN] & AT91C_UDP_TXCOMP)
+			/* wait */;
+	}
+
+	for (size_t i = 0; i < len; i++) {
+		AT91C_BASE_UDP->UDP_FDR[AT91C_EP_IN] = data[i];
+	}
+	UDP_SET_EP_FLAGS(AT91C_EP_IN, AT91C_UDP_TXPKTRDY);
+	while (!(AT91C_BASE_UDP->UDP_CSR[AT91C_EP_IN] & AT91C_UDP_TXPKTRDY))
+		/* wait */;
+	btSendPending = true;
+
+	return true;
+}
+
+
 //***************************************************************************
 // Interface to the main program
 //***************************************************************************
@@ -736,6 +779,31 @@ bool cmd_send(uint16_t cmd, uint32_t arg0, uint32_t arg1, uint32_t arg2, void* d
 }
 
 
+// Send a response which fits into one USB packet (datalen < AT91C_EP_IN_SIZE - header), without
+// waiting for the client to fetch it. Returns false, without sending, if the previous one is still pending.
+bool cmd_send_nowait(uint16_t cmd, uint32_t arg0, uint32_t arg1, uint32_t arg2, void* data, uint16_t datalen) {
+
+	UsbResponse txcmd;
+
+	txcmd.cmd = cmd | CMD_VARIABLE_SIZE_FLAG;
+	txcmd.arg[0] = arg0;
+	txcmd.arg[1] = arg1;
+	txcmd.arg[2] = arg2;
+
+	if (data) {
+		datalen = MIN(datalen, USB_CMD_DATA_SIZE);
+		for (uint16_t i = 0; i < datalen; i++) {
+			txcmd.d.asBytes[i] = ((uint8_t*)data)[i];
+		}
+		txcmd.datalen = datalen;
+	} else {
+		txcmd.datalen = 0;
+	}
+
+	return usb_write_nowait((uint8_t*)&txcmd, offsetof(UsbResponse, d) + txcmd.datalen);
+}
+
+
 // For compatibility only: legacy function to send a response with fixed size to the client via USB
 bool cmd_send_old(uint16_t cmd, uint32_t arg0, uint32_t arg1, uint32_t arg2, void* data, uint16_t datalen) {
 
@@ -77,6 +77,7 @@ typedef struct {
 #define CMD_VERSION                                                       0x0107
 #define CMD_STATUS                                                        0x0108
 #define CMD_PING                                                          0x0109
+#define CMD_TRACE_STREAM                                                  0x010A
 
 // controlling the ADC input multiplexer
 #define CMD_SET_ADC_MUX                                                   0x020F
@@ -131,6 +132,7 @@ typedef struct {
 #define CMD_COTAG                                                         0x0225
 #define CMD_PARADOX_CLONE_TAG                                             0x0226
 #define CMD_EM4X_PROTECT                                                  0x0228
+#define CMD_T55XX_BRUTE_FORCE                                             0x0229
 
 // For the 13.56 MHz tags
 #define CMD_ACQUIRE_RAW_ADC_SAMPLES_ISO_15693                             0x0300
@@ -268,6 +270,29 @@ typedef struct {
 #define ICLASS_SIM_MODE_EXIT_AFTER_MAC        5  // note: device internal only
 
 
+// T55xx brute force: arg0 flags (downlink modes to try in bits 0-3, dictionary
+// size in bits 16-23), arg1 start password/dictionary index, arg2 end password
+#define FLAG_T55XX_BF_DICTIONARY         (1<<8)
+
+// T55xx brute force replies, in arg0 of CMD_ACK. arg1 holds the password or
+// dictionary index, arg2 the downlink modes of a candidate
+#define T55XX_BF_PROGRESS              0
+#define T55XX_BF_CANDIDATE             1
+#define T55XX_BF_DONE                  2
+#define T55XX_BF_ABORTED               3
+
+
+// trace streaming: CMD_TRACE_STREAM carries trace bytes in d, arg0 = stream offset,
+// arg1 = number of bytes, arg2 = number of records dropped so far. The end of the
+// stream is sent as CMD_ACK with arg0 = total bytes, arg1 = dropped records
+#define TRACE_STREAM_CHUNK_SIZE        47  // + 16 byte header < 64 byte USB packet, so no zero length packet
+
+// compact traces (see LogTrace()) start with TRACE_COMPACT_MAGIC_LEN bytes of TRACE_COMPACT_MAGIC,
+// which can't be the header of a normal trace record
+#define TRACE_COMPACT_MAGIC            0xff
+#define TRACE_COMPACT_MAGIC_LEN        8
+
+
 // hw tune args
 #define FLAG_TUNE_LF   1
 #define FLAG_TUNE_HF   2
@@ -0,0 +1,26 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Include this before an armsrc source to compile it for the host. Only the
+// decoders are used, everything else is dropped by the linker (--gc-sections).
+//-----------------------------------------------------------------------------
+
+#ifndef ARMSRC_HOST_H__
+#define ARMSRC_HOST_H__
+
+#include "proxmark3.h"
+#include "common.h"
+
+// LEDs are GPIO register writes
+#undef HIGH
+#undef LOW
+#define HIGH(x)         ((void)(x))
+#define LOW(x)          ((void)(x))
+
+// there is no separate RAM section on the host
+#undef RAMFUNC
+#define RAMFUNC
+
+#endif
@@ -0,0 +1,438 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Host side benchmark of the HF sniffer demodulators
+//
+// The decoders of armsrc/iso14443a.c, iso14443b.c and iso15693.c are compiled
+// for the host and fed with a sample stream, either synthesized from random
+// frames or the frames of a trace file, or a raw dump of the sniffer's DMA
+// buffer. Reports the cost per sample, the worst case cost of a single sample
+// (what the DMA buffer has to absorb) and how many frames were decoded correctly.
+// Host cycles don't translate 1:1 into ARM cycles, but they are good enough to
+// compare two versions of a decoder.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hf_demod_bench.h"
+#include "tracefile.h"
+#include "parity.h"
+
+#define DEFAULT_EXCHANGES   1000
+#define DEFAULT_RUNS        5
+#define MATCH_WINDOW        32          // samples between expected and decoded end of frame
+
+typedef struct {
+	const char *name;
+	const char *description;
+	const char *reader_decoder;
+	const char *tag_decoder;
+	size_t sample_size;
+	uint16_t max_reader_frame;
+	uint16_t max_tag_frame;
+	void (*synthesize)(frame_list_t *frames, const synth_options_t *options, sample_stream_t *stream);
+	void (*replay)(const sample_stream_t *stream, replay_t *replay);
+} protocol_t;
+
+static const protocol_t protocols[] = {
+	{"14a", "ISO14443A sniffer", "MillerDecoding", "ManchesterDecoding", 1, 256, 256, synth_iso14443a, replay_iso14443a},
+	{"14b", "ISO14443B sniffer", "Handle14443bUartBit", "Handle14443bSamplesDemod", 2, 255, 255, synth_iso14443b, replay_iso14443b},
+	{"15",  "ISO15693 sniffer", "Handle15693SampleFromReader", "Handle15693SamplesFromTag", 2, 45, 36, synth_iso15693, replay_iso15693},
+};
+
+typedef struct {
+	size_t ok;
+	size_t corrupt;
+	size_t missed;
+	size_t spurious;
+	long min_delay;
+	long max_delay;
+} accuracy_t;
+
+typedef struct {
+	size_t calls;
+	double mean;
+	uint32_t worst;
+	size_t worst_sample;
+} cost_t;
+
+
+static void usage(void) {
+	printf("Usage: hf_demod_bench [options] <14a|14b|15>\n");
+	printf("Replays an HF sniffer sample stream through the firmware's demodulators.\n\n");
+	printf("Options:\n");
+	printf("  -c <count>  number of random reader/tag exchanges to synthesize (default %d)\n", DEFAULT_EXCHANGES);
+	printf("  -t <file>   synthesize the frames of a trace file (.trc, .pcap, .pcapng) instead\n");
+	printf("  -f <file>   replay a raw dump of the sniffer's DMA buffer instead of synthesizing a stream\n");
+	printf("  -w <file>   save the synthesized sample stream\n");
+	printf("  -e <rate>   bit error rate of the synthesized reader modulation and 14443A subcarrier (default 0)\n");
+	printf("  -a <ampl>   noise amplitude of the synthesized 14443B I/Q and 15693 subcarrier samples (default 0)\n");
+	printf("  -r <runs>   number of timed runs, the best one counts (default %d)\n", DEFAULT_RUNS);
+	printf("  -s <seed>   random seed (default 1)\n");
+	printf("  -v          list the decoded frames\n");
+}
+
+
+static void *xrealloc(void *p, size_t size) {
+	p = realloc(p, size);
+	if (!p) {
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	return p;
+}
+
+
+void frame_list_add(frame_list_t *list, const bench_frame_t *frame) {
+	if (list->count == list->size) {
+		list->size = list->size ? list->size * 2 : 256;
+		list->frames = xrealloc(list->frames, list->size * sizeof(bench_frame_t));
+	}
+	list->frames[list->count++] = *frame;
+}
+
+
+void stream_reserve(sample_stream_t *stream, size_t count) {
+	if (count > stream->size) {
+		stream->data = xrealloc(stream->data, count * stream->sample_size);
+		stream->size = count;
+	}
+}
+
+
+void replay_add_frame(replay_t *replay, bool reader, const uint8_t *data, uint16_t len, const uint8_t *parity, size_t sample) {
+	bench_frame_t frame = {0};
+	frame.reader = reader;
+	frame.len = len > BENCH_MAX_FRAME ? BENCH_MAX_FRAME : len;
+	memcpy(frame.data, data, frame.len);
+	if (parity) {
+		memcpy(frame.parity, parity, (frame.len + 7) / 8);
+	}
+	frame.sample = sample;
+	frame_list_add(replay->frames, &frame);
+}
+
+
+static void set_parity(bench_frame_t *frame) {
+	memset(frame->parity, 0, sizeof(frame->parity));
+	for (int i = 0; i < frame->len; i++) {
+		frame->parity[i / 8] |= oddparity8(frame->data[i]) << (7 - i % 8);
+	}
+}
+
+
+static void random_frames(const protocol_t *protocol, size_t exchanges, frame_list_t *frames) {
+	for (size_t i = 0; i < 2 * exchanges; i++) {
+		bench_frame_t frame = {0};
+		frame.reader = !(i & 0x01);
+		uint16_t max = frame.reader ? protocol->max_reader_frame : protocol->max_tag_frame;
+		frame.len = 1 + rand() % (frame.reader ? (max < 16 ? max : 16) : (max < 32 ? max : 32));
+		for (int j = 0; j < frame.len; j++) {
+			frame.data[j] = rand();
+		}
+		if (protocol->synthesize == synth_iso14443a) {
+			if (frame.reader && frame.len == 1) {
+				frame.short_frame = true;
+				frame.data[0] &= 0x7f;
+			} else {
+				frame.check_parity = true;
+			}
+		}
+		set_parity(&frame);
+		frame_list_add(frames, &frame);
+	}
+}
+
+
+static int trace_frames(const protocol_t *protocol, const char *filename, frame_list_t *frames) {
+	trace_t trace;
+	int res = trace_load(filename, &trace);
+	if (res != TRACE_OK) {
+		fprintf(stderr, "Couldn't load trace file %s (%d)\n", filename, res);
+		return res;
+	}
+	for (size_t i = 0; i < trace.count; i++) {
+		bench_frame_t frame = {0};
+		uint16_t len;
+		const uint8_t *data = trace_record_data(&trace, i, &len);
+		if (len == 0) continue;
+		frame.reader = !trace_is_response(&trace, i);
+		uint16_t max = frame.reader ? protocol->max_reader_frame : protocol->max_tag_frame;
+		frame.len = len > max ? max : len;
+		memcpy(frame.data, data, frame.len);
+		memcpy(frame.parity, data + len, (frame.len + 7) / 8);
+		if (protocol->synthesize == synth_iso14443a) {
+			// REQA, WUPA and the magic card backdoor are 7 bit frames
+			if (frame.reader && frame.len == 1 && (frame.data[0] == 0x26 || frame.data[0] == 0x52 || frame.data[0] == 0x40)) {
+				frame.short_frame = true;
+			} else {
+				frame.check_parity = true;
+			}
+		}
+		frame_list_add(frames, &frame);
+	}
+	trace_free(&trace);
+	return TRACE_OK;
+}
+
+
+static int load_stream(const char *filename, sample_stream_t *stream) {
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		fprintf(stderr, "Couldn't open %s\n", filename);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	stream_reserve(stream, size / stream->sample_size + 1);
+	stream->count = fread(stream->data, stream->sample_size, size / stream->sample_size, f);
+	fclose(f);
+	return 0;
+}
+
+
+static int save_stream(const char *filename, const sample_stream_t *stream) {
+	FILE *f = fopen(filename, "wb");
+	if (!f) {
+		fprintf(stderr, "Couldn't create %s\n", filename);
+		return -1;
+	}
+	size_t written = fwrite(stream->data, stream->sample_size, stream->count, f);
+	fclose(f);
+	return written == stream->count ? 0 : -1;
+}
+
+
+static bool frame_equal(const bench_frame_t *expected, const bench_frame_t *decoded) {
+	if (expected->len != decoded->len || memcmp(expected->data, decoded->data, expected->len)) {
+		return false;
+	}
+	if (expected->check_parity) {
+		for (int i = 0; i < expected->len; i++) {
+			uint8_t mask = 0x80 >> (i % 8);
+			if ((expected->parity[i / 8] ^ decoded->parity[i / 8]) & mask) return false;
+		}
+	}
+	return true;
+}
+
+
+static void check_frames(frame_list_t *expected, const frame_list_t *decoded, accuracy_t *accuracy) {
+	bool *matched = calloc(expected->count + 1, sizeof(bool));
+	size_t first = 0;
+	memset(accuracy, 0, sizeof(accuracy_t));
+	accuracy->min_delay = 0x7fffffff;
+	accuracy->max_delay = -0x7fffffff;
+
+	for (size_t i = 0; i < decoded->count; i++) {
+		const bench_frame_t *d = &decoded->frames[i];
+		while (first < expected->count && expected->frames[first].sample + MATCH_WINDOW < d->sample) {
+			first++;
+		}
+		size_t j;
+		for (j = first; j < expected->count && expected->frames[j].sample <= d->sample + MATCH_WINDOW; j++) {
+			if (!matched[j] && expected->frames[j].reader == d->reader) break;
+		}
+		if (j == expected->count || expected->frames[j].sample > d->sample + MATCH_WINDOW) {
+			accuracy->spurious++;
+			continue;
+		}
+		matched[j] = true;
+		if (frame_equal(&expected->frames[j], d)) {
+			accuracy->ok++;
+			long delay = (long)d->sample - (long)expected->frames[j].sample;
+			if (delay < accuracy->min_delay) accuracy->min_delay = delay;
+			if (delay > accuracy->max_delay) accuracy->max_delay = delay;
+		} else {
+			accuracy->corrupt++;
+		}
+	}
+	for (size_t j = 0; j < expected->count; j++) {
+		if (!matched[j]) accuracy->missed++;
+	}
+	free(matched);
+}
+
+
+static void compute_cost(const uint32_t *ticks, size_t count, uint32_t overhead, cost_t *cost) {
+	uint64_t sum = 0;
+	memset(cost, 0, sizeof(cost_t));
+	for (size_t i = 0; i < count; i++) {
+		if (ticks[i] == UINT32_MAX) continue;
+		uint32_t t = ticks[i] > overhead ? ticks[i] - overhead : 0;
+		sum += t;
+		cost->calls++;
+		if (t > cost->worst) {
+			cost->worst = t;
+			cost->worst_sample = i;
+		}
+	}
+	if (cost->calls) cost->mean = (double)sum / cost->calls;
+}
+
+
+static uint32_t timer_overhead(void) {
+	uint64_t best = UINT64_MAX;
+	for (int i = 0; i < 1000; i++) {
+		uint64_t start = bench_ticks();
+		uint64_t t = bench_ticks() - start;
+		if (t < best) best = t;
+	}
+	return best;
+}
+
+
+static uint64_t now_ns(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+
+static void print_frames(const frame_list_t *frames) {
+	for (size_t i = 0; i < frames->count; i++) {
+		const bench_frame_t *f = &frames->frames[i];
+		printf("%10zu %s ", f->sample, f->reader ? "Rdr" : "Tag");
+		for (int j = 0; j < f->len; j++) {
+			printf("%02x ", f->data[j]);
+		}
+		printf("\n");
+	}
+}
+
+
+int main(int argc, char *argv[]) {
+	size_t exchanges = DEFAULT_EXCHANGES;
+	int runs = DEFAULT_RUNS;
+	const char *trace_file = NULL;
+	const char *stream_file = NULL;
+	const char *save_file = NULL;
+	bool verbose = false;
+	synth_options_t options = {0, 0, 1};
+
+	int opt;
+	while ((opt = getopt(argc, argv, "c:t:f:w:e:a:r:s:vh")) != -1) {
+		switch (opt) {
+			case 'c': exchanges = strtoul(optarg, NULL, 0); break;
+			case 't': trace_file = optarg; break;
+			case 'f': stream_file = optarg; break;
+			case 'w': save_file = optarg; break;
+			case 'e': options.bit_error_rate = atof(optarg); break;
+			case 'a': options.noise = atoi(optarg); break;
+			case 'r': runs = atoi(optarg); break;
+			case 's': options.seed = strtoul(optarg, NULL, 0); break;
+			case 'v': verbose = true; break;
+			default: usage(); return EXIT_FAILURE;
+		}
+	}
+	if (optind != argc - 1 || runs < 1) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	const protocol_t *protocol = NULL;
+	for (size_t i = 0; i < sizeof(protocols) / sizeof(protocols[0]); i++) {
+		if (strcmp(argv[optind], protocols[i].name) == 0) protocol = &protocols[i];
+	}
+	if (!protocol) {
+		usage();
+		return EXIT_FAILURE;
+	}
+
+	sample_stream_t stream = {NULL, 0, 0, protocol->sample_size};
+	frame_list_t expected = {0};
+	if (stream_file) {
+		if (load_stream(stream_file, &stream)) return EXIT_FAILURE;
+	} else {
+		if (trace_file) {
+			if (trace_frames(protocol, trace_file, &expected) != TRACE_OK) return EXIT_FAILURE;
+		} else {
+			srand(options.seed);
+			random_frames(protocol, exchanges, &expected);
+		}
+		protocol->synthesize(&expected, &options, &stream);
+		if (save_file && save_stream(save_file, &stream)) {
+			fprintf(stderr, "Couldn't save the sample stream to %s\n", save_file);
+			return EXIT_FAILURE;
+		}
+	}
+	if (stream.count == 0) {
+		fprintf(stderr, "No samples\n");
+		return EXIT_FAILURE;
+	}
+
+	// untimed runs: decoded frames and throughput of the whole sniffer loop
+	frame_list_t decoded = {0};
+	replay_t replay = {NULL, NULL, &decoded};
+	uint64_t best_ticks = UINT64_MAX, best_ns = UINT64_MAX;
+	for (int run = 0; run < runs; run++) {
+		decoded.count = 0;
+		uint64_t start_ns = now_ns();
+		uint64_t start = bench_ticks();
+		protocol->replay(&stream, &replay);
+		uint64_t ticks = bench_ticks() - start;
+		uint64_t ns = now_ns() - start_ns;
+		if (ticks < best_ticks) best_ticks = ticks;
+		if (ns < best_ns) best_ns = ns;
+	}
+
+	// timed runs: cost of the reader and tag side per sample
+	frame_list_t timed_frames = {0};
+	replay.frames = &timed_frames;
+	replay.reader_ticks = xrealloc(NULL, stream.count * sizeof(uint32_t));
+	replay.tag_ticks = xrealloc(NULL, stream.count * sizeof(uint32_t));
+	memset(replay.reader_ticks, 0xff, stream.count * sizeof(uint32_t));
+	memset(replay.tag_ticks, 0xff, stream.count * sizeof(uint32_t));
+	for (int run = 0; run < runs; run++) {
+		timed_frames.count = 0;
+		protocol->replay(&stream, &replay);
+	}
+	uint32_t overhead = timer_overhead();
+	cost_t reader_cost, tag_cost;
+	compute_cost(replay.reader_ticks, stream.count, overhead, &reader_cost);
+	compute_cost(replay.tag_ticks, stream.count, overhead, &tag_cost);
+
+	if (verbose) print_frames(&decoded);
+
+#if defined(__i386__) || defined(__x86_64__)
+	const char *unit = "cycles";
+#else
+	const char *unit = "ns";
+#endif
+	double sample_us = 1e6 * BENCH_CARRIER_CYCLES_PER_SAMPLE / BENCH_CARRIER_FREQUENCY;
+	size_t reader_frames = 0;
+	for (size_t i = 0; i < decoded.count; i++) {
+		if (decoded.frames[i].reader) reader_frames++;
+	}
+
+	printf("%s, %zu samples (%.3f s air time, one sample every %.2f us)\n", protocol->description, stream.count, stream.count * sample_us / 1e6, sample_us);
+	printf("Decoded frames:   %zu (%zu reader, %zu tag)\n", decoded.count, reader_frames, decoded.count - reader_frames);
+	if (expected.count) {
+		accuracy_t accuracy;
+		check_frames(&expected, &decoded, &accuracy);
+		printf("Accuracy:         %zu of %zu frames ok (%.2f%%), %zu corrupt, %zu missed, %zu spurious\n",
+			accuracy.ok, expected.count, 100.0 * accuracy.ok / expected.count, accuracy.corrupt, accuracy.missed, accuracy.spurious);
+		if (accuracy.ok) {
+			printf("Decode delay:     %ld..%ld samples after the end of the frame\n", accuracy.min_delay, accuracy.max_delay);
+		}
+	}
+	printf("Sniffer loop:     %.2f %s/sample, %.2f ns/sample (best of %d runs)\n",
+		(double)best_ticks / stream.count, unit, (double)best_ns / stream.count, runs);
+	printf("%-28s mean %.1f %s/sample over %zu samples, worst %u %s at sample %zu\n",
+		protocol->reader_decoder, reader_cost.mean, unit, reader_cost.calls, reader_cost.worst, unit, reader_cost.worst_sample);
+	printf("%-28s mean %.1f %s/sample over %zu samples, worst %u %s at sample %zu\n",
+		protocol->tag_decoder, tag_cost.mean, unit, tag_cost.calls, tag_cost.worst, unit, tag_cost.worst_sample);
+
+	free(replay.reader_ticks);
+	free(replay.tag_ticks);
+	free(decoded.frames);
+	free(timed_frames.frames);
+	free(expected.frames);
+	free(stream.data);
+	return EXIT_SUCCESS;
+}
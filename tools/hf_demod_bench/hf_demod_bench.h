@@ -0,0 +1,95 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Host side benchmark of the HF sniffer demodulators
+//-----------------------------------------------------------------------------
+
+#ifndef HF_DEMOD_BENCH_H__
+#define HF_DEMOD_BENCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+#define BENCH_MAX_FRAME         256
+
+// All sniffers get one DMA sample every 64 carrier cycles (4.72us)
+#define BENCH_CARRIER_CYCLES_PER_SAMPLE  64
+#define BENCH_CARRIER_FREQUENCY          13560000
+
+typedef struct {
+	bool reader;
+	bool short_frame;                       // ISO14443A 7 bit frame
+	bool check_parity;
+	uint16_t len;
+	uint8_t data[BENCH_MAX_FRAME];
+	uint8_t parity[BENCH_MAX_FRAME / 8];
+	size_t sample;                          // end of frame in the sample stream
+} bench_frame_t;
+
+typedef struct {
+	bench_frame_t *frames;
+	size_t count;
+	size_t size;
+} frame_list_t;
+
+typedef struct {
+	uint8_t *data;
+	size_t count;                           // number of samples
+	size_t size;                            // allocated samples
+	size_t sample_size;                     // bytes per sample
+} sample_stream_t;
+
+typedef struct {
+	double bit_error_rate;                  // for binary signals (reader modulation, 14443A subcarrier)
+	int noise;                              // max. amplitude of noise on analogue signals
+	uint32_t seed;
+} synth_options_t;
+
+// Per DMA sample cost of the reader and tag side of the sniffer loop. Each entry
+// holds the minimum over all timed runs (UINT32_MAX if the decoder wasn't called
+// for that sample), which filters out interrupts and preemption on the host.
+typedef struct {
+	uint32_t *reader_ticks;                 // NULL for an untimed run
+	uint32_t *tag_ticks;
+	frame_list_t *frames;                   // decoded frames
+} replay_t;
+
+extern void frame_list_add(frame_list_t *list, const bench_frame_t *frame);
+extern void stream_reserve(sample_stream_t *stream, size_t count);
+extern void replay_add_frame(replay_t *replay, bool reader, const uint8_t *data, uint16_t len, const uint8_t *parity, size_t sample);
+
+// synthesize the sample stream the FPGA delivers in sniffer mode for a sequence
+// of frames. Sets frames[].sample to the end of each frame.
+extern void synth_iso14443a(frame_list_t *frames, const synth_options_t *options, sample_stream_t *stream);
+extern void synth_iso14443b(frame_list_t *frames, const synth_options_t *options, sample_stream_t *stream);
+extern void synth_iso15693(frame_list_t *frames, const synth_options_t *options, sample_stream_t *stream);
+
+// run a sample stream through the sniffer loop of the firmware
+extern void replay_iso14443a(const sample_stream_t *stream, replay_t *replay);
+extern void replay_iso14443b(const sample_stream_t *stream, replay_t *replay);
+extern void replay_iso15693(const sample_stream_t *stream, replay_t *replay);
+
+// CPU cycles on x86, nanoseconds elsewhere
+static inline uint64_t bench_ticks(void) {
+#if defined(__i386__) || defined(__x86_64__)
+	return __rdtsc();
+#else
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+#endif
+}
+
+static inline void bench_account(uint32_t *ticks, size_t sample, uint64_t start) {
+	uint64_t t = bench_ticks() - start;
+	if (t < ticks[sample]) ticks[sample] = t;
+}
+
+#endif
@@ -0,0 +1,71 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Replay a sample stream through MillerDecoding() and ManchesterDecoding()
+//-----------------------------------------------------------------------------
+
+#include "armsrc_host.h"
+#include "iso14443a.c"
+#include "hf_demod_bench.h"
+
+uint32_t GetCountSspClk() {
+	return 0;
+}
+
+
+// The decoding part of SnoopIso14443a(). Keep in sync.
+static inline __attribute__((always_inline)) void replay_loop(const sample_stream_t *stream, replay_t *replay, const bool timed) {
+	static uint8_t receivedCmd[MAX_FRAME_SIZE];
+	static uint8_t receivedCmdPar[MAX_PARITY_SIZE];
+	static uint8_t receivedResponse[MAX_FRAME_SIZE];
+	static uint8_t receivedResponsePar[MAX_PARITY_SIZE];
+
+	const uint8_t *data = stream->data;
+	uint8_t previous_data = 0;
+	bool TagIsActive = false;
+	bool ReaderIsActive = false;
+	uint64_t start = 0;
+
+	DemodInit(receivedResponse, receivedResponsePar);
+	UartInit(receivedCmd, receivedCmdPar);
+
+	for (uint32_t rsamples = 0; rsamples < stream->count; rsamples++, data++) {
+		if (rsamples & 0x01) {
+			if (!TagIsActive) {
+				if (timed) start = bench_ticks();
+				uint8_t readerdata = (previous_data & 0xF0) | (*data >> 4);
+				if (MillerDecoding(readerdata, (rsamples-1)*4)) {
+					replay_add_frame(replay, true, receivedCmd, Uart.len, Uart.parity, rsamples);
+					UartReset();
+					DemodReset();
+				}
+				ReaderIsActive = (Uart.state != STATE_UNSYNCD);
+				if (timed) bench_account(replay->reader_ticks, rsamples, start);
+			}
+
+			if (!ReaderIsActive) {
+				if (timed) start = bench_ticks();
+				uint8_t tagdata = (previous_data << 4) | (*data & 0x0F);
+				if (ManchesterDecoding(tagdata, 0, (rsamples-1)*4)) {
+					replay_add_frame(replay, false, receivedResponse, Demod.len, Demod.parity, rsamples);
+					DemodReset();
+					UartInit(receivedCmd, receivedCmdPar);
+				}
+				TagIsActive = (Demod.state != DEMOD_UNSYNCD);
+				if (timed) bench_account(replay->tag_ticks, rsamples, start);
+			}
+		}
+		previous_data = *data;
+	}
+}
+
+
+void replay_iso14443a(const sample_stream_t *stream, replay_t *replay) {
+	if (replay->reader_ticks) {
+		replay_loop(stream, replay, true);
+	} else {
+		replay_loop(stream, replay, false);
+	}
+}
@@ -0,0 +1,71 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Replay a sample stream through Handle14443bUartBit() and Handle14443bSamplesDemod()
+//-----------------------------------------------------------------------------
+
+#include "armsrc_host.h"
+#include "iso14443b.c"
+#include "hf_demod_bench.h"
+
+// The decoding part of SnoopIso14443b(). Keep in sync.
+static inline __attribute__((always_inline)) void replay_loop(const sample_stream_t *stream, replay_t *replay, const bool timed) {
+	static uint8_t receivedCmd[MAX_FRAME_SIZE];
+	static uint8_t receivedResponse[MAX_FRAME_SIZE];
+
+	const uint16_t *upTo = (const uint16_t *)stream->data;
+	int8_t ci, cq;
+	bool TagIsActive = false;
+	bool ReaderIsActive = false;
+	bool triggered = false;
+	uint64_t start = 0;
+
+	DemodInit(receivedResponse);
+	UartInit(receivedCmd);
+
+	for (size_t samples = 0; samples < stream->count; ) {
+		ci = *upTo >> 8;
+		cq = *upTo;
+		upTo++;
+		samples++;
+
+		if (!TagIsActive) {
+			if (timed) start = bench_ticks();
+			if (Handle14443bUartBit(ci & 0x01)) {
+				triggered = true;
+				replay_add_frame(replay, true, Uart.output, Uart.byteCnt, NULL, samples - 1);
+				UartReset();
+				DemodReset();
+			}
+			if (Handle14443bUartBit(cq & 0x01)) {
+				triggered = true;
+				replay_add_frame(replay, true, Uart.output, Uart.byteCnt, NULL, samples - 1);
+				UartReset();
+				DemodReset();
+			}
+			ReaderIsActive = (Uart.state > STATE_GOT_FALLING_EDGE_OF_SOF);
+			if (timed) bench_account(replay->reader_ticks, samples - 1, start);
+		}
+
+		if (!ReaderIsActive && triggered) {
+			if (timed) start = bench_ticks();
+			if (Handle14443bSamplesDemod(ci/2, cq/2)) {
+				replay_add_frame(replay, false, Demod.output, Demod.len, NULL, samples - 1);
+				DemodReset();
+			}
+			TagIsActive = (Demod.state > DEMOD_GOT_FALLING_EDGE_OF_SOF);
+			if (timed) bench_account(replay->tag_ticks, samples - 1, start);
+		}
+	}
+}
+
+
+void replay_iso14443b(const sample_stream_t *stream, replay_t *replay) {
+	if (replay->reader_ticks) {
+		replay_loop(stream, replay, true);
+	} else {
+		replay_loop(stream, replay, false);
+	}
+}
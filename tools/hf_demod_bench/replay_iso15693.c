@@ -0,0 +1,76 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Replay a sample stream through Handle15693SampleFromReader() and Handle15693SamplesFromTag()
+//-----------------------------------------------------------------------------
+
+#include "armsrc_host.h"
+#include "iso15693.c"
+#include "hf_demod_bench.h"
+
+// only called for jamming, which isn't used here
+void FpgaWriteConfWord(uint16_t v) {
+}
+
+// The decoding part of SnoopIso15693(). Keep in sync.
+static inline __attribute__((always_inline)) void replay_loop(const sample_stream_t *stream, replay_t *replay, const bool timed) {
+	static uint8_t response[ISO15693_MAX_RESPONSE_LENGTH];
+	static uint8_t cmd[ISO15693_MAX_COMMAND_LENGTH];
+
+	const uint16_t *upTo = (const uint16_t *)stream->data;
+	bool TagIsActive = false;
+	bool ReaderIsActive = false;
+	bool ExpectTagAnswer = false;
+	uint64_t start = 0;
+
+	DecodeTag_t DecodeTag = {0};
+	DecodeTagInit(&DecodeTag, response, sizeof(response));
+	DecodeReader_t DecodeReader = {0};
+	DecodeReaderInit(&DecodeReader, cmd, sizeof(cmd), 0, NULL);
+
+	for (size_t sample = 0; sample < stream->count; sample++) {
+		uint16_t snoopdata = *upTo++;
+
+		if (!TagIsActive) {
+			if (timed) start = bench_ticks();
+			if (Handle15693SampleFromReader(snoopdata & 0x02, &DecodeReader)
+				|| Handle15693SampleFromReader(snoopdata & 0x01, &DecodeReader)) {
+				if (DecodeReader.byteCount > 0) {
+					replay_add_frame(replay, true, DecodeReader.output, DecodeReader.byteCount, NULL, sample);
+				}
+				DecodeReaderReset(&DecodeReader);
+				DecodeTagReset(&DecodeTag);
+				ReaderIsActive = false;
+				ExpectTagAnswer = true;
+			} else {
+				ReaderIsActive = (DecodeReader.state >= STATE_READER_RECEIVE_DATA_1_OUT_OF_4);
+			}
+			if (timed) bench_account(replay->reader_ticks, sample, start);
+		}
+
+		if (!ReaderIsActive && ExpectTagAnswer) {
+			if (timed) start = bench_ticks();
+			if (Handle15693SamplesFromTag(snoopdata >> 2, &DecodeTag)) {
+				replay_add_frame(replay, false, DecodeTag.output, DecodeTag.len, NULL, sample);
+				DecodeTagReset(&DecodeTag);
+				DecodeReaderReset(&DecodeReader);
+				ExpectTagAnswer = false;
+				TagIsActive = false;
+			} else {
+				TagIsActive = (DecodeTag.state >= STATE_TAG_RECEIVING_DATA);
+			}
+			if (timed) bench_account(replay->tag_ticks, sample, start);
+		}
+	}
+}
+
+
+void replay_iso15693(const sample_stream_t *stream, replay_t *replay) {
+	if (replay->reader_ticks) {
+		replay_loop(stream, replay, true);
+	} else {
+		replay_loop(stream, replay, false);
+	}
+}
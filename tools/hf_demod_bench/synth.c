@@ -0,0 +1,351 @@
+//-----------------------------------------------------------------------------
+// This code is licensed to you under the terms of the GNU GPL, version 2 or,
+// at your option, any later version. See the LICENSE.txt file for the text of
+// the license.
+//-----------------------------------------------------------------------------
+// Synthesize the sample streams the FPGA delivers in HF sniffer mode
+//
+// The frames are first laid out on a timeline of reader and tag modulation,
+// with the timings of the standards and some jitter, and then packed into
+// DMA samples in the format of the respective sniffer.
+//-----------------------------------------------------------------------------
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hf_demod_bench.h"
+
+typedef struct {
+	uint8_t *reader;        // 1 = field on, 0 = pause
+	int8_t *tag;            // subcarrier: 0 = off, 1 = on (or reference phase for BPSK), -1 = inverted phase
+	size_t len;
+	size_t size;
+} timeline_t;
+
+static uint32_t rng_state;
+
+static uint32_t rng(void) {
+	// xorshift32
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+static int rng_range(int min, int max) {
+	return min + rng() % (max - min + 1);
+}
+
+static bool rng_chance(double p) {
+	return p > 0 && rng() < p * 4294967296.0;
+}
+
+static void rng_seed(uint32_t seed) {
+	rng_state = seed ? seed : 0x5eed;
+}
+
+
+static void put(timeline_t *t, uint8_t reader, int8_t tag, size_t steps) {
+	if (t->len + steps > t->size) {
+		while (t->len + steps > t->size) {
+			t->size = t->size ? t->size * 2 : 65536;
+		}
+		t->reader = realloc(t->reader, t->size);
+		t->tag = realloc(t->tag, t->size);
+		if (!t->reader || !t->tag) {
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	memset(t->reader + t->len, reader, steps);
+	memset(t->tag + t->len, tag, steps);
+	t->len += steps;
+}
+
+
+static void add_bit_errors(timeline_t *t, double rate, bool tag) {
+	if (rate <= 0) return;
+	for (size_t i = 0; i < t->len; i++) {
+		if (rng_chance(rate)) t->reader[i] ^= 1;
+		if (tag && rng_chance(rate)) t->tag[i] ^= 1;
+	}
+}
+
+
+static void timeline_free(timeline_t *t) {
+	free(t->reader);
+	free(t->tag);
+}
+
+
+static bool frame_bit(const bench_frame_t *f, int bit) {
+	return (f->data[bit / 8] >> (bit % 8)) & 0x01;
+}
+
+
+static bool frame_parity_bit(const bench_frame_t *f, int byte) {
+	return (f->parity[byte / 8] >> (7 - byte % 8)) & 0x01;
+}
+
+
+//-----------------------------------------------------------------------------
+// ISO14443A. One step is one ssp_clk tick (16 carrier cycles), 8 steps per bit.
+// A sample holds 4 steps of the reader (high nibble) and 4 steps of the tag
+// (low nibble), the earliest step in the MSB.
+//-----------------------------------------------------------------------------
+typedef enum {
+	MILLER_X,       // pause in the second half
+	MILLER_Y,       // no pause
+	MILLER_Z        // pause in the first half
+} miller_t;
+
+static void put_miller(timeline_t *t, miller_t seq) {
+	int pause = rng_range(2, 3);
+	for (int i = 0; i < 8; i++) {
+		bool low = (seq == MILLER_Z && i < pause) || (seq == MILLER_X && i >= 4 && i < 4 + pause);
+		put(t, !low, 0, 1);
+	}
+}
+
+
+static void put_miller_frame(timeline_t *t, const bench_frame_t *f) {
+	miller_t last = MILLER_Z;
+	put_miller(t, MILLER_Z);                                    // start of communication
+	int bits = f->short_frame ? 7 : f->len * 9;
+	for (int i = 0; i < bits; i++) {
+		bool bit;
+		if (f->short_frame) {
+			bit = frame_bit(f, i);
+		} else if (i % 9 == 8) {
+			bit = frame_parity_bit(f, i / 9);
+		} else {
+			bit = frame_bit(f, i / 9 * 8 + i % 9);
+		}
+		last = bit ? MILLER_X : (last == MILLER_X ? MILLER_Y : MILLER_Z);
+		put_miller(t, last);
+	}
+	put_miller(t, last == MILLER_X ? MILLER_Y : MILLER_Z);     // end of communication: logic "0" ...
+	put_miller(t, MILLER_Y);                                    // ... followed by Y
+}
+
+
+static void put_manchester_frame(timeline_t *t, const bench_frame_t *f) {
+	put(t, 1, 1, 4);                                            // start of communication: sequence D
+	put(t, 1, 0, 4);
+	for (int i = 0; i < f->len * 9; i++) {
+		bool bit = (i % 9 == 8) ? frame_parity_bit(f, i / 9) : frame_bit(f, i / 9 * 8 + i % 9);
+		put(t, 1, bit, 4);                                      // "1": sequence D, "0": sequence E
+		put(t, 1, !bit, 4);
+	}
+	put(t, 1, 0, 8);                                            // end of communication: sequence F
+}
+
+
+void synth_iso14443a(frame_list_t *frames, const synth_options_t *options, sample_stream_t *stream) {
+	timeline_t t = {0};
+	rng_seed(options->seed);
+
+	put(&t, 1, 0, 64);
+	bool after_reader = false;
+	for (size_t i = 0; i < frames->count; i++) {
+		bench_frame_t *f = &frames->frames[i];
+		if (!f->reader && after_reader) {
+			put(&t, 1, 0, 1172/16 + rng_range(0, 7));           // frame delay time PCD -> PICC
+		} else {
+			put(&t, 1, 0, rng_range(400, 1200));
+		}
+		if (f->reader) {
+			put_miller_frame(&t, f);
+		} else {
+			put_manchester_frame(&t, f);
+		}
+		f->sample = t.len / 4;
+		after_reader = f->reader;
+	}
+	put(&t, 1, 0, 64 + 8 - t.len % 8);
+	add_bit_errors(&t, options->bit_error_rate, true);
+
+	stream->sample_size = 1;
+	stream_reserve(stream, t.len / 4);
+	for (size_t i = 0; i < t.len / 4; i++) {
+		uint8_t sample = 0;
+		for (int j = 0; j < 4; j++) {
+			sample |= t.reader[4*i + j] << (7 - j);
+			sample |= t.tag[4*i + j] << (3 - j);
+		}
+		stream->data[i] = sample;
+	}
+	stream->count = t.len / 4;
+	timeline_free(&t);
+}
+
+
+//-----------------------------------------------------------------------------
+// ISO14443B. One step is a quarter etu (32 carrier cycles). A sample is the
+// 16 bit I/Q correlation of the tag's BPSK subcarrier, with the reader
+// modulation of two consecutive steps in the LSBs of I and Q.
+//-----------------------------------------------------------------------------
+#define ISO14443B_AMPLITUDE_I   48
+#define ISO14443B_AMPLITUDE_Q   24
+
+static void put_nrz_frame(timeline_t *t, const bench_frame_t *f) {
+	put(t, 0, 0, 4*10);                                         // SOF: 10 etu low ...
+	put(t, 1, 0, 4*2);                                          // ... 2 etu high
+	for (int i = 0; i < f->len; i++) {
+		put(t, 0, 0, 4);                                        // start bit
+		for (int j = 0; j < 8; j++) {
+			put(t, frame_bit(f, i*8 + j), 0, 4);
+		}
+		put(t, 1, 0, 4);                                        // stop bit
+	}
+	put(t, 0, 0, 4*10);                                         // EOF: 10 etu low
+}
+
+
+static void put_bpsk_frame(timeline_t *t, const bench_frame_t *f) {
+	put(t, 1, 1, 4*10);                                         // TR1: subcarrier with reference phase
+	put(t, 1, -1, 4*10);                                        // SOF: 10 etu "0" ...
+	put(t, 1, 1, 4*2);                                          // ... 2 etu "1"
+	for (int i = 0; i < f->len; i++) {
+		put(t, 1, -1, 4);                                       // start bit
+		for (int j = 0; j < 8; j++) {
+			put(t, 1, frame_bit(f, i*8 + j) ? 1 : -1, 4);
+		}
+		put(t, 1, 1, 4);                                        // stop bit
+	}
+	put(t, 1, -1, 4*10);                                        // EOF: 10 etu "0"
+}
+
+
+static int8_t iq_sample(int amplitude, int noise, uint8_t reader) {
+	int v = amplitude;
+	if (noise) v += rng_range(-noise, noise);
+	if (v > 126) v = 126;
+	if (v < -126) v = -126;
+	return (v & ~0x01) | reader;
+}
+
+
+void synth_iso14443b(frame_list_t *frames, const synth_options_t *options, sample_stream_t *stream) {
+	timeline_t t = {0};
+	rng_seed(options->seed);
+
+	put(&t, 1, 0, 4*20);
+	bool after_reader = false;
+	for (size_t i = 0; i < frames->count; i++) {
+		bench_frame_t *f = &frames->frames[i];
+		if (!f->reader && after_reader) {
+			put(&t, 1, 0, rng_range(4*8, 4*20));                // TR0
+		} else {
+			put(&t, 1, 0, rng_range(4*50, 4*150));
+		}
+		if (f->reader) {
+			put_nrz_frame(&t, f);
+		} else {
+			put_bpsk_frame(&t, f);
+		}
+		f->sample = t.len / 2;
+		after_reader = f->reader;
+	}
+	put(&t, 1, 0, 4*20 + t.len % 2);
+	add_bit_errors(&t, options->bit_error_rate, false);
+
+	stream->sample_size = 2;
+	stream_reserve(stream, t.len / 2);
+	uint16_t *samples = (uint16_t *)stream->data;
+	for (size_t i = 0; i < t.len / 2; i++) {
+		int8_t ci = iq_sample(t.tag[2*i] * ISO14443B_AMPLITUDE_I, options->noise, t.reader[2*i]);
+		int8_t cq = iq_sample(t.tag[2*i] * ISO14443B_AMPLITUDE_Q, options->noise, t.reader[2*i + 1]);
+		samples[i] = (uint8_t)ci << 8 | (uint8_t)cq;
+	}
+	stream->count = t.len / 2;
+	timeline_free(&t);
+}
+
+
+//-----------------------------------------------------------------------------
+// ISO15693, high data rate, one subcarrier. One step is 32 carrier cycles. A
+// sample holds the reader modulation of two consecutive steps in bits 1 and 0
+// and the tag's subcarrier amplitude in bits 15..2.
+//-----------------------------------------------------------------------------
+#define ISO15693_AMPLITUDE_LOW  30
+#define ISO15693_AMPLITUDE_HIGH 600
+
+static void put_1_out_of_4_frame(timeline_t *t, const bench_frame_t *f) {
+	put(t, 0, 0, 4);                                            // SOF
+	put(t, 1, 0, 16);
+	put(t, 0, 0, 4);
+	put(t, 1, 0, 8);
+	for (int i = 0; i < f->len; i++) {
+		for (int j = 0; j < 8; j += 2) {
+			int pos = (f->data[i] >> j) & 0x03;
+			for (int slot = 0; slot < 4; slot++) {
+				if (slot == pos) {
+					put(t, 1, 0, 4);
+					put(t, 0, 0, 4);
+				} else {
+					put(t, 1, 0, 8);
+				}
+			}
+		}
+	}
+	put(t, 0, 0, 4);                                            // EOF
+	put(t, 1, 0, 4);
+}
+
+
+static void put_manchester_15693_frame(timeline_t *t, const bench_frame_t *f) {
+	put(t, 1, 0, 24);                                           // SOF: unmodulated ...
+	put(t, 1, 1, 24);                                           // ... modulated ...
+	put(t, 1, 0, 8);                                            // ... logic "1"
+	put(t, 1, 1, 8);
+	for (int i = 0; i < f->len * 8; i++) {
+		bool bit = frame_bit(f, i);
+		put(t, 1, !bit, 8);
+		put(t, 1, bit, 8);
+	}
+	put(t, 1, 1, 8);                                            // EOF: logic "0" ...
+	put(t, 1, 0, 8);
+	put(t, 1, 1, 24);                                           // ... modulated ...
+	put(t, 1, 0, 24);                                           // ... unmodulated
+}
+
+
+void synth_iso15693(frame_list_t *frames, const synth_options_t *options, sample_stream_t *stream) {
+	timeline_t t = {0};
+	rng_seed(options->seed);
+
+	put(&t, 1, 0, 64);
+	bool after_reader = false;
+	for (size_t i = 0; i < frames->count; i++) {
+		bench_frame_t *f = &frames->frames[i];
+		if (!f->reader && after_reader) {
+			put(&t, 1, 0, 136 + rng_range(0, 3));              // t1 = 4352/fc
+		} else {
+			put(&t, 1, 0, rng_range(300, 1000));
+		}
+		if (f->reader) {
+			put_1_out_of_4_frame(&t, f);
+		} else {
+			put_manchester_15693_frame(&t, f);
+		}
+		f->sample = t.len / 2;
+		after_reader = f->reader;
+	}
+	put(&t, 1, 0, 64 + t.len % 2);
+	add_bit_errors(&t, options->bit_error_rate, false);
+
+	stream->sample_size = 2;
+	stream_reserve(stream, t.len / 2);
+	uint16_t *samples = (uint16_t *)stream->data;
+	for (size_t i = 0; i < t.len / 2; i++) {
+		// the amplitude is averaged over the sample, so edges may show up as half amplitude
+		int amplitude = ISO15693_AMPLITUDE_LOW + (t.tag[2*i] + t.tag[2*i + 1]) * (ISO15693_AMPLITUDE_HIGH - ISO15693_AMPLITUDE_LOW) / 2;
+		if (options->noise) amplitude += rng_range(-options->noise, options->noise);
+		if (amplitude < 0) amplitude = 0;
+		if (amplitude > 0x3fff) amplitude = 0x3fff;
+		samples[i] = amplitude << 2 | t.reader[2*i] << 1 | t.reader[2*i + 1];
+	}
+	stream->count = t.len / 2;
+	timeline_free(&t);
+}